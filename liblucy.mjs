@@ -1,5 +1,14 @@
 //import createModule from './dist/liblucy-debug.mjs';
 
+// Flags for xs_init, see compiler_xstate.h
+const XS_FLAG_USE_REMOTE = 1 << 0;
+const XS_FLAG_OPTIMIZE = 1 << 1;
+const XS_FLAG_MINIMIZE = 1 << 2;
+const XS_FLAG_LAZY = 1 << 3;
+
+// PARSER_DEFAULT_MAX_DEPTH, see parser.h
+const DEFAULT_MAX_DEPTH = 100000;
+
 export default async function(createModule) {
   const moduleReady = createModule();
   const Module = await moduleReady;
@@ -13,10 +22,16 @@ export default async function(createModule) {
   } = Module;
 
   const _compileXstate = Module.asm.compile_xstate;
+  const _compileJs = Module.asm.compile_js;
+  const _compileJson = Module.asm.compile_json;
   const _xsGetJS = Module.asm.xs_get_js;
   const _xsCreate = Module.asm.xs_create;
   const _xsInit = Module.asm.xs_init;
+  const _xsEnableStats = Module.asm.xs_enable_stats;
+  const _xsGetStatsJSON = Module.asm.xs_get_stats_json;
+  const _xsGetDiagnosticsJSON = Module.asm.xs_get_diagnostics_json;
   const _destroyXstateResult = Module.asm.destroy_xstate_result;
+  const _parserSetMaxDepth = Module.asm.parser_set_max_depth;
 
   function stringToPtr(str) {
     var ret = 0;
@@ -29,16 +44,7 @@ export default async function(createModule) {
     return ret;
   }
 
-  /**
-   * Compile Lucy source a module of XState machines.
-   * @param source {String} the input Lucy source.
-   * @param filename {String} the name of the Lucy file.
-   * @param options {Object}
-   * @returns {String} The compiled JavaScript module.
-   */
-  function compileXstate(source, filename, options = {
-    useRemote: false
-  }) {
+  function compile(compileFn, source, filename, options) {
     if(!source || !filename) {
       throw new Error('Source and filename are both required.');
     }
@@ -47,8 +53,16 @@ export default async function(createModule) {
     let srcPtr = stringToPtr(source);
     let fnPtr = stringToPtr(filename);
     let resPtr = _xsCreate();
-    _xsInit(resPtr, options.useRemote);
-    _compileXstate(resPtr, srcPtr, fnPtr);
+    let flags = (options.useRemote ? XS_FLAG_USE_REMOTE : 0) |
+      (options.optimize ? XS_FLAG_OPTIMIZE : 0) |
+      (options.minimize ? XS_FLAG_MINIMIZE : 0) |
+      (options.lazy ? XS_FLAG_LAZY : 0);
+    _xsInit(resPtr, flags);
+    _parserSetMaxDepth(options.maxDepth || DEFAULT_MAX_DEPTH);
+    if(options.stats) {
+      _xsEnableStats(resPtr);
+    }
+    compileFn(resPtr, srcPtr, fnPtr);
     stackRestore(stack); 
   
     const HEAPU8 = Module.HEAPU8;  
@@ -57,15 +71,89 @@ export default async function(createModule) {
     if(success) {
       let jsPtr = _xsGetJS(resPtr);
       let js = UTF8ToString(jsPtr);
+      let stats = options.stats ?
+        JSON.parse(UTF8ToString(_xsGetStatsJSON(resPtr))) : null;
       _destroyXstateResult(resPtr);
-      return js;
+      return options.stats ? { js, stats } : js;
     }
   
-    let err = new Error('Compiler error');
+    // Each diagnostic has code, severity, start, end, line, column and
+    // message, see diagnostics.h.
+    let diagnostics = JSON.parse(UTF8ToString(_xsGetDiagnosticsJSON(resPtr)));
+    _destroyXstateResult(resPtr);
+    let first = diagnostics.find(d => d.severity === 'error');
+    let err = new Error(first ? first.message : 'Compiler error');
+    err.diagnostics = diagnostics;
     throw err;
   }
 
+  /**
+   * Compile Lucy source a module of XState machines.
+   * @param source {String} the input Lucy source.
+   * @param filename {String} the name of the Lucy file.
+   * @param options {Object}
+   * @param options.useRemote {Boolean} import XState from a CDN URL.
+   * @param options.stats {Boolean} also return compiler statistics.
+   * @param options.optimize {Boolean} remove unreachable states and share
+   * repeated ones, like lc -O.
+   * @param options.minimize {Boolean} merge states that behave the same,
+   * like lc --minimize.
+   * @param options.lazy {Boolean} export functions that build each machine
+   * on the first call, like lc --lazy.
+   * @param options.maxDepth {Number} fail on machines nested deeper than
+   * this, like lc --max-depth.
+   * @returns {String|Object} The compiled JavaScript module, or
+   * { js, stats } when options.stats is set.
+   */
+  function compileXstate(source, filename, options = {
+    useRemote: false,
+    stats: false,
+    optimize: false,
+    minimize: false,
+    lazy: false
+  }) {
+    return compile(_compileXstate, source, filename, options);
+  }
+
+  /**
+   * Compile Lucy source to a module with no dependencies, its machines run
+   * with the interpret function it exports, like lc --target js.
+   * @param source {String} the input Lucy source.
+   * @param filename {String} the name of the Lucy file.
+   * @param options {Object} stats, optimize and minimize as for
+   * compileXstate.
+   * @returns {String|Object} The compiled JavaScript module, or
+   * { js, stats } when options.stats is set.
+   */
+  function compileJs(source, filename, options = {
+    stats: false,
+    optimize: false,
+    minimize: false
+  }) {
+    return compile(_compileJs, source, filename, options);
+  }
+
+  /**
+   * Compile Lucy source to JSON describing its imports and machines, like
+   * lc --emit json. Guards and actions are referenced by name.
+   * @param source {String} the input Lucy source.
+   * @param filename {String} the name of the Lucy file.
+   * @param options {Object} stats, optimize and minimize as for
+   * compileXstate.
+   * @returns {String|Object} The JSON, or { js, stats } when options.stats
+   * is set.
+   */
+  function compileJson(source, filename, options = {
+    stats: false,
+    optimize: false,
+    minimize: false
+  }) {
+    return compile(_compileJson, source, filename, options);
+  }
+
   return {
-    compileXstate
+    compileXstate,
+    compileJs,
+    compileJson
   };
 }
\ No newline at end of file
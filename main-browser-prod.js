@@ -2,7 +2,11 @@ import createModule from './dist/liblucy-release-browser.mjs';
 import init from './liblucy.mjs';
 
 export let compileXstate;
+export let compileJs;
+export let compileJson;
 
 export let ready = init(createModule).then(exports => {
   compileXstate = exports.compileXstate;
+  compileJs = exports.compileJs;
+  compileJson = exports.compileJson;
 });
\ No newline at end of file
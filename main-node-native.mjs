@@ -0,0 +1,17 @@
+import { createRequire } from 'module';
+
+// The N-API addon built by make dist/liblucy.node. Same signatures as the
+// wasm build, see liblucy.mjs, and each compile also has an Async variant
+// returning a promise, compiled on libuv's thread pool.
+const addon = createRequire(import.meta.url)('./dist/liblucy.node');
+
+export const {
+  compileXstate,
+  compileJs,
+  compileJson,
+  compileXstateAsync,
+  compileJsAsync,
+  compileJsonAsync
+} = addon;
+
+export let ready = Promise.resolve();
@@ -0,0 +1,163 @@
+#!/usr/bin/env node
+// End-to-end compiler benchmarks. Generates Lucy programs of various sizes,
+// compiles each with the native core (bin/lc-bench) and both wasm builds,
+// and prints a JSON report.
+//
+//   scripts/bench.mjs [--preset name ...] [--targets native,wasm-debug,wasm-release]
+//                     [--iterations N] [--out report.json] [generator options]
+//
+// Generator options (see scripts/gen_lucy.mjs) describe a custom program that
+// is benchmarked in place of the presets.
+import { existsSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+import { generate, defaults } from './gen_lucy.mjs';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+
+const presets = {
+  small: { machines: 0, states: 10, transitions: 2 },
+  medium: {
+    machines: 4, states: 100, transitions: 4,
+    guards: 0.2, actions: 0.2, assigns: 0.1, delays: 0.1, invokes: 0.1
+  },
+  large: {
+    machines: 8, states: 500, transitions: 6, depth: 1,
+    guards: 0.3, actions: 0.3, assigns: 0.1, delays: 0.2, invokes: 0.1
+  },
+  deep: { machines: 1, states: 4, transitions: 2, depth: 30 }
+};
+
+const targets = {
+  'native': {
+    available: () => existsSync(join(root, 'bin/lc-bench')),
+    missing: 'bin/lc-bench not built (make bin/lc-bench)',
+    command: (iterations, files) => [join(root, 'bin/lc-bench'), ['--iterations', iterations, ...files]]
+  },
+  'wasm-debug': {
+    available: () => existsSync(join(root, 'dist/liblucy-debug-node.mjs')),
+    missing: 'dist/liblucy-debug-node.mjs not built (make dist/liblucy-debug-node.mjs)',
+    command: (iterations, files) => [process.execPath,
+      [join(root, 'scripts/bench_wasm.mjs'), 'debug', '--iterations', iterations, ...files]]
+  },
+  'wasm-release': {
+    available: () => existsSync(join(root, 'dist/liblucy-release-node.mjs')),
+    missing: 'dist/liblucy-release-node.mjs not built (make dist/liblucy-release-node.mjs)',
+    command: (iterations, files) => [process.execPath,
+      [join(root, 'scripts/bench_wasm.mjs'), 'release', '--iterations', iterations, ...files]]
+  }
+};
+
+function parseArgs(argv) {
+  const opts = {
+    presets: [],
+    targets: Object.keys(targets),
+    iterations: 20,
+    out: null,
+    custom: null
+  };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const key = arg.slice(2);
+    if(arg === '--preset') {
+      opts.presets.push(argv[++i]);
+    } else if(arg === '--targets') {
+      opts.targets = argv[++i].split(',');
+    } else if(arg === '--iterations') {
+      opts.iterations = Number(argv[++i]);
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else if(arg.startsWith('--') && key in defaults) {
+      opts.custom = opts.custom || {};
+      opts.custom[key] = Number(argv[++i]);
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+
+  for(const name of opts.presets) {
+    if(!(name in presets)) {
+      console.error(`Unknown preset: ${name}. Available: ${Object.keys(presets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  for(const name of opts.targets) {
+    if(!(name in targets)) {
+      console.error(`Unknown target: ${name}. Available: ${Object.keys(targets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  const programs = opts.custom ? { custom: opts.custom } :
+    Object.fromEntries((opts.presets.length ? opts.presets : Object.keys(presets))
+      .map(name => [name, presets[name]]));
+
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-bench-'));
+  const generated = Object.entries(programs).map(([name, options]) => {
+    const { source, counts } = generate(options);
+    const file = join(dir, `${name}.lucy`);
+    writeFileSync(file, source);
+    return { name, file, options: { ...defaults, ...options }, counts };
+  });
+  const results = [];
+  const skipped = [];
+  for(const name of opts.targets) {
+    const target = targets[name];
+    if(!target.available()) {
+      skipped.push({ target: name, reason: target.missing });
+      continue;
+    }
+
+    // One process per program so peak RSS belongs to that program alone.
+    for(const program of generated) {
+      const [cmd, args] = target.command(String(opts.iterations), [program.file]);
+      const proc = spawnSync(cmd, args, { encoding: 'utf-8', maxBuffer: 64 * 1024 * 1024 });
+      if(proc.status !== 0) {
+        skipped.push({ target: name, program: program.name,
+          reason: `exited with ${proc.status}: ${proc.stderr.trim()}` });
+        continue;
+      }
+
+      const [measurement] = JSON.parse(proc.stdout);
+      const seconds = measurement.mean_ns / 1e9;
+      results.push({
+        target: name,
+        program: program.name,
+        ...measurement,
+        file: undefined,
+        states: program.counts.states,
+        transitions: program.counts.transitions,
+        states_per_s: Math.round(program.counts.states / seconds)
+      });
+    }
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+
+  const pkg = JSON.parse(readFileSync(join(root, 'package.json'), 'utf-8'));
+  const report = {
+    version: pkg.version,
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, node: process.version },
+    iterations: opts.iterations,
+    programs: generated.map(({ name, options, counts }) => ({ name, options, ...counts })),
+    results,
+    skipped
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
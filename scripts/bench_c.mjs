@@ -0,0 +1,167 @@
+#!/usr/bin/env node
+// Benchmarks the dispatch code of the C target. Generates Lucy programs,
+// compiles them with bin/lc --target c, builds each machine with a driver
+// that sends it a fixed pseudo-random sequence of events and prints a JSON
+// report of events per second.
+//
+//   scripts/bench_c.mjs [--preset name ...] [--events N] [--cc cc] [--out report.json]
+//
+// The driver's host is zeroed, so guards pass and actions are skipped: what
+// is measured is the generated selection and state bookkeeping alone.
+import { existsSync, mkdirSync, mkdtempSync, readdirSync, readFileSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+import { generate, defaults } from './gen_lucy.mjs';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const lc = join(root, 'bin/lc');
+
+const presets = {
+  small: { machines: 1, states: 10, transitions: 2 },
+  medium: {
+    machines: 1, states: 100, transitions: 4,
+    guards: 0.2, actions: 0.2, assigns: 0.1, delays: 0.1, invokes: 0.1
+  },
+  large: {
+    machines: 1, states: 1000, transitions: 8, depth: 1,
+    guards: 0.3, actions: 0.3, assigns: 0.1, delays: 0.2, invokes: 0.1
+  }
+};
+
+// NAME is replaced with the machine's prefix and UPPER with its enum prefix.
+const driver = `#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "NAME.h"
+
+int main(int argc, char* argv[]) {
+  long events = argc > 1 ? atol(argv[1]) : 1000000;
+  NAME_host host = {0};
+  NAME_machine machine;
+  NAME_init(&machine, &host);
+
+  unsigned long taken = 0;
+  unsigned int seed = 1;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(long i = 0; i < events; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    taken += NAME_send(&machine, (NAME_event)((seed >> 16) % UPPER_EVENT_COUNT), NULL);
+    if(NAME_is_final(&machine)) {
+      NAME_init(&machine, &host);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  long long ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+  printf("{\\"events\\": %ld, \\"taken\\": %lu, \\"ns\\": %lld}\\n", events, taken, ns);
+  return 0;
+}
+`;
+
+function parseArgs(argv) {
+  const opts = { presets: [], events: 10000000, cc: process.env.CC || 'cc', out: null };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--preset') {
+      opts.presets.push(argv[++i]);
+    } else if(arg === '--events') {
+      opts.events = Number(argv[++i]);
+    } else if(arg === '--cc') {
+      opts.cc = argv[++i];
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+
+  for(const name of opts.presets) {
+    if(!(name in presets)) {
+      console.error(`Unknown preset: ${name}. Available: ${Object.keys(presets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function check(proc, what) {
+  if(proc.status !== 0) {
+    console.error(`${what} exited with ${proc.status}:\n${proc.stderr}`);
+    process.exit(1);
+  }
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  if(!existsSync(lc)) {
+    console.error('bin/lc not built (make bin/lc)');
+    process.exit(1);
+  }
+
+  const names = opts.presets.length ? opts.presets : Object.keys(presets);
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-bench-c-'));
+  const results = [];
+  const programs = [];
+
+  for(const name of names) {
+    const options = presets[name];
+    const { source, counts } = generate(options);
+    const programDir = join(dir, name);
+    const file = `${programDir}.lucy`;
+    writeFileSync(file, source);
+    programs.push({ name, options: { ...defaults, ...options }, ...counts });
+
+    mkdirSync(programDir);
+    check(spawnSync(lc, ['--target', 'c', '--out-dir', programDir, file], { encoding: 'utf-8' }), 'lc');
+
+    for(const header of readdirSync(programDir).filter(f => f.endsWith('.h'))) {
+      const machine = header.slice(0, -2);
+      // Machines without events have nothing to dispatch.
+      const contents = readFileSync(join(programDir, header), 'utf-8');
+      if(new RegExp(`\\{\\s*${machine.toUpperCase()}_EVENT_COUNT`).test(contents)) {
+        continue;
+      }
+
+      const main = join(programDir, `${machine}_main.c`);
+      const exe = join(programDir, machine);
+      writeFileSync(main, driver.replace(/NAME/g, machine).replace(/UPPER/g, machine.toUpperCase()));
+      check(spawnSync(opts.cc, ['-O2', '-std=c99', '-D_POSIX_C_SOURCE=199309L', '-o', exe,
+        join(programDir, `${machine}.c`), main], { encoding: 'utf-8' }), opts.cc);
+
+      const proc = spawnSync(exe, [String(opts.events)], { encoding: 'utf-8' });
+      check(proc, machine);
+      const measurement = JSON.parse(proc.stdout);
+      results.push({
+        program: name,
+        machine,
+        ...measurement,
+        events_per_s: Math.round(measurement.events / (measurement.ns / 1e9))
+      });
+    }
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+
+  const pkg = JSON.parse(readFileSync(join(root, 'package.json'), 'utf-8'));
+  const report = {
+    version: pkg.version,
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, node: process.version },
+    cc: opts.cc,
+    programs,
+    results
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
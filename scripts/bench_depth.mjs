@@ -0,0 +1,112 @@
+#!/usr/bin/env node
+// Benchmarks deeply nested machines. Generates a chain of machines nested
+// in the initial state of the one before, at each depth, and compiles them
+// with bin/lc-bench --frontend. Prints a JSON report with the time per
+// level, which stays flat when parsing, validation and lowering are linear
+// in the depth.
+//
+//   scripts/bench_depth.mjs [--depths 10,100,...] [--iterations N] [--out report.json]
+//
+// Only the frontend is timed: each emitted format spells out every state's
+// path or indents it by its depth, so output grows with the square of the
+// depth whatever the compiler does.
+import { existsSync, mkdtempSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const bench = join(root, 'bin/lc-bench');
+
+// Lucy identifiers are letters only, so numbers are spelled in base 26.
+function alpha(n) {
+  let str = '';
+  do {
+    str = String.fromCharCode(97 + (n % 26)) + str;
+    n = Math.floor(n / 26) - 1;
+  } while(n >= 0);
+  return str;
+}
+
+// Unindented, so the source stays linear in the depth too.
+function generate(depth) {
+  const out = ['machine top {'];
+  for(let i = 0; i < depth; i++) {
+    out.push(`initial state s${alpha(i)} {`, `go => s${alpha(i)}`, `machine n${alpha(i)} {`);
+  }
+  out.push('initial state leaf {', '}');
+  for(let i = 0; i < depth; i++) {
+    out.push('}', '}');
+  }
+  out.push('}', '');
+  return out.join('\n');
+}
+
+function parseArgs(argv) {
+  const opts = { depths: [10, 100, 1000, 10000, 100000], iterations: 5, out: null };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--depths') {
+      opts.depths = argv[++i].split(',').map(Number);
+    } else if(arg === '--iterations') {
+      opts.iterations = Number(argv[++i]);
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  if(!existsSync(bench)) {
+    console.error('bin/lc-bench not built (make bin/lc-bench)');
+    process.exit(1);
+  }
+
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-depth-'));
+  const results = [];
+  for(const depth of opts.depths) {
+    const file = join(dir, `depth-${depth}.lucy`);
+    writeFileSync(file, generate(depth));
+
+    const proc = spawnSync(bench, ['--frontend', '--max-depth', String(depth),
+      '--iterations', String(opts.iterations), file], { encoding: 'utf-8' });
+    if(proc.status !== 0) {
+      results.push({ depth, error: `exited with ${proc.status}: ${proc.stderr.trim()}` });
+      continue;
+    }
+
+    const [measurement] = JSON.parse(proc.stdout);
+    results.push({
+      depth,
+      success: measurement.success,
+      bytes: measurement.bytes,
+      mean_ns: measurement.mean_ns,
+      ns_per_level: Math.round(measurement.mean_ns / depth),
+      phases: measurement.phases,
+      peak_rss_kb: measurement.peak_rss_kb
+    });
+  }
+  rmSync(dir, { recursive: true, force: true });
+
+  const report = {
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, node: process.version },
+    iterations: opts.iterations,
+    results
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
@@ -0,0 +1,215 @@
+#!/usr/bin/env node
+// Benchmarks the output of the JS target against the XState target.
+// Generates Lucy programs, compiles them with bin/lc and bin/lc --target js,
+// and prints a JSON report of module load time and events sent per second.
+//
+//   scripts/bench_js.mjs [--preset name ...] [--events N] [--loads N] [--out report.json]
+//
+// Imported guards pass and actions return a constant, invoked services never
+// settle. Each measurement runs in a fresh node process so module caches and
+// JIT state don't carry over. The XState target is skipped when the xstate
+// package can't be resolved from the repo (npm install).
+import { existsSync, mkdirSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { createRequire } from 'module';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath, pathToFileURL } from 'url';
+import { generate, defaults } from './gen_lucy.mjs';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const lc = join(root, 'bin/lc');
+
+const presets = {
+  small: { machines: 1, states: 10, transitions: 2 },
+  medium: {
+    machines: 1, states: 100, transitions: 4,
+    guards: 0.2, actions: 0.2, assigns: 0.1, delays: 0.1, invokes: 0.1
+  },
+  large: {
+    machines: 1, states: 1000, transitions: 8, depth: 1,
+    guards: 0.3, actions: 0.3, assigns: 0.1, delays: 0.2, invokes: 0.1
+  }
+};
+
+// Both targets export an interpret function, XState's from the package.
+const runner = `import { performance } from 'perf_hooks';
+const [mode, file, name, count, xstate] = process.argv.slice(2);
+
+const start = performance.now();
+const mod = await import(file);
+const load = performance.now() - start;
+if(mode === 'load') {
+  console.log(JSON.stringify({ ns: Math.round(load * 1e6) }));
+  process.exit(0);
+}
+
+const { interpret } = xstate ? await import(xstate) : mod;
+const events = JSON.parse(process.env.BENCH_EVENTS);
+const n = Number(count);
+let service = interpret(mod[name]).start();
+let seed = 1;
+const t0 = performance.now();
+for(let i = 0; i < n; i++) {
+  seed = (Math.imul(seed, 1664525) + 1013904223) >>> 0;
+  if(service.send(events[(seed >>> 16) % events.length]).done) {
+    service.stop();
+    service = interpret(mod[name]).start();
+  }
+}
+const ns = Math.round((performance.now() - t0) * 1e6);
+service.stop();
+console.log(JSON.stringify({ events: n, ns }));
+process.exit(0);
+`;
+
+function parseArgs(argv) {
+  const opts = { presets: [], events: 1000000, loads: 10, out: null };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--preset') {
+      opts.presets.push(argv[++i]);
+    } else if(arg === '--events') {
+      opts.events = Number(argv[++i]);
+    } else if(arg === '--loads') {
+      opts.loads = Number(argv[++i]);
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+
+  for(const name of opts.presets) {
+    if(!(name in presets)) {
+      console.error(`Unknown preset: ${name}. Available: ${Object.keys(presets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function check(proc, what) {
+  if(proc.status !== 0) {
+    console.error(`${what} exited with ${proc.status}:\n${proc.stderr}`);
+    process.exit(1);
+  }
+}
+
+function resolveXstate() {
+  try {
+    return pathToFileURL(createRequire(join(root, 'package.json')).resolve('xstate')).href;
+  } catch {
+    return null;
+  }
+}
+
+// Stubs for everything a generated program imports.
+function impl(source) {
+  const match = source.match(/^import \{ (.*) \} from/m);
+  return (match ? match[1].split(', ') : []).map(name => {
+    const value = /check/.test(name) ? '() => true' :
+      /service/.test(name) ? '() => new Promise(() => {})' : '() => 1';
+    return `export const ${name} = ${value};\n`;
+  }).join('');
+}
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  if(!existsSync(lc)) {
+    console.error('bin/lc not built (make bin/lc)');
+    process.exit(1);
+  }
+
+  const xstate = resolveXstate();
+  const targets = {
+    js: { args: ['--target', 'js'] },
+    xstate: xstate ? { args: [] } : { skipped: 'the xstate package is not installed (npm install)' }
+  };
+
+  const names = opts.presets.length ? opts.presets : Object.keys(presets);
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-bench-js-'));
+  const runnerFile = join(dir, 'runner.mjs');
+  writeFileSync(runnerFile, runner);
+  const results = [];
+  const programs = [];
+
+  for(const name of names) {
+    const options = presets[name];
+    const { source, counts } = generate(options);
+    const programDir = join(dir, name);
+    mkdirSync(programDir);
+    const file = join(programDir, 'input.lucy');
+    writeFileSync(file, source);
+    writeFileSync(join(programDir, 'impl.js'), impl(source));
+    programs.push({ name, options: { ...defaults, ...options }, ...counts });
+
+    const machines = [...source.matchAll(/^machine (\w+) \{/gm)].map(m => m[1]);
+    const events = [...new Set(source.match(/\bev[A-Z]+\b/g))];
+
+    for(const [target, { args, skipped }] of Object.entries(targets)) {
+      if(skipped) {
+        results.push({ program: name, target, skipped });
+        continue;
+      }
+
+      const proc = spawnSync(lc, [...args, file], { encoding: 'utf-8', maxBuffer: 1 << 30 });
+      check(proc, 'lc');
+      const out = join(programDir, `${target}.mjs`);
+      writeFileSync(out, target === 'xstate' ? proc.stdout.replace(/'xstate'/, `'${xstate}'`) : proc.stdout);
+
+      const spawn = (mode, machine) => {
+        const child = spawnSync(process.execPath,
+          [runnerFile, mode, pathToFileURL(out).href, machine, String(opts.events), target === 'xstate' ? xstate : ''],
+          { encoding: 'utf-8', env: { ...process.env, BENCH_EVENTS: JSON.stringify(events) } });
+        check(child, `${target} ${mode}`);
+        return JSON.parse(child.stdout);
+      };
+
+      const loads = [];
+      for(let i = 0; i < opts.loads; i++) {
+        loads.push(spawn('load', machines[0]).ns);
+      }
+
+      for(const machine of machines) {
+        const measurement = spawn('send', machine);
+        results.push({
+          program: name,
+          target,
+          machine,
+          bytes: Buffer.byteLength(proc.stdout),
+          load_ns: median(loads),
+          ...measurement,
+          events_per_s: Math.round(measurement.events / (measurement.ns / 1e9))
+        });
+      }
+    }
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+
+  const pkg = JSON.parse(readFileSync(join(root, 'package.json'), 'utf-8'));
+  const report = {
+    version: pkg.version,
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, node: process.version },
+    events: opts.events,
+    programs,
+    results
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
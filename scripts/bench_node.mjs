@@ -0,0 +1,202 @@
+#!/usr/bin/env node
+// Throughput of the ways Node tooling can compile Lucy: the N-API addon,
+// synchronously and on libuv's thread pool, the wasm release build, and
+// spawning bin/lc once per file. Each target compiles the same batch of a
+// generated program and the report has compiles per second. large, at
+// around a second a compile, only runs when asked for.
+//
+//   scripts/bench_node.mjs [--preset name ...] [--targets addon,addon-async,wasm,cli]
+//                          [--compiles N] [--jobs N] [--out report.json]
+//
+// addon-async and cli keep --jobs compiles in flight, by default libuv's
+// pool size (UV_THREADPOOL_SIZE, 4 unless set).
+import { existsSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'fs';
+import { spawn } from 'child_process';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+import { performance } from 'perf_hooks';
+import { generate } from './gen_lucy.mjs';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+
+const presets = {
+  small: { machines: 0, states: 10, transitions: 2 },
+  medium: {
+    machines: 4, states: 100, transitions: 4,
+    guards: 0.2, actions: 0.2, assigns: 0.1, delays: 0.1, invokes: 0.1
+  },
+  large: {
+    machines: 8, states: 500, transitions: 6, depth: 1,
+    guards: 0.3, actions: 0.3, assigns: 0.1, delays: 0.2, invokes: 0.1
+  }
+};
+
+// Runs count compiles with at most jobs at a time.
+async function pool(count, jobs, compileOne) {
+  let next = 0;
+  const worker = async () => {
+    while(next < count) {
+      next++;
+      await compileOne();
+    }
+  };
+  await Promise.all(Array.from({ length: Math.min(jobs, count) }, worker));
+}
+
+function spawnLc(file) {
+  return new Promise((resolve, reject) => {
+    const proc = spawn(join(root, 'bin/lc'), [file], { stdio: ['ignore', 'ignore', 'ignore'] });
+    proc.on('error', reject);
+    proc.on('exit', status => status === 0 ? resolve() :
+      reject(new Error(`bin/lc exited with ${status}`)));
+  });
+}
+
+const targets = {
+  'addon': {
+    available: () => existsSync(join(root, 'dist/liblucy.node')),
+    missing: 'dist/liblucy.node not built (make dist/liblucy.node)',
+    async setup() {
+      const { compileXstate } = await import('../main-node-native.mjs');
+      return ({ source, filename }, count) => {
+        for(let i = 0; i < count; i++) {
+          compileXstate(source, filename);
+        }
+      };
+    }
+  },
+  'addon-async': {
+    available: () => existsSync(join(root, 'dist/liblucy.node')),
+    missing: 'dist/liblucy.node not built (make dist/liblucy.node)',
+    async setup(jobs) {
+      const { compileXstateAsync } = await import('../main-node-native.mjs');
+      return ({ source, filename }, count) =>
+        pool(count, jobs, () => compileXstateAsync(source, filename));
+    }
+  },
+  'wasm': {
+    available: () => existsSync(join(root, 'dist/liblucy-release-node.mjs')),
+    missing: 'dist/liblucy-release-node.mjs not built (make dist/liblucy-release-node.mjs)',
+    async setup() {
+      const { compileXstate, ready } = await import('../main-node-prod.mjs');
+      await ready;
+      return ({ source, filename }, count) => {
+        for(let i = 0; i < count; i++) {
+          compileXstate(source, filename);
+        }
+      };
+    }
+  },
+  'cli': {
+    available: () => existsSync(join(root, 'bin/lc')),
+    missing: 'bin/lc not built (make bin/lc)',
+    async setup(jobs) {
+      return ({ file }, count) => pool(count, jobs, () => spawnLc(file));
+    }
+  }
+};
+
+function parseArgs(argv) {
+  const opts = {
+    presets: [],
+    targets: Object.keys(targets),
+    compiles: 200,
+    jobs: Number(process.env.UV_THREADPOOL_SIZE) || 4,
+    out: null
+  };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--preset') {
+      opts.presets.push(argv[++i]);
+    } else if(arg === '--targets') {
+      opts.targets = argv[++i].split(',');
+    } else if(arg === '--compiles') {
+      opts.compiles = Number(argv[++i]);
+    } else if(arg === '--jobs') {
+      opts.jobs = Number(argv[++i]);
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+
+  for(const name of opts.presets) {
+    if(!(name in presets)) {
+      console.error(`Unknown preset: ${name}. Available: ${Object.keys(presets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  for(const name of opts.targets) {
+    if(!(name in targets)) {
+      console.error(`Unknown target: ${name}. Available: ${Object.keys(targets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+async function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  // The pool is sized when first used, so this has to come before any
+  // async work is queued.
+  process.env.UV_THREADPOOL_SIZE = String(opts.jobs);
+
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-bench-node-'));
+  const programs = (opts.presets.length ? opts.presets : ['small', 'medium']).map(name => {
+    const { source, counts } = generate(presets[name]);
+    const file = join(dir, `${name}.lucy`);
+    writeFileSync(file, source);
+    return { name, file, filename: `${name}.lucy`, source, ...counts };
+  });
+
+  const results = [];
+  const skipped = [];
+  for(const name of opts.targets) {
+    const target = targets[name];
+    if(!target.available()) {
+      skipped.push({ target: name, reason: target.missing });
+      continue;
+    }
+
+    const compile = await target.setup(opts.jobs);
+    for(const program of programs) {
+      // A few compiles first so startup and JIT warmup aren't counted.
+      await compile(program, Math.max(1, Math.ceil(opts.compiles / 20)));
+      const start = performance.now();
+      await compile(program, opts.compiles);
+      const seconds = (performance.now() - start) / 1000;
+      results.push({
+        target: name,
+        program: program.name,
+        compiles: opts.compiles,
+        seconds: Number(seconds.toFixed(4)),
+        compiles_per_s: Math.round(opts.compiles / seconds)
+      });
+    }
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+
+  const pkg = JSON.parse(readFileSync(join(root, 'package.json'), 'utf-8'));
+  const report = {
+    version: pkg.version,
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, cpus: cpus().length, node: process.version },
+    jobs: opts.jobs,
+    programs: programs.map(({ name, states, transitions }) => ({ name, states, transitions })),
+    results,
+    skipped
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
@@ -0,0 +1,196 @@
+#!/usr/bin/env node
+// Benchmarks the bytecode VM. Generates Lucy programs, compiles each to one
+// bytecode file with bin/lc --emit bytecode, then runs a driver linked with
+// bin/liblucy-vm.a that maps the file, starts every machine in it and sends
+// them a fixed pseudo-random sequence of events. Prints a JSON report of
+// load and start times and events per second.
+//
+//   scripts/bench_vm.mjs [--preset name ...] [--events N] [--cc cc] [--out report.json]
+//
+// The driver's host is zeroed, so guards pass and actions are skipped.
+import { existsSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { tmpdir, cpus, platform, arch } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+import { generate, defaults } from './gen_lucy.mjs';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const lc = join(root, 'bin/lc');
+const lib = join(root, 'bin/liblucy-vm.a');
+
+const presets = {
+  small: { machines: 1, states: 10, transitions: 2 },
+  large: {
+    machines: 1, states: 1000, transitions: 8, depth: 1,
+    guards: 0.3, actions: 0.3, assigns: 0.1, delays: 0.2, invokes: 0.1
+  },
+  many: {
+    machines: 500, states: 20, transitions: 4,
+    guards: 0.2, actions: 0.2, assigns: 0.1, delays: 0.1, invokes: 0.1
+  }
+};
+
+// Generated events are all named ev followed by letters.
+const driver = `#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "vm.h"
+
+static long long now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+  long events = atol(argv[2]);
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  fstat(fd, &st);
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  long long start = now();
+  VMProgram program;
+  int error = vm_load(&program, data, st.st_size);
+  long long load_ns = now() - start;
+  if(error != VM_OK) {
+    fprintf(stderr, "%s\\n", vm_load_error(error));
+    return 1;
+  }
+
+  uint32_t count = vm_machine_count(&program);
+  uint32_t strings = program.header->string_count;
+  uint32_t* ids = malloc((strings + 1) * sizeof(uint32_t));
+  uint32_t event_count = 0;
+  for(uint32_t i = 0; i < strings; i++) {
+    const char* str = vm_string(&program, i);
+    if(strncmp(str, "ev", 2) == 0 && str[2] >= 'A' && str[2] <= 'Z') {
+      ids[event_count++] = i;
+    }
+  }
+
+  VMHost host = {0};
+  VMMachine* machines = malloc((count + 1) * sizeof(VMMachine));
+  start = now();
+  for(uint32_t i = 0; i < count; i++) {
+    vm_init(&machines[i], &program, i, &host);
+  }
+  long long init_ns = now() - start;
+
+  unsigned long taken = 0;
+  unsigned int seed = 1;
+  start = now();
+  for(long i = 0; i < events; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    VMMachine* m = &machines[(seed >> 8) % count];
+    taken += vm_send(m, ids[(seed >> 16) % event_count], NULL);
+    if(vm_is_final(m)) {
+      vm_init(m, &program, (uint32_t)(m - machines), &host);
+    }
+  }
+  long long ns = now() - start;
+
+  printf("{\\"machines\\": %u, \\"bytes\\": %lld, \\"load_ns\\": %lld, \\"init_ns\\": %lld, "
+    "\\"events\\": %ld, \\"taken\\": %lu, \\"ns\\": %lld}\\n",
+    count, (long long)st.st_size, load_ns, init_ns, events, taken, ns);
+  return 0;
+}
+`;
+
+function parseArgs(argv) {
+  const opts = { presets: [], events: 10000000, cc: process.env.CC || 'cc', out: null };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--preset') {
+      opts.presets.push(argv[++i]);
+    } else if(arg === '--events') {
+      opts.events = Number(argv[++i]);
+    } else if(arg === '--cc') {
+      opts.cc = argv[++i];
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+
+  for(const name of opts.presets) {
+    if(!(name in presets)) {
+      console.error(`Unknown preset: ${name}. Available: ${Object.keys(presets).join(', ')}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function check(proc, what) {
+  if(proc.status !== 0) {
+    console.error(`${what} exited with ${proc.status}:\n${proc.stderr}`);
+    process.exit(1);
+  }
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  if(!existsSync(lc) || !existsSync(lib)) {
+    console.error('bin/lc or bin/liblucy-vm.a not built (make bin/lc bin/liblucy-vm.a)');
+    process.exit(1);
+  }
+
+  const names = opts.presets.length ? opts.presets : Object.keys(presets);
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-bench-vm-'));
+  const main = join(dir, 'main.c');
+  const exe = join(dir, 'driver');
+  writeFileSync(main, driver);
+  check(spawnSync(opts.cc, ['-O2', '-std=c99', '-D_POSIX_C_SOURCE=199309L', '-I', join(root, 'src/vm'),
+    '-o', exe, main, lib], { encoding: 'utf-8' }), opts.cc);
+
+  const results = [];
+  const programs = [];
+  for(const name of names) {
+    const options = presets[name];
+    const { source, counts } = generate(options);
+    const file = join(dir, `${name}.lucy`);
+    const bytecode = join(dir, `${name}.lucyc`);
+    writeFileSync(file, source);
+    programs.push({ name, options: { ...defaults, ...options }, ...counts });
+
+    check(spawnSync(lc, ['--emit', 'bytecode', '--out-file', bytecode, file], { encoding: 'utf-8' }), 'lc');
+    const proc = spawnSync(exe, [bytecode, String(opts.events)], { encoding: 'utf-8' });
+    check(proc, 'driver');
+    const measurement = JSON.parse(proc.stdout);
+    results.push({
+      program: name,
+      ...measurement,
+      events_per_s: Math.round(measurement.events / (measurement.ns / 1e9))
+    });
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+
+  const pkg = JSON.parse(readFileSync(join(root, 'package.json'), 'utf-8'));
+  const report = {
+    version: pkg.version,
+    date: new Date().toISOString(),
+    host: { platform: platform(), arch: arch(), cpu: cpus()[0].model, node: process.version },
+    cc: opts.cc,
+    programs,
+    results
+  };
+
+  const json = JSON.stringify(report, null, 2) + '\n';
+  if(opts.out) {
+    writeFileSync(opts.out, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+run();
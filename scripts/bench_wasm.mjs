@@ -0,0 +1,83 @@
+#!/usr/bin/env node
+// Wasm counterpart of bin/lc-bench, prints results in the same JSON shape.
+//
+//   scripts/bench_wasm.mjs <debug|release> [--iterations N] [--warmup N] file ...
+import { readFileSync } from 'fs';
+import { performance } from 'perf_hooks';
+import init from '../liblucy.mjs';
+
+const [,, build, ...rest] = process.argv;
+
+if(build !== 'debug' && build !== 'release') {
+  console.error('Usage: bench_wasm.mjs <debug|release> [--iterations N] [--warmup N] file ...');
+  process.exit(1);
+}
+
+let iterations = 20;
+let warmup = 2;
+const files = [];
+for(let i = 0; i < rest.length; i++) {
+  switch(rest[i]) {
+    case '--iterations': iterations = Number(rest[++i]); break;
+    case '--warmup': warmup = Number(rest[++i]); break;
+    default: files.push(rest[i]);
+  }
+}
+
+function compile(compileXstate, source, filename, options) {
+  try {
+    return compileXstate(source, filename, options) || true;
+  } catch {
+    return false;
+  }
+}
+
+async function run() {
+  const { default: createModule } = await import(`../dist/liblucy-${build}-node.mjs`);
+  const { compileXstate } = await init(createModule);
+
+  const results = files.map(filename => {
+    const source = readFileSync(filename, 'utf-8');
+
+    for(let i = 0; i < warmup; i++) {
+      compile(compileXstate, source, filename);
+    }
+
+    let success = true;
+    let total = 0;
+    let min = Infinity;
+    for(let i = 0; i < iterations; i++) {
+      const start = performance.now();
+      success = compile(compileXstate, source, filename) && success;
+      const elapsed = (performance.now() - start) * 1e6;
+      total += elapsed;
+      min = Math.min(min, elapsed);
+    }
+
+    // One extra run with stats on, which adds per-token timers.
+    const result = compile(compileXstate, source, filename, { stats: true });
+    const stats = result ? result.stats : null;
+
+    const bytes = Buffer.byteLength(source);
+    const mean = total / iterations;
+    return {
+      file: filename,
+      bytes,
+      success,
+      iterations,
+      mean_ns: Math.round(mean),
+      min_ns: Math.round(min),
+      mb_per_s: Number(((bytes / (1024 * 1024)) / (mean / 1e9)).toFixed(3)),
+      phases: stats && stats.phases,
+      tokens: stats && stats.tokens,
+      allocations: stats && stats.allocations,
+      frees: stats && stats.frees,
+      peak_heap_bytes: stats && stats.peak_heap_bytes,
+      peak_rss_kb: process.resourceUsage().maxRSS
+    };
+  });
+
+  process.stdout.write(JSON.stringify(results) + '\n');
+}
+
+run();
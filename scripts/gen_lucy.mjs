@@ -0,0 +1,192 @@
+#!/usr/bin/env node
+// Generates synthetic Lucy programs of a configurable size. Used by the
+// benchmark harness, but can be run directly to produce a corpus:
+//
+//   scripts/gen_lucy.mjs --states 200 --transitions 4 --depth 2 > big.lucy
+import { writeFileSync } from 'fs';
+import { pathToFileURL } from 'url';
+
+export const defaults = {
+  machines: 1,       // top-level machine blocks (0 = implicit machine)
+  states: 10,        // states per machine block
+  transitions: 2,    // event transitions per state
+  depth: 0,          // nesting depth of machine blocks
+  guards: 0,         // fraction of transitions with a named guard
+  actions: 0,        // fraction of transitions with a named action
+  assigns: 0,        // fraction of transitions with an inline assign
+  delays: 0,         // fraction of states with a delay transition
+  invokes: 0,        // fraction of states with an invoke block
+  seed: 1
+};
+
+// mulberry32, so a given seed always produces the same program.
+function random(seed) {
+  let a = seed >>> 0;
+  return function() {
+    a = (a + 0x6D2B79F5) >>> 0;
+    let t = a;
+    t = Math.imul(t ^ (t >>> 15), t | 1);
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+// Lucy identifiers are letters only, so numbers are spelled in base 26.
+function alpha(n) {
+  let str = '';
+  do {
+    str = String.fromCharCode(65 + (n % 26)) + str;
+    n = Math.floor(n / 26) - 1;
+  } while(n >= 0);
+  return str;
+}
+
+export function generate(options = {}) {
+  const opts = { ...defaults, ...options };
+  const rand = random(opts.seed);
+  const chance = p => p > 0 && rand() < p;
+
+  const counts = { states: 0, transitions: 0, machines: 0, lines: 0 };
+  const imports = new Set();
+  const out = [];
+  let uid = 0;
+
+  function line(indent, text) {
+    out.push('  '.repeat(indent) + text);
+  }
+
+  function machineBody(indent, level) {
+    const prefix = `l${alpha(level)}m${alpha(uid++)}`;
+    const names = [];
+    for(let i = 0; i < opts.states; i++) {
+      names.push(`${prefix}s${alpha(i)}`);
+    }
+    counts.machines++;
+
+    // Bindings are declared once the states are written, and only those
+    // that ended up used, so the program compiles without warnings.
+    const declarations = out.length;
+    const guards = [];
+    const actions = [];
+    for(let i = 0; i < opts.states; i++) {
+      if(opts.guards > 0) guards.push(`${prefix}g${alpha(i)}`);
+      if(opts.actions > 0) actions.push(`${prefix}a${alpha(i)}`);
+    }
+    const usedGuards = new Set();
+    const usedActions = new Set();
+
+    names.forEach((name, i) => {
+      const modifier = i === 0 ? 'initial ' : (i === names.length - 1 ? 'final ' : '');
+      line(indent, `${modifier}state ${name} {`);
+      counts.states++;
+
+      for(let t = 0; t < opts.transitions; t++) {
+        const dest = names[(i + t + 1) % names.length];
+        let parts = [`ev${alpha(t)}`];
+        if(chance(opts.guards)) {
+          const g = (i + t) % guards.length;
+          usedGuards.add(g);
+          parts.push(guards[g]);
+        }
+        if(chance(opts.actions)) {
+          const a = (i + t) % actions.length;
+          usedActions.add(a);
+          parts.push(actions[a]);
+        }
+        if(chance(opts.assigns)) parts.push(`assign key${alpha(t)}`);
+        parts.push(dest);
+        line(indent + 1, parts.join(' => '));
+        counts.transitions++;
+      }
+
+      if(chance(opts.delays)) {
+        line(indent + 1, `delay ${1 + (i % 5)}s => ${names[(i + 1) % names.length]}`);
+        counts.transitions++;
+      }
+
+      if(chance(opts.invokes)) {
+        const service = `${prefix}service${alpha(i)}`;
+        imports.add(service);
+        line(indent + 1, `invoke ${service} {`);
+        line(indent + 2, `done => ${names[(i + 1) % names.length]}`);
+        line(indent + 2, `error => ${names[0]}`);
+        line(indent + 1, '}');
+        counts.transitions += 2;
+      }
+
+      if(i === 0 && level < opts.depth) {
+        line(0, '');
+        line(indent + 1, `machine ${prefix}nested {`);
+        machineBody(indent + 2, level + 1);
+        line(indent + 1, '}');
+      }
+
+      line(indent, '}');
+      line(0, '');
+    });
+
+    const bindings = [];
+    for(let i = 0; i < opts.states; i++) {
+      const pad = '  '.repeat(indent);
+      if(usedGuards.has(i)) {
+        imports.add(`${prefix}check${alpha(i)}`);
+        bindings.push(`${pad}guard ${guards[i]} = ${prefix}check${alpha(i)}`);
+      }
+      if(usedActions.has(i)) {
+        imports.add(`${prefix}set${alpha(i)}`);
+        bindings.push(`${pad}action ${actions[i]} = assign key${alpha(i)} ${prefix}set${alpha(i)}`);
+      }
+    }
+    if(bindings.length) {
+      out.splice(declarations, 0, ...bindings, '');
+    }
+  }
+
+  if(opts.machines === 0) {
+    machineBody(0, 0);
+  } else {
+    for(let m = 0; m < opts.machines; m++) {
+      line(0, `machine m${alpha(m)} {`);
+      machineBody(1, 0);
+      line(0, '}');
+      line(0, '');
+    }
+  }
+
+  if(imports.size) {
+    out.unshift(`import { ${[...imports].join(', ')} } from './impl.js'`, '');
+  }
+
+  const source = out.join('\n');
+  counts.lines = out.length;
+  counts.bytes = Buffer.byteLength(source);
+  return { source, counts };
+}
+
+function parseArgs(argv) {
+  const opts = {};
+  let out = null;
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--out') {
+      out = argv[++i];
+    } else if(arg.startsWith('--') && arg.slice(2) in defaults) {
+      opts[arg.slice(2)] = Number(argv[++i]);
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      console.error(`Options: ${Object.keys(defaults).map(k => '--' + k).join(' ')} --out <file>`);
+      process.exit(1);
+    }
+  }
+  return { opts, out };
+}
+
+if(import.meta.url === pathToFileURL(process.argv[1]).href) {
+  const { opts, out } = parseArgs(process.argv.slice(2));
+  const { source } = generate(opts);
+  if(out) {
+    writeFileSync(out, source);
+  } else {
+    process.stdout.write(source);
+  }
+}
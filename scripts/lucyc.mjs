@@ -2,7 +2,12 @@
 import { promises as fsPromises } from 'fs';
 const { readFile } = fsPromises;
 
-const [,, filename] = process.argv;
+const args = process.argv.slice(2);
+const optimize = args.includes('-O');
+const minimize = args.includes('--minimize');
+const lazy = args.includes('--lazy');
+const target = args.includes('--emit=json') ? 'json' : args.includes('--target=js') ? 'js' : 'xstate';
+const filename = args.find(arg => !arg.startsWith('-'));
 
 if(!filename) {
   console.error('A filename is required')
@@ -12,7 +17,7 @@ if(!filename) {
 async function run() {
   const [
     contents,
-    { compileXstate, ready }
+    { compileXstate, compileJs, compileJson, ready }
   ] = await Promise.all([
     readFile(filename, 'utf-8'),
     import('../main-node-dev.mjs') // dynamic to support debug/release mode
@@ -20,7 +25,8 @@ async function run() {
   await ready;
 
   try {
-    const js = compileXstate(contents, filename);
+    const compile = target === 'json' ? compileJson : target === 'js' ? compileJs : compileXstate;
+    const js = compile(contents, filename, { optimize, minimize, lazy });
     process.stdout.write(js);
     process.stdout.write("\n");
   } catch {
@@ -0,0 +1,95 @@
+#!/usr/bin/env node
+// Component microbenchmarks. Runs bin/lc-microbench and prints its JSON, or
+// with --baseline compares against an earlier report and fails when a
+// component got slower by more than the threshold or allocates more.
+//
+//   scripts/microbench.mjs [--runs N] [--min-time MS] [--filter SUBSTRING]
+//                          [--out report.json] [--baseline report.json] [--threshold 0.15]
+import { existsSync, readFileSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const microbench = join(root, 'bin/lc-microbench');
+
+function parseArgs(argv) {
+  const opts = { args: [], out: null, baseline: null, threshold: 0.15 };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--runs' || arg === '--min-time' || arg === '--filter') {
+      opts.args.push(arg, argv[++i]);
+    } else if(arg === '--out') {
+      opts.out = argv[++i];
+    } else if(arg === '--baseline') {
+      opts.baseline = argv[++i];
+    } else if(arg === '--threshold') {
+      opts.threshold = Number(argv[++i]);
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+// Allocation counts are exact, so any increase is a regression.
+function compare(results, baseline, threshold) {
+  const before = new Map(baseline.map(result => [result.name, result]));
+  let regressions = 0;
+  const rows = results.map(result => {
+    const old = before.get(result.name);
+    if(old === undefined) {
+      return { name: result.name, ns_per_op: result.ns_per_op, status: 'new' };
+    }
+    const change = result.ns_per_op / old.ns_per_op - 1;
+    const slower = change > threshold;
+    const allocates = result.allocations_per_op > old.allocations_per_op + 1e-9;
+    if(slower || allocates) {
+      regressions++;
+    }
+    return {
+      name: result.name,
+      ns_per_op: result.ns_per_op,
+      baseline_ns_per_op: old.ns_per_op,
+      change: `${change >= 0 ? '+' : ''}${(change * 100).toFixed(1)}%`,
+      allocations_per_op: result.allocations_per_op,
+      baseline_allocations_per_op: old.allocations_per_op,
+      status: slower ? 'slower' : allocates ? 'allocates more' : 'ok'
+    };
+  });
+  return { rows, regressions };
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  if(!existsSync(microbench)) {
+    console.error(`${microbench} not built (make bin/lc-microbench)`);
+    process.exit(1);
+  }
+
+  const proc = spawnSync(microbench, opts.args, { encoding: 'utf-8', stdio: ['ignore', 'pipe', 'inherit'] });
+  if(proc.status !== 0) {
+    console.error(`lc-microbench exited with ${proc.status}`);
+    process.exit(1);
+  }
+  const results = JSON.parse(proc.stdout);
+  if(opts.out) {
+    writeFileSync(opts.out, JSON.stringify(results, null, 2) + '\n');
+  }
+
+  if(!opts.baseline) {
+    console.log(JSON.stringify(results, null, 2));
+    return;
+  }
+
+  const baseline = JSON.parse(readFileSync(opts.baseline, 'utf-8'));
+  const { rows, regressions } = compare(results, baseline, opts.threshold);
+  console.log(JSON.stringify(rows, null, 2));
+  if(regressions > 0) {
+    console.error(`${regressions} component${regressions === 1 ? '' : 's'} regressed`);
+    process.exit(1);
+  }
+}
+
+run();
@@ -0,0 +1,102 @@
+#!/usr/bin/env node
+// Checks the N-API addon against bin/lc on the snapshot inputs: the same
+// output, or the same diagnostics when compiling fails, from both the sync
+// and the async compiles.
+//
+//   scripts/test_addon.mjs
+import { existsSync, readdirSync, readFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+import { isDeepStrictEqual } from 'util';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const snapshots = join(root, 'test/snapshots');
+const lc = join(root, 'bin/lc');
+
+// The lc flags the addon has options for.
+function parseFlags(flags) {
+  const options = {};
+  let compile = 'compileXstate';
+  for(const flag of flags) {
+    if(flag === '-O') {
+      options.optimize = true;
+    } else if(flag === '--minimize') {
+      options.minimize = true;
+    } else if(flag === '--lazy') {
+      options.lazy = true;
+    } else if(flag === '--target=js') {
+      compile = 'compileJs';
+    } else if(flag === '--emit=json') {
+      compile = 'compileJson';
+    } else if(flag.startsWith('--max-depth=')) {
+      options.maxDepth = Number(flag.slice('--max-depth='.length));
+    } else if(flag !== '--diagnostics=json') {
+      return null;
+    }
+  }
+  return { compile, options };
+}
+
+function runLc(flags, input) {
+  const args = [...flags.filter(flag => !flag.startsWith('--diagnostics')), '--diagnostics=json', input];
+  const proc = spawnSync(lc, args, { encoding: 'utf-8' });
+  if(proc.status === 0) {
+    return { js: proc.stdout.replace(/\n$/, '') };
+  }
+  const json = (proc.stdout + proc.stderr).split('\n').find(line => line.startsWith('['));
+  return { diagnostics: JSON.parse(json) };
+}
+
+async function runAddon(fn, source, filename, options) {
+  try {
+    return { js: await fn(source, filename, options) };
+  } catch(err) {
+    if(!err.diagnostics) {
+      throw err;
+    }
+    return { diagnostics: err.diagnostics };
+  }
+}
+
+async function run() {
+  if(!existsSync(lc)) {
+    console.error(`${lc} not built (make bin/lc)`);
+    process.exit(1);
+  }
+  const addon = await import('../main-node-native.mjs');
+
+  let failed = 0;
+  for(const name of readdirSync(snapshots).sort()) {
+    const dir = join(snapshots, name);
+    if(existsSync(join(dir, '.skip')) || existsSync(join(dir, '.native'))) {
+      continue;
+    }
+    const flagsFile = join(dir, 'flags');
+    const flags = existsSync(flagsFile) ? readFileSync(flagsFile, 'utf-8').trim().split(/\s+/) : [];
+    const parsed = parseFlags(flags);
+    if(parsed === null) {
+      continue;
+    }
+
+    const input = join('test/snapshots', name, 'input.lucy');
+    const source = readFileSync(join(root, input), 'utf-8');
+    const expected = runLc(flags, input);
+    const { compile, options } = parsed;
+    const results = {
+      sync: await runAddon(addon[compile], source, input, options),
+      async: await runAddon(addon[compile + 'Async'], source, input, options)
+    };
+
+    for(const [mode, actual] of Object.entries(results)) {
+      if(!isDeepStrictEqual(actual, expected)) {
+        console.error(`FAILED (${mode}) - ${input}`);
+        failed++;
+      }
+    }
+  }
+
+  process.exit(failed > 0 ? 1 : 0);
+}
+
+run();
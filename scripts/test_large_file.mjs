@@ -0,0 +1,152 @@
+#!/usr/bin/env node
+// Stress test for large sources. Generates a program of about a million
+// lines with unreachable states planted throughout, checks that bin/lc
+// reports each one at the right line, column and offset, well past where
+// 16-bit positions would wrap, then times the parse with bin/lc-bench.
+//
+//   scripts/test_large_file.mjs [--lines N] [--iterations N]
+import { existsSync, mkdtempSync, rmSync, writeFileSync } from 'fs';
+import { spawnSync } from 'child_process';
+import { tmpdir } from 'os';
+import { join, dirname } from 'path';
+import { fileURLToPath } from 'url';
+
+const root = join(dirname(fileURLToPath(import.meta.url)), '..');
+const lc = join(root, 'bin/lc');
+const bench = join(root, 'bin/lc-bench');
+
+// Lucy identifiers are letters only, so numbers are spelled in base 26.
+function alpha(n) {
+  let str = '';
+  do {
+    str = String.fromCharCode(97 + (n % 26)) + str;
+    n = Math.floor(n / 26) - 1;
+  } while(n >= 0);
+  return str;
+}
+
+// Machines of ten lines, every plantEvery-th with an unreachable state
+// after its others. Returns the source and where each warning should be.
+function generate(lines, plantEvery) {
+  const out = [];
+  const expected = [];
+  let line = 1;
+  let offset = 0;
+  const push = str => {
+    out.push(str);
+    line++;
+    offset += Buffer.byteLength(str) + 1;
+  };
+
+  for(let i = 0; line <= lines; i++) {
+    const name = alpha(i);
+    push(`machine m${name} {`);
+    push('  initial state idle {');
+    push('    go => busy');
+    push('  }');
+    push('  state busy {');
+    push('    done => idle');
+    push('    delay 5s => idle');
+    push('  }');
+    if(i % plantEvery === plantEvery - 1) {
+      expected.push({ line, column: 3, start: offset + 2, message: `State 'lost${name}' is unreachable.` });
+      push(`  state lost${name} {`);
+      push('    go => idle');
+      push('  }');
+    }
+    push('}');
+    push('');
+  }
+  return { source: out.join('\n'), lines: line - 1, expected };
+}
+
+function parseArgs(argv) {
+  const opts = { lines: 1000000, iterations: 3 };
+  for(let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if(arg === '--lines') {
+      opts.lines = Number(argv[++i]);
+    } else if(arg === '--iterations') {
+      opts.iterations = Number(argv[++i]);
+    } else {
+      console.error(`Unknown argument: ${arg}`);
+      process.exit(1);
+    }
+  }
+  return opts;
+}
+
+function run() {
+  const opts = parseArgs(process.argv.slice(2));
+  for(const bin of [lc, bench]) {
+    if(!existsSync(bin)) {
+      console.error(`${bin} not built (make bin/lc bin/lc-bench)`);
+      process.exit(1);
+    }
+  }
+
+  // About fourteen warnings, whatever the size.
+  const { source, lines, expected } = generate(opts.lines, Math.max(1, Math.floor(opts.lines / 140)));
+  const dir = mkdtempSync(join(tmpdir(), 'lucy-large-'));
+  const file = join(dir, 'large.lucy');
+  writeFileSync(file, source);
+
+  let failures = 0;
+  const fail = msg => {
+    console.error(`FAIL ${msg}`);
+    failures++;
+  };
+
+  const proc = spawnSync(lc, ['--diagnostics=json', file],
+    { encoding: 'utf-8', maxBuffer: 1 << 30 });
+  let diagnostics = [];
+  try {
+    diagnostics = JSON.parse(proc.stderr);
+  } catch {
+    fail(`lc exited with ${proc.status}: ${proc.stderr.slice(0, 200)}`);
+  }
+
+  if(diagnostics.length !== expected.length) {
+    fail(`expected ${expected.length} diagnostics, got ${diagnostics.length}`);
+  }
+  for(let i = 0; i < Math.min(diagnostics.length, expected.length); i++) {
+    const got = diagnostics[i];
+    const want = expected[i];
+    for(const key of ['line', 'column', 'start', 'message']) {
+      if(got[key] !== want[key]) {
+        fail(`diagnostic ${i}: ${key} is ${JSON.stringify(got[key])}, expected ${JSON.stringify(want[key])}`);
+      }
+    }
+  }
+
+  // The rendered header carries the same position.
+  const last = expected[expected.length - 1];
+  const human = spawnSync(lc, [file], { encoding: 'utf-8', maxBuffer: 1 << 30 });
+  if(!human.stderr.includes(`:${last.line}:${last.column}\n`)) {
+    fail(`rendered diagnostics don't mention line ${last.line}`);
+  }
+
+  const timing = spawnSync(bench, ['--frontend', '--iterations', String(opts.iterations), file],
+    { encoding: 'utf-8' });
+  const [measurement] = timing.status === 0 ? JSON.parse(timing.stdout) : [];
+  if(measurement === undefined || !measurement.success) {
+    fail(`lc-bench exited with ${timing.status}: ${timing.stderr.trim()}`);
+  } else {
+    const seconds = measurement.mean_ns / 1e9;
+    console.log(JSON.stringify({
+      lines,
+      bytes: measurement.bytes,
+      diagnostics: expected.length,
+      last_line: last.line,
+      mean_ms: Math.round(measurement.mean_ns / 1e6),
+      lines_per_s: Math.round(lines / seconds),
+      mb_per_s: Number((measurement.bytes / 1e6 / seconds).toFixed(1)),
+      peak_rss_kb: measurement.peak_rss_kb
+    }, null, 2));
+  }
+
+  rmSync(dir, { recursive: true, force: true });
+  process.exit(failures > 0 ? 1 : 0);
+}
+
+run();
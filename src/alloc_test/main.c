@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "../core/alloc.h"
+#include "../core/identifier.h"
+#include "../core/parser.h"
+#include "../core/compiler_xstate.h"
+#include "../core/compiler_js.h"
+#include "../core/compiler_json.h"
+#include "../core/compiler_c.h"
+#include "../core/compiler_bytecode.h"
+#include "../core/explore.h"
+
+// Compiles each file to every format with a test allocator, and fails on
+// any allocation that reaches libc instead or that isn't freed with its
+// result. Linked with --wrap for the libc allocation functions, so the
+// __wrap_ ones below see every call the compiler makes to them.
+
+void* __real_malloc(size_t);
+void* __real_calloc(size_t, size_t);
+void* __real_realloc(void*, size_t);
+void __real_free(void*);
+char* __real_strdup(const char*);
+char* __real_strndup(const char*, size_t);
+
+// Set while compiling, when nothing should reach libc.
+static atomic_bool checking = false;
+static atomic_int stray = 0;
+
+static void check_stray(const char* function) {
+  if(atomic_load(&checking)) {
+    if(atomic_fetch_add(&stray, 1) == 0) {
+      fprintf(stderr, "%s called while compiling\n", function);
+    }
+  }
+}
+
+void* __wrap_malloc(size_t size) {
+  check_stray("malloc");
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  check_stray("calloc");
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  check_stray("realloc");
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+  if(ptr != NULL) {
+    check_stray("free");
+  }
+  __real_free(ptr);
+}
+
+char* __wrap_strdup(const char* str) {
+  check_stray("strdup");
+  return __real_strdup(str);
+}
+
+char* __wrap_strndup(const char* str, size_t n) {
+  check_stray("strndup");
+  return __real_strndup(str, n);
+}
+
+typedef struct TestHeap {
+  atomic_llong live_bytes;
+  atomic_llong allocations;
+} TestHeap;
+
+static void* test_malloc(void* ctx, size_t size) {
+  TestHeap* heap = ctx;
+  atomic_fetch_add(&heap->live_bytes, size);
+  atomic_fetch_add(&heap->allocations, 1);
+  return __real_malloc(size);
+}
+
+static void* test_realloc(void* ctx, void* ptr, size_t old_size, size_t size) {
+  TestHeap* heap = ctx;
+  atomic_fetch_add(&heap->live_bytes, (long long)size - (long long)old_size);
+  return __real_realloc(ptr, size);
+}
+
+static void test_free(void* ctx, void* ptr, size_t size) {
+  TestHeap* heap = ctx;
+  atomic_fetch_sub(&heap->live_bytes, size);
+  __real_free(ptr);
+}
+
+static TestHeap heap;
+static const LucyAllocator test_allocator = {
+  .malloc = test_malloc,
+  .realloc = test_realloc,
+  .free = test_free,
+  .ctx = &heap
+};
+
+static int failures = 0;
+static int compiles = 0;
+
+static void begin() {
+  atomic_store(&checking, true);
+}
+
+static void end(char* filename, const char* format) {
+  atomic_store(&checking, false);
+  compiles++;
+  if(atomic_load(&stray) > 0) {
+    fprintf(stderr, "FAIL %s (%s): %d allocations bypassed the allocator\n", filename, format,
+      atomic_load(&stray));
+    atomic_store(&stray, 0);
+    failures++;
+  }
+}
+
+static void check_freed(char* filename, const char* format) {
+  long long live = atomic_load(&heap.live_bytes);
+  if(live != 0) {
+    fprintf(stderr, "FAIL %s (%s): %lld bytes not freed with the result\n", filename, format, live);
+    atomic_store(&heap.live_bytes, 0);
+    failures++;
+  }
+}
+
+typedef void (*compile_fn)(CompileResult*, char*, char*);
+
+static void test_js(char* source, char* filename, compile_fn compile, const char* format, int flags) {
+  CompileResult* result = xs_create();
+  xs_init(result, flags);
+  xs_set_allocator(result, &test_allocator);
+  begin();
+  compile(result, source, filename);
+  xs_get_diagnostics_json(result);
+  end(filename, format);
+  destroy_xstate_result(result);
+  check_freed(filename, format);
+}
+
+static void test_c(char* source, char* filename, int flags) {
+  CCompileResult* result = cc_create();
+  cc_init(result, flags);
+  cc_set_allocator(result, &test_allocator);
+  begin();
+  compile_c(result, source, filename);
+  end(filename, "c");
+  destroy_c_result(result);
+  check_freed(filename, "c");
+}
+
+static void test_bytecode(char* source, char* filename, int flags) {
+  BytecodeResult* result = bytecode_create();
+  bytecode_init(result, flags);
+  bytecode_set_allocator(result, &test_allocator);
+  begin();
+  compile_bytecode(result, source, filename);
+  end(filename, "bytecode");
+  destroy_bytecode_result(result);
+  check_freed(filename, "bytecode");
+}
+
+static void test_explore(char* source, char* filename, int jobs) {
+  ExploreResult* result = explore_create();
+  explore_init(result, 0, jobs);
+  explore_set_allocator(result, &test_allocator);
+  begin();
+  explore_program(result, source, filename);
+  char* json = result->success ? explore_to_json(result) : NULL;
+  end(filename, "explore");
+  lucy_free(json);
+  destroy_explore_result(result);
+  check_freed(filename, "explore");
+}
+
+// With the thread's allocator set the result itself comes from it too.
+static void test_thread(char* source, char* filename) {
+  lucy_set_allocator(&test_allocator);
+  begin();
+  CompileResult* result = xs_create();
+  xs_init(result, XS_FLAG_OPTIMIZE);
+  xs_enable_stats(result);
+  compile_xstate(result, source, filename);
+  xs_get_stats_json(result);
+  destroy_xstate_result(result);
+  end(filename, "thread");
+  lucy_set_allocator(NULL);
+  check_freed(filename, "thread");
+}
+
+static char* read_file(char* filename) {
+  FILE* fp = fopen(filename, "rb");
+  if(fp == NULL) {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  long length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char* buffer = __real_malloc(length + 1);
+  size_t read = fread(buffer, 1, length, fp);
+  buffer[read] = '\0';
+  fclose(fp);
+  return buffer;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    fprintf(stderr, "Usage: %s file ...\n", argv[0]);
+    return 1;
+  }
+
+  identifier_init();
+  parser_init();
+
+  for(int i = 1; i < argc; i++) {
+    char* filename = argv[i];
+    char* source = read_file(filename);
+    if(source == NULL) {
+      fprintf(stderr, "FAIL %s: can't read it\n", filename);
+      failures++;
+      continue;
+    }
+
+    for(int optimize = 0; optimize < 2; optimize++) {
+      test_js(source, filename, compile_xstate, "xstate", optimize ? XS_FLAG_OPTIMIZE | XS_FLAG_MINIMIZE : 0);
+      test_js(source, filename, compile_js, "js", optimize ? XS_FLAG_OPTIMIZE | XS_FLAG_MINIMIZE : 0);
+      test_js(source, filename, compile_json, "json", optimize ? XS_FLAG_OPTIMIZE | XS_FLAG_MINIMIZE : 0);
+      test_c(source, filename, optimize ? CC_FLAG_OPTIMIZE | CC_FLAG_MINIMIZE : 0);
+      test_bytecode(source, filename, optimize ? BYTECODE_FLAG_OPTIMIZE | BYTECODE_FLAG_MINIMIZE : 0);
+    }
+    test_explore(source, filename, 1);
+    test_explore(source, filename, 2);
+    test_thread(source, filename);
+
+    __real_free(source);
+  }
+
+  if(failures > 0) {
+    fprintf(stderr, "%d of %d compiles failed the allocator test\n", failures, compiles);
+    return 1;
+  }
+  return 0;
+}
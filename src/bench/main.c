@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include "../core/identifier.h"
+#include "../core/parser.h"
+#include "../core/compiler_xstate.h"
+#include "../core/frontend.h"
+#include "../core/ir.h"
+#include "../core/stats.h"
+
+#define DEFAULT_ITERATIONS 20
+#define DEFAULT_WARMUP 2
+
+typedef struct BenchResult {
+  char* filename;
+  size_t bytes;
+  bool success;
+  int iterations;
+  unsigned long long total_ns;
+  unsigned long long min_ns;
+  unsigned long long phase_ns[STATS_PHASE_COUNT];
+  size_t tokens;
+  size_t allocations;
+  size_t frees;
+  long long peak_heap_bytes;
+  long peak_rss_kb;
+} BenchResult;
+
+static void usage(char* program_name) {
+  fprintf(stderr, "%s - Benchmark the Lucy compiler core.\n\n", program_name);
+  fprintf(stderr, "Usage: %s [--iterations N] [--warmup N] [--max-depth N] [--frontend] [-O] file ...\n",
+    program_name);
+  fprintf(stderr, "\n--frontend stops after lowering, for programs whose output dwarfs the compile.\n");
+}
+
+static unsigned long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static char* read_file(char* filename, size_t* length) {
+  FILE *fp;
+  if((fp = fopen(filename, "r")) == NULL) {
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char* buffer = malloc(len + 1);
+  if(buffer) {
+    fread(buffer, 1, len, fp);
+    buffer[len] = '\0';
+  }
+  fclose(fp);
+
+  *length = len;
+  return buffer;
+}
+
+static bool frontend_only = false;
+
+static void add_stats(BenchResult* res, Stats* stats) {
+  for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+    res->phase_ns[i] += stats_phase_ns(stats, i);
+  }
+  res->tokens = stats->tokens;
+  res->allocations += stats->allocations;
+  res->frees += stats->frees;
+  if(stats->heap_peak > res->peak_heap_bytes) {
+    res->peak_heap_bytes = stats->heap_peak;
+  }
+}
+
+static bool frontend_once(BenchResult* res, char* source, char* filename, int flags) {
+  Stats* stats = NULL;
+  if(res != NULL) {
+    stats = stats_create();
+    stats_start(stats);
+  }
+
+  Diagnostics diagnostics;
+  diagnostics_init(&diagnostics);
+  IRProgram* ir = frontend_compile(source, filename, flags & XS_FLAG_MINIMIZE,
+    flags & XS_FLAG_OPTIMIZE, &diagnostics);
+  bool success = ir != NULL;
+  if(success) {
+    ir_destroy(ir);
+  }
+  diagnostics_destroy(&diagnostics);
+
+  if(stats != NULL) {
+    stats_stop();
+    add_stats(res, stats);
+    stats_destroy(stats);
+  }
+  return success;
+}
+
+static bool compile_once(BenchResult* res, char* source, char* filename, int flags) {
+  if(frontend_only) {
+    return frontend_once(res, source, filename, flags);
+  }
+
+  CompileResult* result = xs_create();
+  xs_init(result, flags);
+  if(res != NULL) {
+    xs_enable_stats(result);
+  }
+  compile_xstate(result, source, filename);
+  bool success = result->success;
+
+  if(res != NULL) {
+    add_stats(res, xs_get_stats(result));
+  }
+
+  destroy_xstate_result(result);
+  return success;
+}
+
+static int bench_file(BenchResult* res, char* filename, int iterations, int warmup, int flags) {
+  size_t length;
+  char* source = read_file(filename, &length);
+  if(source == NULL) {
+    fprintf(stderr, "Error opening file %s\n", filename);
+    return 1;
+  }
+
+  res->filename = filename;
+  res->bytes = length;
+  res->iterations = iterations;
+  res->success = true;
+  res->total_ns = 0;
+  res->min_ns = 0;
+  memset(res->phase_ns, 0, sizeof(res->phase_ns));
+  res->tokens = 0;
+  res->allocations = 0;
+  res->frees = 0;
+  res->peak_heap_bytes = 0;
+
+  for(int i = 0; i < warmup; i++) {
+    compile_once(NULL, source, filename, flags);
+  }
+
+  // Timed runs leave stats off so the per-token timers don't skew them.
+  for(int i = 0; i < iterations; i++) {
+    unsigned long long start = now_ns();
+    res->success = compile_once(NULL, source, filename, flags) && res->success;
+    unsigned long long elapsed = now_ns() - start;
+
+    res->total_ns += elapsed;
+    if(i == 0 || elapsed < res->min_ns) {
+      res->min_ns = elapsed;
+    }
+  }
+
+  compile_once(res, source, filename, flags);
+  res->peak_rss_kb = peak_rss_kb();
+
+  free(source);
+  return 0;
+}
+
+static void print_result(BenchResult* res) {
+  double mean_ns = (double)res->total_ns / res->iterations;
+  double mb_per_s = mean_ns > 0 ? (res->bytes / (1024.0 * 1024.0)) / (mean_ns / 1e9) : 0;
+
+  printf("{\"file\": \"%s\", \"bytes\": %zu, \"success\": %s, ", res->filename,
+    res->bytes, res->success ? "true" : "false");
+  printf("\"iterations\": %d, \"mean_ns\": %.0f, \"min_ns\": %llu, ", res->iterations,
+    mean_ns, res->min_ns);
+  printf("\"mb_per_s\": %.3f, \"phases\": {", mb_per_s);
+  for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+    printf("%s\"%s_ns\": %llu", i > 0 ? ", " : "", stats_phase_name(i), res->phase_ns[i]);
+  }
+  printf("}, \"tokens\": %zu, \"allocations\": %zu, \"frees\": %zu, ", res->tokens,
+    res->allocations, res->frees);
+  printf("\"peak_heap_bytes\": %lld, \"peak_rss_kb\": %ld}", res->peak_heap_bytes,
+    res->peak_rss_kb);
+}
+
+#define OPTION_ITERATIONS 0
+#define OPTION_WARMUP 1
+#define OPTION_MAX_DEPTH 2
+#define OPTION_FRONTEND 3
+
+static struct option long_options[] = {
+  {"iterations", required_argument, 0, OPTION_ITERATIONS},
+  {"warmup", required_argument, 0, OPTION_WARMUP},
+  {"max-depth", required_argument, 0, OPTION_MAX_DEPTH},
+  {"frontend", no_argument, 0, OPTION_FRONTEND},
+  {"help", no_argument, 0, 'h'},
+  {0, 0, 0, 0}
+};
+
+int main(int argc, char *argv[]) {
+  identifier_init();
+  parser_init();
+
+  int iterations = DEFAULT_ITERATIONS;
+  int warmup = DEFAULT_WARMUP;
+  int flags = 0;
+
+  int option_index = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "hO", long_options, &option_index)) != -1) {
+    switch(opt) {
+      case OPTION_ITERATIONS: {
+        iterations = atoi(optarg);
+        break;
+      }
+      case OPTION_WARMUP: {
+        warmup = atoi(optarg);
+        break;
+      }
+      case OPTION_MAX_DEPTH: {
+        parser_set_max_depth(atoi(optarg));
+        break;
+      }
+      case OPTION_FRONTEND: {
+        frontend_only = true;
+        break;
+      }
+      case 'O': {
+        flags |= XS_FLAG_OPTIMIZE;
+        break;
+      }
+      case 'h': {
+        usage(argv[0]);
+        exit(0);
+      }
+      default: {
+        usage(argv[0]);
+        exit(1);
+      }
+    }
+  }
+
+  if(optind >= argc || iterations < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  printf("[");
+  for(int i = optind; i < argc; i++) {
+    BenchResult res;
+    if(bench_file(&res, argv[i], iterations, warmup, flags) != 0) {
+      return 1;
+    }
+    if(i > optind) {
+      printf(",\n ");
+    }
+    print_result(&res);
+  }
+  printf("]\n");
+
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,10 +6,21 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 #include "../core/identifier.h"
 #include "../core/parser.h"
+#include "../core/alloc.h"
 #include "../core/compiler_xstate.h"
+#include "../core/compiler_c.h"
+#include "../core/compiler_js.h"
+#include "../core/compiler_bytecode.h"
+#include "../core/compiler_json.h"
+#include "../core/frontend.h"
+#include "../core/explore.h"
 #include "../core/error.h"
+#include "../core/stats.h"
+#include "../core/symtab.h"
+#include "../core/trace.h"
 
 #define RESET   "\033[0m"
 #define BOLDWHITE   "\033[1m\033[37m"      /* Bold White */
@@ -21,6 +33,30 @@
 
 #define U_INDENT "    "
 
+#define STATS_FORMAT_NONE 0
+#define STATS_FORMAT_HUMAN 1
+#define STATS_FORMAT_JSON 2
+
+#define TARGET_XSTATE 0
+#define TARGET_C 1
+#define TARGET_JS 2
+
+#define DIAGNOSTICS_FORMAT_HUMAN 0
+#define DIAGNOSTICS_FORMAT_JSON 1
+
+#define EXPLORE_NONE 0
+#define EXPLORE_HUMAN 1
+#define EXPLORE_JSON 2
+
+// Formats for --emit, any number of them can be combined.
+#define EMIT_SOURCE 1 << 0
+#define EMIT_BYTECODE 1 << 1
+#define EMIT_XSTATE 1 << 2
+#define EMIT_JS 1 << 3
+#define EMIT_C 1 << 4
+#define EMIT_JSON 1 << 5
+#define EMIT_FORMAT_COUNT 6
+
 static void usage(char* program_name) {
   fprintf(stderr, "%s - Compile Lucy programs.\n\n", program_name);
   fprintf(stderr, BOLDWHITE "Usage:\n" RESET);
@@ -30,7 +66,29 @@ static void usage(char* program_name) {
   fprintf(stderr, BOLDWHITE "Options:\n" RESET);
   fprintf(stderr, "%s--out-file <file>     Specify a file to output to.\n", U_INDENT);
   fprintf(stderr, "%s--out-dir <dir>       Specify a directory to output to.\n", U_INDENT);
+  fprintf(stderr, "%s--target <target>     Compile to xstate (default), js or c.\n", U_INDENT);
+  fprintf(stderr, "%s--emit <format,...>   Emit source for the target (default), xstate, js, c,\n", U_INDENT);
+  fprintf(stderr, "%s                      json or bytecode for the VM. Several formats share\n", U_INDENT);
+  fprintf(stderr, "%s                      one parse and are written to --out-dir.\n", U_INDENT);
   fprintf(stderr, "%s--remote-imports      Specify remote import URLs.\n", U_INDENT);
+  fprintf(stderr, "%s--stats[=json]        Print compile statistics to stderr.\n", U_INDENT);
+  fprintf(stderr, "%s--diagnostics <fmt>   Print errors and warnings as human (default) or json.\n", U_INDENT);
+  fprintf(stderr, "%s--explore[=json]      Report reachable configurations, deadlocks and\n", U_INDENT);
+  fprintf(stderr, "%s                      unreachable states instead of compiling.\n", U_INDENT);
+  fprintf(stderr, "%s--jobs <n>            Threads to explore or compile files with, one per core\n", U_INDENT);
+  fprintf(stderr, "%s                      by default.\n", U_INDENT);
+  fprintf(stderr, "%s--bundle              Compile every file into one module, exporting each\n", U_INDENT);
+  fprintf(stderr, "%s                      machine as <file>_<machine>, or <file> for a file's\n", U_INDENT);
+  fprintf(stderr, "%s                      default machine.\n", U_INDENT);
+  fprintf(stderr, "%s--lazy                Export xstate machines as functions that build them\n", U_INDENT);
+  fprintf(stderr, "%s                      on the first call, so unused ones are never built and\n", U_INDENT);
+  fprintf(stderr, "%s                      bundlers can drop them.\n", U_INDENT);
+  fprintf(stderr, "%s--trace <file>        Write a timeline of each phase per file and thread,\n", U_INDENT);
+  fprintf(stderr, "%s                      for chrome://tracing or Perfetto.\n", U_INDENT);
+  fprintf(stderr, "%s-O                    Remove unreachable states and share repeated ones.\n", U_INDENT);
+  fprintf(stderr, "%s--minimize            Merge states that behave the same.\n", U_INDENT);
+  fprintf(stderr, "%s--max-depth <n>       Fail on machines nested deeper than this (default %u).\n",
+    U_INDENT, PARSER_DEFAULT_MAX_DEPTH);
   fprintf(stderr, "%s-h, --help            Prints help information.\n", U_INDENT);
   fprintf(stderr, "%s-v, --version         Prints the version.\n\n", U_INDENT);
 
@@ -39,7 +97,17 @@ static void usage(char* program_name) {
   fprintf(stderr, "%s# Compile a Lucy file and print to stdout.\n", U_INDENT);
   fprintf(stderr, "%s$ %s input.lucy\n\n", U_INDENT, program_name);
   fprintf(stderr, "%s# Compile a Lucy file and output to out.js\n", U_INDENT);
-  fprintf(stderr, "%s$ %s --out-file out.js input.lucy\n", U_INDENT, program_name);
+  fprintf(stderr, "%s$ %s --out-file out.js input.lucy\n\n", U_INDENT, program_name);
+  fprintf(stderr, "%s# Compile each machine to a C header and source in gen/\n", U_INDENT);
+  fprintf(stderr, "%s$ %s --target c --out-dir gen input.lucy\n\n", U_INDENT, program_name);
+  fprintf(stderr, "%s# Compile every machine to one bytecode file\n", U_INDENT);
+  fprintf(stderr, "%s$ %s --emit bytecode --out-file input.lucyc input.lucy\n\n", U_INDENT, program_name);
+  fprintf(stderr, "%s# Write input.js, input.json and input.lucyc to gen/\n", U_INDENT);
+  fprintf(stderr, "%s$ %s --emit xstate,json,bytecode --out-dir gen input.lucy\n\n", U_INDENT, program_name);
+  fprintf(stderr, "%s# Compile several files on 4 threads and record how long each took\n", U_INDENT);
+  fprintf(stderr, "%s$ %s --jobs 4 --trace trace.json --out-dir gen *.lucy\n\n", U_INDENT, program_name);
+  fprintf(stderr, "%s# Compile every machine in src/ into machines.js\n", U_INDENT);
+  fprintf(stderr, "%s$ %s --bundle --out-file machines.js src/*.lucy\n", U_INDENT, program_name);
 }
 
 static void version() {
@@ -61,13 +129,58 @@ int write_file(char* outfile, char* output) {
   return 0;
 }
 
-int compile_file(char* filename, int use_remote_imports, char* out_file) {
+// Set once from --diagnostics, every compile reports the same way.
+static int diagnostics_format = DIAGNOSTICS_FORMAT_HUMAN;
+
+// Held while reporting, so files compiled in parallel don't interleave.
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void print_diagnostics(Diagnostics* diagnostics, char* source, char* filename) {
+  pthread_mutex_lock(&output_lock);
+  if(diagnostics_format == DIAGNOSTICS_FORMAT_JSON) {
+    if(diagnostics->count > 0) {
+      char* json = diagnostics_to_json(diagnostics);
+      fprintf(stderr, "%s\n", json);
+      lucy_free(json);
+    }
+  } else {
+    error_print(stderr, diagnostics, source, filename);
+  }
+  pthread_mutex_unlock(&output_lock);
+}
+
+static void print_failed(char* filename, bool batch) {
+  pthread_mutex_lock(&output_lock);
+  if(batch) {
+    fprintf(stderr, "Compilation of %s failed!\n", filename);
+  } else {
+    fprintf(stderr, "Compilation failed!\n");
+  }
+  pthread_mutex_unlock(&output_lock);
+}
+
+static void print_stats(Stats* stats, char* filename, int stats_format) {
+  pthread_mutex_lock(&output_lock);
+  switch(stats_format) {
+    case STATS_FORMAT_HUMAN: {
+      stats_print(stderr, stats, filename);
+      break;
+    }
+    case STATS_FORMAT_JSON: {
+      char* json = stats_to_json(stats);
+      fprintf(stderr, "%s\n", json);
+      lucy_free(json);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&output_lock);
+}
+
+static char* read_file(char* filename) {
   FILE *fp;
   if ((fp = fopen(filename, "r")) == NULL) {
       printf("Error opening file!\n");
-
-      // Program exits if the file pointer returns NULL.
-      return 1;
+      return NULL;
   }
 
   char* buffer;
@@ -76,15 +189,45 @@ int compile_file(char* filename, int use_remote_imports, char* out_file) {
   fseek(fp, 0, SEEK_END);
   length = ftell(fp);
   fseek(fp, 0, SEEK_SET);
-  buffer = malloc(length);
+  buffer = malloc(length + 1);
   if(buffer) {
     fread(buffer, 1, length, fp);
+    buffer[length] = '\0';
   }
   fclose(fp);
+  return buffer;
+}
 
+// Reads the file as the read phase, timed into stats when not NULL.
+static char* read_source(char* filename, Stats* stats) {
+  trace_begin("read", filename);
+  unsigned long long read_start = stats_now();
+  char* buffer = read_file(filename);
+  if(stats != NULL) {
+    stats->phase_ns[STATS_PHASE_READ] = stats_now() - read_start;
+  }
+  trace_end("read");
+  return buffer;
+}
+
+// Compiles to a single JS module or JSON document, with compile_xstate,
+// compile_js or compile_json.
+static int compile_file_js(void (*compile)(CompileResult*, char*, char*),
+  char* filename, int flags, char* out_file, int stats_format) {
   CompileResult* result = xs_create();
-  xs_init(result, use_remote_imports);
-  compile_xstate(result, buffer, filename);
+  xs_init(result, flags);
+  if(stats_format != STATS_FORMAT_NONE) {
+    xs_enable_stats(result);
+  }
+
+  char* buffer = read_source(filename, xs_get_stats(result));
+  if(buffer == NULL) {
+    // Program exits if the file pointer returns NULL.
+    return 1;
+  }
+
+  compile(result, buffer, filename);
+  print_diagnostics(&result->diagnostics, buffer, filename);
 
   if(result->success) {
     int ret = 0;
@@ -94,44 +237,918 @@ int compile_file(char* filename, int use_remote_imports, char* out_file) {
       printf("%s\n", result->js);
     }
 
+    print_stats(xs_get_stats(result), filename, stats_format);
     destroy_xstate_result(result);
     return ret;
   } else {
+    print_stats(xs_get_stats(result), filename, stats_format);
+    fprintf(stderr, "Compilation failed!\n");
+    return 1;
+  }
+}
+
+static int write_c_files(CCompileResult* result, char* out_dir) {
+  int ret = 0;
+  for(size_t i = 0; i < result->file_count && ret == 0; i++) {
+    CFile* file = &result->files[i];
+    if(out_dir != NULL) {
+      size_t len = strlen(out_dir) + strlen(file->name) + 2;
+      char* path = malloc(len);
+      snprintf(path, len, "%s/%s", out_dir, file->name);
+      ret = write_file(path, file->contents);
+      free(path);
+    } else {
+      printf("// %s\n%s\n", file->name, file->contents);
+    }
+  }
+  return ret;
+}
+
+// Writes a header and source per machine to out_dir, or prints them each
+// preceded by their name.
+static int compile_file_c(char* filename, int flags, char* out_dir, int stats_format) {
+  CCompileResult* result = cc_create();
+  cc_init(result, flags);
+  if(stats_format != STATS_FORMAT_NONE) {
+    cc_enable_stats(result);
+  }
+
+  char* buffer = read_source(filename, cc_get_stats(result));
+  if(buffer == NULL) {
+    return 1;
+  }
+
+  compile_c(result, buffer, filename);
+  print_diagnostics(&result->diagnostics, buffer, filename);
+
+  if(result->success) {
+    int ret = write_c_files(result, out_dir);
+
+    print_stats(cc_get_stats(result), filename, stats_format);
+    destroy_c_result(result);
+    return ret;
+  } else {
+    print_stats(cc_get_stats(result), filename, stats_format);
+    fprintf(stderr, "Compilation failed!\n");
+    return 1;
+  }
+}
+
+// Writes the program's bytecode to out_file, or to stdout unless that's a
+// terminal.
+static int compile_file_bytecode(char* filename, int flags, char* out_file, int stats_format) {
+  if(out_file == NULL && isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "Bytecode is binary, use --out-file or redirect the output.\n");
+    return 1;
+  }
+
+  BytecodeResult* result = bytecode_create();
+  bytecode_init(result, flags);
+  if(stats_format != STATS_FORMAT_NONE) {
+    bytecode_enable_stats(result);
+  }
+
+  char* buffer = read_source(filename, bytecode_get_stats(result));
+  if(buffer == NULL) {
+    return 1;
+  }
+
+  compile_bytecode(result, buffer, filename);
+  print_diagnostics(&result->diagnostics, buffer, filename);
+
+  if(result->success) {
+    int ret = 0;
+    FILE* fp = out_file != NULL ? fopen(out_file, "wb") : stdout;
+    if(fp == NULL) {
+      printf("Error opening file!\n");
+      ret = 1;
+    } else {
+      if(fwrite(result->data, 1, result->size, fp) != result->size) {
+        ret = 1;
+      }
+      if(fp != stdout) {
+        fclose(fp);
+      }
+    }
+
+    print_stats(bytecode_get_stats(result), filename, stats_format);
+    destroy_bytecode_result(result);
+    return ret;
+  } else {
+    print_stats(bytecode_get_stats(result), filename, stats_format);
+    fprintf(stderr, "Compilation failed!\n");
+    return 1;
+  }
+}
+
+// One emitter of several sharing a compiled program.
+typedef struct EmitTask {
+  int format;
+  IRProgram* ir;
+  char* filename;
+  CompileResult* js;
+  CCompileResult* c;
+  BytecodeResult* bytecode;
+} EmitTask;
+
+static const char* emit_format_name(int format) {
+  switch(format) {
+    case EMIT_XSTATE: return "xstate";
+    case EMIT_JS: return "js";
+    case EMIT_JSON: return "json";
+    case EMIT_C: return "c";
+    default: return "bytecode";
+  }
+}
+
+static void* run_emit_task(void* arg) {
+  EmitTask* task = arg;
+  const char* name = emit_format_name(task->format);
+  trace_begin(name, task->filename);
+  switch(task->format) {
+    case EMIT_XSTATE: xs_emit(task->js, task->ir); break;
+    case EMIT_JS: js_emit(task->js, task->ir); break;
+    case EMIT_JSON: json_emit(task->js, task->ir); break;
+    case EMIT_C: cc_emit(task->c, task->ir, task->filename); break;
+    case EMIT_BYTECODE: bytecode_emit(task->bytecode, task->ir); break;
+  }
+  trace_end(name);
+  return NULL;
+}
+
+static void* run_emit_thread(void* arg) {
+  trace_thread_name("emit");
+  return run_emit_task(arg);
+}
+
+// The input's file name without its directory and .lucy extension.
+static char* output_base(char* filename) {
+  char* base = strrchr(filename, '/');
+  base = base == NULL ? filename : base + 1;
+  size_t len = strlen(base);
+  if(len > 5 && strcmp(base + len - 5, ".lucy") == 0) {
+    len -= 5;
+  }
+  return strndup(base, len);
+}
+
+static int write_output(char* out_dir, char* base, char* extension, void* data, size_t size) {
+  size_t len = strlen(out_dir) + strlen(base) + strlen(extension) + 2;
+  char* path = malloc(len);
+  snprintf(path, len, "%s/%s%s", out_dir, base, extension);
+  FILE* fp = fopen(path, "wb");
+  free(path);
+  if(fp == NULL) {
+    printf("Error opening file!\n");
+    return 1;
+  }
+  int ret = fwrite(data, 1, size, fp) == size ? 0 : 1;
+  fclose(fp);
+  return ret;
+}
+
+// The C files a batch has written and the input each came from. They are
+// named after machines, so two inputs can only be seen to clash once both
+// are compiled.
+typedef struct CClaims {
+  SymbolTable names;
+  char** files;
+  char** owners;
+  int count;
+  int capacity;
+  pthread_mutex_t lock;
+} CClaims;
+
+static CClaims c_claims;
+
+static void c_claims_init() {
+  symtab_init(&c_claims.names, 0);
+  c_claims.files = NULL;
+  c_claims.owners = NULL;
+  c_claims.count = 0;
+  c_claims.capacity = 0;
+  pthread_mutex_init(&c_claims.lock, NULL);
+}
+
+static void c_claims_destroy() {
+  symtab_destroy(&c_claims.names);
+  for(int i = 0; i < c_claims.count; i++) {
+    free(c_claims.files[i]);
+  }
+  free(c_claims.files);
+  free(c_claims.owners);
+  pthread_mutex_destroy(&c_claims.lock);
+}
+
+// Claims the result's files for filename, false if another input already
+// wrote one of them. The first to finish keeps its files.
+static bool c_claims_take(CCompileResult* result, char* filename, char* out_dir) {
+  bool taken = true;
+  pthread_mutex_lock(&c_claims.lock);
+  for(size_t i = 0; i < result->file_count; i++) {
+    int owner = symtab_get(&c_claims.names, result->files[i].name);
+    if(owner != SYMTAB_NOT_FOUND) {
+      printf("%s and %s would both write %s/%s, compile them separately.\n",
+        c_claims.owners[owner], filename, out_dir, result->files[i].name);
+      taken = false;
+      break;
+    }
+  }
+  for(size_t i = 0; taken && i < result->file_count; i++) {
+    if(c_claims.count == c_claims.capacity) {
+      c_claims.capacity = c_claims.capacity == 0 ? 16 : c_claims.capacity * 2;
+      c_claims.files = realloc(c_claims.files, c_claims.capacity * sizeof(char*));
+      c_claims.owners = realloc(c_claims.owners, c_claims.capacity * sizeof(char*));
+    }
+    c_claims.files[c_claims.count] = strdup(result->files[i].name);
+    c_claims.owners[c_claims.count] = filename;
+    symtab_insert(&c_claims.names, c_claims.files[c_claims.count], c_claims.count);
+    c_claims.count++;
+  }
+  pthread_mutex_unlock(&c_claims.lock);
+  return taken;
+}
+
+// Compiles once and runs an emitter per format in parallel, each only
+// reading the program, then writes their output to out_dir. In a batch the
+// files are already spread over threads, so the emitters run in turn.
+static int compile_file_many(char* filename, int flags, int emit, char* out_dir, int stats_format,
+  bool batch) {
+  Stats* stats = NULL;
+  if(stats_format != STATS_FORMAT_NONE) {
+    stats = stats_create();
+  }
+
+  char* buffer = read_source(filename, stats);
+  if(buffer == NULL) {
+    return 1;
+  }
+
+  if(stats != NULL) {
+    stats_start(stats);
+    stats->source_bytes = strlen(buffer);
+  }
+
+  Diagnostics diagnostics;
+  diagnostics_init(&diagnostics);
+  IRProgram* ir = frontend_compile(buffer, filename, flags & XS_FLAG_MINIMIZE, flags & XS_FLAG_OPTIMIZE,
+    &diagnostics);
+  print_diagnostics(&diagnostics, buffer, filename);
+  diagnostics_destroy(&diagnostics);
+  if(ir == NULL) {
+    stats_stop();
+    if(stats != NULL) {
+      print_stats(stats, filename, stats_format);
+      stats_destroy(stats);
+    }
+    free(buffer);
+    print_failed(filename, batch);
+    return 1;
+  }
+
+  // Emitters don't record stats, their time is the emit phase.
+  stats_phase_begin(STATS_PHASE_EMIT);
+  EmitTask tasks[EMIT_FORMAT_COUNT];
+  pthread_t threads[EMIT_FORMAT_COUNT];
+  int task_count = 0;
+  for(int format = EMIT_BYTECODE; format <= EMIT_JSON; format <<= 1) {
+    if((emit & format) == 0) {
+      continue;
+    }
+    EmitTask* task = &tasks[task_count];
+    memset(task, 0, sizeof(*task));
+    task->format = format;
+    task->ir = ir;
+    task->filename = filename;
+    if(format == EMIT_C) {
+      task->c = cc_create();
+      cc_init(task->c, flags);
+    } else if(format == EMIT_BYTECODE) {
+      task->bytecode = bytecode_create();
+      bytecode_init(task->bytecode, flags);
+    } else {
+      task->js = xs_create();
+      xs_init(task->js, flags);
+    }
+    if(batch) {
+      stats_stop();
+      run_emit_task(task);
+      stats_start(stats);
+    } else {
+      pthread_create(&threads[task_count], NULL, run_emit_thread, task);
+    }
+    task_count++;
+  }
+  for(int i = 0; i < task_count && !batch; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  stats_phase_end(STATS_PHASE_EMIT);
+  stats_stop();
+  ir_destroy(ir);
+  free(buffer);
+
+  trace_begin("write", filename);
+  int ret = 0;
+  char* base = output_base(filename);
+  for(int i = 0; i < task_count; i++) {
+    EmitTask* task = &tasks[i];
+    switch(task->format) {
+      case EMIT_C: {
+        if(ret == 0 && batch && !c_claims_take(task->c, filename, out_dir)) {
+          ret = 1;
+        }
+        if(ret == 0) {
+          ret = write_c_files(task->c, out_dir);
+        }
+        for(size_t f = 0; stats != NULL && f < task->c->file_count; f++) {
+          stats->bytes_emitted += strlen(task->c->files[f].contents);
+        }
+        destroy_c_result(task->c);
+        break;
+      }
+      case EMIT_BYTECODE: {
+        if(ret == 0) {
+          ret = write_output(out_dir, base, ".lucyc", task->bytecode->data, task->bytecode->size);
+        }
+        if(stats != NULL) {
+          stats->bytes_emitted += task->bytecode->size;
+        }
+        destroy_bytecode_result(task->bytecode);
+        break;
+      }
+      default: {
+        size_t size = strlen(task->js->js);
+        if(ret == 0) {
+          ret = write_output(out_dir, base, task->format == EMIT_JSON ? ".json" : ".js", task->js->js, size);
+        }
+        if(stats != NULL) {
+          stats->bytes_emitted += size;
+        }
+        destroy_xstate_result(task->js);
+        break;
+      }
+    }
+  }
+  free(base);
+  trace_end("write");
+
+  if(stats != NULL) {
+    print_stats(stats, filename, stats_format);
+    stats_destroy(stats);
+  }
+  return ret;
+}
+
+// Compiles one file to the formats in emit.
+static int compile_file(char* filename, int flags, int emit, char* out_file, char* out_dir,
+  int stats_format) {
+  if(emit & (emit - 1)) {
+    return compile_file_many(filename, flags, emit, out_dir, stats_format, false);
+  }
+
+  if(emit == EMIT_BYTECODE) {
+    return compile_file_bytecode(filename, flags, out_file, stats_format);
+  }
+
+  if(emit == EMIT_C) {
+    if(out_file != NULL) {
+      printf("The C target writes a file per machine, use --out-dir.\n");
+      return 1;
+    }
+    return compile_file_c(filename, flags, out_dir, stats_format);
+  }
+
+  return compile_file_js(emit == EMIT_JSON ? compile_json : emit == EMIT_JS ? compile_js : compile_xstate,
+    filename, flags, out_file, stats_format);
+}
+
+// Files compiled by --jobs threads, each taking the next one when done.
+typedef struct Batch {
+  char** filenames;
+  int file_count;
+  int next;
+  int failed;
+  pthread_mutex_t lock;
+
+  int flags;
+  int emit;
+  char* out_dir;
+  int stats_format;
+} Batch;
+
+static void* run_batch_worker(void* arg) {
+  Batch* batch = arg;
+  trace_thread_name("compile");
+  while(true) {
+    pthread_mutex_lock(&batch->lock);
+    int i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if(i >= batch->file_count) {
+      break;
+    }
+
+    char* filename = batch->filenames[i];
+    trace_begin("compile", filename);
+    int ret = compile_file_many(filename, batch->flags, batch->emit, batch->out_dir,
+      batch->stats_format, true);
+    trace_end("compile");
+    if(ret != 0) {
+      pthread_mutex_lock(&batch->lock);
+      batch->failed++;
+      pthread_mutex_unlock(&batch->lock);
+    }
+  }
+  return NULL;
+}
+
+// Files with the same base name would write the same outputs, in whatever
+// order their jobs finish. C files are named after machines instead, see
+// c_claims_take.
+static bool outputs_collide(char** filenames, int file_count, int emit, char* out_dir) {
+  if((emit & ~(EMIT_C)) == 0) {
+    return false;
+  }
+
+  char** bases = malloc(file_count * sizeof(char*));
+  SymbolTable seen;
+  symtab_init(&seen, file_count);
+  bool collide = false;
+  for(int i = 0; i < file_count; i++) {
+    bases[i] = output_base(filenames[i]);
+    if(!symtab_insert(&seen, bases[i], i)) {
+      printf("%s and %s would both write %s/%s.*, compile them separately.\n",
+        filenames[symtab_get(&seen, bases[i])], filenames[i], out_dir, bases[i]);
+      collide = true;
+    }
+  }
+  symtab_destroy(&seen);
+  for(int i = 0; i < file_count; i++) {
+    free(bases[i]);
+  }
+  free(bases);
+  return collide;
+}
+
+static int compile_files(char** filenames, int file_count, int flags, int emit, char* out_dir,
+  int stats_format, int jobs) {
+  if(outputs_collide(filenames, file_count, emit, out_dir)) {
+    return 1;
+  }
+  if(emit & EMIT_C) {
+    c_claims_init();
+  }
+
+  Batch batch = {
+    .filenames = filenames,
+    .file_count = file_count,
+    .next = 0,
+    .failed = 0,
+    .flags = flags,
+    .emit = emit,
+    .out_dir = out_dir,
+    .stats_format = stats_format
+  };
+  pthread_mutex_init(&batch.lock, NULL);
+
+  if(jobs > file_count) {
+    jobs = file_count;
+  }
+  pthread_t* threads = malloc(jobs * sizeof(pthread_t));
+  for(int i = 0; i < jobs; i++) {
+    pthread_create(&threads[i], NULL, run_batch_worker, &batch);
+  }
+  for(int i = 0; i < jobs; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&batch.lock);
+  if(emit & EMIT_C) {
+    c_claims_destroy();
+  }
+
+  return batch.failed > 0 ? 1 : 0;
+}
+
+static int explore_file(char* filename, int flags, int jobs, int format) {
+  ExploreResult* result = explore_create();
+  explore_init(result, flags, jobs);
+
+  char* buffer = read_source(filename, NULL);
+  if(buffer == NULL) {
+    return 1;
+  }
+
+  explore_program(result, buffer, filename);
+  print_diagnostics(&result->diagnostics, buffer, filename);
+
+  if(!result->success) {
+    destroy_explore_result(result);
     fprintf(stderr, "Compilation failed!\n");
     return 1;
   }
+
+  if(format == EXPLORE_JSON) {
+    char* json = explore_to_json(result);
+    printf("%s\n", json);
+    lucy_free(json);
+  } else {
+    explore_print(stdout, result);
+  }
+  destroy_explore_result(result);
+  return 0;
+}
+
+// The path joined to the working directory unless it's absolute, with .
+// and .. resolved by name rather than on disk. dir drops the last part.
+static char* absolute_path(char* path, bool dir) {
+  char cwd[4096];
+  if(path[0] != '/' && getcwd(cwd, sizeof(cwd)) == NULL) {
+    cwd[0] = '\0';
+  }
+  size_t len = (path[0] == '/' ? 0 : strlen(cwd)) + strlen(path) + 2;
+  char* joined = malloc(len);
+  snprintf(joined, len, "%s/%s", path[0] == '/' ? "" : cwd, path);
+
+  char* out = malloc(len);
+  size_t out_len = 0;
+  for(char* part = strtok(joined, "/"); part != NULL; part = strtok(NULL, "/")) {
+    if(strcmp(part, ".") == 0) {
+      continue;
+    }
+    if(strcmp(part, "..") == 0) {
+      while(out_len > 0 && out[--out_len] != '/');
+      continue;
+    }
+    out_len += sprintf(out + out_len, "/%s", part);
+  }
+  if(dir) {
+    while(out_len > 0 && out[--out_len] != '/');
+  }
+  out[out_len] = '\0';
+  free(joined);
+  return out;
+}
+
+// How to get to the absolute path to from the absolute directory from, as
+// an import specifier.
+static char* relative_path(char* from, char* to) {
+  // The end of the directories they share.
+  size_t i = 0;
+  size_t common = 0;
+  while(from[i] != '\0' && from[i] == to[i]) {
+    if(from[i] == '/') {
+      common = i;
+    }
+    i++;
+  }
+  if(from[i] == '\0' && to[i] == '/') {
+    common = i;
+  }
+
+  size_t ups = 0;
+  for(char* c = from + common; *c != '\0'; c++) {
+    ups += *c == '/';
+  }
+  char* rest = to + common + (to[common] == '/' ? 1 : 0);
+  char* out = malloc(ups * 3 + strlen(rest) + 3);
+  strcpy(out, ups == 0 ? "./" : "");
+  for(size_t i = 0; i < ups; i++) {
+    strcat(out, "../");
+  }
+  strcat(out, rest);
+  return out;
+}
+
+// Points the program's relative imports at the same files from where the
+// bundle is written, the working directory if it's printed.
+static void bundle_rewrite_imports(IRProgram* ir, char* filename, char* out_file) {
+  char* source_dir = absolute_path(filename, true);
+  char* out_dir = absolute_path(out_file != NULL ? out_file : ".", out_file != NULL);
+  for(uint32_t i = 0; i < ir->import_count; i++) {
+    char* from = ir_string(ir, ir->imports[i].from);
+    size_t len = strlen(from);
+    if(len < 2 || (strncmp(from + 1, "./", 2) != 0 && strncmp(from + 1, "../", 3) != 0)) {
+      continue;
+    }
+
+    char* spec = strndup(from + 1, len - 2);
+    size_t path_len = strlen(source_dir) + len + 1;
+    char* path = malloc(path_len);
+    snprintf(path, path_len, "%s/%s", source_dir, spec);
+    char* target = absolute_path(path, false);
+    char* relative = relative_path(out_dir, target);
+
+    size_t quoted_len = strlen(relative) + 3;
+    char* quoted = malloc(quoted_len);
+    snprintf(quoted, quoted_len, "%c%s%c", from[0], relative, from[len - 1]);
+    ir->imports[i].from = ir_intern(ir, quoted);
+
+    free(quoted);
+    free(relative);
+    free(target);
+    free(path);
+    free(spec);
+  }
+  free(out_dir);
+  free(source_dir);
+}
+
+// The file's name as an identifier: letters and digits, the rest dropped
+// and the letter after them capitalized, so traffic-light is trafficLight.
+static char* bundle_namespace(char* filename) {
+  char* base = output_base(filename);
+  char* namespace = malloc(strlen(base) + 2);
+  size_t len = 0;
+  bool upper = false;
+  for(char* c = base; *c != '\0'; c++) {
+    if(!isalnum((unsigned char)*c)) {
+      upper = len > 0;
+      continue;
+    }
+    if(len == 0 && isdigit((unsigned char)*c)) {
+      namespace[len++] = '_';
+    }
+    namespace[len++] = upper ? toupper((unsigned char)*c) : *c;
+    upper = false;
+  }
+  namespace[len] = '\0';
+  free(base);
+  return namespace;
+}
+
+// Compiles every file and emits them as one module, see xs_emit_bundle.
+static int bundle_files(char** filenames, int file_count, int flags, char* out_file) {
+  IRProgram** programs = calloc(file_count, sizeof(IRProgram*));
+  char** namespaces = calloc(file_count, sizeof(char*));
+  int failed = 0;
+
+  for(int i = 0; i < file_count; i++) {
+    char* filename = filenames[i];
+    namespaces[i] = bundle_namespace(filename);
+    if(namespaces[i][0] == '\0') {
+      printf("%s can't be bundled, its name has no letters or digits.\n", filename);
+      failed++;
+      continue;
+    }
+    for(int j = 0; j < i; j++) {
+      if(strcmp(namespaces[i], namespaces[j]) == 0) {
+        printf("%s and %s would both be bundled as %s, rename one.\n", filenames[j], filename,
+          namespaces[i]);
+        failed++;
+      }
+    }
+
+    trace_begin("compile", filename);
+    char* buffer = read_source(filename, NULL);
+    if(buffer == NULL) {
+      trace_end("compile");
+      failed++;
+      continue;
+    }
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics);
+    programs[i] = frontend_compile(buffer, filename, flags & XS_FLAG_MINIMIZE, flags & XS_FLAG_OPTIMIZE,
+      &diagnostics);
+    print_diagnostics(&diagnostics, buffer, filename);
+    diagnostics_destroy(&diagnostics);
+    free(buffer);
+    trace_end("compile");
+
+    if(programs[i] == NULL) {
+      print_failed(filename, true);
+      failed++;
+      continue;
+    }
+    // Only the default machine is exported by the bare namespace.
+    for(uint32_t m = 0; m < programs[i]->machine_count; m++) {
+      if(programs[i]->machines[m].name == IR_NONE && xs_bundle_reserved(namespaces[i])) {
+        printf("%s can't be bundled, its machine would be exported as %s, which JavaScript "
+          "reserves. Rename the file.\n", filename, namespaces[i]);
+        failed++;
+      }
+    }
+    bundle_rewrite_imports(programs[i], filename, out_file);
+  }
+
+  int ret = failed > 0 ? 1 : 0;
+  if(ret == 0) {
+    CompileResult* result = xs_create();
+    xs_init(result, flags);
+    trace_begin("bundle", NULL);
+    xs_emit_bundle(result, programs, namespaces, file_count);
+    trace_end("bundle");
+    if(out_file != NULL) {
+      ret = write_file(out_file, result->js);
+    } else {
+      printf("%s\n", result->js);
+    }
+    destroy_xstate_result(result);
+  }
+
+  for(int i = 0; i < file_count; i++) {
+    if(programs[i] != NULL) {
+      ir_destroy(programs[i]);
+    }
+    free(namespaces[i]);
+  }
+  free(programs);
+  free(namespaces);
+  return ret;
 }
 
 #define OPTION_REMOTE_IMPORTS 0
 #define OPTION_OUT_FILE 1
 #define OPTION_OUT_DIR 2
+#define OPTION_STATS 3
+#define OPTION_MINIMIZE 4
+#define OPTION_TARGET 5
+#define OPTION_EMIT 6
+#define OPTION_EXPLORE 7
+#define OPTION_JOBS 8
+#define OPTION_DIAGNOSTICS 9
+#define OPTION_MAX_DEPTH 10
+#define OPTION_TRACE 11
+#define OPTION_BUNDLE 12
+#define OPTION_LAZY 13
 
 static struct option long_options[] = {
   {"remote-imports", no_argument, 0, OPTION_REMOTE_IMPORTS},
   {"out-file", required_argument, 0, OPTION_OUT_FILE},
+  {"out-dir", required_argument, 0, OPTION_OUT_DIR},
+  {"target", required_argument, 0, OPTION_TARGET},
+  {"emit", required_argument, 0, OPTION_EMIT},
+  {"explore", optional_argument, 0, OPTION_EXPLORE},
+  {"jobs", required_argument, 0, OPTION_JOBS},
+  {"stats", optional_argument, 0, OPTION_STATS},
+  {"diagnostics", required_argument, 0, OPTION_DIAGNOSTICS},
+  {"minimize", no_argument, 0, OPTION_MINIMIZE},
+  {"max-depth", required_argument, 0, OPTION_MAX_DEPTH},
+  {"trace", required_argument, 0, OPTION_TRACE},
+  {"bundle", no_argument, 0, OPTION_BUNDLE},
+  {"lazy", no_argument, 0, OPTION_LAZY},
   {"help", no_argument, 0, 'h'},
   {"version", no_argument, 0, 'v'},
+  {0, 0, 0, 0}
 };
 
+// Set from --trace, written however lc exits.
+static char* trace_file = NULL;
+
+static void write_trace() {
+  FILE* fp = fopen(trace_file, "w");
+  if(fp == NULL) {
+    fprintf(stderr, "Error opening trace file %s\n", trace_file);
+    return;
+  }
+  trace_write(fp);
+  fclose(fp);
+  trace_destroy();
+}
+
 int main(int argc, char *argv[]) {
   identifier_init();
   parser_init();
 
-  int use_remote_imports = 0;
+  int flags = 0;
+  int stats_format = STATS_FORMAT_NONE;
   char* out_file = NULL;
+  char* out_dir = NULL;
+  int target = TARGET_XSTATE;
+  int emit = EMIT_SOURCE;
+  int explore = EXPLORE_NONE;
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  bool bundle = false;
 
   int option_index = 0;
   int opt;
-  while ((opt = getopt_long(argc, argv, "hv", long_options, &option_index)) != -1) {
+  while ((opt = getopt_long(argc, argv, "hvO", long_options, &option_index)) != -1) {
     switch(opt) {
       case 0: {
-        use_remote_imports = 1;
+        flags |= XS_FLAG_USE_REMOTE;
         break;
       }
       case 1: {
         out_file = strdup(optarg);
         break;
       }
+      case OPTION_OUT_DIR: {
+        out_dir = strdup(optarg);
+        break;
+      }
+      case OPTION_TARGET: {
+        if(strcmp(optarg, "xstate") == 0) {
+          target = TARGET_XSTATE;
+        } else if(strcmp(optarg, "c") == 0) {
+          target = TARGET_C;
+        } else if(strcmp(optarg, "js") == 0) {
+          target = TARGET_JS;
+        } else {
+          fprintf(stderr, "Unknown target: %s\n\n", optarg);
+          usage(argv[0]);
+          exit(1);
+        }
+        break;
+      }
+      case OPTION_EMIT: {
+        emit = 0;
+        char* formats = strdup(optarg);
+        for(char* format = strtok(formats, ","); format != NULL; format = strtok(NULL, ",")) {
+          if(strcmp(format, "source") == 0) {
+            emit |= EMIT_SOURCE;
+          } else if(strcmp(format, "bytecode") == 0) {
+            emit |= EMIT_BYTECODE;
+          } else if(strcmp(format, "xstate") == 0) {
+            emit |= EMIT_XSTATE;
+          } else if(strcmp(format, "js") == 0) {
+            emit |= EMIT_JS;
+          } else if(strcmp(format, "c") == 0) {
+            emit |= EMIT_C;
+          } else if(strcmp(format, "json") == 0) {
+            emit |= EMIT_JSON;
+          } else {
+            fprintf(stderr, "Unknown emit format: %s\n\n", format);
+            usage(argv[0]);
+            exit(1);
+          }
+        }
+        free(formats);
+        break;
+      }
+      case OPTION_EXPLORE: {
+        if(optarg == NULL || strcmp(optarg, "human") == 0) {
+          explore = EXPLORE_HUMAN;
+        } else if(strcmp(optarg, "json") == 0) {
+          explore = EXPLORE_JSON;
+        } else {
+          fprintf(stderr, "Unknown explore format: %s\n\n", optarg);
+          usage(argv[0]);
+          exit(1);
+        }
+        break;
+      }
+      case OPTION_JOBS: {
+        jobs = atoi(optarg);
+        if(jobs < 1) {
+          fprintf(stderr, "--jobs takes a positive number\n\n");
+          usage(argv[0]);
+          exit(1);
+        }
+        break;
+      }
+      case OPTION_STATS: {
+        if(optarg == NULL || strcmp(optarg, "human") == 0) {
+          stats_format = STATS_FORMAT_HUMAN;
+        } else if(strcmp(optarg, "json") == 0) {
+          stats_format = STATS_FORMAT_JSON;
+        } else {
+          fprintf(stderr, "Unknown stats format: %s\n\n", optarg);
+          usage(argv[0]);
+          exit(1);
+        }
+        break;
+      }
+      case OPTION_DIAGNOSTICS: {
+        if(strcmp(optarg, "human") == 0) {
+          diagnostics_format = DIAGNOSTICS_FORMAT_HUMAN;
+        } else if(strcmp(optarg, "json") == 0) {
+          diagnostics_format = DIAGNOSTICS_FORMAT_JSON;
+        } else {
+          fprintf(stderr, "Unknown diagnostics format: %s\n\n", optarg);
+          usage(argv[0]);
+          exit(1);
+        }
+        break;
+      }
+      case OPTION_MAX_DEPTH: {
+        int depth = atoi(optarg);
+        if(depth < 1) {
+          fprintf(stderr, "--max-depth takes a positive number\n\n");
+          usage(argv[0]);
+          exit(1);
+        }
+        parser_set_max_depth(depth);
+        break;
+      }
+      case OPTION_TRACE: {
+        trace_file = strdup(optarg);
+        break;
+      }
+      case OPTION_BUNDLE: {
+        bundle = true;
+        break;
+      }
+      case OPTION_LAZY: {
+        flags |= XS_FLAG_LAZY;
+        break;
+      }
+      case OPTION_MINIMIZE: {
+        flags |= XS_FLAG_MINIMIZE;
+        break;
+      }
+      case 'O': {
+        flags |= XS_FLAG_OPTIMIZE;
+        break;
+      }
       case 'h': {
         usage(argv[0]);
         exit(0);
@@ -150,6 +1167,12 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if(trace_file != NULL) {
+    trace_start();
+    trace_thread_name("main");
+    atexit(write_trace);
+  }
+
   char* program_name = argv[0];
   char* filename = argv[optind];
 
@@ -172,7 +1195,60 @@ int main(int argc, char *argv[]) {
         }
       }
 
-      int ret = compile_file(filename, use_remote_imports, out_file);
+      int file_count = argc - optind;
+      if(bundle) {
+        if(explore != EXPLORE_NONE || target != TARGET_XSTATE || (emit != EMIT_SOURCE && emit != EMIT_XSTATE)) {
+          printf("--bundle only compiles to xstate.\n");
+          return 1;
+        }
+        if(out_dir != NULL) {
+          printf("A bundle is a single file, use --out-file.\n");
+          return 1;
+        }
+        return bundle_files(argv + optind, file_count, flags, out_file);
+      }
+      if(file_count > 1) {
+        if(explore != EXPLORE_NONE) {
+          printf("--explore takes a single file.\n");
+          return 1;
+        }
+        if(out_dir == NULL || out_file != NULL) {
+          printf("Compiling several files writes a file each, use --out-dir.\n");
+          return 1;
+        }
+      }
+
+      if(explore != EXPLORE_NONE) {
+        trace_begin("explore", filename);
+        int ret = explore_file(filename, flags, jobs, explore);
+        trace_end("explore");
+        return ret;
+      }
+
+      // Source is whichever format the target is.
+      if(emit & EMIT_SOURCE) {
+        emit &= ~(EMIT_SOURCE);
+        emit |= target == TARGET_C ? EMIT_C : target == TARGET_JS ? EMIT_JS : EMIT_XSTATE;
+      }
+
+      if(emit & (emit - 1)) {
+        if(out_dir == NULL) {
+          printf("Emitting several formats writes a file each, use --out-dir.\n");
+          return 1;
+        }
+        if((emit & EMIT_XSTATE) && (emit & EMIT_JS)) {
+          printf("The xstate and js formats both write a .js file, emit them separately.\n");
+          return 1;
+        }
+      }
+
+      if(file_count > 1) {
+        return compile_files(argv + optind, file_count, flags, emit, out_dir, stats_format, jobs);
+      }
+
+      trace_begin("compile", filename);
+      int ret = compile_file(filename, flags, emit, out_file, out_dir, stats_format);
+      trace_end("compile");
       return ret;
     }
   } else {
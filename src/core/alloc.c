@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "stats.h"
+
+static void* libc_malloc(void* ctx, size_t size) {
+  return malloc(size);
+}
+
+static void* libc_realloc(void* ctx, void* ptr, size_t old_size, size_t size) {
+  return realloc(ptr, size);
+}
+
+static void libc_free(void* ctx, void* ptr, size_t size) {
+  free(ptr);
+}
+
+const LucyAllocator lucy_libc_allocator = {
+  .malloc = libc_malloc,
+  .realloc = libc_realloc,
+  .free = libc_free,
+  .ctx = NULL
+};
+
+static _Thread_local const LucyAllocator* alloc_current = &lucy_libc_allocator;
+
+void lucy_set_allocator(const LucyAllocator* allocator) {
+  alloc_current = allocator != NULL ? allocator : &lucy_libc_allocator;
+}
+
+const LucyAllocator* lucy_get_allocator() {
+  return alloc_current;
+}
+
+const LucyAllocator* lucy_use_allocator(const LucyAllocator* allocator) {
+  const LucyAllocator* previous = alloc_current;
+  if(allocator != NULL) {
+    alloc_current = allocator;
+  }
+  return previous;
+}
+
+// Each block is prefixed with its size so frees can be accounted for, and
+// with the allocator it came from so it goes back there wherever it's
+// freed. On 64-bit hosts that fits the alignment padding of one size.
+typedef union AllocHeader {
+  struct {
+    size_t size;
+    const LucyAllocator* allocator;
+  };
+  max_align_t align;
+} AllocHeader;
+
+static inline void* header_to_ptr(AllocHeader* header) {
+  return (void*)(header + 1);
+}
+
+static inline AllocHeader* ptr_to_header(void* ptr) {
+  return ((AllocHeader*)ptr) - 1;
+}
+
+void* lucy_malloc(size_t size) {
+  const LucyAllocator* allocator = alloc_current;
+  AllocHeader* header = allocator->malloc(allocator->ctx, sizeof(AllocHeader) + size);
+  if(header == NULL) {
+    return NULL;
+  }
+  header->size = size;
+  header->allocator = allocator;
+  stats_count_alloc(size);
+  return header_to_ptr(header);
+}
+
+void* lucy_calloc(size_t n, size_t size) {
+  void* ptr = lucy_malloc(n * size);
+  if(ptr != NULL) {
+    memset(ptr, 0, n * size);
+  }
+  return ptr;
+}
+
+void* lucy_realloc(void* ptr, size_t size) {
+  if(ptr == NULL) {
+    return lucy_malloc(size);
+  }
+
+  AllocHeader* header = ptr_to_header(ptr);
+  size_t old_size = header->size;
+  const LucyAllocator* allocator = header->allocator;
+  header = allocator->realloc(allocator->ctx, header, sizeof(AllocHeader) + old_size,
+    sizeof(AllocHeader) + size);
+  if(header == NULL) {
+    return NULL;
+  }
+  header->size = size;
+  stats_count_realloc(old_size, size);
+  return header_to_ptr(header);
+}
+
+char* lucy_strdup(const char* str) {
+  size_t len = strlen(str) + 1;
+  char* copy = lucy_malloc(len);
+  if(copy != NULL) {
+    memcpy(copy, str, len);
+  }
+  return copy;
+}
+
+void lucy_free(void* ptr) {
+  if(ptr == NULL) {
+    return;
+  }
+
+  AllocHeader* header = ptr_to_header(ptr);
+  stats_count_free(header->size);
+  header->allocator->free(header->allocator->ctx, header, sizeof(AllocHeader) + header->size);
+}
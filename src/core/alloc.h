@@ -0,0 +1,37 @@
+#ifndef LUCY_ALLOC_H_
+#define LUCY_ALLOC_H_
+
+#include <stddef.h>
+
+// Where compiler memory comes from. Hosts can route it through an arena,
+// a budget or another malloc with a compile result's *_set_allocator, or
+// for everything on a thread with lucy_set_allocator. Sizes are passed
+// back so allocators that don't record them can still free. Explore's
+// threads share the allocator, so it has to be thread safe when they do.
+typedef struct LucyAllocator {
+  void* (*malloc)(void* ctx, size_t size);
+  void* (*realloc)(void* ctx, void* ptr, size_t old_size, size_t size);
+  void (*free)(void* ctx, void* ptr, size_t size);
+  void* ctx;
+} LucyAllocator;
+
+// Backed by libc, the default.
+extern const LucyAllocator lucy_libc_allocator;
+
+// Sets the allocator new memory comes from on this thread, NULL for the
+// default. Memory is always freed by the allocator it came from.
+void lucy_set_allocator(const LucyAllocator*);
+const LucyAllocator* lucy_get_allocator();
+// For entry points compiling with a result's allocator: makes it current
+// unless NULL and returns the one to restore with lucy_set_allocator.
+const LucyAllocator* lucy_use_allocator(const LucyAllocator*);
+
+// All compiler memory goes through these so that it can be accounted for
+// (see stats.h). Memory from them must be released with lucy_free.
+void* lucy_malloc(size_t);
+void* lucy_calloc(size_t, size_t);
+void* lucy_realloc(void*, size_t);
+char* lucy_strdup(const char*);
+void lucy_free(void*);
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "ir.h"
+#include "frontend.h"
+#include "compiler_bytecode.h"
+#include "stats.h"
+#include "symtab.h"
+#include "../vm/bytecode.h"
+
+typedef struct BCWriter {
+  IRProgram* ir;
+  uint8_t* data;
+  uint32_t size;
+  uint32_t capacity;
+
+  // State paths missing from the program's strings, numbered after them so
+  // the program itself isn't changed.
+  SymbolTable path_table;
+  char** paths;
+  uint32_t path_count;
+  uint32_t path_capacity;
+} BCWriter;
+
+typedef struct SortedString {
+  const char* str;
+  uint32_t id;
+} SortedString;
+
+// Appends zeroed room for count items, padded to keep tables aligned, and
+// returns its offset. Pointers into the data don't survive the next call.
+static uint32_t reserve(BCWriter* w, uint32_t count, uint32_t item) {
+  uint32_t bytes = (count * item + 3) & ~3u;
+  if(w->size + bytes > w->capacity) {
+    while(w->size + bytes > w->capacity) {
+      w->capacity = w->capacity == 0 ? 256 : w->capacity * 2;
+    }
+    w->data = lucy_realloc(w->data, w->capacity);
+  }
+  uint32_t offset = w->size;
+  memset(w->data + offset, 0, bytes);
+  w->size += bytes;
+  return offset;
+}
+
+static void* at(BCWriter* w, uint32_t offset) {
+  return w->data + offset;
+}
+
+static uint32_t write_u32s(BCWriter* w, uint32_t* values, uint32_t count) {
+  uint32_t offset = reserve(w, count, sizeof(uint32_t));
+  if(count > 0) {
+    memcpy(at(w, offset), values, count * sizeof(uint32_t));
+  }
+  return offset;
+}
+
+static int compare_strings(const void* a, const void* b) {
+  return strcmp(((SortedString*)a)->str, ((SortedString*)b)->str);
+}
+
+static int compare_dispatch(const void* a, const void* b) {
+  uint32_t x = ((BCDispatch*)a)->event;
+  uint32_t y = ((BCDispatch*)b)->event;
+  return x < y ? -1 : x > y;
+}
+
+static char* string_at(BCWriter* w, uint32_t id) {
+  IRStrings* strings = &w->ir->strings;
+  return id < strings->count ? strings->items[id] : w->paths[id - strings->count];
+}
+
+static uint32_t intern_path(BCWriter* w, char* path) {
+  IRStrings* strings = &w->ir->strings;
+  int id = symtab_get(&strings->table, path);
+  if(id == SYMTAB_NOT_FOUND) {
+    id = symtab_get(&w->path_table, path);
+  }
+  if(id != SYMTAB_NOT_FOUND) {
+    lucy_free(path);
+    return id;
+  }
+
+  if(w->path_count == w->path_capacity) {
+    w->path_capacity = w->path_capacity == 0 ? 16 : w->path_capacity * 2;
+    w->paths = lucy_realloc(w->paths, w->path_capacity * sizeof(char*));
+  }
+  w->paths[w->path_count] = path;
+  symtab_insert(&w->path_table, path, strings->count + w->path_count);
+  return strings->count + w->path_count++;
+}
+
+static void write_strings(BCWriter* w) {
+  uint32_t count = w->ir->strings.count + w->path_count;
+  uint32_t offsets = reserve(w, count, sizeof(uint32_t));
+  uint32_t sorted = reserve(w, count, sizeof(uint32_t));
+
+  SortedString* order = lucy_malloc((count + 1) * sizeof(SortedString));
+  for(uint32_t i = 0; i < count; i++) {
+    char* str = string_at(w, i);
+    uint32_t length = strlen(str) + 1;
+    uint32_t offset = reserve(w, length, 1);
+    memcpy(at(w, offset), str, length);
+    ((uint32_t*)at(w, offsets))[i] = offset;
+    order[i].str = str;
+    order[i].id = i;
+  }
+  qsort(order, count, sizeof(SortedString), compare_strings);
+  for(uint32_t i = 0; i < count; i++) {
+    ((uint32_t*)at(w, sorted))[i] = order[i].id;
+  }
+  lucy_free(order);
+
+  BCHeader* header = at(w, 0);
+  header->string_count = count;
+  header->strings = offsets;
+  header->sorted = sorted;
+}
+
+// States are named by their path, interned before the string table is
+// written.
+static uint32_t* state_names(BCWriter* w, IRMachine* machine) {
+  uint32_t* names = lucy_malloc((machine->state_count + 1) * sizeof(uint32_t));
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    IRState* state = &machine->states[s];
+    if(state->parent == IR_NONE) {
+      names[s] = state->name;
+      continue;
+    }
+    char* parent = string_at(w, names[state->parent]);
+    char* name = ir_string(w->ir, state->name);
+    size_t length = strlen(parent) + strlen(name) + 2;
+    char* path = lucy_malloc(length);
+    strcpy(path, parent);
+    strcat(path, ".");
+    strcat(path, name);
+    names[s] = intern_path(w, path);
+  }
+  return names;
+}
+
+static void write_states(BCWriter* w, IRMachine* machine, uint32_t* names, uint32_t offset) {
+  BCState* out = at(w, offset);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    IRState* state = &machine->states[s];
+    out[s].name = names[s];
+    out[s].parent = state->parent;
+    out[s].child = state->child_count == 0 ? BC_NONE :
+      state->initial != IR_NONE ? state->initial : state->child_start;
+    out[s].flags = state->flags & IR_STATE_FINAL ? BC_STATE_FINAL : 0;
+  }
+}
+
+// The last transition for an event is the one taken, one entry per event.
+static uint32_t write_dispatch(BCWriter* w, IRMachine* machine, uint32_t* offsets) {
+  uint32_t* rows = machine->offsets[IR_EVENT];
+  // Events are all program strings, paths are only state names.
+  uint32_t* stamps = lucy_malloc((w->ir->strings.count + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < w->ir->strings.count; i++) {
+    stamps[i] = IR_NONE;
+  }
+
+  BCDispatch* dispatch = lucy_malloc((rows[machine->state_count] - rows[0] + 1) * sizeof(BCDispatch));
+  uint32_t count = 0;
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    offsets[s] = count;
+    for(uint32_t t = rows[s + 1]; t > rows[s]; t--) {
+      uint32_t event = machine->transitions[t - 1].event;
+      if(stamps[event] != s) {
+        stamps[event] = s;
+        dispatch[count].event = event;
+        dispatch[count].transition = t - 1;
+        count++;
+      }
+    }
+    qsort(&dispatch[offsets[s]], count - offsets[s], sizeof(BCDispatch), compare_dispatch);
+  }
+  offsets[machine->state_count] = count;
+
+  uint32_t offset = reserve(w, count, sizeof(BCDispatch));
+  if(count > 0) {
+    memcpy(at(w, offset), dispatch, count * sizeof(BCDispatch));
+  }
+  lucy_free(dispatch);
+  lucy_free(stamps);
+  return offset;
+}
+
+static void write_machine(BCWriter* w, IRMachine* machine, uint32_t* names, uint32_t index) {
+  BCMachine def = {0};
+  def.name = machine->name;
+  def.initial = machine->state_count == 0 ? BC_NONE :
+    machine->initial != IR_NONE ? machine->initial : 0;
+  def.state_count = machine->state_count;
+  def.transition_count = machine->transition_count;
+  def.guard_count = machine->guard_count;
+  def.action_count = machine->action_count;
+  def.invoke_count = machine->invoke_count;
+
+  def.states = reserve(w, machine->state_count, sizeof(BCState));
+  write_states(w, machine, names, def.states);
+
+  def.transitions = reserve(w, machine->transition_count, sizeof(BCTransition));
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    BCTransition* out = &((BCTransition*)at(w, def.transitions))[t];
+    out->event = transition->event;
+    out->delay = transition->delay;
+    out->target = transition->target;
+    out->guard_start = transition->guard_start;
+    out->guard_count = transition->guard_count;
+    out->action_start = transition->action_start;
+    out->action_count = transition->action_count;
+  }
+  for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+    def.offsets[kind] = write_u32s(w, machine->offsets[kind], ir_row_count(machine, kind) + 1);
+  }
+
+  uint32_t* dispatch_offsets = lucy_malloc((machine->state_count + 1) * sizeof(uint32_t));
+  def.dispatch = write_dispatch(w, machine, dispatch_offsets);
+  def.dispatch_count = dispatch_offsets[machine->state_count];
+  def.dispatch_offsets = write_u32s(w, dispatch_offsets, machine->state_count + 1);
+  lucy_free(dispatch_offsets);
+
+  // Bindings are resolved here, the VM only sees functions and keys.
+  def.guards = reserve(w, machine->guard_count, sizeof(uint32_t));
+  for(uint32_t i = 0; i < machine->guard_count; i++) {
+    IRRef* ref = &machine->guards[i];
+    ((uint32_t*)at(w, def.guards))[i] = ref->type == IR_REF_BINDING ?
+      machine->bindings[ref->id].ref : ref->id;
+  }
+
+  def.actions = reserve(w, machine->action_count, sizeof(BCAction));
+  for(uint32_t i = 0; i < machine->action_count; i++) {
+    IRRef* ref = &machine->actions[i];
+    BCAction* out = &((BCAction*)at(w, def.actions))[i];
+    switch(ref->type) {
+      case IR_REF_BINDING: {
+        out->fn = machine->bindings[ref->id].ref;
+        out->key = machine->bindings[ref->id].key;
+        break;
+      }
+      case IR_REF_INLINE: {
+        out->fn = ref->id;
+        out->key = BC_NONE;
+        break;
+      }
+      case IR_REF_ASSIGN: {
+        out->fn = BC_NONE;
+        out->key = ref->id;
+        break;
+      }
+    }
+  }
+
+  def.invokes = reserve(w, machine->invoke_count, sizeof(uint32_t));
+  for(uint32_t i = 0; i < machine->invoke_count; i++) {
+    ((uint32_t*)at(w, def.invokes))[i] = machine->invokes[i].src;
+  }
+  def.invoke_offsets = write_u32s(w, machine->invoke_offsets, machine->state_count + 1);
+
+  BCHeader* header = at(w, 0);
+  ((BCMachine*)at(w, header->machines))[index] = def;
+}
+
+static void write_program(BCWriter* w) {
+  IRProgram* ir = w->ir;
+  uint32_t** names = lucy_malloc((ir->machine_count + 1) * sizeof(uint32_t*));
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    names[i] = state_names(w, &ir->machines[i]);
+  }
+
+  reserve(w, 1, sizeof(BCHeader));
+  write_strings(w);
+  uint32_t machines = reserve(w, ir->machine_count, sizeof(BCMachine));
+  BCHeader* header = at(w, 0);
+  header->magic = BC_MAGIC;
+  header->version = BC_VERSION;
+  header->machine_count = ir->machine_count;
+  header->machines = machines;
+
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    write_machine(w, &ir->machines[i], names[i], i);
+    lucy_free(names[i]);
+  }
+  lucy_free(names);
+
+  header = at(w, 0);
+  header->size = w->size;
+}
+
+void bytecode_emit(BytecodeResult* result, IRProgram* ir) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  BCWriter w = {
+    .ir = ir,
+    .data = NULL,
+    .size = 0,
+    .capacity = 0,
+    .paths = NULL,
+    .path_count = 0,
+    .path_capacity = 0
+  };
+  symtab_init(&w.path_table, 0);
+  write_program(&w);
+  result->success = true;
+  result->data = w.data;
+  result->size = w.size;
+
+  for(uint32_t i = 0; i < w.path_count; i++) {
+    lucy_free(w.paths[i]);
+  }
+  if(w.paths != NULL) {
+    lucy_free(w.paths);
+  }
+  symtab_destroy(&w.path_table);
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+
+  if(result->stats != NULL) {
+    result->stats->bytes_emitted = result->size;
+  }
+}
+
+BytecodeResult* bytecode_create() {
+  BytecodeResult* result = lucy_malloc(sizeof(*result));
+  return result;
+}
+
+void bytecode_init(BytecodeResult* result, int flags) {
+  result->success = false;
+  result->flags = flags;
+  result->data = NULL;
+  result->size = 0;
+  result->stats = NULL;
+  diagnostics_init(&result->diagnostics);
+  result->allocator = NULL;
+}
+
+void bytecode_enable_stats(BytecodeResult* result) {
+  if(result->stats == NULL) {
+    result->stats = stats_create();
+  }
+}
+
+void bytecode_set_allocator(BytecodeResult* result, const LucyAllocator* allocator) {
+  result->allocator = allocator;
+}
+
+void compile_bytecode(BytecodeResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  if(result->stats != NULL) {
+    stats_start(result->stats);
+    result->stats->source_bytes = strlen(source);
+  }
+
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & BYTECODE_FLAG_MINIMIZE, result->flags & BYTECODE_FLAG_OPTIMIZE, &result->diagnostics);
+
+  if(ir == NULL) {
+    result->success = false;
+    lucy_set_allocator(outer);
+    stats_stop();
+    return;
+  }
+
+  bytecode_emit(result, ir);
+  ir_destroy(ir);
+  lucy_set_allocator(outer);
+  stats_stop();
+}
+
+Stats* bytecode_get_stats(BytecodeResult* result) {
+  return result->stats;
+}
+
+void destroy_bytecode_result(BytecodeResult* result) {
+  if(result->data != NULL) {
+    lucy_free(result->data);
+  }
+  if(result->stats != NULL) {
+    stats_destroy(result->stats);
+  }
+  diagnostics_destroy(&result->diagnostics);
+  lucy_free(result);
+}
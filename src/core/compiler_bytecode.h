@@ -0,0 +1,37 @@
+#ifndef LUCY_COMPILER_BYTECODE_H_
+#define LUCY_COMPILER_BYTECODE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "ir.h"
+#include "stats.h"
+
+// Flags for bytecode_init, the same bits as the XState ones they mirror.
+#define BYTECODE_FLAG_OPTIMIZE 1 << 1
+#define BYTECODE_FLAG_MINIMIZE 1 << 2
+
+// One file with every machine in the program, see src/vm/bytecode.h.
+typedef struct BytecodeResult {
+  bool success;
+  int flags;
+  uint8_t* data;
+  size_t size;
+  Stats* stats;
+  Diagnostics diagnostics;
+  const LucyAllocator* allocator;
+} BytecodeResult;
+
+BytecodeResult* bytecode_create();
+void bytecode_init(BytecodeResult*, int);
+void bytecode_enable_stats(BytecodeResult*);
+void bytecode_set_allocator(BytecodeResult*, const LucyAllocator*);
+void compile_bytecode(BytecodeResult*, char*, char*);
+// Emits a program from frontend_compile without changing it.
+void bytecode_emit(BytecodeResult*, IRProgram*);
+Stats* bytecode_get_stats(BytecodeResult*);
+void destroy_bytecode_result(BytecodeResult*);
+
+#endif
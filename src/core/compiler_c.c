@@ -0,0 +1,961 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "alloc.h"
+#include "ir.h"
+#include "frontend.h"
+#include "str_builder.h"
+#include "compiler_c.h"
+#include "stats.h"
+
+// The most cells the event table of a machine can have, states times
+// events. Larger machines dispatch through a switch.
+#define CC_DENSE_LIMIT (1 << 20)
+
+typedef struct CGen {
+  IRProgram* ir;
+  IRMachine* machine;
+  str_builder_t* sb;
+
+  // The machine's prefix as written and uppercased for enum constants.
+  char* name;
+  char* upper;
+
+  // Per state, the path from the top of the machine joined with _ for
+  // enum constants and with . for state names.
+  char** paths;
+  char** dotted;
+
+  // Per string id, the event's enum index and the index of the function
+  // called as a guard or action, or IR_NONE. Inline assigns come after
+  // the action functions.
+  uint32_t* event_index;
+  uint32_t* events;
+  uint32_t event_count;
+  uint32_t* guard_ids;
+  uint32_t guard_fn_count;
+  uint32_t* action_ids;
+  uint32_t action_fn_count;
+
+  bool uses_assign;
+  bool has_actions;
+  bool has_always;
+  bool has_delays;
+  bool has_invokes;
+} CGen;
+
+static void emit(CGen* g, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  str_builder_add_vfmt(g->sb, fmt, args);
+  va_end(args);
+}
+
+static char* join(char* prefix, char separator, char* name) {
+  size_t prefix_len = prefix == NULL ? 0 : strlen(prefix);
+  size_t name_len = strlen(name);
+  char* path = lucy_malloc(prefix_len + name_len + 2);
+  char* out = path;
+  if(prefix != NULL) {
+    memcpy(out, prefix, prefix_len);
+    out += prefix_len;
+    *out++ = separator;
+  }
+  memcpy(out, name, name_len + 1);
+  return path;
+}
+
+// The implicit machine is named after the file, minus its directory and
+// extension, as a C identifier.
+static char* name_from_filename(char* filename) {
+  char* base = strrchr(filename, '/');
+  base = base == NULL ? filename : base + 1;
+  char* dot = strchr(base, '.');
+  size_t len = dot == NULL ? strlen(base) : (size_t)(dot - base);
+
+  char* name = lucy_malloc(len + 2);
+  char* out = name;
+  if(len == 0 || isdigit((unsigned char)base[0])) {
+    *out++ = '_';
+  }
+  for(size_t i = 0; i < len; i++) {
+    *out++ = isalnum((unsigned char)base[i]) ? base[i] : '_';
+  }
+  *out = '\0';
+  return name;
+}
+
+static uint32_t guard_fn(CGen* g, IRRef* ref) {
+  return ref->type == IR_REF_BINDING ? g->machine->bindings[ref->id].ref : ref->id;
+}
+
+static void collect(CGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t string_count = g->ir->strings.count;
+
+  g->event_index = lucy_malloc((string_count + 1) * sizeof(uint32_t));
+  g->events = lucy_malloc((string_count + 1) * sizeof(uint32_t));
+  g->guard_ids = lucy_malloc((string_count + 1) * sizeof(uint32_t));
+  g->action_ids = lucy_malloc((string_count + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < string_count; i++) {
+    g->event_index[i] = IR_NONE;
+    g->guard_ids[i] = IR_NONE;
+    g->action_ids[i] = IR_NONE;
+  }
+
+  uint32_t* event_rows = machine->offsets[IR_EVENT];
+  for(uint32_t t = event_rows[0]; t < event_rows[machine->state_count]; t++) {
+    uint32_t event = machine->transitions[t].event;
+    if(g->event_index[event] == IR_NONE) {
+      g->event_index[event] = g->event_count;
+      g->events[g->event_count++] = event;
+    }
+  }
+
+  for(uint32_t i = 0; i < machine->guard_count; i++) {
+    g->guard_ids[guard_fn(g, &machine->guards[i])] = 0;
+  }
+  for(uint32_t i = 0; i < machine->action_count; i++) {
+    IRRef* ref = &machine->actions[i];
+    switch(ref->type) {
+      case IR_REF_BINDING: {
+        g->action_ids[machine->bindings[ref->id].ref] = 0;
+        break;
+      }
+      case IR_REF_INLINE: {
+        g->action_ids[ref->id] = 0;
+        break;
+      }
+      case IR_REF_ASSIGN: {
+        g->uses_assign = true;
+        break;
+      }
+    }
+  }
+
+  // Functions are numbered in the order they were first named.
+  for(uint32_t i = 0; i < string_count; i++) {
+    if(g->guard_ids[i] != IR_NONE) {
+      g->guard_ids[i] = g->guard_fn_count++;
+    }
+    if(g->action_ids[i] != IR_NONE) {
+      g->action_ids[i] = g->action_fn_count++;
+    }
+  }
+
+  g->has_actions = machine->action_count > 0;
+  g->has_always = machine->offsets[IR_ALWAYS][machine->state_count] > machine->offsets[IR_ALWAYS][0];
+  g->has_delays = machine->offsets[IR_DELAY][machine->state_count] > machine->offsets[IR_DELAY][0];
+  g->has_invokes = machine->invoke_count > 0;
+
+  g->paths = lucy_malloc((machine->state_count + 1) * sizeof(char*));
+  g->dotted = lucy_malloc((machine->state_count + 1) * sizeof(char*));
+  // Parents are numbered before their children.
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    IRState* state = &machine->states[s];
+    char* name = ir_string(g->ir, state->name);
+    bool nested = state->parent != IR_NONE;
+    g->paths[s] = join(nested ? g->paths[state->parent] : NULL, '_', name);
+    g->dotted[s] = join(nested ? g->dotted[state->parent] : NULL, '.', name);
+  }
+}
+
+static void destroy_gen(CGen* g) {
+  for(uint32_t s = 0; s < g->machine->state_count; s++) {
+    lucy_free(g->paths[s]);
+    lucy_free(g->dotted[s]);
+  }
+  lucy_free(g->paths);
+  lucy_free(g->dotted);
+  lucy_free(g->event_index);
+  lucy_free(g->events);
+  lucy_free(g->guard_ids);
+  lucy_free(g->action_ids);
+  lucy_free(g->name);
+  lucy_free(g->upper);
+}
+
+static void emit_state(CGen* g, uint32_t state) {
+  if(state == IR_NONE) {
+    emit(g, "%s_STATE_COUNT", g->upper);
+  } else {
+    emit(g, "%s_STATE_%s", g->upper, g->paths[state]);
+  }
+}
+
+// The state a state enters next: its nested machine's initial state, or the
+// first one when it has none.
+static uint32_t child_of(IRState* state) {
+  if(state->child_count == 0) {
+    return IR_NONE;
+  }
+  return state->initial != IR_NONE ? state->initial : state->child_start;
+}
+
+// Returns the transition if its guards pass.
+static void emit_return(CGen* g, uint32_t t, char* indent) {
+  if(g->machine->transitions[t].guard_count == 0) {
+    emit(g, "%sreturn %u;\n", indent, t);
+    return;
+  }
+  emit(g, "%sif(%s_guards(host, %u, event, data)) {\n%s  return %u;\n%s}\n",
+    indent, g->name, t, indent, t, indent);
+}
+
+static void emit_header(CGen* g, char* filename) {
+  IRMachine* machine = g->machine;
+  IRProgram* ir = g->ir;
+  char* name = g->name;
+  char* upper = g->upper;
+
+  emit(g, "// Generated by lc from %s. Do not edit.\n", filename);
+  emit(g, "#ifndef %s_H_\n#define %s_H_\n\n", upper, upper);
+  emit(g, "#include <stdbool.h>\n#include <stdint.h>\n\n");
+
+  emit(g, "typedef enum %s_state {\n", name);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    emit(g, "  %s_STATE_%s,\n", upper, g->paths[s]);
+  }
+  emit(g, "  %s_STATE_COUNT\n} %s_state;\n\n", upper, name);
+
+  emit(g, "// Transitions that aren't taken on an event pass %s_EVENT_COUNT.\n", upper);
+  emit(g, "typedef enum %s_event {\n", name);
+  for(uint32_t i = 0; i < g->event_count; i++) {
+    emit(g, "  %s_EVENT_%s,\n", upper, ir_string(ir, g->events[i]));
+  }
+  emit(g, "  %s_EVENT_COUNT\n} %s_event;\n\n", upper, name);
+
+  emit(g, "// Callbacks into the host, any of them can be NULL. Missing guards pass.\n");
+  emit(g, "typedef struct %s_host {\n  void* context;\n", name);
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    if(g->guard_ids[i] != IR_NONE) {
+      emit(g, "  bool (*guard_%s)(void* context, %s_event event, const void* data);\n",
+        ir_string(ir, i), name);
+    }
+  }
+  // Key is the context key an assign action sets, or NULL.
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    if(g->action_ids[i] != IR_NONE) {
+      emit(g, "  void (*action_%s)(void* context, const char* key, %s_event event, const void* data);\n",
+        ir_string(ir, i), name);
+    }
+  }
+  if(g->uses_assign) {
+    emit(g, "  // Sets key to the event data.\n");
+    emit(g, "  void (*assign)(void* context, const char* key, %s_event event, const void* data);\n", name);
+  }
+  if(g->has_delays) {
+    emit(g, "  // Call %s_timeout with the state and ms once ms have passed.\n", name);
+    emit(g, "  void (*schedule)(void* context, %s_state state, uint32_t ms);\n", name);
+  }
+  if(g->has_invokes) {
+    emit(g, "  // Call %s_done or %s_error with the id once src settles.\n", name, name);
+    emit(g, "  void (*invoke)(void* context, int id, const char* src);\n");
+  }
+  if(g->has_delays || g->has_invokes) {
+    emit(g, "  // The state was exited, what it scheduled or invoked can be dropped.\n");
+    emit(g, "  void (*cancel)(void* context, %s_state state);\n", name);
+  }
+  emit(g, "} %s_host;\n\n", name);
+
+  emit(g, "typedef struct %s_machine {\n", name);
+  emit(g, "  // The active leaf state, its parents are active too.\n");
+  emit(g, "  %s_state state;\n  const %s_host* host;\n} %s_machine;\n\n", name, name, name);
+
+  emit(g, "void %s_init(%s_machine*, const %s_host*);\n", name, name, name);
+  emit(g, "bool %s_send(%s_machine*, %s_event, const void* data);\n", name, name, name);
+  emit(g, "void %s_timeout(%s_machine*, %s_state, uint32_t ms);\n", name, name, name);
+  emit(g, "void %s_done(%s_machine*, int id, const void* data);\n", name, name);
+  emit(g, "void %s_error(%s_machine*, int id, const void* data);\n", name, name);
+  emit(g, "bool %s_in(const %s_machine*, %s_state);\n", name, name, name);
+  emit(g, "bool %s_is_final(const %s_machine*);\n", name, name);
+  emit(g, "const char* %s_state_name(%s_state);\n\n", name, name);
+
+  emit(g, "#endif\n");
+}
+
+static void emit_tables(CGen* g) {
+  IRMachine* machine = g->machine;
+  char* name = g->name;
+  char* upper = g->upper;
+
+  emit(g, "static const %s_state %s_parents[%s_STATE_COUNT + 1] = {\n", name, name, upper);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    emit(g, "  ");
+    emit_state(g, machine->states[s].parent);
+    emit(g, ",\n");
+  }
+  emit(g, "  %s_STATE_COUNT\n};\n\n", upper);
+
+  emit(g, "static const %s_state %s_children[%s_STATE_COUNT + 1] = {\n", name, name, upper);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    emit(g, "  ");
+    emit_state(g, child_of(&machine->states[s]));
+    emit(g, ",\n");
+  }
+  emit(g, "  %s_STATE_COUNT\n};\n\n", upper);
+
+  emit(g, "static const bool %s_final[%s_STATE_COUNT + 1] = {\n", name, upper);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    emit(g, "  %s,\n", machine->states[s].flags & IR_STATE_FINAL ? "true" : "false");
+  }
+  emit(g, "  false\n};\n\n");
+
+  emit(g, "static const char* const %s_names[%s_STATE_COUNT + 1] = {\n", name, upper);
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    emit(g, "  \"%s\",\n", g->dotted[s]);
+  }
+  emit(g, "  NULL\n};\n\n");
+
+  emit(g, "static const %s_state %s_targets[%u] = {\n", name, name, machine->transition_count + 1);
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    emit(g, "  ");
+    emit_state(g, machine->transitions[t].target);
+    emit(g, ",\n");
+  }
+  emit(g, "  %s_STATE_COUNT\n};\n\n", upper);
+
+  if(g->has_invokes) {
+    emit(g, "static const %s_state %s_invoke_states[%u] = {\n", name, name, machine->invoke_count);
+    for(uint32_t s = 0; s < machine->state_count; s++) {
+      for(uint32_t i = machine->invoke_offsets[s]; i < machine->invoke_offsets[s + 1]; i++) {
+        emit(g, "  ");
+        emit_state(g, s);
+        emit(g, ",\n");
+      }
+    }
+    emit(g, "};\n\n");
+  }
+}
+
+// Prints a table of ints, several to a line.
+static void emit_ints(CGen* g, char* type, char* name, uint32_t* values, uint32_t count) {
+  emit(g, "static const %s %s_%s[%u] = {", type, g->name, name, count);
+  for(uint32_t i = 0; i < count; i++) {
+    emit(g, i % 16 == 0 ? "\n  %u" : " %u", values[i]);
+    if(i + 1 < count) {
+      emit(g, ",");
+    }
+  }
+  emit(g, "\n};\n\n");
+}
+
+// Guards and actions are listed in transition order, the offsets of
+// transition t and t + 1 bound its entries.
+static uint32_t* list_offsets(CGen* g, bool guards) {
+  IRMachine* machine = g->machine;
+  uint32_t* offsets = lucy_malloc((machine->transition_count + 1) * sizeof(uint32_t));
+  uint32_t offset = 0;
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    offsets[t] = offset;
+    offset += guards ? transition->guard_count : transition->action_count;
+  }
+  offsets[machine->transition_count] = offset;
+  return offsets;
+}
+
+static void emit_guards(CGen* g) {
+  IRMachine* machine = g->machine;
+  IRProgram* ir = g->ir;
+  char* name = g->name;
+
+  // Sized by what the transitions use, not guard_count.
+  uint32_t* offsets = list_offsets(g, true);
+  uint32_t count = offsets[machine->transition_count];
+  uint32_t* list = lucy_malloc((count == 0 ? 1 : count) * sizeof(uint32_t));
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    for(uint32_t i = 0; i < transition->guard_count; i++) {
+      list[offsets[t] + i] = g->guard_ids[guard_fn(g, &machine->guards[transition->guard_start + i])];
+    }
+  }
+  emit_ints(g, "uint32_t", "guard_offsets", offsets, machine->transition_count + 1);
+  emit_ints(g, "uint16_t", "guard_list", list, count);
+  lucy_free(offsets);
+  lucy_free(list);
+
+  emit(g, "static bool %s_guard(const %s_host* host, int guard, %s_event event, const void* data) {\n",
+    name, name, name);
+  emit(g, "  switch(guard) {\n");
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    if(g->guard_ids[i] != IR_NONE) {
+      char* fn = ir_string(ir, i);
+      emit(g, "    case %u:\n", g->guard_ids[i]);
+      emit(g, "      return host->guard_%s == NULL || host->guard_%s(host->context, event, data);\n", fn, fn);
+    }
+  }
+  emit(g, "    default:\n      return true;\n  }\n}\n\n");
+
+  emit(g, "// Whether a transition's guards pass, true for transitions without any.\n");
+  emit(g, "static bool %s_guards(const %s_host* host, int transition, %s_event event, const void* data) {\n",
+    name, name, name);
+  emit(g, "  for(uint32_t i = %s_guard_offsets[transition]; i < %s_guard_offsets[transition + 1]; i++) {\n",
+    name, name);
+  emit(g, "    if(!%s_guard(host, %s_guard_list[i], event, data)) {\n      return false;\n    }\n  }\n", name, name);
+  emit(g, "  return true;\n}\n\n");
+}
+
+// Event transitions are keyed by event, so the last one for an event is
+// the one that counts. Dispatch is a table lookup unless the table would
+// be too large, then a switch per state.
+static void emit_select(CGen* g) {
+  IRMachine* machine = g->machine;
+  char* name = g->name;
+  char* upper = g->upper;
+  uint32_t* rows = machine->offsets[IR_EVENT];
+  uint32_t events = g->event_count + 1;
+  bool dense = (uint64_t)(machine->state_count + 1) * events <= CC_DENSE_LIMIT;
+  int* row = lucy_malloc(events * sizeof(int));
+
+  if(dense) {
+    emit(g, "// The transition taken per state and event, or -1.\n");
+    emit(g, "static const int %s_events[%s_STATE_COUNT + 1][%s_EVENT_COUNT + 1] = {\n", name, upper, upper);
+    for(uint32_t s = 0; s <= machine->state_count; s++) {
+      for(uint32_t e = 0; e < events; e++) {
+        row[e] = -1;
+      }
+      for(uint32_t t = s < machine->state_count ? rows[s] : 0; s < machine->state_count && t < rows[s + 1]; t++) {
+        row[g->event_index[machine->transitions[t].event]] = t;
+      }
+      emit(g, "  {");
+      for(uint32_t e = 0; e < events; e++) {
+        emit(g, e == 0 ? " %d" : ", %d", row[e]);
+      }
+      emit(g, s < machine->state_count ? " },\n" : " }\n");
+    }
+    emit(g, "};\n\n");
+  }
+
+  emit(g, "static int %s_select(const %s_host* host, %s_state state, %s_event event, const void* data) {\n",
+    name, name, name, name);
+  if(dense) {
+    emit(g, "  int transition = %s_events[state][event];\n", name);
+    if(machine->guard_count > 0) {
+      emit(g, "  if(transition >= 0 && !%s_guards(host, transition, event, data)) {\n    return -1;\n  }\n", name);
+    } else {
+      emit(g, "  (void)host;\n  (void)data;\n");
+    }
+    emit(g, "  return transition;\n}\n\n");
+    lucy_free(row);
+    return;
+  }
+
+  // The row doubles as the last state each event was seen in.
+  for(uint32_t e = 0; e < events; e++) {
+    row[e] = -1;
+  }
+  emit(g, "  (void)host;\n  (void)data;\n  switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(rows[s] == rows[s + 1]) {
+      continue;
+    }
+    emit(g, "    case %s_STATE_%s:\n      switch(event) {\n", upper, g->paths[s]);
+    for(uint32_t t = rows[s + 1]; t > rows[s]; t--) {
+      uint32_t event = g->event_index[machine->transitions[t - 1].event];
+      if(row[event] == (int)s) {
+        continue;
+      }
+      row[event] = s;
+      emit(g, "        case %s_EVENT_%s:\n", upper, ir_string(g->ir, g->events[event]));
+      emit_return(g, t - 1, "          ");
+      if(machine->transitions[t - 1].guard_count > 0) {
+        emit(g, "          return -1;\n");
+      }
+    }
+    emit(g, "        default:\n          return -1;\n      }\n");
+  }
+  emit(g, "    default:\n      return -1;\n  }\n}\n\n");
+
+  lucy_free(row);
+}
+
+// The first always transition whose guards pass is taken.
+static void emit_select_always(CGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t* rows = machine->offsets[IR_ALWAYS];
+
+  emit(g, "static int %s_select_always(const %s_host* host, %s_state state, %s_event event, const void* data) {\n",
+    g->name, g->name, g->name, g->name);
+  emit(g, "  (void)host;\n  (void)event;\n  (void)data;\n  switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(rows[s] == rows[s + 1]) {
+      continue;
+    }
+    emit(g, "    case %s_STATE_%s:\n", g->upper, g->paths[s]);
+    bool returned = false;
+    for(uint32_t t = rows[s]; t < rows[s + 1] && !returned; t++) {
+      emit_return(g, t, "      ");
+      returned = machine->transitions[t].guard_count == 0;
+    }
+    if(!returned) {
+      emit(g, "      return -1;\n");
+    }
+  }
+  emit(g, "    default:\n      return -1;\n  }\n}\n\n");
+}
+
+// Delayed transitions are keyed by ms, the last one for a delay counts.
+static void emit_select_delay(CGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t* rows = machine->offsets[IR_DELAY];
+
+  emit(g, "static int %s_select_delay(const %s_host* host, %s_state state, uint32_t ms, %s_event event, const void* data) {\n",
+    g->name, g->name, g->name, g->name);
+  emit(g, "  (void)host;\n  (void)event;\n  (void)data;\n  switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(rows[s] == rows[s + 1]) {
+      continue;
+    }
+    emit(g, "    case %s_STATE_%s:\n", g->upper, g->paths[s]);
+    for(uint32_t t = rows[s]; t < rows[s + 1]; t++) {
+      IRTransition* transition = &machine->transitions[t];
+      bool last = true;
+      for(uint32_t later = t + 1; later < rows[s + 1]; later++) {
+        if(machine->transitions[later].delay == transition->delay) {
+          last = false;
+          break;
+        }
+      }
+      if(!last) {
+        continue;
+      }
+      emit(g, "      if(ms == %uu", transition->delay);
+      if(transition->guard_count > 0) {
+        emit(g, " && %s_guards(host, %u, event, data)", g->name, t);
+      }
+      emit(g, ") {\n        return %u;\n      }\n", t);
+    }
+    emit(g, "      return -1;\n");
+  }
+  emit(g, "    default:\n      return -1;\n  }\n}\n\n");
+}
+
+static void emit_select_settled(CGen* g) {
+  IRMachine* machine = g->machine;
+
+  emit(g, "static int %s_select_settled(const %s_host* host, int id, bool error, %s_event event, const void* data) {\n",
+    g->name, g->name, g->name);
+  emit(g, "  (void)host;\n  (void)event;\n  (void)data;\n  switch(id) {\n");
+  for(uint32_t i = 0; i < machine->invoke_count; i++) {
+    uint32_t* done = machine->offsets[IR_DONE];
+    uint32_t* error = machine->offsets[IR_ERROR];
+    if(done[i] == done[i + 1] && error[i] == error[i + 1]) {
+      continue;
+    }
+    emit(g, "    case %u:\n", i);
+    for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+      uint32_t* rows = machine->offsets[kind];
+      if(rows[i] == rows[i + 1]) {
+        continue;
+      }
+      uint32_t t = rows[i + 1] - 1;
+      IRTransition* transition = &machine->transitions[t];
+      emit(g, "      if(%s", kind == IR_DONE ? "!error" : "error");
+      if(transition->guard_count > 0) {
+        emit(g, " && %s_guards(host, %u, event, data)", g->name, t);
+      }
+      emit(g, ") {\n        return %u;\n      }\n", t);
+    }
+    emit(g, "      return -1;\n");
+  }
+  emit(g, "    default:\n      return -1;\n  }\n}\n\n");
+}
+
+static void emit_actions(CGen* g) {
+  IRMachine* machine = g->machine;
+  IRProgram* ir = g->ir;
+  char* name = g->name;
+
+  uint32_t* offsets = list_offsets(g, false);
+  uint32_t count = offsets[machine->transition_count];
+  uint32_t* list = lucy_malloc((count == 0 ? 1 : count) * sizeof(uint32_t));
+  uint32_t* keys = lucy_malloc((count == 0 ? 1 : count) * sizeof(uint32_t));
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    for(uint32_t i = 0; i < transition->action_count; i++) {
+      IRRef* ref = &machine->actions[transition->action_start + i];
+      uint32_t index = offsets[t] + i;
+      switch(ref->type) {
+        case IR_REF_BINDING: {
+          list[index] = g->action_ids[machine->bindings[ref->id].ref];
+          keys[index] = machine->bindings[ref->id].key;
+          break;
+        }
+        case IR_REF_INLINE: {
+          list[index] = g->action_ids[ref->id];
+          keys[index] = IR_NONE;
+          break;
+        }
+        case IR_REF_ASSIGN: {
+          list[index] = g->action_fn_count;
+          keys[index] = ref->id;
+          break;
+        }
+      }
+    }
+  }
+  emit_ints(g, "uint32_t", "action_offsets", offsets, machine->transition_count + 1);
+  emit_ints(g, "uint16_t", "action_list", list, count);
+
+  // The context key each action assigns, if any.
+  emit(g, "static const char* const %s_action_keys[%u] = {\n", name, count);
+  for(uint32_t i = 0; i < count; i++) {
+    char* separator = i + 1 < count ? "," : "";
+    if(keys[i] == IR_NONE) {
+      emit(g, "  NULL%s\n", separator);
+    } else {
+      emit(g, "  \"%s\"%s\n", ir_string(ir, keys[i]), separator);
+    }
+  }
+  emit(g, "};\n\n");
+  lucy_free(offsets);
+  lucy_free(list);
+  lucy_free(keys);
+
+  emit(g, "static void %s_action(const %s_host* host, int action, const char* key, %s_event event, const void* data) {\n",
+    name, name, name);
+  emit(g, "  switch(action) {\n");
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    if(g->action_ids[i] != IR_NONE) {
+      char* fn = ir_string(ir, i);
+      emit(g, "    case %u:\n", g->action_ids[i]);
+      emit(g, "      if(host->action_%s != NULL) {\n", fn);
+      emit(g, "        host->action_%s(host->context, key, event, data);\n      }\n      break;\n", fn);
+    }
+  }
+  if(g->uses_assign) {
+    emit(g, "    case %u:\n", g->action_fn_count);
+    emit(g, "      if(host->assign != NULL) {\n");
+    emit(g, "        host->assign(host->context, key, event, data);\n      }\n      break;\n");
+  }
+  emit(g, "    default:\n      break;\n  }\n}\n\n");
+
+  emit(g, "static void %s_actions(const %s_host* host, int transition, %s_event event, const void* data) {\n",
+    name, name, name);
+  emit(g, "  for(uint32_t i = %s_action_offsets[transition]; i < %s_action_offsets[transition + 1]; i++) {\n",
+    name, name);
+  emit(g, "    %s_action(host, %s_action_list[i], %s_action_keys[i], event, data);\n  }\n}\n\n", name, name, name);
+}
+
+// Schedules a state's delays and starts its invokes as it's entered.
+static void emit_activate(CGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t* rows = machine->offsets[IR_DELAY];
+
+  emit(g, "static void %s_activate(const %s_host* host, %s_state state) {\n", g->name, g->name, g->name);
+  emit(g, "  switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    uint32_t invoke_start = machine->invoke_offsets[s];
+    uint32_t invoke_end = machine->invoke_offsets[s + 1];
+    if(rows[s] == rows[s + 1] && invoke_start == invoke_end) {
+      continue;
+    }
+
+    emit(g, "    case %s_STATE_%s:\n", g->upper, g->paths[s]);
+    if(rows[s] < rows[s + 1]) {
+      emit(g, "      if(host->schedule != NULL) {\n");
+      for(uint32_t t = rows[s]; t < rows[s + 1]; t++) {
+        uint32_t delay = machine->transitions[t].delay;
+        bool first = true;
+        for(uint32_t earlier = rows[s]; earlier < t; earlier++) {
+          if(machine->transitions[earlier].delay == delay) {
+            first = false;
+            break;
+          }
+        }
+        if(first) {
+          emit(g, "        host->schedule(host->context, state, %uu);\n", delay);
+        }
+      }
+      emit(g, "      }\n");
+    }
+    if(invoke_start < invoke_end) {
+      emit(g, "      if(host->invoke != NULL) {\n");
+      for(uint32_t i = invoke_start; i < invoke_end; i++) {
+        emit(g, "        host->invoke(host->context, %u, \"%s\");\n", i,
+          ir_string(g->ir, machine->invokes[i].src));
+      }
+      emit(g, "      }\n");
+    }
+    emit(g, "      break;\n");
+  }
+  emit(g, "    default:\n      break;\n  }\n}\n\n");
+}
+
+static void emit_runtime(CGen* g) {
+  IRMachine* machine = g->machine;
+  char* name = g->name;
+  char* upper = g->upper;
+  bool has_activities = g->has_delays || g->has_invokes;
+
+  emit(g, "static void %s_enter(%s_machine* m, %s_state state) {\n", name, name, name);
+  emit(g, "  while(state != %s_STATE_COUNT) {\n", upper);
+  if(has_activities) {
+    emit(g, "    %s_activate(m->host, state);\n", name);
+  }
+  emit(g, "    m->state = state;\n    state = %s_children[state];\n  }\n}\n\n", name);
+
+  if(has_activities) {
+    emit(g, "// Exits the active states up to and including until.\n");
+    emit(g, "static void %s_exit(%s_machine* m, %s_state until) {\n", name, name, name);
+    emit(g, "  const %s_host* host = m->host;\n", name);
+    emit(g, "  %s_state state = m->state;\n", name);
+    emit(g, "  while(state != %s_STATE_COUNT) {\n", upper);
+    emit(g, "    if(host->cancel != NULL) {\n      host->cancel(host->context, state);\n    }\n");
+    emit(g, "    if(state == until) {\n      break;\n    }\n");
+    emit(g, "    state = %s_parents[state];\n  }\n}\n\n", name);
+  }
+
+  emit(g, "static void %s_step(%s_machine* m, %s_state source, int transition, %s_event event, const void* data) {\n",
+    name, name, name, name);
+  if(has_activities) {
+    emit(g, "  %s_exit(m, source);\n", name);
+  } else {
+    emit(g, "  (void)source;\n");
+  }
+  if(g->has_actions) {
+    emit(g, "  %s_actions(m->host, transition, event, data);\n", name);
+  } else {
+    emit(g, "  (void)event;\n  (void)data;\n");
+  }
+  emit(g, "  %s_enter(m, %s_targets[transition]);\n}\n\n", name, name);
+
+  emit(g, "// Takes enabled always transitions, bounded so that ones which cycle\n");
+  emit(g, "// can't hang the host.\n");
+  emit(g, "static void %s_settle(%s_machine* m) {\n", name, name);
+  if(g->has_always) {
+    emit(g, "  for(int i = 0; i <= %s_STATE_COUNT; i++) {\n", upper);
+    emit(g, "    int transition = -1;\n");
+    emit(g, "    %s_state source = m->state;\n", name);
+    emit(g, "    while(source != %s_STATE_COUNT) {\n", upper);
+    emit(g, "      transition = %s_select_always(m->host, source, %s_EVENT_COUNT, NULL);\n", name, upper);
+    emit(g, "      if(transition >= 0) {\n        break;\n      }\n");
+    emit(g, "      source = %s_parents[source];\n    }\n", name);
+    emit(g, "    if(transition < 0) {\n      return;\n    }\n");
+    emit(g, "    %s_step(m, source, transition, %s_EVENT_COUNT, NULL);\n  }\n", name, upper);
+  } else {
+    emit(g, "  (void)m;\n");
+  }
+  emit(g, "}\n\n");
+
+  emit(g, "static void %s_take(%s_machine* m, %s_state source, int transition, %s_event event, const void* data) {\n",
+    name, name, name, name);
+  emit(g, "  %s_step(m, source, transition, event, data);\n  %s_settle(m);\n}\n\n", name, name);
+
+  if(g->has_invokes) {
+    emit(g, "static void %s_settled(%s_machine* m, int id, bool error, const void* data) {\n", name, name);
+    emit(g, "  if(id < 0 || id >= %u) {\n    return;\n  }\n", machine->invoke_count);
+    emit(g, "  %s_state state = %s_invoke_states[id];\n", name, name);
+    emit(g, "  if(!%s_in(m, state)) {\n    return;\n  }\n", name);
+    emit(g, "  int transition = %s_select_settled(m->host, id, error, %s_EVENT_COUNT, data);\n", name, upper);
+    emit(g, "  if(transition >= 0) {\n");
+    emit(g, "    %s_take(m, state, transition, %s_EVENT_COUNT, data);\n  }\n}\n\n", name, upper);
+  }
+
+  // Public functions
+  uint32_t initial = machine->initial;
+  if(initial == IR_NONE && machine->top_count > 0) {
+    initial = 0;
+  }
+  emit(g, "void %s_init(%s_machine* m, const %s_host* host) {\n", name, name, name);
+  emit(g, "  m->state = %s_STATE_COUNT;\n  m->host = host;\n  %s_enter(m, ", upper, name);
+  emit_state(g, initial);
+  emit(g, ");\n  %s_settle(m);\n}\n\n", name);
+
+  emit(g, "bool %s_send(%s_machine* m, %s_event event, const void* data) {\n", name, name, name);
+  emit(g, "  for(%s_state state = m->state; state != %s_STATE_COUNT; state = %s_parents[state]) {\n",
+    name, upper, name);
+  emit(g, "    int transition = %s_select(m->host, state, event, data);\n", name);
+  emit(g, "    if(transition >= 0) {\n");
+  emit(g, "      %s_take(m, state, transition, event, data);\n      return true;\n    }\n  }\n", name);
+  emit(g, "  return false;\n}\n\n");
+
+  emit(g, "void %s_timeout(%s_machine* m, %s_state state, uint32_t ms) {\n", name, name, name);
+  if(g->has_delays) {
+    emit(g, "  if(!%s_in(m, state)) {\n    return;\n  }\n", name);
+    emit(g, "  int transition = %s_select_delay(m->host, state, ms, %s_EVENT_COUNT, NULL);\n", name, upper);
+    emit(g, "  if(transition >= 0) {\n");
+    emit(g, "    %s_take(m, state, transition, %s_EVENT_COUNT, NULL);\n  }\n", name, upper);
+  } else {
+    emit(g, "  (void)m;\n  (void)state;\n  (void)ms;\n");
+  }
+  emit(g, "}\n\n");
+
+  for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+    emit(g, "void %s_%s(%s_machine* m, int id, const void* data) {\n", name,
+      kind == IR_DONE ? "done" : "error", name);
+    if(g->has_invokes) {
+      emit(g, "  %s_settled(m, id, %s, data);\n", name, kind == IR_DONE ? "false" : "true");
+    } else {
+      emit(g, "  (void)m;\n  (void)id;\n  (void)data;\n");
+    }
+    emit(g, "}\n\n");
+  }
+
+  emit(g, "bool %s_in(const %s_machine* m, %s_state state) {\n", name, name, name);
+  emit(g, "  for(%s_state active = m->state; active != %s_STATE_COUNT; active = %s_parents[active]) {\n",
+    name, upper, name);
+  emit(g, "    if(active == state) {\n      return true;\n    }\n  }\n  return false;\n}\n\n");
+
+  emit(g, "// Whether the machine reached one of its own final states.\n");
+  emit(g, "bool %s_is_final(const %s_machine* m) {\n", name, name);
+  emit(g, "  %s_state state = m->state;\n", name);
+  emit(g, "  while(state != %s_STATE_COUNT && %s_parents[state] != %s_STATE_COUNT) {\n", upper, name, upper);
+  emit(g, "    state = %s_parents[state];\n  }\n", name);
+  emit(g, "  return %s_final[state];\n}\n\n", name);
+
+  emit(g, "const char* %s_state_name(%s_state state) {\n", name, name);
+  emit(g, "  return state < %s_STATE_COUNT ? %s_names[state] : NULL;\n}\n", upper, name);
+}
+
+static void emit_source(CGen* g, char* filename) {
+  emit(g, "// Generated by lc from %s. Do not edit.\n", filename);
+  emit(g, "#include <stddef.h>\n#include \"%s.h\"\n\n", g->name);
+
+  emit_tables(g);
+  if(g->machine->guard_count > 0) {
+    emit_guards(g);
+  }
+  emit_select(g);
+  if(g->has_always) {
+    emit_select_always(g);
+  }
+  if(g->has_delays) {
+    emit_select_delay(g);
+  }
+  if(g->has_invokes) {
+    emit_select_settled(g);
+  }
+  if(g->has_actions) {
+    emit_actions(g);
+  }
+  if(g->has_delays || g->has_invokes) {
+    emit_activate(g);
+  }
+  emit_runtime(g);
+}
+
+static CFile* add_file(CCompileResult* result, char* name, char* extension) {
+  result->files = lucy_realloc(result->files, (result->file_count + 1) * sizeof(CFile));
+  CFile* file = &result->files[result->file_count++];
+  file->name = join(name, '.', extension);
+  file->contents = NULL;
+  return file;
+}
+
+static void compile_machine(CCompileResult* result, IRProgram* ir, IRMachine* machine, char* filename) {
+  CGen g = {0};
+  g.ir = ir;
+  g.machine = machine;
+  g.sb = str_builder_create();
+
+  if(machine->name == IR_NONE) {
+    g.name = name_from_filename(filename);
+  } else {
+    char* name = ir_string(ir, machine->name);
+    g.name = lucy_malloc(strlen(name) + 1);
+    strcpy(g.name, name);
+  }
+  g.upper = lucy_malloc(strlen(g.name) + 1);
+  for(size_t i = 0; i <= strlen(g.name); i++) {
+    g.upper[i] = toupper((unsigned char)g.name[i]);
+  }
+
+  collect(&g);
+
+  emit_header(&g, filename);
+  add_file(result, g.name, "h")->contents = str_builder_dump(g.sb, NULL);
+  str_builder_clear(g.sb);
+
+  emit_source(&g, filename);
+  add_file(result, g.name, "c")->contents = str_builder_dump(g.sb, NULL);
+
+  str_builder_destroy(g.sb);
+  destroy_gen(&g);
+}
+
+CCompileResult* cc_create() {
+  CCompileResult* result = lucy_malloc(sizeof(*result));
+  return result;
+}
+
+void cc_init(CCompileResult* result, int flags) {
+  result->success = false;
+  result->flags = flags;
+  result->files = NULL;
+  result->file_count = 0;
+  result->stats = NULL;
+  diagnostics_init(&result->diagnostics);
+  result->allocator = NULL;
+}
+
+void cc_enable_stats(CCompileResult* result) {
+  if(result->stats == NULL) {
+    result->stats = stats_create();
+  }
+}
+
+void cc_set_allocator(CCompileResult* result, const LucyAllocator* allocator) {
+  result->allocator = allocator;
+}
+
+void cc_emit(CCompileResult* result, IRProgram* ir, char* filename) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    compile_machine(result, ir, &ir->machines[i], filename);
+  }
+  result->success = true;
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+
+  if(result->stats != NULL) {
+    for(size_t i = 0; i < result->file_count; i++) {
+      result->stats->bytes_emitted += strlen(result->files[i].contents);
+    }
+  }
+}
+
+void compile_c(CCompileResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  if(result->stats != NULL) {
+    stats_start(result->stats);
+    result->stats->source_bytes = strlen(source);
+  }
+
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & CC_FLAG_MINIMIZE, result->flags & CC_FLAG_OPTIMIZE, &result->diagnostics);
+
+  if(ir == NULL) {
+    result->success = false;
+    lucy_set_allocator(outer);
+    stats_stop();
+    return;
+  }
+
+  cc_emit(result, ir, filename);
+  ir_destroy(ir);
+  lucy_set_allocator(outer);
+  stats_stop();
+}
+
+Stats* cc_get_stats(CCompileResult* result) {
+  return result->stats;
+}
+
+void destroy_c_result(CCompileResult* result) {
+  for(size_t i = 0; i < result->file_count; i++) {
+    lucy_free(result->files[i].name);
+    lucy_free(result->files[i].contents);
+  }
+  if(result->files != NULL) {
+    lucy_free(result->files);
+  }
+  if(result->stats != NULL) {
+    stats_destroy(result->stats);
+  }
+  diagnostics_destroy(&result->diagnostics);
+  lucy_free(result);
+}
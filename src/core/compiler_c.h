@@ -0,0 +1,42 @@
+#ifndef LUCY_COMPILER_C_H_
+#define LUCY_COMPILER_C_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "ir.h"
+#include "stats.h"
+
+// Flags for cc_init, the same bits as the XState ones they mirror.
+#define CC_FLAG_OPTIMIZE 1 << 1
+#define CC_FLAG_MINIMIZE 1 << 2
+
+typedef struct CFile {
+  char* name;
+  char* contents;
+} CFile;
+
+// A header and source file per machine.
+typedef struct CCompileResult {
+  bool success;
+  int flags;
+  CFile* files;
+  size_t file_count;
+  Stats* stats;
+  Diagnostics diagnostics;
+  const LucyAllocator* allocator;
+} CCompileResult;
+
+CCompileResult* cc_create();
+void cc_init(CCompileResult*, int);
+void cc_enable_stats(CCompileResult*);
+void cc_set_allocator(CCompileResult*, const LucyAllocator*);
+void compile_c(CCompileResult*, char*, char*);
+// Emits a program from frontend_compile without changing it. The filename
+// names an unnamed machine's files.
+void cc_emit(CCompileResult*, IRProgram*, char*);
+Stats* cc_get_stats(CCompileResult*);
+void destroy_c_result(CCompileResult*);
+
+#endif
@@ -0,0 +1,596 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "alloc.h"
+#include "ir.h"
+#include "frontend.h"
+#include "str_builder.h"
+#include "compiler_xstate.h"
+#include "compiler_js.h"
+#include "stats.h"
+
+// Emitted once per module. Machines are tables plus select functions that
+// return the transition taken from a state, the interpreter walks from the
+// active leaf state up through its parents and keeps the context.
+static const char* runtime =
+  "function __interpret(machine, context = {}) {\n"
+  "  const { parents, children, targets, actions } = machine;\n"
+  "  const listeners = new Set();\n"
+  "  const activities = new Map();\n"
+  "  let state = -1;\n"
+  "  let running = false;\n"
+  "\n"
+  "  function active(s) {\n"
+  "    for(let a = state; a !== -1; a = parents[a]) {\n"
+  "      if(a === s) {\n"
+  "        return true;\n"
+  "      }\n"
+  "    }\n"
+  "    return false;\n"
+  "  }\n"
+  "\n"
+  "  function fire(s, event) {\n"
+  "    if(running && active(s)) {\n"
+  "      const t = machine.select(s, event, context);\n"
+  "      if(t !== -1) {\n"
+  "        take(s, t, event);\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  // Settled invokes report back as done:id and error:id events.\n"
+  "  function invoke(s, id, src, event) {\n"
+  "    let live = true;\n"
+  "    const settle = type => data => {\n"
+  "      if(live) {\n"
+  "        fire(s, { type: type + id, data });\n"
+  "      }\n"
+  "    };\n"
+  "    if(typeof src === 'object') {\n"
+  "      const child = __interpret(src).start();\n"
+  "      const subscription = child.subscribe(snapshot => {\n"
+  "        if(snapshot.done) {\n"
+  "          Promise.resolve(snapshot.context).then(settle('done:'));\n"
+  "        }\n"
+  "      });\n"
+  "      return () => {\n"
+  "        live = false;\n"
+  "        subscription.unsubscribe();\n"
+  "        child.stop();\n"
+  "      };\n"
+  "    }\n"
+  "    Promise.resolve().then(() => src(context, event)).then(settle('done:'), settle('error:'));\n"
+  "    return () => {\n"
+  "      live = false;\n"
+  "    };\n"
+  "  }\n"
+  "\n"
+  "  // Delays fire after:ms events at the state that scheduled them.\n"
+  "  function activate(s, event) {\n"
+  "    const delays = machine.delays && machine.delays[s];\n"
+  "    const invokes = machine.invokes && machine.invokes[s];\n"
+  "    if(!delays && !invokes) {\n"
+  "      return;\n"
+  "    }\n"
+  "    const stops = [];\n"
+  "    for(const ms of delays || []) {\n"
+  "      const timer = setTimeout(fire, ms, s, { type: 'after:' + ms });\n"
+  "      stops.push(() => clearTimeout(timer));\n"
+  "    }\n"
+  "    for(const [id, src] of invokes || []) {\n"
+  "      stops.push(invoke(s, id, src, event));\n"
+  "    }\n"
+  "    activities.set(s, stops);\n"
+  "  }\n"
+  "\n"
+  "  // Exits the active states up to and including until.\n"
+  "  function exit(until) {\n"
+  "    for(let a = state; a !== -1; a = parents[a]) {\n"
+  "      const stops = activities.get(a);\n"
+  "      if(stops) {\n"
+  "        activities.delete(a);\n"
+  "        for(const stop of stops) {\n"
+  "          stop();\n"
+  "        }\n"
+  "      }\n"
+  "      if(a === until) {\n"
+  "        break;\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  function enter(s, event) {\n"
+  "    for(; s !== -1; s = children[s]) {\n"
+  "      state = s;\n"
+  "      activate(s, event);\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  // Actions are [key, fn] pairs, a null key calls fn for its effect and a\n"
+  "  // null fn assigns the event's data. The context is copied at most once.\n"
+  "  function step(source, t, event) {\n"
+  "    exit(source);\n"
+  "    const list = actions[t];\n"
+  "    if(list !== null) {\n"
+  "      let next = context;\n"
+  "      for(const [key, fn] of list) {\n"
+  "        if(key === null) {\n"
+  "          fn(next, event);\n"
+  "          continue;\n"
+  "        }\n"
+  "        if(next === context) {\n"
+  "          next = { ...context };\n"
+  "        }\n"
+  "        next[key] = fn === null ? event.data : fn(next, event);\n"
+  "      }\n"
+  "      context = next;\n"
+  "    }\n"
+  "    enter(targets[t], event);\n"
+  "  }\n"
+  "\n"
+  "  // Takes enabled always transitions, bounded so that ones which cycle\n"
+  "  // can't hang, then tells the listeners.\n"
+  "  function settle(event) {\n"
+  "    for(let i = 0; machine.always && i <= parents.length; i++) {\n"
+  "      let source = state;\n"
+  "      let t = -1;\n"
+  "      while(source !== -1 && (t = machine.always(source, event, context)) === -1) {\n"
+  "        source = parents[source];\n"
+  "      }\n"
+  "      if(t === -1) {\n"
+  "        break;\n"
+  "      }\n"
+  "      step(source, t, event);\n"
+  "    }\n"
+  "\n"
+  "    let top = state;\n"
+  "    while(top !== -1 && parents[top] !== -1) {\n"
+  "      top = parents[top];\n"
+  "    }\n"
+  "    const done = top !== -1 && machine.final[top];\n"
+  "    service.state = { value: machine.names[state], context, done };\n"
+  "    if(done) {\n"
+  "      exit(-1);\n"
+  "      running = false;\n"
+  "    }\n"
+  "    for(const listener of listeners) {\n"
+  "      listener(service.state);\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  function take(source, t, event) {\n"
+  "    step(source, t, event);\n"
+  "    settle(event);\n"
+  "  }\n"
+  "\n"
+  "  const service = {\n"
+  "    state: undefined,\n"
+  "    start() {\n"
+  "      if(!running && service.state === undefined) {\n"
+  "        const event = { type: 'init' };\n"
+  "        running = true;\n"
+  "        enter(machine.initial, event);\n"
+  "        settle(event);\n"
+  "      }\n"
+  "      return service;\n"
+  "    },\n"
+  "    send(event) {\n"
+  "      if(typeof event === 'string') {\n"
+  "        event = { type: event };\n"
+  "      }\n"
+  "      for(let a = running ? state : -1; a !== -1; a = parents[a]) {\n"
+  "        const t = machine.select(a, event, context);\n"
+  "        if(t !== -1) {\n"
+  "          take(a, t, event);\n"
+  "          break;\n"
+  "        }\n"
+  "      }\n"
+  "      return service.state;\n"
+  "    },\n"
+  "    subscribe(listener) {\n"
+  "      listeners.add(listener);\n"
+  "      if(service.state !== undefined) {\n"
+  "        listener(service.state);\n"
+  "      }\n"
+  "      return { unsubscribe: () => listeners.delete(listener) };\n"
+  "    },\n"
+  "    stop() {\n"
+  "      exit(-1);\n"
+  "      running = false;\n"
+  "      return service;\n"
+  "    }\n"
+  "  };\n"
+  "  return service;\n"
+  "}\n"
+  "\n"
+  "export { __interpret as interpret };\n";
+
+typedef struct JSGen {
+  IRProgram* ir;
+  IRMachine* machine;
+  str_builder_t* sb;
+
+  // Scratch space for emit_path.
+  uint32_t* path;
+  uint32_t path_capacity;
+} JSGen;
+
+static void emit(JSGen* g, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  str_builder_add_vfmt(g->sb, fmt, args);
+  va_end(args);
+}
+
+// Prints a table prop, several entries to a line. Entries are ints, or
+// null where the value is -1.
+static void emit_list(JSGen* g, char* name, int32_t* values, uint32_t count) {
+  emit(g, "  %s: [", name);
+  for(uint32_t i = 0; i < count; i++) {
+    if(i > 0) {
+      emit(g, i % 16 == 0 ? ",\n    " : ", ");
+    }
+    emit(g, "%d", values[i]);
+  }
+  emit(g, "],\n");
+}
+
+static uint32_t guard_fn(JSGen* g, IRRef* ref) {
+  return ref->type == IR_REF_BINDING ? g->machine->bindings[ref->id].ref : ref->id;
+}
+
+static void emit_guards(JSGen* g, IRTransition* transition) {
+  for(uint32_t i = 0; i < transition->guard_count; i++) {
+    IRRef* ref = &g->machine->guards[transition->guard_start + i];
+    emit(g, i > 0 ? " && %s(context, event)" : "%s(context, event)", ir_string(g->ir, guard_fn(g, ref)));
+  }
+}
+
+// Returns the transition, or -1 if its guards don't pass.
+static void emit_return(JSGen* g, uint32_t t, char* indent, bool fallthrough) {
+  IRTransition* transition = &g->machine->transitions[t];
+  if(transition->guard_count == 0) {
+    emit(g, "%sreturn %u;\n", indent, t);
+  } else if(fallthrough) {
+    emit(g, "%sif(", indent);
+    emit_guards(g, transition);
+    emit(g, ") {\n%s  return %u;\n%s}\n", indent, t, indent);
+  } else {
+    emit(g, "%sreturn ", indent);
+    emit_guards(g, transition);
+    emit(g, " ? %u : -1;\n", t);
+  }
+}
+
+static void emit_event_case(JSGen* g, char* prefix, uint32_t id, uint32_t t) {
+  emit(g, "          case '%s%u':\n", prefix, id);
+  emit_return(g, t, "            ", false);
+}
+
+// Event, delay, done and error transitions are keyed by event type, so the
+// last one for a type is the one that counts.
+static void emit_select(JSGen* g) {
+  IRMachine* machine = g->machine;
+  IRProgram* ir = g->ir;
+  uint32_t* rows = machine->offsets[IR_EVENT];
+  uint32_t* delays = machine->offsets[IR_DELAY];
+  uint32_t* stamps = lucy_malloc((ir->strings.count + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    stamps[i] = IR_NONE;
+  }
+
+  emit(g, "  select(state, event, context) {\n    switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    uint32_t invoke_start = machine->invoke_offsets[s];
+    uint32_t invoke_end = machine->invoke_offsets[s + 1];
+    bool has_settled = false;
+    for(uint32_t i = invoke_start; i < invoke_end; i++) {
+      has_settled = has_settled || machine->offsets[IR_DONE][i] < machine->offsets[IR_DONE][i + 1] ||
+        machine->offsets[IR_ERROR][i] < machine->offsets[IR_ERROR][i + 1];
+    }
+    if(rows[s] == rows[s + 1] && delays[s] == delays[s + 1] && !has_settled) {
+      continue;
+    }
+
+    emit(g, "      case %u:\n        switch(event.type) {\n", s);
+    for(uint32_t t = rows[s + 1]; t > rows[s]; t--) {
+      uint32_t event = machine->transitions[t - 1].event;
+      if(stamps[event] == s) {
+        continue;
+      }
+      stamps[event] = s;
+      emit(g, "          case '%s':\n", ir_string(ir, event));
+      emit_return(g, t - 1, "            ", false);
+    }
+    for(uint32_t t = delays[s]; t < delays[s + 1]; t++) {
+      bool last = true;
+      for(uint32_t later = t + 1; later < delays[s + 1]; later++) {
+        last = last && machine->transitions[later].delay != machine->transitions[t].delay;
+      }
+      if(last) {
+        emit_event_case(g, "after:", machine->transitions[t].delay, t);
+      }
+    }
+    for(uint32_t i = invoke_start; i < invoke_end; i++) {
+      for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+        uint32_t* settled = machine->offsets[kind];
+        if(settled[i] < settled[i + 1]) {
+          emit_event_case(g, kind == IR_DONE ? "done:" : "error:", i, settled[i + 1] - 1);
+        }
+      }
+    }
+    emit(g, "        }\n        break;\n");
+  }
+  emit(g, "    }\n    return -1;\n  }");
+
+  lucy_free(stamps);
+}
+
+// The first always transition whose guards pass is taken.
+static void emit_always(JSGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t* rows = machine->offsets[IR_ALWAYS];
+
+  emit(g, "  always(state, event, context) {\n    switch(state) {\n");
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(rows[s] == rows[s + 1]) {
+      continue;
+    }
+    emit(g, "      case %u:\n", s);
+    bool returned = false;
+    for(uint32_t t = rows[s]; t < rows[s + 1] && !returned; t++) {
+      emit_return(g, t, "        ", true);
+      returned = machine->transitions[t].guard_count == 0;
+    }
+    if(!returned) {
+      emit(g, "        break;\n");
+    }
+  }
+  emit(g, "    }\n    return -1;\n  }");
+}
+
+static void emit_actions(JSGen* g) {
+  IRMachine* machine = g->machine;
+  IRProgram* ir = g->ir;
+
+  emit(g, "  actions: [");
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    if(t > 0) {
+      emit(g, ",");
+    }
+    emit(g, "\n    ");
+    if(transition->action_count == 0) {
+      emit(g, "null");
+      continue;
+    }
+
+    emit(g, "[");
+    for(uint32_t i = 0; i < transition->action_count; i++) {
+      IRRef* ref = &machine->actions[transition->action_start + i];
+      if(i > 0) {
+        emit(g, ", ");
+      }
+      switch(ref->type) {
+        case IR_REF_BINDING: {
+          IRBinding* binding = &machine->bindings[ref->id];
+          if(binding->key == IR_NONE) {
+            emit(g, "[null, %s]", ir_string(ir, binding->ref));
+          } else {
+            emit(g, "['%s', %s]", ir_string(ir, binding->key), ir_string(ir, binding->ref));
+          }
+          break;
+        }
+        case IR_REF_INLINE: {
+          emit(g, "[null, %s]", ir_string(ir, ref->id));
+          break;
+        }
+        case IR_REF_ASSIGN: {
+          emit(g, "['%s', null]", ir_string(ir, ref->id));
+          break;
+        }
+      }
+    }
+    emit(g, "]");
+  }
+  emit(g, "\n  ],\n");
+}
+
+// Delays and invokes per state, null for states without any.
+static void emit_activities(JSGen* g) {
+  IRMachine* machine = g->machine;
+  uint32_t* rows = machine->offsets[IR_DELAY];
+  bool has_delays = rows[machine->state_count] > rows[0];
+
+  if(has_delays) {
+    emit(g, "  delays: [");
+    for(uint32_t s = 0; s < machine->state_count; s++) {
+      emit(g, s > 0 ? ",\n    " : "\n    ");
+      if(rows[s] == rows[s + 1]) {
+        emit(g, "null");
+        continue;
+      }
+      emit(g, "[");
+      bool first = true;
+      for(uint32_t t = rows[s]; t < rows[s + 1]; t++) {
+        uint32_t delay = machine->transitions[t].delay;
+        bool seen = false;
+        for(uint32_t earlier = rows[s]; earlier < t; earlier++) {
+          seen = seen || machine->transitions[earlier].delay == delay;
+        }
+        if(!seen) {
+          emit(g, first ? "%u" : ", %u", delay);
+          first = false;
+        }
+      }
+      emit(g, "]");
+    }
+    emit(g, "\n  ],\n");
+  }
+
+  if(machine->invoke_count > 0) {
+    emit(g, "  invokes: [");
+    for(uint32_t s = 0; s < machine->state_count; s++) {
+      emit(g, s > 0 ? ",\n    " : "\n    ");
+      uint32_t start = machine->invoke_offsets[s];
+      uint32_t end = machine->invoke_offsets[s + 1];
+      if(start == end) {
+        emit(g, "null");
+        continue;
+      }
+      emit(g, "[");
+      for(uint32_t i = start; i < end; i++) {
+        emit(g, i > start ? ", [%u, %s]" : "[%u, %s]", i, ir_string(g->ir, machine->invokes[i].src));
+      }
+      emit(g, "]");
+    }
+    emit(g, "\n  ],\n");
+  }
+}
+
+// Nested states are named by their path, like XState's state values.
+static void emit_path(JSGen* g, uint32_t s) {
+  uint32_t count = ir_state_path(g->machine, s, &g->path, &g->path_capacity);
+  for(uint32_t i = 0; i < count; i++) {
+    emit(g, i > 0 ? ".%s" : "%s", ir_string(g->ir, g->machine->states[g->path[i]].name));
+  }
+}
+
+static void emit_machine(JSGen* g, IRMachine* machine) {
+  g->machine = machine;
+  uint32_t count = machine->state_count;
+  int32_t* values = lucy_malloc((count > machine->transition_count ? count : machine->transition_count) * sizeof(int32_t) + sizeof(int32_t));
+
+  if(machine->name == IR_NONE) {
+    emit(g, "\nexport default {\n");
+  } else {
+    emit(g, "\nexport const %s = {\n", ir_string(g->ir, machine->name));
+  }
+
+  // Machines without an initial state start in their first.
+  uint32_t initial = machine->initial != IR_NONE ? machine->initial : 0;
+  emit(g, "  initial: %d,\n", count == 0 ? -1 : (int)initial);
+
+  emit(g, "  names: [");
+  for(uint32_t s = 0; s < count; s++) {
+    emit(g, s == 0 ? "'" : s % 8 == 0 ? ",\n    '" : ", '");
+    emit_path(g, s);
+    emit(g, "'");
+  }
+  emit(g, "],\n");
+
+  for(uint32_t s = 0; s < count; s++) {
+    uint32_t parent = machine->states[s].parent;
+    values[s] = parent == IR_NONE ? -1 : (int32_t)parent;
+  }
+  emit_list(g, "parents", values, count);
+
+  for(uint32_t s = 0; s < count; s++) {
+    IRState* state = &machine->states[s];
+    uint32_t child = state->child_count == 0 ? IR_NONE :
+      state->initial != IR_NONE ? state->initial : state->child_start;
+    values[s] = child == IR_NONE ? -1 : (int32_t)child;
+  }
+  emit_list(g, "children", values, count);
+
+  emit(g, "  final: [");
+  for(uint32_t s = 0; s < count; s++) {
+    if(s > 0) {
+      emit(g, s % 16 == 0 ? ",\n    " : ", ");
+    }
+    emit(g, machine->states[s].flags & IR_STATE_FINAL ? "true" : "false");
+  }
+  emit(g, "],\n");
+
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    values[t] = machine->transitions[t].target;
+  }
+  emit_list(g, "targets", values, machine->transition_count);
+  lucy_free(values);
+
+  emit_actions(g);
+  emit_activities(g);
+  emit_select(g);
+
+  uint32_t* always = machine->offsets[IR_ALWAYS];
+  if(always[count] > always[0]) {
+    emit(g, ",\n");
+    emit_always(g);
+  }
+  emit(g, "\n};\n");
+}
+
+static void emit_import(JSGen* g, IRImport* import) {
+  if(import->specifier_count == 0) {
+    return;
+  }
+
+  emit(g, "import { ");
+  for(uint32_t i = 0; i < import->specifier_count; i++) {
+    emit(g, i > 0 ? ", %s" : "%s", ir_string(g->ir, g->ir->specifiers[import->specifier_start + i]));
+  }
+  emit(g, " } from %s;\n", ir_string(g->ir, import->from));
+}
+
+void js_emit(CompileResult* result, IRProgram* ir) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+
+  JSGen g = {
+    .ir = ir,
+    .machine = NULL,
+    .sb = str_builder_create(),
+    .path = NULL,
+    .path_capacity = 0
+  };
+
+  for(uint32_t i = 0; i < ir->import_count; i++) {
+    emit_import(&g, &ir->imports[i]);
+  }
+  if(ir->machine_count > 0) {
+    if(ir->import_count > 0) {
+      emit(&g, "\n");
+    }
+    emit(&g, "%s", runtime);
+  }
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    emit_machine(&g, &ir->machines[i]);
+  }
+
+  char* js = str_builder_dump(g.sb, NULL);
+  result->success = true;
+  result->js = js;
+
+  str_builder_destroy(g.sb);
+  lucy_free(g.path);
+
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+  if(result->stats != NULL) {
+    result->stats->bytes_emitted = strlen(js);
+  }
+}
+
+void compile_js(CompileResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  if(result->stats != NULL) {
+    stats_start(result->stats);
+    result->stats->source_bytes = strlen(source);
+  }
+
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & XS_FLAG_MINIMIZE, result->flags & XS_FLAG_OPTIMIZE, &result->diagnostics);
+
+  if(ir == NULL) {
+    result->success = false;
+    result->js = NULL;
+    lucy_set_allocator(outer);
+    stats_stop();
+    return;
+  }
+
+  js_emit(result, ir);
+  ir_destroy(ir);
+  lucy_set_allocator(outer);
+  stats_stop();
+}
@@ -0,0 +1,12 @@
+#ifndef LUCY_COMPILER_JS_H_
+#define LUCY_COMPILER_JS_H_
+
+#include "compiler_xstate.h"
+
+// Compiles to a dependency-free module with its own interpreter. Takes a
+// result from xs_create, of the XState flags only the optimize and
+// minimize ones apply.
+void compile_js(CompileResult*, char*, char*);
+void js_emit(CompileResult*, IRProgram*);
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include "alloc.h"
+#include "ir.h"
+#include "frontend.h"
+#include "str_builder.h"
+#include "compiler_json.h"
+#include "stats.h"
+
+typedef struct JSONGen {
+  IRProgram* ir;
+  IRMachine* machine;
+  str_builder_t* sb;
+
+  // Whether each open object or array has a member yet.
+  bool* members;
+  int depth;
+  int capacity;
+
+  // The next and end state of each states member being added.
+  uint32_t* blocks;
+  uint32_t block_count;
+  uint32_t block_capacity;
+} JSONGen;
+
+static void add_string(JSONGen* g, const char* str) {
+  str_builder_add_json_str(g->sb, str, strlen(str));
+}
+
+static void add_indent(JSONGen* g) {
+  str_builder_add_char(g->sb, '\n');
+  for(int i = 0; i < g->depth; i++) {
+    str_builder_add_str(g->sb, "  ", 2);
+  }
+}
+
+// Starts a member of the innermost object or array, with its key when
+// it's an object.
+static void start_member(JSONGen* g, const char* key) {
+  if(g->depth > 0) {
+    if(g->members[g->depth - 1]) {
+      str_builder_add_char(g->sb, ',');
+    }
+    g->members[g->depth - 1] = true;
+    add_indent(g);
+  }
+  if(key != NULL) {
+    add_string(g, key);
+    str_builder_add_str(g->sb, ": ", 2);
+  }
+}
+
+static void start(JSONGen* g, const char* key, char open) {
+  start_member(g, key);
+  str_builder_add_char(g->sb, open);
+  if(g->depth == g->capacity) {
+    g->capacity = g->capacity == 0 ? 16 : g->capacity * 2;
+    g->members = lucy_realloc(g->members, g->capacity * sizeof(bool));
+  }
+  g->members[g->depth++] = false;
+}
+
+static void end(JSONGen* g, char close) {
+  g->depth--;
+  if(g->members[g->depth]) {
+    add_indent(g);
+  }
+  str_builder_add_char(g->sb, close);
+}
+
+static void add_member(JSONGen* g, const char* key, const char* value) {
+  start_member(g, key);
+  if(value == NULL) {
+    str_builder_add_str(g->sb, "null", 4);
+  } else {
+    add_string(g, value);
+  }
+}
+
+static char* state_name(JSONGen* g, uint32_t id) {
+  return ir_string(g->ir, g->machine->states[id].name);
+}
+
+// Bound guards and actions are referenced by name and listed with their
+// machine, inline ones by the imported function.
+static char* ref_name(JSONGen* g, IRRef* ref) {
+  if(ref->type == IR_REF_BINDING) {
+    return ir_string(g->ir, g->machine->bindings[ref->id].name);
+  }
+  return ir_string(g->ir, ref->id);
+}
+
+static void add_transition(JSONGen* g, const char* key, IRTransition* transition) {
+  IRMachine* machine = g->machine;
+  start(g, key, '{');
+  add_member(g, "target", state_name(g, transition->target));
+
+  if(transition->guard_count > 0) {
+    start(g, "cond", '[');
+    for(uint32_t i = 0; i < transition->guard_count; i++) {
+      add_member(g, NULL, ref_name(g, &machine->guards[transition->guard_start + i]));
+    }
+    end(g, ']');
+  }
+
+  if(transition->action_count > 0) {
+    start(g, "actions", '[');
+    for(uint32_t i = 0; i < transition->action_count; i++) {
+      IRRef* ref = &machine->actions[transition->action_start + i];
+      if(ref->type == IR_REF_ASSIGN) {
+        start(g, NULL, '{');
+        add_member(g, "assign", ir_string(g->ir, ref->id));
+        end(g, '}');
+      } else {
+        add_member(g, NULL, ref_name(g, ref));
+      }
+    }
+    end(g, ']');
+  }
+
+  end(g, '}');
+}
+
+// Only the last transition for an event or delay is ever taken.
+static bool is_shadowed(IRTransition* transitions, uint32_t t, uint32_t end, int kind) {
+  for(uint32_t u = t + 1; u < end; u++) {
+    if(kind == IR_EVENT ? transitions[u].event == transitions[t].event :
+      transitions[u].delay == transitions[t].delay) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Adds the initial member, and starts the states member when there are
+// states to add to it.
+static bool add_states_open(JSONGen* g, uint32_t initial, uint32_t count) {
+  if(initial != IR_NONE) {
+    add_member(g, "initial", state_name(g, initial));
+  }
+  if(count == 0) {
+    return false;
+  }
+  start(g, "states", '{');
+  return true;
+}
+
+// Starts a state's object and adds all but its nested states. Returns
+// whether those are left to add, before the object is ended.
+static bool add_state_open(JSONGen* g, uint32_t id) {
+  IRMachine* machine = g->machine;
+  IRState* state = &machine->states[id];
+  IRTransition* transitions = machine->transitions;
+  start(g, state_name(g, id), '{');
+
+  if(state->flags & IR_STATE_FINAL) {
+    add_member(g, "type", "final");
+  }
+
+  uint32_t* events = machine->offsets[IR_EVENT];
+  if(events[id] < events[id + 1]) {
+    start(g, "on", '{');
+    for(uint32_t t = events[id]; t < events[id + 1]; t++) {
+      if(!is_shadowed(transitions, t, events[id + 1], IR_EVENT)) {
+        add_transition(g, ir_string(g->ir, transitions[t].event), &transitions[t]);
+      }
+    }
+    end(g, '}');
+  }
+
+  uint32_t* always = machine->offsets[IR_ALWAYS];
+  if(always[id] < always[id + 1]) {
+    start(g, "always", '[');
+    for(uint32_t t = always[id]; t < always[id + 1]; t++) {
+      add_transition(g, NULL, &transitions[t]);
+    }
+    end(g, ']');
+  }
+
+  uint32_t* delays = machine->offsets[IR_DELAY];
+  if(delays[id] < delays[id + 1]) {
+    start(g, "delay", '{');
+    for(uint32_t t = delays[id]; t < delays[id + 1]; t++) {
+      if(!is_shadowed(transitions, t, delays[id + 1], IR_DELAY)) {
+        char ms[12];
+        snprintf(ms, sizeof(ms), "%u", transitions[t].delay);
+        add_transition(g, ms, &transitions[t]);
+      }
+    }
+    end(g, '}');
+  }
+
+  uint32_t invoke_start = machine->invoke_offsets[id];
+  uint32_t invoke_end = machine->invoke_offsets[id + 1];
+  if(invoke_start < invoke_end) {
+    start(g, "invoke", '[');
+    for(uint32_t i = invoke_start; i < invoke_end; i++) {
+      start(g, NULL, '{');
+      add_member(g, "src", ir_string(g->ir, machine->invokes[i].src));
+      uint32_t* done = machine->offsets[IR_DONE];
+      if(done[i] < done[i + 1]) {
+        add_transition(g, "onDone", &transitions[done[i + 1] - 1]);
+      }
+      uint32_t* error = machine->offsets[IR_ERROR];
+      if(error[i] < error[i + 1]) {
+        add_transition(g, "onError", &transitions[error[i + 1] - 1]);
+      }
+      end(g, '}');
+    }
+    end(g, ']');
+  }
+
+  return add_states_open(g, state->initial, state->child_count);
+}
+
+static void push_block(JSONGen* g, uint32_t first, uint32_t count) {
+  if(g->block_count == g->block_capacity) {
+    g->block_capacity = g->block_capacity == 0 ? 32 : g->block_capacity * 2;
+    g->blocks = lucy_realloc(g->blocks, g->block_capacity * sizeof(uint32_t));
+  }
+  g->blocks[g->block_count++] = first;
+  g->blocks[g->block_count++] = first + count;
+}
+
+// Adds the states to a states member started by add_states_open. Nested
+// ones are added in turn rather than recursing, and each ends its state's
+// object when done.
+static void add_block(JSONGen* g, uint32_t first, uint32_t count) {
+  uint32_t base = g->block_count;
+  push_block(g, first, count);
+
+  while(g->block_count > base) {
+    uint32_t* block = &g->blocks[g->block_count - 2];
+    if(block[0] == block[1]) {
+      end(g, '}');
+      g->block_count -= 2;
+      if(g->block_count > base) {
+        end(g, '}');
+      }
+      continue;
+    }
+
+    uint32_t id = block[0]++;
+    IRState* state = &g->machine->states[id];
+    if(add_state_open(g, id)) {
+      push_block(g, state->child_start, state->child_count);
+    } else {
+      end(g, '}');
+    }
+  }
+}
+
+static void add_bindings(JSONGen* g, int type) {
+  IRMachine* machine = g->machine;
+  bool started = false;
+  for(uint32_t i = 0; i < machine->binding_count; i++) {
+    IRBinding* binding = &machine->bindings[i];
+    if(binding->type != type) {
+      continue;
+    }
+    if(!started) {
+      started = true;
+      start(g, type == IR_BINDING_GUARD ? "guards" : "actions", '{');
+    }
+
+    char* name = ir_string(g->ir, binding->name);
+    if(type == IR_BINDING_GUARD) {
+      add_member(g, name, ir_string(g->ir, binding->ref));
+    } else {
+      start(g, name, '{');
+      add_member(g, "assign", ir_string(g->ir, binding->key));
+      add_member(g, "from", ir_string(g->ir, binding->ref));
+      end(g, '}');
+    }
+  }
+  if(started) {
+    end(g, '}');
+  }
+}
+
+static void add_machine(JSONGen* g, IRMachine* machine) {
+  g->machine = machine;
+  start(g, NULL, '{');
+  add_member(g, "name", machine->name == IR_NONE ? NULL : ir_string(g->ir, machine->name));
+  if(add_states_open(g, machine->initial, machine->top_count)) {
+    add_block(g, 0, machine->top_count);
+  }
+  add_bindings(g, IR_BINDING_GUARD);
+  add_bindings(g, IR_BINDING_ACTION);
+  end(g, '}');
+}
+
+void json_emit(CompileResult* result, IRProgram* ir) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+
+  JSONGen g = {
+    .ir = ir,
+    .machine = NULL,
+    .sb = str_builder_create(),
+    .members = NULL,
+    .depth = 0,
+    .capacity = 0,
+    .blocks = NULL,
+    .block_count = 0,
+    .block_capacity = 0
+  };
+
+  start(&g, NULL, '{');
+  start(&g, "imports", '[');
+  for(uint32_t i = 0; i < ir->import_count; i++) {
+    IRImport* import = &ir->imports[i];
+    start(&g, NULL, '{');
+    // The path is kept with its quotes for the JS emitters.
+    char* from = ir_string(ir, import->from);
+    size_t length = strlen(from);
+    bool quoted = length >= 2 && (from[0] == '\'' || from[0] == '"') && from[length - 1] == from[0];
+    start_member(&g, "from");
+    if(quoted && length == 2) {
+      str_builder_add_str(g.sb, "\"\"", 2);
+    } else if(quoted) {
+      str_builder_add_json_str(g.sb, from + 1, length - 2);
+    } else {
+      add_string(&g, from);
+    }
+    start(&g, "specifiers", '[');
+    for(uint32_t s = 0; s < import->specifier_count; s++) {
+      add_member(&g, NULL, ir_string(ir, ir->specifiers[import->specifier_start + s]));
+    }
+    end(&g, ']');
+    end(&g, '}');
+  }
+  end(&g, ']');
+
+  start(&g, "machines", '[');
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    add_machine(&g, &ir->machines[i]);
+  }
+  end(&g, ']');
+  end(&g, '}');
+
+  char* json = str_builder_dump(g.sb, NULL);
+  result->success = true;
+  result->js = json;
+  str_builder_destroy(g.sb);
+  lucy_free(g.members);
+  lucy_free(g.blocks);
+
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+  if(result->stats != NULL) {
+    result->stats->bytes_emitted = strlen(json);
+  }
+}
+
+void compile_json(CompileResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  if(result->stats != NULL) {
+    stats_start(result->stats);
+    result->stats->source_bytes = strlen(source);
+  }
+
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & XS_FLAG_MINIMIZE, result->flags & XS_FLAG_OPTIMIZE, &result->diagnostics);
+
+  if(ir == NULL) {
+    result->success = false;
+    result->js = NULL;
+    lucy_set_allocator(outer);
+    stats_stop();
+    return;
+  }
+
+  json_emit(result, ir);
+  ir_destroy(ir);
+  lucy_set_allocator(outer);
+  stats_stop();
+}
@@ -0,0 +1,12 @@
+#ifndef LUCY_COMPILER_JSON_H_
+#define LUCY_COMPILER_JSON_H_
+
+#include "compiler_xstate.h"
+
+// Compiles to a JSON description of the imports and machines, shaped like
+// an XState config with guards and actions referenced by name. Takes a
+// result from xs_create, the JSON is in its js field.
+void compile_json(CompileResult*, char*, char*);
+void json_emit(CompileResult*, IRProgram*);
+
+#endif
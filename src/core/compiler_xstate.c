@@ -1,623 +1,807 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <math.h>
+#include "alloc.h"
 #include "node.h"
 #include "program.h"
 #include "parser.h"
+#include "ir.h"
+#include "frontend.h"
 #include "str_builder.h"
 #include "js_builder.h"
 #include "compiler_xstate.h"
-
-// API flags
-#define FLAG_USE_REMOTE 1 << 0
-
-// Machine implementation flags
-#define XS_HAS_STATE_PROP 1 << 0
-
-typedef struct Ref {
-  char* key;
-  struct Ref* next;
-  Expression* value;
-} Ref;
+#include "stats.h"
+#include "symtab.h"
 
 typedef struct PrintState {
-  bool on_prop_added;
-  bool always_prop_added;
-  Ref* guard;
-  Ref* action;
+  IRProgram* ir;
+  IRMachine* machine;
+  JSBuilder* jsb;
+
+  // Consts are numbered across machines.
+  uint32_t const_base;
+
+  // When bundling, the program's namespace and the name each imported
+  // function has in the bundle, by string id, NULL where it's unchanged.
+  char* namespace;
+  char** locals;
+
+  // Export a factory that builds each machine on its first call.
+  bool lazy;
+
+  // The next and end state of each states object being printed, nested
+  // ones go here rather than on the C stack.
+  uint32_t* blocks;
+  uint32_t block_count;
+  uint32_t block_capacity;
 } PrintState;
 
-static void add_action_ref(PrintState* state, char* key, Expression* value) {
-  Ref *ref = malloc(sizeof(Ref));
-  ref->key = key;
-  ref->value = node_clone_expression(value);
-  ref->next = NULL;
+static bool print_state_open(PrintState*, uint32_t);
 
-  if(state->action == NULL) {
-    state->action = ref;
-  } else {
-    Ref* cur = state->action;
-    while(cur->next != NULL) {
-      cur = cur->next;
-    }
-    cur->next = ref;
-  }
+static uint32_t const_at(uint32_t* consts, uint32_t index) {
+  return consts == NULL ? IR_NONE : consts[index];
 }
 
-static void add_guard_ref(PrintState* state, char* key, Expression* value) {
-  Ref *ref = malloc(sizeof(Ref));
-  ref->key = key;
-  ref->value = node_clone_expression(value);
-  ref->next = NULL;
-
-  if(state->guard == NULL) {
-    state->guard = ref;
-  } else {
-    Ref* cur = state->guard;
-    while(cur->next != NULL) {
-      cur = cur->next;
-    }
-    cur->next = ref;
-  }
+static void print_const_name(PrintState* state, uint32_t index) {
+  // Lucy identifiers are letters only, so these can't clash.
+  char name[16];
+  snprintf(name, sizeof(name), "__c%u", state->const_base + index);
+  js_builder_add_str(state->jsb, name);
 }
 
-static void destroy_ref(Ref* ref) {
-  if(ref->next != NULL) {
-    destroy_ref(ref->next);
-  }
-  if(ref->value != NULL) {
-    node_destroy_expression(ref->value);
-  }
-  free(ref);
+// An imported function.
+static void print_ref(PrintState* state, uint32_t id) {
+  char* local = state->locals != NULL ? state->locals[id] : NULL;
+  js_builder_add_str(state->jsb, local != NULL ? local : ir_string(state->ir, id));
 }
 
-static void destroy_state(PrintState *state) {
-  if(state->guard != NULL) {
-    destroy_ref(state->guard);
-  }
-  if(state->action != NULL) {
-    destroy_ref(state->action);
+static void print_guards(PrintState* state, IRTransition* transition) {
+  JSBuilder* jsb = state->jsb;
+  IRRef* guards = &state->machine->guards[transition->guard_start];
+  uint32_t count = transition->guard_count;
+
+  // If there are multiple guards use an array.
+  if(count > 1) {
+    js_builder_start_array(jsb, false);
   }
-}
 
-static void enter_machine(PrintState* state, JSBuilder* jsb, Node* node) {
-  MachineNode *machine_node = (MachineNode*)node;
-  Node* parent_node = node->parent;
-  bool is_nested = node_machine_is_nested(node);
+  for(uint32_t i = 0; i < count; i++) {
+    if(i > 0) {
+      js_builder_add_str(jsb, ", ");
+    }
 
-  if(!is_nested) {
-    if(machine_node->name == NULL) {
-      js_builder_add_str(jsb, "\nexport default ");
+    if(guards[i].type == IR_REF_BINDING) {
+      IRBinding* binding = &state->machine->bindings[guards[i].id];
+      js_builder_add_string(jsb, ir_string(state->ir, binding->name));
     } else {
-      js_builder_add_export(jsb);
-      js_builder_add_const(jsb, machine_node->name);
-      js_builder_add_str(jsb, " = ");
-    }
-    js_builder_start_call(jsb, "Machine");
-    js_builder_start_object(jsb);
-  } else {
-    // Close out the on prop
-    if(state->on_prop_added) {
-      state->on_prop_added = false;
-      js_builder_end_object(jsb);
+      print_ref(state, guards[i].id);
     }
   }
 
-  if(machine_node->initial != NULL) {
-    js_builder_start_prop(jsb, "initial");
-    js_builder_add_string(jsb, machine_node->initial);
+  if(count > 1) {
+    js_builder_end_array(jsb, false);
   }
 }
 
-static void exit_machine(PrintState* state, JSBuilder* jsb, Node* node) {
-  bool has_guard = state->guard != NULL;
-  bool has_action = state->action != NULL;
-  bool needs_options = has_guard || has_action;
-  bool is_nested = node_machine_is_nested(node);
+static void print_actions(PrintState* state, IRTransition* transition) {
+  JSBuilder* jsb = state->jsb;
+  IRRef* actions = &state->machine->actions[transition->action_start];
+  uint32_t count = transition->action_count;
 
-  if(!is_nested && needs_options) {
-    js_builder_end_object(jsb);
-    js_builder_add_str(jsb, ", ");
+  // Leading with an inline assign puts each action on its own line.
+  bool use_multiline = actions[0].type == IR_REF_ASSIGN;
 
-    js_builder_start_object(jsb);
+  js_builder_start_array(jsb, use_multiline);
 
-    if(has_guard) {
-      js_builder_start_prop(jsb, "guards");
-      js_builder_start_object(jsb);
+  for(uint32_t i = 0; i < count; i++) {
+    if(i > 0) {
+      js_builder_add_str(jsb, ", ");
+    }
 
-      Ref* ref = state->guard;
-      while(ref != NULL) {
-        js_builder_start_prop(jsb, ref->key);
+    switch(actions[i].type) {
+      case IR_REF_BINDING: {
+        IRBinding* binding = &state->machine->bindings[actions[i].id];
+        js_builder_add_string(jsb, ir_string(state->ir, binding->name));
+        break;
+      }
+      case IR_REF_ASSIGN: {
+        js_builder_start_call(jsb, "assign");
+        js_builder_start_object(jsb);
+        js_builder_start_prop(jsb, ir_string(state->ir, actions[i].id));
+        js_builder_add_str(jsb, "(context, event) => event.data");
+        js_builder_end_object(jsb);
+        js_builder_end_call(jsb);
+        break;
+      }
+      case IR_REF_INLINE: {
+        if(use_multiline) {
+          js_builder_add_indent(jsb);
+        }
+        print_ref(state, actions[i].id);
+        break;
+      }
+    }
+  }
 
-        Expression* expression = ref->value;
+  js_builder_end_array(jsb, use_multiline);
+}
 
-        if(expression->type != EXPRESSION_IDENTIFIER) {
-          printf("Unexpected type of expression\n");
-          break;
-        }
+static void print_transition(PrintState* state, IRTransition* transition, bool is_always) {
+  JSBuilder* jsb = state->jsb;
+  IRState* target = &state->machine->states[transition->target];
+  char* dest = ir_string(state->ir, target->name);
 
-        char* identifier = ((IdentifierExpression*)expression)->name;
-        js_builder_add_str(jsb, identifier);
+  bool has_guard = transition->guard_count > 0;
+  bool has_action = transition->action_count > 0;
 
-        ref = ref->next;
-      }
+  if(!has_guard && !has_action && !is_always) {
+    js_builder_add_string(jsb, dest);
+    return;
+  }
 
-      js_builder_end_object(jsb);
+  js_builder_start_object(jsb);
+  js_builder_start_prop(jsb, "target");
+  js_builder_add_string(jsb, dest);
+
+  uint32_t index = transition - state->machine->transitions;
+  if(has_guard) {
+    js_builder_start_prop(jsb, "cond");
+    uint32_t guards = const_at(state->machine->guard_consts, index);
+    if(guards != IR_NONE) {
+      print_const_name(state, guards);
+    } else {
+      print_guards(state, transition);
+    }
+  }
+  if(has_action) {
+    js_builder_start_prop(jsb, "actions");
+    uint32_t actions = const_at(state->machine->action_consts, index);
+    if(actions != IR_NONE) {
+      print_const_name(state, actions);
+    } else {
+      print_actions(state, transition);
     }
+  }
 
-    if(has_action) {
-      js_builder_start_prop(jsb, "actions");
-      js_builder_start_object(jsb);
-
-      Ref* ref = state->action;
-      while(ref != NULL) {
-        js_builder_start_prop(jsb, ref->key);
-
-        Expression* expression = ref->value;
-
-        switch(expression->type) {
-          case EXPRESSION_ASSIGN: {
-            AssignExpression* assign = (AssignExpression*)expression;
-
-            js_builder_start_call(jsb, "assign");
-            js_builder_start_object(jsb);
-            js_builder_start_prop(jsb, assign->key);
-            js_builder_add_str(jsb, assign->identifier);
-            js_builder_end_object(jsb);
-            js_builder_end_call(jsb);
-
-            //js_builder_add_string(jsb, assign->identifier);
-            break;
-          }
-          default: {
-            printf("This type of expression is not currently supported.\n");
-            break;
-          }
-        }
+  js_builder_end_object(jsb);
+}
 
-        ref = ref->next;
-      }
+static void print_invoke(PrintState* state, uint32_t invoke) {
+  JSBuilder* jsb = state->jsb;
+  IRMachine* machine = state->machine;
 
-      js_builder_end_object(jsb);
-    }
+  js_builder_start_object(jsb);
+  js_builder_start_prop(jsb, "src");
+  print_ref(state, machine->invokes[invoke].src);
 
-    js_builder_end_object(jsb);
-  } else if(!is_nested) {
-    js_builder_end_object(jsb);
+  uint32_t* done = machine->offsets[IR_DONE];
+  for(uint32_t t = done[invoke]; t < done[invoke + 1]; t++) {
+    js_builder_start_prop(jsb, "onDone");
+    print_transition(state, &machine->transitions[t], false);
   }
 
-  if(!is_nested) {
-    js_builder_end_call(jsb);
-    js_builder_add_str(jsb, ";");
+  uint32_t* error = machine->offsets[IR_ERROR];
+  for(uint32_t t = error[invoke]; t < error[invoke + 1]; t++) {
+    js_builder_start_prop(jsb, "onError");
+    print_transition(state, &machine->transitions[t], false);
   }
-}
-
-static void enter_import(PrintState* state, JSBuilder* jsb, Node* node) {
-  js_builder_add_str(jsb, "import ");
 
-  ImportNode *import_node = (ImportNode*)node;
-  Node* child = node->child;
-  bool multiple = false;
+  js_builder_end_object(jsb);
+}
 
-  if(child == NULL) {
-    printf("TODO add support for imports with no specifiers\n");
-    return;
+static void push_block(PrintState* state, uint32_t start, uint32_t count) {
+  if(state->block_count == state->block_capacity) {
+    state->block_capacity = state->block_capacity == 0 ? 32 : state->block_capacity * 2;
+    state->blocks = lucy_realloc(state->blocks, state->block_capacity * sizeof(uint32_t));
   }
+  state->blocks[state->block_count++] = start;
+  state->blocks[state->block_count++] = start + count;
+  js_builder_start_object(state->jsb);
+}
 
-  js_builder_add_str(jsb, "{ ");
+// Prints a states object. A nested one is printed once its state's other
+// props are, and closes that state's object when it's done.
+static void print_block(PrintState* state, uint32_t start, uint32_t count) {
+  JSBuilder* jsb = state->jsb;
+  IRMachine* machine = state->machine;
+  uint32_t base = state->block_count;
+  push_block(state, start, count);
+
+  while(state->block_count > base) {
+    uint32_t* block = &state->blocks[state->block_count - 2];
+    if(block[0] == block[1]) {
+      js_builder_end_object(jsb);
+      state->block_count -= 2;
+      if(state->block_count > base) {
+        js_builder_end_object(jsb);
+      }
+      continue;
+    }
 
-  while(child != NULL) {
-    ImportSpecifier *specifier = (ImportSpecifier*)child;
+    uint32_t id = block[0]++;
+    js_builder_start_prop(jsb, ir_string(state->ir, machine->states[id].name));
 
-    if(multiple) {
-      js_builder_add_str(jsb, ", ");
+    uint32_t body = const_at(machine->state_consts, id);
+    if(body != IR_NONE) {
+      print_const_name(state, body);
+    } else if(print_state_open(state, id)) {
+      push_block(state, machine->states[id].child_start, machine->states[id].child_count);
+    } else {
+      js_builder_end_object(jsb);
     }
+  }
+}
 
-    js_builder_add_str(jsb, specifier->imported);
-    // TODO support local
+// Prints the initial and states props of a machine, or of the nested
+// machine of a state when owner is that state. Returns whether the states
+// still need printing as a block.
+static bool print_states(PrintState* state, uint32_t owner, uint32_t initial, uint32_t count) {
+  JSBuilder* jsb = state->jsb;
 
-    child = child->next;
-    multiple = true;
+  if(initial != IR_NONE) {
+    js_builder_start_prop(jsb, "initial");
+    js_builder_add_string(jsb, ir_string(state->ir, state->machine->states[initial].name));
   }
 
-  js_builder_add_str(jsb, " } from ");
-  js_builder_add_str(jsb, import_node->from);
-  js_builder_add_str(jsb, ";\n");
-}
+  if(count == 0) {
+    return false;
+  }
 
-static void enter_state(PrintState* state, JSBuilder* jsb, Node* node) {
-  StateNode* state_node = (StateNode*)node;
-  MachineNode* machine_node = (MachineNode*)node->parent;
-  if(!(machine_node->impl_flags & XS_HAS_STATE_PROP)) {
-    machine_node->impl_flags |= XS_HAS_STATE_PROP;
-    js_builder_start_prop(jsb, "states");
-    js_builder_start_object(jsb);
+  js_builder_start_prop(jsb, "states");
+  uint32_t block = owner == IR_NONE ? IR_NONE : const_at(state->machine->block_consts, owner);
+  if(block != IR_NONE) {
+    print_const_name(state, block);
+    return false;
   }
+  return true;
+}
+
+// Opens a state's object and prints all but its nested states. Returns
+// whether those are left to print, before the object is closed.
+static bool print_state_open(PrintState* state, uint32_t id) {
+  JSBuilder* jsb = state->jsb;
+  IRMachine* machine = state->machine;
+  IRState* ir_state = &machine->states[id];
+  IRTransition* transitions = machine->transitions;
 
-  js_builder_start_prop(jsb, state_node->name);
   js_builder_start_object(jsb);
 
-  if(state_node->final) {
+  if(ir_state->flags & IR_STATE_FINAL) {
     js_builder_start_prop(jsb, "type");
     js_builder_add_string(jsb, "final");
   }
-}
 
-static void exit_state(PrintState* state, JSBuilder* jsb, Node* node) {
-  js_builder_end_object(jsb);
+  uint32_t* events = machine->offsets[IR_EVENT];
+  if(events[id] < events[id + 1]) {
+    js_builder_start_prop(jsb, "on");
+    js_builder_start_object(jsb);
+    for(uint32_t t = events[id]; t < events[id + 1]; t++) {
+      js_builder_start_prop(jsb, ir_string(state->ir, transitions[t].event));
+      print_transition(state, &transitions[t], false);
+    }
+    js_builder_end_object(jsb);
+  }
 
-  StateNode* state_node = (StateNode*)node;
+  uint32_t* always = machine->offsets[IR_ALWAYS];
+  if(always[id] < always[id + 1]) {
+    js_builder_start_prop(jsb, "always");
+    js_builder_start_array(jsb, true);
+    js_builder_add_indent(jsb);
+    for(uint32_t t = always[id]; t < always[id + 1]; t++) {
+      if(t > always[id]) {
+        js_builder_add_str(jsb, ", ");
+      }
+      print_transition(state, &transitions[t], true);
+    }
+    js_builder_end_array(jsb, true);
+  }
 
-  // End of all state nodes
-  if(!node->next || node->next->type != NODE_STATE_TYPE) {
+  uint32_t* delays = machine->offsets[IR_DELAY];
+  if(delays[id] < delays[id + 1]) {
+    js_builder_start_prop(jsb, "delay");
+    js_builder_start_object(jsb);
+    for(uint32_t t = delays[id]; t < delays[id + 1]; t++) {
+      char str[12];
+      snprintf(str, sizeof(str), "%u", transitions[t].delay);
+      js_builder_start_prop(jsb, str);
+      print_transition(state, &transitions[t], false);
+    }
     js_builder_end_object(jsb);
   }
-}
 
-static void enter_invoke(PrintState* state, JSBuilder* jsb, Node* node) {
-  js_builder_start_prop(jsb, "invoke");
-  js_builder_start_object(jsb);
+  uint32_t invoke_start = machine->invoke_offsets[id];
+  uint32_t invoke_count = machine->invoke_offsets[id + 1] - invoke_start;
+  if(invoke_count > 0) {
+    js_builder_start_prop(jsb, "invoke");
+    // Multiple services are invoked with an array.
+    if(invoke_count > 1) {
+      js_builder_start_array(jsb, true);
+      js_builder_add_indent(jsb);
+    }
+    for(uint32_t i = invoke_start; i < invoke_start + invoke_count; i++) {
+      if(i > invoke_start) {
+        js_builder_add_str(jsb, ", ");
+      }
+      print_invoke(state, i);
+    }
+    if(invoke_count > 1) {
+      js_builder_end_array(jsb, true);
+    }
+  }
 
-  InvokeNode* invoke_node = (InvokeNode*)node;
-  js_builder_start_prop(jsb, "src");
-  js_builder_add_str(jsb, invoke_node->call);
+  return print_states(state, id, ir_state->initial, ir_state->child_count);
 }
 
-static void exit_invoke(PrintState* state, JSBuilder* jsb, Node* node) {
-  js_builder_end_object(jsb);
+static void print_state_body(PrintState* state, uint32_t id) {
+  IRState* ir_state = &state->machine->states[id];
+  if(print_state_open(state, id)) {
+    print_block(state, ir_state->child_start, ir_state->child_count);
+  }
+  js_builder_end_object(state->jsb);
 }
 
-static void enter_transition(PrintState* state, JSBuilder* jsb, Node* node) {
-  TransitionNode* transition_node = (TransitionNode*)node;
-  Node* parent_node = node->parent;
-  char* event_name = transition_node->event;
-  int type = transition_node->type;
-
-  bool is_always = transition_node->type == TRANSITION_IMMEDIATE_TYPE;
-
-  if(parent_node->type == NODE_INVOKE_TYPE) {
-    if(strcmp(event_name, "done") == 0) {
-      js_builder_start_prop(jsb, "onDone");
-    } else if(strcmp(event_name, "error") == 0) {
-      js_builder_start_prop(jsb, "onError");
-    } else {
-      printf("Regular events in invoke are not supported.\n");
+// Shared values hoisted by the optimizer, declared ahead of the machine.
+static void print_consts(PrintState* state) {
+  JSBuilder* jsb = state->jsb;
+  IRMachine* machine = state->machine;
+
+  for(uint32_t i = 0; i < machine->const_count; i++) {
+    IRConst* item = &machine->consts[i];
+    if(i > 0) {
+      js_builder_add_str(jsb, "\n");
+    } else if(!state->lazy) {
+      js_builder_start_statement(jsb);
     }
-  } else {
-    switch(type) {
-      case TRANSITION_EVENT_TYPE: {
-        if(!state->on_prop_added) {
-          state->on_prop_added = true;
-          js_builder_start_prop(jsb, "on");
-          js_builder_start_object(jsb);
-        }
-
-        js_builder_start_prop(jsb, event_name);
+    // Lazy machines declare these inside their factory.
+    js_builder_add_indent(jsb);
+    js_builder_add_str(jsb, "const ");
+    print_const_name(state, i);
+    js_builder_add_str(jsb, " = ");
+
+    switch(item->type) {
+      case IR_CONST_STATE: {
+        print_state_body(state, item->id);
         break;
       }
-      case TRANSITION_IMMEDIATE_TYPE: {
-        if(!state->always_prop_added) {
-          state->always_prop_added = true;
-          js_builder_start_prop(jsb, "always");
-          js_builder_start_array(jsb, true);
-          js_builder_add_indent(jsb);
-        } else {
-          js_builder_add_str(jsb, ", ");
-        }
+      case IR_CONST_BLOCK: {
+        IRState* owner = &machine->states[item->id];
+        print_block(state, owner->child_start, owner->child_count);
         break;
       }
-      case TRANSITION_DELAY_TYPE: {
-        js_builder_start_prop(jsb, "delay");
-        js_builder_start_object(jsb);
-
-        int ms = transition_node->delay->ms;
-        int length = (int)((ceil(log10(ms))+1)*sizeof(char));
-        char str[length];
-        sprintf(str, "%i", ms);
-        js_builder_start_prop(jsb, str);
+      case IR_CONST_GUARDS: {
+        print_guards(state, &machine->transitions[item->id]);
+        break;
+      }
+      case IR_CONST_ACTIONS: {
+        print_actions(state, &machine->transitions[item->id]);
         break;
       }
     }
+    js_builder_add_str(jsb, ";");
   }
+}
 
-  bool has_guard = transition_node->guard != NULL;
-  bool has_action = transition_node->action != NULL;
-  bool has_guard_or_action = has_guard || has_action;
-  bool use_object_notation = has_guard_or_action || is_always;
+static void print_options(PrintState* state) {
+  JSBuilder* jsb = state->jsb;
+  IRMachine* machine = state->machine;
 
-  if(use_object_notation) {
-    js_builder_start_object(jsb);
-    js_builder_start_prop(jsb, "target");
-    js_builder_add_string(jsb, transition_node->dest);
-
-    if(has_guard) {
-      js_builder_start_prop(jsb, "cond");
-
-      TransitionGuard* guard = transition_node->guard;
-      // If there are multiple guards use an array.
-      if(guard->next) {
-        js_builder_start_array(jsb, false);
-        while(true) {
-          if(guard->name != NULL) {
-            js_builder_add_string(jsb, guard->name);
-          } else {
-            // Expression!
-            js_builder_add_str(jsb, guard->expression->ref);
-          }
-
-          
-          guard = guard->next;
-
-          if(guard == NULL) {
-            break;
-          }
-
-          js_builder_add_str(jsb, ", ");
-        }
+  for(int type = IR_BINDING_GUARD; type <= IR_BINDING_ACTION; type++) {
+    bool started = false;
 
-        js_builder_end_array(jsb, false);
+    for(uint32_t i = 0; i < machine->binding_count; i++) {
+      IRBinding* binding = &machine->bindings[i];
+      if(binding->type != type) {
+        continue;
       }
-      // If a single guard use a string
-      else {
-        if(guard->name != NULL) {
-          js_builder_add_string(jsb, guard->name);
-        } else {
-          // Expression!
-          js_builder_add_str(jsb, guard->expression->ref);
-        }
+
+      if(!started) {
+        started = true;
+        js_builder_start_prop(jsb, type == IR_BINDING_GUARD ? "guards" : "actions");
+        js_builder_start_object(jsb);
       }
-    }
 
-    if(has_action) {
-      TransitionAction* action = transition_node->action;
-      TransitionAction* inner = action;
-      bool use_multiline = false;
-      while(inner && !use_multiline) {
-        if(action->expression && action->expression->type == EXPRESSION_ASSIGN) {
-          use_multiline = true;
-          break;
-        }
-        inner = inner->next;
+      js_builder_start_prop(jsb, ir_string(state->ir, binding->name));
+      if(type == IR_BINDING_GUARD) {
+        print_ref(state, binding->ref);
+      } else {
+        js_builder_start_call(jsb, "assign");
+        js_builder_start_object(jsb);
+        js_builder_start_prop(jsb, ir_string(state->ir, binding->key));
+        print_ref(state, binding->ref);
+        js_builder_end_object(jsb);
+        js_builder_end_call(jsb);
       }
-      js_builder_start_prop(jsb, "actions");
-      js_builder_start_array(jsb, use_multiline);
-
-      while(true) {
-        if(action->name != NULL) {
-          js_builder_add_string(jsb, action->name);
-        } else {
-          // Inline assign!
-          unsigned short expression_type = action->expression->type;
-          switch(expression_type) {
-            case EXPRESSION_ASSIGN: {
-              AssignExpression* assign_expression = (AssignExpression*)action->expression;
-              js_builder_start_call(jsb, "assign");
-              js_builder_start_object(jsb);
-              js_builder_start_prop(jsb, assign_expression->key);
-              js_builder_add_str(jsb, "(context, event) => event.data");
-              js_builder_end_object(jsb);
-              js_builder_end_call(jsb);
-              break;
-            }
-            case EXPRESSION_ACTION: {
-              ActionExpression* action_expression = (ActionExpression*)action->expression;
-              if(use_multiline) {
-                js_builder_add_indent(jsb);
-              }
-              js_builder_add_str(jsb, action_expression->ref);
-              break;
-            }
-          }
-        }
+    }
 
-        action = action->next;
+    if(started) {
+      js_builder_end_object(jsb);
+    }
+  }
+}
 
-        if(action == NULL) {
-          break;
-        }
+static void print_machine(PrintState* state, IRMachine* machine) {
+  JSBuilder* jsb = state->jsb;
+  state->machine = machine;
 
-        js_builder_add_str(jsb, ", ");
-      }
+  if(!state->lazy) {
+    print_consts(state);
+  }
 
-      js_builder_end_array(jsb, use_multiline);
+  if(state->namespace != NULL) {
+    js_builder_add_export(jsb);
+    js_builder_add_str(jsb, "const ");
+    js_builder_add_str(jsb, state->namespace);
+    if(machine->name != IR_NONE) {
+      js_builder_add_str(jsb, "_");
+      js_builder_add_str(jsb, ir_string(state->ir, machine->name));
     }
+    js_builder_add_str(jsb, " = ");
+  } else if(machine->name == IR_NONE) {
+    js_builder_add_export(jsb);
+    js_builder_add_str(jsb, "default ");
+  } else {
+    js_builder_add_export(jsb);
+    js_builder_add_const(jsb, ir_string(state->ir, machine->name));
+    js_builder_add_str(jsb, " = ");
+  }
+
+  // Bundlers can drop the call when the export isn't used, and the
+  // machine and its consts aren't built until it's asked for.
+  bool body = state->lazy && machine->const_count > 0;
+  if(state->lazy) {
+    js_builder_add_str(jsb, "/*#__PURE__*/ __lazy(() => ");
+  }
+  if(body) {
+    js_builder_start_object(jsb);
+    print_consts(state);
+    js_builder_add_str(jsb, "\n");
+    js_builder_add_indent(jsb);
+    js_builder_add_str(jsb, "return ");
+  }
+  js_builder_start_call(jsb, "Machine");
+  js_builder_start_object(jsb);
 
+  if(print_states(state, IR_NONE, machine->initial, machine->top_count)) {
+    print_block(state, 0, machine->top_count);
+  }
+
+  js_builder_end_object(jsb);
+
+  if(machine->binding_count > 0) {
+    js_builder_add_str(jsb, ", ");
+    js_builder_start_object(jsb);
+    print_options(state);
     js_builder_end_object(jsb);
+  }
 
-    if(is_always) {
-      if(!node_transition_has_sibling_always(transition_node)) {
-        js_builder_end_array(jsb, true);
-      }
-    }
-  } else {
-    js_builder_add_string(jsb, transition_node->dest);
+  js_builder_end_call(jsb);
+  if(body) {
+    js_builder_add_str(jsb, ";");
+    js_builder_end_object(jsb);
+  }
+  if(state->lazy) {
+    js_builder_end_call(jsb);
   }
+  js_builder_add_str(jsb, ";");
+
+  state->const_base += machine->const_count;
 }
 
-static void exit_transition(PrintState* state, JSBuilder* jsb, Node* node) {
-  if(node->next) {
-    
-  } else {
-    TransitionNode* transition_node = (TransitionNode*)node;
-    if(state->on_prop_added) {
-      state->on_prop_added = false;
-      js_builder_end_object(jsb);
-    }
+static void print_import(PrintState* state, IRImport* import) {
+  JSBuilder* jsb = state->jsb;
+  js_builder_add_str(jsb, "import ");
 
-    if(state->always_prop_added) {
-      state->always_prop_added = false;
-    }
+  if(import->specifier_count == 0) {
+    printf("TODO add support for imports with no specifiers\n");
+    return;
+  }
 
-    if(transition_node->type == TRANSITION_DELAY_TYPE) {
-      js_builder_end_object(jsb);
+  js_builder_add_str(jsb, "{ ");
+  for(uint32_t i = 0; i < import->specifier_count; i++) {
+    if(i > 0) {
+      js_builder_add_str(jsb, ", ");
     }
+    js_builder_add_str(jsb, ir_string(state->ir, state->ir->specifiers[import->specifier_start + i]));
+    // TODO support local
   }
+  js_builder_add_str(jsb, " } from ");
+  js_builder_add_str(jsb, ir_string(state->ir, import->from));
+  js_builder_add_str(jsb, ";\n");
 }
 
-static void enter_assignment(PrintState* state, JSBuilder* jsb, Node* node) {
-  Assignment* assignment = (Assignment*)node;
-
-  switch(assignment->binding_type) {
-    case ASSIGNMENT_ACTION: {
-      add_action_ref(state, assignment->binding_name, assignment->value);
-      break;
-    }
-    case ASSIGNMENT_GUARD: {
-      add_guard_ref(state, assignment->binding_name, assignment->value);
-      break;
-    }
+static void print_xstate_import(JSBuilder* jsb, int flags, bool uses_assign) {
+  js_builder_add_str(jsb, "import { Machine");
+  if(uses_assign) {
+    js_builder_add_str(jsb, ", assign");
   }
+  js_builder_add_str(jsb, " } from '");
+  if(flags & XS_FLAG_USE_REMOTE) {
+    js_builder_add_str(jsb, "https://cdn.skypack.dev/xstate");
+  } else {
+    js_builder_add_str(jsb, "xstate");
+  }
+  js_builder_add_str(jsb, "';\n");
+}
+
+// Memoizes a machine factory for XS_FLAG_LAZY.
+static void print_lazy_helper(JSBuilder* jsb) {
+  js_builder_start_statement(jsb);
+  js_builder_add_str(jsb, "const __lazy = build => {\n");
+  js_builder_add_str(jsb, "  let machine;\n");
+  js_builder_add_str(jsb, "  return () => machine || (machine = build());\n");
+  js_builder_add_str(jsb, "};");
 }
 
 CompileResult* xs_create() {
-  CompileResult* result = malloc(sizeof(*result));
+  CompileResult* result = lucy_malloc(sizeof(*result));
   return result;
 }
 
-void xs_init(CompileResult* result, int use_remote_source) {
+void xs_init(CompileResult* result, int flags) {
   result->success = false;
   result->js = NULL;
-  result->flags = 0;
-  
-  if(use_remote_source) {
-    result->flags |= FLAG_USE_REMOTE;
+  result->flags = flags;
+  result->stats = NULL;
+  result->stats_json = NULL;
+  diagnostics_init(&result->diagnostics);
+  result->diagnostics_json = NULL;
+  result->allocator = NULL;
+}
+
+void xs_enable_stats(CompileResult* result) {
+  if(result->stats == NULL) {
+    result->stats = stats_create();
   }
 }
 
-void compile_xstate(CompileResult* result, char* source, char* filename) {
-  ParseResult *parse_result = parse(source, filename);
+void xs_set_allocator(CompileResult* result, const LucyAllocator* allocator) {
+  result->allocator = allocator;
+}
 
-  if(parse_result->success == false) {
-    result->success = false;
-    result->js = NULL;
-    return;
-  }
+void xs_emit(CompileResult* result, IRProgram* ir) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
 
-  Program *program = parse_result->program;
-  char* xstate_specifier;
-  if(result->flags & FLAG_USE_REMOTE) {
-    xstate_specifier = "https://cdn.skypack.dev/xstate";
-  } else {
-    xstate_specifier = "xstate";
+  JSBuilder *jsb = js_builder_create();
+  PrintState state = {
+    .ir = ir,
+    .machine = NULL,
+    .jsb = jsb,
+    .const_base = 0,
+    .namespace = NULL,
+    .locals = NULL,
+    .lazy = result->flags & XS_FLAG_LAZY,
+    .blocks = NULL,
+    .block_count = 0,
+    .block_capacity = 0
+  };
+
+  if(ir->import_count > 0 || ir->machine_count > 0) {
+    print_xstate_import(jsb, result->flags, ir->flags & PROGRAM_USES_ASSIGN);
   }
 
-  JSBuilder *jsb;
-  Node* node;
-  jsb = js_builder_create();
-  node = program->body;
+  for(uint32_t i = 0; i < ir->import_count; i++) {
+    print_import(&state, &ir->imports[i]);
+  }
+  if(state.lazy && ir->machine_count > 0) {
+    print_lazy_helper(jsb);
+  }
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    print_machine(&state, &ir->machines[i]);
+  }
 
-  if(node != NULL) {
-    js_builder_add_str(jsb, "import { Machine");
+  char* js = js_builder_dump(jsb);
+  result->success = true;
+  result->js = js;
 
-    if(program->flags & PROGRAM_USES_ASSIGN) {
-      js_builder_add_str(jsb, ", assign");
-    }
+  // Teardown
+  js_builder_destroy(jsb);
+  lucy_free(state.blocks);
 
-    js_builder_add_str(jsb, " } from '");
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+  if(result->stats != NULL) {
+    result->stats->bytes_emitted = strlen(js);
+  }
+}
 
-    js_builder_add_str(jsb, xstate_specifier);
-    js_builder_add_str(jsb, "';\n");
+// A function the bundle imports, once for every program importing it.
+typedef struct BundleImport {
+  char* from;
+  char* name;
+  // "from name", what it's looked up by.
+  char* key;
+  // The name it's bound to in the bundle.
+  char* local;
+} BundleImport;
+
+typedef struct Bundle {
+  BundleImport* imports;
+  uint32_t import_count;
+  uint32_t import_capacity;
+  SymbolTable by_key;
+  // Every name bound in the bundle: the imports and the exports.
+  SymbolTable bound;
+  // The exports, kept so the names outlive the table.
+  char** exports;
+  uint32_t export_count;
+} Bundle;
+
+// Names a bundle can't bind: what it imports from xstate and the words a
+// module can't declare.
+static const char* bundle_reserved[] = {
+  "Machine", "assign",
+  "arguments", "await", "break", "case", "catch", "class", "const",
+  "continue", "debugger", "default", "delete", "do", "else", "enum", "eval",
+  "export", "extends", "false", "finally", "for", "function", "if",
+  "implements", "import", "in", "instanceof", "interface", "let", "new",
+  "null", "package", "private", "protected", "public", "return", "static",
+  "super", "switch", "this", "throw", "true", "try", "typeof", "var",
+  "void", "while", "with", "yield"
+};
+
+#define BUNDLE_RESERVED_COUNT (sizeof(bundle_reserved) / sizeof(bundle_reserved[0]))
+
+bool xs_bundle_reserved(const char* name) {
+  for(size_t i = 0; i < BUNDLE_RESERVED_COUNT; i++) {
+    if(strcmp(bundle_reserved[i], name) == 0) {
+      return true;
+    }
   }
+  return false;
+}
 
-  PrintState state = {
-    .on_prop_added = false,
-    .always_prop_added = false,
-    .guard = NULL,
-    .action = NULL
-  };
+// name, or name$1, name$2 and so on when that's already bound. Lucy
+// names are letters only, so the $ ones can't clash with theirs.
+static char* bundle_local(Bundle* bundle, char* name) {
+  size_t len = strlen(name) + 12;
+  char* local = lucy_malloc(len);
+  snprintf(local, len, "%s", name);
+  for(uint32_t n = 1; symtab_get(&bundle->bound, local) != SYMTAB_NOT_FOUND; n++) {
+    snprintf(local, len, "%s$%u", name, n);
+  }
+  return local;
+}
 
-  bool exit = false;
-  while(node != NULL) {
-    unsigned short type = node->type;
+static void bundle_add_export(Bundle* bundle, char* namespace, char* name) {
+  size_t len = strlen(namespace) + (name != NULL ? strlen(name) + 1 : 0) + 1;
+  char* export = lucy_malloc(len);
+  snprintf(export, len, name != NULL ? "%s_%s" : "%s", namespace, name);
+  bundle->exports[bundle->export_count++] = export;
+  symtab_insert(&bundle->bound, export, 0);
+}
 
-    if(exit) {
-      switch(type) {
-        case NODE_STATE_TYPE: {
-          exit_state(&state, jsb, node);
-          node_destroy_state((StateNode*)node);
-          break;
-        }
-        case NODE_TRANSITION_TYPE: {
-          exit_transition(&state, jsb, node);
-          node_destroy_transition((TransitionNode*)node);
-          break;
-        }
-        case NODE_ASSIGNMENT_TYPE: {
-          node_destroy_assignment((Assignment*)node);
-          break;
-        }
-        case NODE_IMPORT_SPECIFIER_TYPE: {
-          node_destroy_import_specifier((ImportSpecifier*)node);
-          break;
-        }
-        case NODE_IMPORT_TYPE: {
-          node_destroy_import((ImportNode*)node);
-          break;
-        }
-        case NODE_MACHINE_TYPE: {
-          exit_machine(&state, jsb, node);
-          node_destroy_machine((MachineNode*)node);
-          break;
-        }
-        case NODE_INVOKE_TYPE: {
-          exit_invoke(&state, jsb, node);
-          node_destroy_invoke((InvokeNode*)node);
-          break;
-        }
-        default: {
-          printf("Node type %hu not torn down (this is a compiler bug)\n", type);
-          break;
+// Merges the program's imports into the bundle's, returning the locals
+// for PrintState.
+static char** bundle_add_imports(Bundle* bundle, IRProgram* ir) {
+  char** locals = lucy_calloc(ir->strings.count, sizeof(char*));
+  for(uint32_t i = 0; i < ir->import_count; i++) {
+    IRImport* import = &ir->imports[i];
+    char* from = ir_string(ir, import->from);
+    for(uint32_t s = import->specifier_start; s < import->specifier_start + import->specifier_count; s++) {
+      uint32_t id = ir->specifiers[s];
+      char* name = ir_string(ir, id);
+      size_t len = strlen(from) + strlen(name) + 2;
+      char* key = lucy_malloc(len);
+      snprintf(key, len, "%s %s", from, name);
+
+      int index = symtab_get(&bundle->by_key, key);
+      if(index == SYMTAB_NOT_FOUND) {
+        if(bundle->import_count == bundle->import_capacity) {
+          bundle->import_capacity = bundle->import_capacity == 0 ? 16 : bundle->import_capacity * 2;
+          bundle->imports = lucy_realloc(bundle->imports, bundle->import_capacity * sizeof(BundleImport));
         }
+        index = bundle->import_count++;
+        BundleImport* added = &bundle->imports[index];
+        added->from = from;
+        added->name = name;
+        added->key = key;
+        added->local = bundle_local(bundle, name);
+        symtab_insert(&bundle->by_key, key, index);
+        symtab_insert(&bundle->bound, added->local, index);
+      } else {
+        lucy_free(key);
       }
-    } else {
-      switch(type) {
-        case NODE_IMPORT_TYPE: {
-          enter_import(&state, jsb, node);
-          break;
-        }
-        case NODE_STATE_TYPE: {
-          enter_state(&state, jsb, node);
-          break;
-        }
-        case NODE_TRANSITION_TYPE: {
-          enter_transition(&state, jsb, node);
-          break;
-        }
-        case NODE_ASSIGNMENT_TYPE: {
-          enter_assignment(&state, jsb, node);
-          break;
-        }
-        case NODE_INVOKE_TYPE: {
-          enter_invoke(&state, jsb, node);
-          break;
-        }
-        case NODE_MACHINE_TYPE: {
-          enter_machine(&state, jsb, node);
-          break;
-        }
+
+      if(strcmp(bundle->imports[index].local, name) != 0) {
+        locals[id] = bundle->imports[index].local;
       }
     }
+  }
+  return locals;
+}
 
-    // Node has no children, so go again for the exit.
-    if(!exit && !node->child) {
-      exit = true;
+// The imports of each module in the order they were first seen.
+static void print_bundle_imports(JSBuilder* jsb, Bundle* bundle) {
+  bool* printed = lucy_calloc(bundle->import_count, sizeof(bool));
+  for(uint32_t i = 0; i < bundle->import_count; i++) {
+    if(printed[i]) {
       continue;
     }
-    // Node has a child
-    else if(!exit && node->child) {
-      node = node->child;
-    } else if(node->next) {
-      exit = false;
-      node = node->next;
-    } else if(node->parent) {
-      exit = true;
-      node_destroy(node);
-      node = node->parent;
-    } else {
-      // Reached the end.
-      node_destroy(node);
-      break;
+    char* from = bundle->imports[i].from;
+    js_builder_add_str(jsb, "import { ");
+    for(uint32_t j = i; j < bundle->import_count; j++) {
+      BundleImport* import = &bundle->imports[j];
+      if(printed[j] || strcmp(import->from, from) != 0) {
+        continue;
+      }
+      printed[j] = true;
+      if(j > i) {
+        js_builder_add_str(jsb, ", ");
+      }
+      js_builder_add_str(jsb, import->name);
+      if(strcmp(import->local, import->name) != 0) {
+        js_builder_add_str(jsb, " as ");
+        js_builder_add_str(jsb, import->local);
+      }
+    }
+    js_builder_add_str(jsb, " } from ");
+    js_builder_add_str(jsb, from);
+    js_builder_add_str(jsb, ";\n");
+  }
+  lucy_free(printed);
+}
+
+void xs_emit_bundle(CompileResult* result, IRProgram** programs, char** namespaces, size_t count) {
+  stats_phase_begin(STATS_PHASE_EMIT);
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+
+  Bundle bundle = {0};
+  size_t machine_count = 0;
+  size_t import_count = 0;
+  bool uses_assign = false;
+  for(size_t p = 0; p < count; p++) {
+    machine_count += programs[p]->machine_count;
+    import_count += programs[p]->specifier_count;
+    uses_assign = uses_assign || (programs[p]->flags & PROGRAM_USES_ASSIGN);
+  }
+  symtab_init(&bundle.by_key, import_count);
+  symtab_init(&bundle.bound, BUNDLE_RESERVED_COUNT + import_count + machine_count);
+  bundle.exports = lucy_malloc((machine_count + 1) * sizeof(char*));
+
+  // Imports by these names are renamed, exports can't have them, see
+  // xs_bundle_reserved.
+  for(size_t i = 0; i < BUNDLE_RESERVED_COUNT; i++) {
+    symtab_insert(&bundle.bound, bundle_reserved[i], 0);
+  }
+
+  // Exports are bound first so imports are the ones renamed.
+  for(size_t p = 0; p < count; p++) {
+    IRProgram* ir = programs[p];
+    for(uint32_t m = 0; m < ir->machine_count; m++) {
+      uint32_t name = ir->machines[m].name;
+      bundle_add_export(&bundle, namespaces[p], name == IR_NONE ? NULL : ir_string(ir, name));
+    }
+  }
+  char*** locals = lucy_malloc((count + 1) * sizeof(char**));
+  for(size_t p = 0; p < count; p++) {
+    locals[p] = bundle_add_imports(&bundle, programs[p]);
+  }
+
+  JSBuilder* jsb = js_builder_create();
+  if(import_count > 0 || machine_count > 0) {
+    print_xstate_import(jsb, result->flags, uses_assign);
+  }
+  print_bundle_imports(jsb, &bundle);
+  if((result->flags & XS_FLAG_LAZY) && machine_count > 0) {
+    print_lazy_helper(jsb);
+  }
+
+  PrintState state = {
+    .machine = NULL,
+    .jsb = jsb,
+    .const_base = 0,
+    .lazy = result->flags & XS_FLAG_LAZY,
+    .blocks = NULL,
+    .block_count = 0,
+    .block_capacity = 0
+  };
+  for(size_t p = 0; p < count; p++) {
+    state.ir = programs[p];
+    state.namespace = namespaces[p];
+    state.locals = locals[p];
+    for(uint32_t m = 0; m < programs[p]->machine_count; m++) {
+      print_machine(&state, &programs[p]->machines[m]);
     }
   }
 
@@ -625,20 +809,101 @@ void compile_xstate(CompileResult* result, char* source, char* filename) {
   result->success = true;
   result->js = js;
 
-  // Teardown
-  destroy_state(&state);
   js_builder_destroy(jsb);
+  lucy_free(state.blocks);
+  for(size_t p = 0; p < count; p++) {
+    lucy_free(locals[p]);
+  }
+  lucy_free(locals);
+  for(uint32_t i = 0; i < bundle.import_count; i++) {
+    lucy_free(bundle.imports[i].key);
+    lucy_free(bundle.imports[i].local);
+  }
+  lucy_free(bundle.imports);
+  for(uint32_t i = 0; i < bundle.export_count; i++) {
+    lucy_free(bundle.exports[i]);
+  }
+  lucy_free(bundle.exports);
+  symtab_destroy(&bundle.by_key);
+  symtab_destroy(&bundle.bound);
+
+  lucy_set_allocator(outer);
+  stats_phase_end(STATS_PHASE_EMIT);
+  if(result->stats != NULL) {
+    result->stats->bytes_emitted = strlen(js);
+  }
+}
 
-  return;
+void compile_xstate(CompileResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  if(result->stats != NULL) {
+    stats_start(result->stats);
+    result->stats->source_bytes = strlen(source);
+  }
+
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & XS_FLAG_MINIMIZE, result->flags & XS_FLAG_OPTIMIZE, &result->diagnostics);
+
+  if(ir == NULL) {
+    result->success = false;
+    result->js = NULL;
+    lucy_set_allocator(outer);
+    stats_stop();
+    return;
+  }
+
+  xs_emit(result, ir);
+  ir_destroy(ir);
+  lucy_set_allocator(outer);
+  stats_stop();
 }
 
 char* xs_get_js(CompileResult* result) {
   return result->js;
 }
 
+Stats* xs_get_stats(CompileResult* result) {
+  return result->stats;
+}
+
+Diagnostics* xs_get_diagnostics(CompileResult* result) {
+  return &result->diagnostics;
+}
+
+char* xs_get_diagnostics_json(CompileResult* result) {
+  if(result->diagnostics_json == NULL) {
+    const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+    result->diagnostics_json = diagnostics_to_json(&result->diagnostics);
+    lucy_set_allocator(outer);
+  }
+  return result->diagnostics_json;
+}
+
+char* xs_get_stats_json(CompileResult* result) {
+  if(result->stats == NULL) {
+    return NULL;
+  }
+  if(result->stats_json == NULL) {
+    const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+    result->stats_json = stats_to_json(result->stats);
+    lucy_set_allocator(outer);
+  }
+  return result->stats_json;
+}
+
 void destroy_xstate_result(CompileResult* result) {
   if(result->js != NULL) {
-    free(result->js);
+    lucy_free(result->js);
+  }
+  if(result->stats != NULL) {
+    stats_destroy(result->stats);
+  }
+  if(result->stats_json != NULL) {
+    lucy_free(result->stats_json);
+  }
+  diagnostics_destroy(&result->diagnostics);
+  if(result->diagnostics_json != NULL) {
+    lucy_free(result->diagnostics_json);
   }
-  free(result);
+  lucy_free(result);
 }
\ No newline at end of file
@@ -1,16 +1,53 @@
 #ifndef LUCY_COMPILER_XSTATE_H_
 #define LUCY_COMPILER_XSTATE_H_
 
+#include <stdbool.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "ir.h"
+#include "stats.h"
+
+// Flags for xs_init
+#define XS_FLAG_USE_REMOTE 1 << 0
+#define XS_FLAG_OPTIMIZE 1 << 1
+#define XS_FLAG_MINIMIZE 1 << 2
+// Export each machine as a function that builds it on the first call.
+#define XS_FLAG_LAZY 1 << 3
+
 typedef struct CompileResult {
   bool success;
   char* js;
   int flags;
+  Stats* stats;
+  char* stats_json;
+  Diagnostics diagnostics;
+  char* diagnostics_json;
+  const LucyAllocator* allocator;
 } CompileResult;
 
 CompileResult* xs_create();
 void xs_init(CompileResult*, int);
+void xs_enable_stats(CompileResult*);
+// Compiles with the allocator instead of the thread's, NULL for that.
+void xs_set_allocator(CompileResult*, const LucyAllocator*);
 void compile_xstate(CompileResult*, char*, char*);
+// Emits a program compiled with frontend_compile, which is only read so
+// other emitters can share it.
+void xs_emit(CompileResult*, IRProgram*);
+// Emits the programs as one module, for lc --bundle. It imports xstate
+// once, merges the programs' imports and renames any that clash. Each
+// program's machines are exported as <namespace>_<name>, its default
+// machine as <namespace>, so the namespaces have to be unique
+// identifiers without a _ past the first character.
+void xs_emit_bundle(CompileResult*, IRProgram**, char**, size_t);
+// Whether a bundle can't export a default machine by this name, because
+// it's a reserved word or imported from xstate.
+bool xs_bundle_reserved(const char*);
 char* xs_get_js(CompileResult*);
+Stats* xs_get_stats(CompileResult*);
+char* xs_get_stats_json(CompileResult*);
+Diagnostics* xs_get_diagnostics(CompileResult*);
+char* xs_get_diagnostics_json(CompileResult*);
 void destroy_xstate_result(CompileResult*);
 
 #endif
\ No newline at end of file
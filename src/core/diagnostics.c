@@ -0,0 +1,62 @@
+#include <string.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "str_builder.h"
+
+void diagnostics_init(Diagnostics* diagnostics) {
+  diagnostics->items = NULL;
+  diagnostics->count = 0;
+  diagnostics->capacity = 0;
+  diagnostics->error_count = 0;
+}
+
+void diagnostics_destroy(Diagnostics* diagnostics) {
+  for(uint32_t i = 0; i < diagnostics->count; i++) {
+    lucy_free(diagnostics->items[i].message);
+  }
+  if(diagnostics->items != NULL) {
+    lucy_free(diagnostics->items);
+  }
+  diagnostics_init(diagnostics);
+}
+
+void diagnostics_add(Diagnostics* diagnostics, Diagnostic* diagnostic) {
+  if(diagnostics->count == diagnostics->capacity) {
+    diagnostics->capacity = diagnostics->capacity == 0 ? 4 : diagnostics->capacity * 2;
+    diagnostics->items = lucy_realloc(diagnostics->items, diagnostics->capacity * sizeof(Diagnostic));
+  }
+
+  Diagnostic* copy = &diagnostics->items[diagnostics->count++];
+  *copy = *diagnostic;
+  if(copy->end < copy->start) {
+    copy->end = copy->start;
+  }
+  copy->message = lucy_strdup(diagnostic->message);
+
+  if(diagnostic->severity == DIAGNOSTIC_ERROR) {
+    diagnostics->error_count++;
+  }
+}
+
+const char* diagnostics_severity_name(int severity) {
+  return severity == DIAGNOSTIC_ERROR ? "error" : "warning";
+}
+
+char* diagnostics_to_json(Diagnostics* diagnostics) {
+  str_builder_t* sb = str_builder_create();
+  str_builder_add_char(sb, '[');
+  for(uint32_t i = 0; i < diagnostics->count; i++) {
+    Diagnostic* diagnostic = &diagnostics->items[i];
+    str_builder_add_fmt(sb, "%s{\"code\": %u, \"severity\": \"%s\", \"start\": %u, \"end\": %u, "
+      "\"line\": %u, \"column\": %u, \"message\": ", i > 0 ? ", " : "",
+      diagnostic->code, diagnostics_severity_name(diagnostic->severity),
+      diagnostic->start, diagnostic->end, diagnostic->line, diagnostic->column);
+    str_builder_add_json_str(sb, diagnostic->message, strlen(diagnostic->message));
+    str_builder_add_char(sb, '}');
+  }
+  str_builder_add_char(sb, ']');
+
+  char* json = str_builder_dump(sb, NULL);
+  str_builder_destroy(sb);
+  return json;
+}
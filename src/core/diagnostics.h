@@ -0,0 +1,66 @@
+#ifndef LUCY_DIAGNOSTICS_H_
+#define LUCY_DIAGNOSTICS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIAGNOSTIC_ERROR 0
+#define DIAGNOSTIC_WARNING 1
+
+// Diagnostic codes. These are part of the output, don't renumber them.
+#define DIAG_INTERNAL 1
+#define DIAG_UNEXPECTED_IDENTIFIER 2
+#define DIAG_UNKNOWN_TOP_LEVEL 3
+#define DIAG_EXPECTED_NAME 4
+#define DIAG_EXPECTED_IDENTIFIER 5
+#define DIAG_EXPECTED_ASSIGNMENT 6
+#define DIAG_EXPECTED_DESTINATION 7
+#define DIAG_EXPECTED_FUNCTION 8
+#define DIAG_EXPECTED_PROPERTY 9
+#define DIAG_EXPECTED_DELAY 10
+#define DIAG_INVALID_TIMEFRAME 11
+#define DIAG_UNSUPPORTED 12
+#define DIAG_IMPORT_NOT_FIRST 13
+#define DIAG_DUPLICATE_NAME 14
+#define DIAG_NOT_A_BINDING 15
+#define DIAG_NOT_IMPORTED 16
+#define DIAG_UNKNOWN_STATE 17
+#define DIAG_UNKNOWN_INVOKE 18
+#define DIAG_DUPLICATE_STATE 19
+#define DIAG_INVOKE_TRANSITION 20
+#define DIAG_UNREACHABLE_STATE 21
+#define DIAG_UNUSED_BINDING 22
+#define DIAG_TOO_DEEP 23
+#define DIAG_TOO_LARGE 24
+
+// A problem found while compiling. start and end are the byte span it's
+// about and span_line the line that starts on. line and column (1-based)
+// are where it's reported, which for parse errors is where the parser
+// stopped.
+typedef struct Diagnostic {
+  uint16_t code;
+  uint8_t severity;
+  uint32_t start;
+  uint32_t end;
+  uint32_t span_line;
+  uint32_t line;
+  uint32_t column;
+  char* message;
+} Diagnostic;
+
+typedef struct Diagnostics {
+  Diagnostic* items;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t error_count;
+} Diagnostics;
+
+void diagnostics_init(Diagnostics*);
+void diagnostics_destroy(Diagnostics*);
+// Adds a copy of the diagnostic and its message.
+void diagnostics_add(Diagnostics*, Diagnostic*);
+const char* diagnostics_severity_name(int);
+char* diagnostics_to_json(Diagnostics*);
+
+#endif
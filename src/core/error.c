@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <limits.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "error.h"
 #include "node.h"
 #include "state.h"
 #include "str_builder.h"
@@ -41,17 +45,64 @@ static int num_places (int n) {
     return 10;
 }
 
-void error_file_info(State* state) {
-  unsigned short line = state->line + 1;
-  unsigned short col = state->column;
-  fprintf(stderr, BOLDWHITE "%s" RESET ":%hu:%hu\n", state->filename, line, col);
+void error_msg_with_code_block(State* state, Node* node, int code, const char* msg) {
+  Diagnostic diagnostic = {
+    .code = code,
+    .severity = DIAGNOSTIC_ERROR,
+    .start = node == NULL ? state->index : node->start,
+    .end = node == NULL ? state->index : node->end,
+    .span_line = (node == NULL ? state->line : node->line) + 1,
+    .line = state->line + 1,
+    .column = state->column,
+    .message = (char*)msg
+  };
+  diagnostics_add(state->diagnostics, &diagnostic);
 }
 
-void error_message(const char* msg) {
-  fprintf(stderr, "\n " BOLDRED "𝒙" RESET RED " %s\n\n" RESET, msg);
+void error_unexpected_identifier(State* state, Node* node) {
+  error_msg_with_code_block(state, node, DIAG_UNEXPECTED_IDENTIFIER, "Unexpected identifier");
+}
+
+static void add_at_node(State* state, Node* node, int code, int severity, const char* msg) {
+  size_t line_start = node->start;
+  while(line_start > 0 && state->source[line_start - 1] != '\n') {
+    line_start--;
+  }
+
+  Diagnostic diagnostic = {
+    .code = code,
+    .severity = severity,
+    .start = node->start,
+    .end = node->end,
+    .span_line = node->line + 1,
+    .line = node->line + 1,
+    .column = node->start - line_start + 1,
+    .message = (char*)msg
+  };
+  diagnostics_add(state->diagnostics, &diagnostic);
+}
+
+void error_msg_at_node(State* state, Node* node, int code, const char* msg) {
+  add_at_node(state, node, code, DIAGNOSTIC_ERROR, msg);
+}
+
+void warning_msg_at_node(State* state, Node* node, int code, const char* msg) {
+  add_at_node(state, node, code, DIAGNOSTIC_WARNING, msg);
+}
+
+static void print_file_info(FILE* fp, char* filename, Diagnostic* diagnostic) {
+  fprintf(fp, BOLDWHITE "%s" RESET ":%u:%u\n", filename, diagnostic->line, diagnostic->column);
+}
+
+static void print_message(FILE* fp, Diagnostic* diagnostic) {
+  if(diagnostic->severity == DIAGNOSTIC_WARNING) {
+    fprintf(fp, "\n " BOLDYELLOW "!" RESET YELLOW " %s\n\n" RESET, diagnostic->message);
+  } else {
+    fprintf(fp, "\n " BOLDRED "𝒙" RESET RED " %s\n\n" RESET, diagnostic->message);
+  }
 }
 
-static void print_code_line(str_builder_t *sb, size_t line, int max_spaces) {
+static void print_code_line(FILE* fp, str_builder_t *sb, size_t line, int max_spaces) {
   int line_spaces = num_places(line);
   int num_spaces = max_spaces - line_spaces + 1;
 
@@ -61,23 +112,47 @@ static void print_code_line(str_builder_t *sb, size_t line, int max_spaces) {
   }
   spaces[num_spaces] = '\0';
 
-  fprintf(stderr, BOLDWHITE "    %zu" RESET "%s│ %s", line, spaces, str_builder_dump(sb, NULL));
+  fprintf(fp, BOLDWHITE "    %zu" RESET "%s│ %s", line, spaces, str_builder_peek(sb));
 }
 
-void error_annotate(State* state, Node* node) {
-  char* source = state->source;
-  size_t source_len = state->source_len;
+// Where each line starts, so each code block is found without rescanning
+// the source from the top.
+static uint32_t* index_lines(char* source, size_t source_len, uint32_t* count) {
+  uint32_t capacity = 1024;
+  uint32_t* starts = lucy_malloc(capacity * sizeof(uint32_t));
+  uint32_t n = 0;
+  starts[n++] = 0;
+
+  char* end = source + source_len;
+  for(char* c = memchr(source, '\n', source_len); c != NULL; c = memchr(c + 1, '\n', end - c - 1)) {
+    if(n == capacity) {
+      capacity *= 2;
+      starts = lucy_realloc(starts, capacity * sizeof(uint32_t));
+    }
+    starts[n++] = c + 1 - source;
+  }
+
+  *count = n;
+  return starts;
+}
 
-  unsigned short problem_line = node == NULL ? state->line : node->line;
-  unsigned short start_line = problem_line > 2 ? (problem_line - 2) : 0;
-  unsigned short end_line = problem_line + 2;
+// Prints the lines around the span's, with a marker after it.
+static void print_annotation(FILE* fp, char* source, size_t source_len, uint32_t* line_starts,
+  uint32_t line_count, Diagnostic* diagnostic) {
+  uint32_t problem_line = diagnostic->span_line - 1;
+  uint32_t start_line = problem_line > 2 ? (problem_line - 2) : 0;
+  uint32_t end_line = problem_line + 2;
   unsigned int max_num_places = num_places(end_line);
 
   str_builder_t *sb = str_builder_create();
 
   bool in_block = false;
-  size_t i = 0;
-  size_t line = 0;
+  size_t i = source_len;
+  size_t line = line_count - 1;
+  if(start_line < line_count) {
+    i = line_starts[start_line];
+    line = start_line;
+  }
   size_t col = 0;
   char c;
   while(i < source_len) {
@@ -98,19 +173,13 @@ void error_annotate(State* state, Node* node) {
 
     if(c == '\n') {
       if(in_block) {
-        print_code_line(sb, line + 1, max_num_places);
+        print_code_line(fp, sb, line + 1, max_num_places);
         str_builder_clear(sb);
       }
 
       if(line == problem_line) {
-        unsigned short places = CODE_BLOCK_INDENT + max_num_places + 1 + col + 1;
-        char spaces[places + 1];
-        for(int pi = 0; pi < places; pi++) {
-          spaces[pi] = ' ';
-        }
-        spaces[places] = '\0';
-
-        fprintf(stderr, "%s" BOLDRED "˄" RESET "\n", spaces);
+        size_t places = CODE_BLOCK_INDENT + max_num_places + 1 + col + 1;
+        fprintf(fp, "%*s" BOLDRED "˄" RESET "\n", (int)places, "");
       }
 
       line++;
@@ -122,19 +191,26 @@ void error_annotate(State* state, Node* node) {
     i++;
   }
 
-  print_code_line(sb, line + 1, max_num_places);
-  fprintf(stderr, "\n");
+  print_code_line(fp, sb, line + 1, max_num_places);
+  fprintf(fp, "\n");
 
   str_builder_destroy(sb);
 }
 
-void error_msg_with_code_block(State* state, Node* node, const char* msg) {
-  error_file_info(state);
-  error_message(msg);
-  error_annotate(state, node);
-  fprintf(stderr, "\n");
-}
+void error_print(FILE* fp, Diagnostics* diagnostics, char* source, char* filename) {
+  if(diagnostics->count == 0) {
+    return;
+  }
 
-void error_unexpected_identifier(State* state, Node* node) {
-  error_msg_with_code_block(state, node, "Unexpected identifier");
-}
\ No newline at end of file
+  size_t source_len = strlen(source);
+  uint32_t line_count;
+  uint32_t* line_starts = index_lines(source, source_len, &line_count);
+  for(uint32_t i = 0; i < diagnostics->count; i++) {
+    Diagnostic* diagnostic = &diagnostics->items[i];
+    print_file_info(fp, filename, diagnostic);
+    print_message(fp, diagnostic);
+    print_annotation(fp, source, source_len, line_starts, line_count, diagnostic);
+    fprintf(fp, "\n");
+  }
+  lucy_free(line_starts);
+}
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <stdio.h>
+#include "diagnostics.h"
 #include "node.h"
 #include "state.h"
 
-void error_file_info(State*);
-void error_annotate(State*, Node*);
-void error_message(char*);
-void error_msg_with_code_block(State*, Node*, const char*);
-void error_unexpected_identifier(State*, Node*);
\ No newline at end of file
+// Record a diagnostic in the state's list. Reported at the parser's
+// position, or at the node's for the _at_node ones.
+void error_msg_with_code_block(State*, Node*, int, const char*);
+void error_unexpected_identifier(State*, Node*);
+void error_msg_at_node(State*, Node*, int, const char*);
+void warning_msg_at_node(State*, Node*, int, const char*);
+
+// Pretty prints diagnostics with the source lines around each, for a
+// terminal.
+void error_print(FILE*, Diagnostics*, char*, char*);
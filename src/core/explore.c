@@ -0,0 +1,652 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "ir.h"
+#include "frontend.h"
+#include "str_builder.h"
+#include "explore.h"
+#include "stats.h"
+
+// Frontier items claimed at a time, by a worker or a thief.
+#define EXPLORE_CHUNK 64
+
+typedef struct Dispatch {
+  uint32_t event;
+  uint32_t transition;
+} Dispatch;
+
+typedef struct Barrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int count;
+  int waiting;
+  unsigned generation;
+} Barrier;
+
+// A worker's share of the frontier. The owner and thieves both claim from
+// next, so a worker that runs dry takes chunks from the others.
+typedef struct Range {
+  _Atomic uint32_t next;
+  uint32_t end;
+  char pad[56];
+} Range;
+
+// A leaf being settled, and the always transition to try next.
+typedef struct Frame {
+  uint32_t leaf;
+  uint32_t state;
+  uint32_t t;
+  bool certain;
+} Frame;
+
+struct Explorer;
+
+typedef struct Worker {
+  struct Explorer* e;
+  int id;
+  pthread_t thread;
+
+  // Configurations this worker found first in the current level.
+  uint32_t* found;
+  uint32_t found_count;
+  uint32_t found_capacity;
+
+  uint32_t* deadlocks;
+  uint32_t deadlock_count;
+  uint32_t deadlock_capacity;
+  uint64_t transitions;
+  uint64_t finals;
+
+  // Per event and per state marks, reset by bumping the epoch.
+  uint32_t* event_marks;
+  uint32_t event_epoch;
+  uint32_t* settle_marks;
+  uint32_t settle_epoch;
+  Frame* frames;
+} Worker;
+
+typedef struct Explorer {
+  IRProgram* ir;
+  IRMachine* machine;
+
+  // The last event transition per event and state, they're the ones taken.
+  uint32_t* dispatch_offsets;
+  Dispatch* dispatch;
+
+  // A bit per configuration, set by whoever reaches it first, and a bit per
+  // leaf passed through on the way by always transitions.
+  _Atomic uint64_t* visited;
+  _Atomic uint64_t* passed;
+
+  uint32_t* frontier;
+  uint32_t frontier_count;
+  uint32_t frontier_capacity;
+  uint32_t depth;
+  bool done;
+
+  Range* ranges;
+  Worker* workers;
+  int jobs;
+  Barrier barrier;
+  const LucyAllocator* allocator;
+} Explorer;
+
+#define explore_grow(ptr, count, capacity) \
+  if((count) == (capacity)) { \
+    (capacity) = (capacity) == 0 ? 64 : (capacity) * 2; \
+    (ptr) = lucy_realloc((ptr), (capacity) * sizeof(*(ptr))); \
+  }
+
+static void barrier_init(Barrier* barrier, int count) {
+  pthread_mutex_init(&barrier->mutex, NULL);
+  pthread_cond_init(&barrier->cond, NULL);
+  barrier->count = count;
+  barrier->waiting = 0;
+  barrier->generation = 0;
+}
+
+static void barrier_destroy(Barrier* barrier) {
+  pthread_mutex_destroy(&barrier->mutex);
+  pthread_cond_destroy(&barrier->cond);
+}
+
+static void barrier_wait(Barrier* barrier) {
+  if(barrier->count == 1) {
+    return;
+  }
+  pthread_mutex_lock(&barrier->mutex);
+  unsigned generation = barrier->generation;
+  if(++barrier->waiting == barrier->count) {
+    barrier->waiting = 0;
+    barrier->generation++;
+    pthread_cond_broadcast(&barrier->cond);
+  } else {
+    while(generation == barrier->generation) {
+      pthread_cond_wait(&barrier->cond, &barrier->mutex);
+    }
+  }
+  pthread_mutex_unlock(&barrier->mutex);
+}
+
+static int compare_dispatch(const void* a, const void* b) {
+  uint32_t x = ((Dispatch*)a)->event;
+  uint32_t y = ((Dispatch*)b)->event;
+  return x < y ? -1 : x > y;
+}
+
+static int compare_ids(const void* a, const void* b) {
+  uint32_t x = *(uint32_t*)a;
+  uint32_t y = *(uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void build_dispatch(Explorer* e) {
+  IRMachine* machine = e->machine;
+  uint32_t* rows = machine->offsets[IR_EVENT];
+  uint32_t* marks = lucy_malloc((e->ir->strings.count + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < e->ir->strings.count; i++) {
+    marks[i] = IR_NONE;
+  }
+
+  e->dispatch_offsets = lucy_malloc((machine->state_count + 1) * sizeof(uint32_t));
+  e->dispatch = lucy_malloc((rows[machine->state_count] - rows[0] + 1) * sizeof(Dispatch));
+  uint32_t count = 0;
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    e->dispatch_offsets[s] = count;
+    for(uint32_t t = rows[s + 1]; t > rows[s]; t--) {
+      uint32_t event = machine->transitions[t - 1].event;
+      if(marks[event] != s) {
+        marks[event] = s;
+        e->dispatch[count].event = event;
+        e->dispatch[count].transition = t - 1;
+        count++;
+      }
+    }
+    qsort(&e->dispatch[e->dispatch_offsets[s]], count - e->dispatch_offsets[s], sizeof(Dispatch), compare_dispatch);
+  }
+  e->dispatch_offsets[machine->state_count] = count;
+  lucy_free(marks);
+}
+
+// The leaf entered along with a state.
+static uint32_t descend(IRMachine* machine, uint32_t state) {
+  while(machine->states[state].child_count > 0) {
+    IRState* s = &machine->states[state];
+    state = s->initial != IR_NONE ? s->initial : s->child_start;
+  }
+  return state;
+}
+
+static bool is_final(IRMachine* machine, uint32_t leaf) {
+  uint32_t state = leaf;
+  while(machine->states[state].parent != IR_NONE) {
+    state = machine->states[state].parent;
+  }
+  return machine->states[state].flags & IR_STATE_FINAL;
+}
+
+static void pass(Worker* w, uint32_t leaf) {
+  uint64_t bit = 1ull << (leaf % 64);
+  if((atomic_load_explicit(&w->e->passed[leaf / 64], memory_order_relaxed) & bit) == 0) {
+    atomic_fetch_or_explicit(&w->e->passed[leaf / 64], bit, memory_order_relaxed);
+  }
+}
+
+static void reach(Worker* w, uint32_t leaf) {
+  Explorer* e = w->e;
+  uint64_t bit = 1ull << (leaf % 64);
+  w->transitions++;
+  if((atomic_load_explicit(&e->visited[leaf / 64], memory_order_relaxed) & bit) != 0) {
+    return;
+  }
+  if((atomic_fetch_or_explicit(&e->visited[leaf / 64], bit, memory_order_relaxed) & bit) == 0) {
+    explore_grow(w->found, w->found_count, w->found_capacity);
+    w->found[w->found_count++] = leaf;
+  }
+}
+
+// Follows always transitions from a leaf to the configurations it can come
+// to rest in. Guarded ones may or may not be taken, so a leaf rests where it
+// is unless an unguarded always transition is certain to be taken. The
+// runtime gives up on always transitions that cycle, so a cycle rests where
+// it closes. Depth first, marking leaves on the path and leaves done.
+static void settle(Worker* w, uint32_t start) {
+  IRMachine* machine = w->e->machine;
+  uint32_t* rows = machine->offsets[IR_ALWAYS];
+  if(rows[0] == rows[machine->state_count]) {
+    reach(w, start);
+    return;
+  }
+
+  w->settle_epoch += 2;
+  if(w->settle_epoch < 2) {
+    memset(w->settle_marks, 0, machine->state_count * sizeof(uint32_t));
+    w->settle_epoch = 2;
+  }
+  uint32_t on_path = w->settle_epoch;
+  uint32_t done = w->settle_epoch + 1;
+
+  uint32_t top = 0;
+  w->frames[top++] = (Frame){ start, start, rows[start], false };
+  w->settle_marks[start] = on_path;
+  pass(w, start);
+  while(top > 0) {
+    Frame* frame = &w->frames[top - 1];
+    while(!frame->certain && frame->state != IR_NONE && frame->t == rows[frame->state + 1]) {
+      frame->state = machine->states[frame->state].parent;
+      frame->t = frame->state == IR_NONE ? 0 : rows[frame->state];
+    }
+    if(frame->certain || frame->state == IR_NONE) {
+      if(!frame->certain) {
+        reach(w, frame->leaf);
+      }
+      w->settle_marks[frame->leaf] = done;
+      top--;
+      continue;
+    }
+
+    IRTransition* transition = &machine->transitions[frame->t++];
+    frame->certain = transition->guard_count == 0;
+    uint32_t next = descend(machine, transition->target);
+    if(w->settle_marks[next] == on_path) {
+      reach(w, next);
+    } else if(w->settle_marks[next] != done) {
+      w->settle_marks[next] = on_path;
+      w->frames[top++] = (Frame){ next, next, rows[next], false };
+      pass(w, next);
+    }
+  }
+}
+
+// Takes every transition out of a configuration that can be taken, with
+// guards that may go either way.
+static void expand(Worker* w, uint32_t leaf) {
+  Explorer* e = w->e;
+  IRMachine* machine = e->machine;
+  if(is_final(machine, leaf)) {
+    w->finals++;
+    return;
+  }
+
+  if(++w->event_epoch == 0) {
+    memset(w->event_marks, 0, e->ir->strings.count * sizeof(uint32_t));
+    w->event_epoch = 1;
+  }
+
+  // Events go to the innermost state that takes them, past ones whose
+  // guards don't pass.
+  bool exits = false;
+  for(uint32_t state = leaf; state != IR_NONE; state = machine->states[state].parent) {
+    for(uint32_t i = e->dispatch_offsets[state]; i < e->dispatch_offsets[state + 1]; i++) {
+      Dispatch* dispatch = &e->dispatch[i];
+      if(w->event_marks[dispatch->event] == w->event_epoch) {
+        continue;
+      }
+      IRTransition* transition = &machine->transitions[dispatch->transition];
+      if(transition->guard_count == 0) {
+        w->event_marks[dispatch->event] = w->event_epoch;
+      }
+      settle(w, descend(machine, transition->target));
+      exits = true;
+    }
+
+    // Every active state's timers and invokes can fire, the last
+    // transition for each is the one taken.
+    uint32_t* delays = machine->offsets[IR_DELAY];
+    for(uint32_t t = delays[state]; t < delays[state + 1]; t++) {
+      bool last = true;
+      for(uint32_t later = t + 1; later < delays[state + 1] && last; later++) {
+        last = machine->transitions[later].delay != machine->transitions[t].delay;
+      }
+      if(last) {
+        settle(w, descend(machine, machine->transitions[t].target));
+        exits = true;
+      }
+    }
+    for(uint32_t i = machine->invoke_offsets[state]; i < machine->invoke_offsets[state + 1]; i++) {
+      for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+        uint32_t* rows = machine->offsets[kind];
+        if(rows[i] < rows[i + 1]) {
+          settle(w, descend(machine, machine->transitions[rows[i + 1] - 1].target));
+          exits = true;
+        }
+      }
+    }
+  }
+
+  if(!exits) {
+    explore_grow(w->deadlocks, w->deadlock_count, w->deadlock_capacity);
+    w->deadlocks[w->deadlock_count++] = leaf;
+  }
+}
+
+static bool claim(Range* range, uint32_t* start, uint32_t* end) {
+  if(atomic_load_explicit(&range->next, memory_order_relaxed) >= range->end) {
+    return false;
+  }
+  uint32_t next = atomic_fetch_add_explicit(&range->next, EXPLORE_CHUNK, memory_order_relaxed);
+  if(next >= range->end) {
+    return false;
+  }
+  *start = next;
+  *end = next + EXPLORE_CHUNK < range->end ? next + EXPLORE_CHUNK : range->end;
+  return true;
+}
+
+// Splits the frontier between the workers.
+static void share(Explorer* e) {
+  uint32_t share = (e->frontier_count + e->jobs - 1) / e->jobs;
+  for(int i = 0; i < e->jobs; i++) {
+    uint32_t start = share * i < e->frontier_count ? share * i : e->frontier_count;
+    uint32_t end = start + share < e->frontier_count ? start + share : e->frontier_count;
+    atomic_store_explicit(&e->ranges[i].next, start, memory_order_relaxed);
+    e->ranges[i].end = end;
+  }
+}
+
+// Makes what the workers found the next level's frontier.
+static void advance(Explorer* e) {
+  uint32_t count = 0;
+  for(int i = 0; i < e->jobs; i++) {
+    count += e->workers[i].found_count;
+  }
+  if(count > e->frontier_capacity) {
+    e->frontier_capacity = count;
+    e->frontier = lucy_realloc(e->frontier, count * sizeof(uint32_t));
+  }
+  e->frontier_count = 0;
+  for(int i = 0; i < e->jobs; i++) {
+    Worker* w = &e->workers[i];
+    if(w->found_count == 0) {
+      continue;
+    }
+    memcpy(&e->frontier[e->frontier_count], w->found, w->found_count * sizeof(uint32_t));
+    e->frontier_count += w->found_count;
+    w->found_count = 0;
+  }
+  if(count > 0) {
+    e->depth++;
+  }
+  e->done = count == 0;
+  share(e);
+}
+
+// Level by level: every worker drains its range then steals from the
+// others', and the first worker gathers the next level in between.
+static void* work(void* arg) {
+  Worker* w = arg;
+  Explorer* e = w->e;
+  lucy_set_allocator(e->allocator);
+  while(true) {
+    barrier_wait(&e->barrier);
+    if(e->done) {
+      break;
+    }
+    for(int i = 0; i < e->jobs; i++) {
+      Range* range = &e->ranges[(w->id + i) % e->jobs];
+      uint32_t start, end;
+      while(claim(range, &start, &end)) {
+        for(uint32_t j = start; j < end; j++) {
+          expand(w, e->frontier[j]);
+        }
+      }
+    }
+    barrier_wait(&e->barrier);
+    if(w->id != 0) {
+      continue;
+    }
+    // Levels too narrow to share are cheaper to run alone than to sync on.
+    advance(e);
+    while(!e->done && e->frontier_count < EXPLORE_CHUNK) {
+      for(uint32_t j = 0; j < e->frontier_count; j++) {
+        expand(w, e->frontier[j]);
+      }
+      advance(e);
+    }
+  }
+  return NULL;
+}
+
+static void explore_machine(ExploreResult* result, IRMachine* machine, ExploreReport* report) {
+  unsigned long long start = stats_now();
+  memset(report, 0, sizeof(*report));
+  report->machine = machine->name;
+  if(machine->state_count == 0) {
+    return;
+  }
+
+  Explorer e = {0};
+  e.ir = result->ir;
+  e.machine = machine;
+  e.jobs = result->jobs;
+  e.allocator = lucy_get_allocator();
+  build_dispatch(&e);
+  uint32_t words = (machine->state_count + 63) / 64;
+  e.visited = lucy_malloc(words * sizeof(uint64_t));
+  e.passed = lucy_malloc(words * sizeof(uint64_t));
+  for(uint32_t i = 0; i < words; i++) {
+    atomic_init(&e.visited[i], 0);
+    atomic_init(&e.passed[i], 0);
+  }
+  e.ranges = lucy_malloc(e.jobs * sizeof(Range));
+  e.workers = lucy_calloc(e.jobs, sizeof(Worker));
+  barrier_init(&e.barrier, e.jobs);
+
+  for(int i = 0; i < e.jobs; i++) {
+    Worker* w = &e.workers[i];
+    w->e = &e;
+    w->id = i;
+    w->event_marks = lucy_calloc(result->ir->strings.count + 1, sizeof(uint32_t));
+    w->settle_marks = lucy_calloc(machine->state_count, sizeof(uint32_t));
+    w->frames = lucy_malloc(machine->state_count * sizeof(Frame));
+  }
+
+  uint32_t initial = machine->initial != IR_NONE ? machine->initial : 0;
+  settle(&e.workers[0], descend(machine, initial));
+  e.workers[0].transitions = 0;
+  advance(&e);
+  e.depth = 0;
+
+  for(int i = 1; i < e.jobs; i++) {
+    pthread_create(&e.workers[i].thread, NULL, work, &e.workers[i]);
+  }
+  work(&e.workers[0]);
+  for(int i = 1; i < e.jobs; i++) {
+    pthread_join(e.workers[i].thread, NULL);
+  }
+
+  // States are reached if they're in a configuration that was reached or
+  // passed through.
+  bool* active = lucy_calloc(machine->state_count, sizeof(bool));
+  for(uint32_t leaf = 0; leaf < machine->state_count; leaf++) {
+    uint64_t bit = 1ull << (leaf % 64);
+    bool visited = atomic_load(&e.visited[leaf / 64]) & bit;
+    if(!visited && (atomic_load(&e.passed[leaf / 64]) & bit) == 0) {
+      continue;
+    }
+    report->configurations += visited;
+    for(uint32_t state = leaf; state != IR_NONE && !active[state]; state = machine->states[state].parent) {
+      active[state] = true;
+    }
+  }
+  report->unreachable = lucy_malloc((machine->state_count + 1) * sizeof(uint32_t));
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(!active[s]) {
+      report->unreachable[report->unreachable_count++] = s;
+    }
+  }
+  lucy_free(active);
+
+  uint32_t deadlock_capacity = 0;
+  for(int i = 0; i < e.jobs; i++) {
+    Worker* w = &e.workers[i];
+    report->transitions += w->transitions;
+    report->finals += w->finals;
+    for(uint32_t j = 0; j < w->deadlock_count; j++) {
+      explore_grow(report->deadlocks, report->deadlock_count, deadlock_capacity);
+      report->deadlocks[report->deadlock_count++] = w->deadlocks[j];
+    }
+    lucy_free(w->found);
+    lucy_free(w->deadlocks);
+    lucy_free(w->event_marks);
+    lucy_free(w->settle_marks);
+    lucy_free(w->frames);
+  }
+  if(report->deadlock_count > 0) {
+    qsort(report->deadlocks, report->deadlock_count, sizeof(uint32_t), compare_ids);
+  }
+  report->depth = e.depth;
+
+  barrier_destroy(&e.barrier);
+  lucy_free(e.workers);
+  lucy_free(e.ranges);
+  lucy_free((void*)e.visited);
+  lucy_free((void*)e.passed);
+  lucy_free(e.frontier);
+  lucy_free(e.dispatch);
+  lucy_free(e.dispatch_offsets);
+  report->ns = stats_now() - start;
+}
+
+ExploreResult* explore_create() {
+  ExploreResult* result = lucy_malloc(sizeof(*result));
+  return result;
+}
+
+// Without thread support in the build there's one worker.
+void explore_init(ExploreResult* result, int flags, int jobs) {
+  result->success = false;
+  result->flags = flags;
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  (void)jobs;
+  result->jobs = 1;
+#else
+  result->jobs = jobs < 1 ? 1 : jobs;
+#endif
+  result->ir = NULL;
+  result->reports = NULL;
+  result->report_count = 0;
+  diagnostics_init(&result->diagnostics);
+  result->allocator = NULL;
+}
+
+void explore_set_allocator(ExploreResult* result, const LucyAllocator* allocator) {
+  result->allocator = allocator;
+}
+
+void explore_program(ExploreResult* result, char* source, char* filename) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  IRProgram* ir = frontend_compile(source, filename,
+    result->flags & EXPLORE_FLAG_MINIMIZE, result->flags & EXPLORE_FLAG_OPTIMIZE, &result->diagnostics);
+  if(ir == NULL) {
+    result->success = false;
+    lucy_set_allocator(outer);
+    return;
+  }
+
+  result->ir = ir;
+  result->reports = lucy_malloc((ir->machine_count + 1) * sizeof(ExploreReport));
+  result->report_count = ir->machine_count;
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    explore_machine(result, &ir->machines[i], &result->reports[i]);
+  }
+  result->success = true;
+  lucy_set_allocator(outer);
+}
+
+static void print_states(FILE* fp, ExploreResult* result, IRMachine* machine, char* label, uint32_t* states, uint32_t count) {
+  uint32_t* path = NULL;
+  uint32_t capacity = 0;
+  fprintf(fp, "  %-16s %10u\n", label, count);
+  for(uint32_t i = 0; i < count; i++) {
+    fprintf(fp, "    ");
+    uint32_t length = ir_state_path(machine, states[i], &path, &capacity);
+    for(uint32_t p = 0; p < length; p++) {
+      if(p > 0) {
+        fputc('.', fp);
+      }
+      fputs(ir_string(result->ir, machine->states[path[p]].name), fp);
+    }
+    fputc('\n', fp);
+  }
+  lucy_free(path);
+}
+
+void explore_print(FILE* fp, ExploreResult* result) {
+  for(uint32_t i = 0; i < result->report_count; i++) {
+    ExploreReport* report = &result->reports[i];
+    IRMachine* machine = &result->ir->machines[i];
+    fprintf(fp, "%smachine %s\n", i > 0 ? "\n" : "",
+      report->machine == IR_NONE ? "(default)" : ir_string(result->ir, report->machine));
+    fprintf(fp, "  %-16s %10llu\n", "configurations", (unsigned long long)report->configurations);
+    fprintf(fp, "  %-16s %10llu\n", "final", (unsigned long long)report->finals);
+    fprintf(fp, "  %-16s %10llu\n", "transitions", (unsigned long long)report->transitions);
+    fprintf(fp, "  %-16s %10u\n", "depth", report->depth);
+    print_states(fp, result, machine, "deadlocks", report->deadlocks, report->deadlock_count);
+    print_states(fp, result, machine, "unreachable", report->unreachable, report->unreachable_count);
+  }
+}
+
+static void add_states(str_builder_t* sb, ExploreResult* result, IRMachine* machine, char* key, uint32_t* states, uint32_t count) {
+  uint32_t* path = NULL;
+  uint32_t capacity = 0;
+  str_builder_add_fmt(sb, ", \"%s\": [", key);
+  for(uint32_t i = 0; i < count; i++) {
+    str_builder_add_str(sb, i > 0 ? ", \"" : "\"", 0);
+    uint32_t length = ir_state_path(machine, states[i], &path, &capacity);
+    for(uint32_t p = 0; p < length; p++) {
+      if(p > 0) {
+        str_builder_add_char(sb, '.');
+      }
+      str_builder_add_str(sb, ir_string(result->ir, machine->states[path[p]].name), 0);
+    }
+    str_builder_add_char(sb, '"');
+  }
+  str_builder_add_char(sb, ']');
+  lucy_free(path);
+}
+
+char* explore_to_json(ExploreResult* result) {
+  const LucyAllocator* outer = lucy_use_allocator(result->allocator);
+  str_builder_t* sb = str_builder_create();
+  str_builder_add_str(sb, "{\"machines\": [", 0);
+  for(uint32_t i = 0; i < result->report_count; i++) {
+    ExploreReport* report = &result->reports[i];
+    IRMachine* machine = &result->ir->machines[i];
+    str_builder_add_str(sb, i > 0 ? ", {\"name\": " : "{\"name\": ", 0);
+    if(report->machine == IR_NONE) {
+      str_builder_add_str(sb, "null", 0);
+    } else {
+      str_builder_add_fmt(sb, "\"%s\"", ir_string(result->ir, report->machine));
+    }
+    str_builder_add_fmt(sb, ", \"configurations\": %llu, \"final\": %llu, \"transitions\": %llu, \"depth\": %u, \"ns\": %llu",
+      (unsigned long long)report->configurations, (unsigned long long)report->finals,
+      (unsigned long long)report->transitions, report->depth, report->ns);
+    add_states(sb, result, machine, "deadlocks", report->deadlocks, report->deadlock_count);
+    add_states(sb, result, machine, "unreachable", report->unreachable, report->unreachable_count);
+    str_builder_add_char(sb, '}');
+  }
+  str_builder_add_fmt(sb, "], \"jobs\": %d}", result->jobs);
+
+  char* json = str_builder_dump(sb, NULL);
+  str_builder_destroy(sb);
+  lucy_set_allocator(outer);
+  return json;
+}
+
+void destroy_explore_result(ExploreResult* result) {
+  for(uint32_t i = 0; i < result->report_count; i++) {
+    lucy_free(result->reports[i].deadlocks);
+    lucy_free(result->reports[i].unreachable);
+  }
+  if(result->reports != NULL) {
+    lucy_free(result->reports);
+  }
+  if(result->ir != NULL) {
+    ir_destroy(result->ir);
+  }
+  diagnostics_destroy(&result->diagnostics);
+  lucy_free(result);
+}
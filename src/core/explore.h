@@ -0,0 +1,53 @@
+#ifndef LUCY_EXPLORE_H_
+#define LUCY_EXPLORE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "alloc.h"
+#include "diagnostics.h"
+#include "ir.h"
+
+// Flags for explore_init, the same bits as the XState ones they mirror.
+#define EXPLORE_FLAG_OPTIMIZE 1 << 1
+#define EXPLORE_FLAG_MINIMIZE 1 << 2
+
+// What's reachable in one machine. A configuration is the set of active
+// states, which without parallel states is a leaf and its parents, so
+// configurations are numbered by their leaf.
+typedef struct ExploreReport {
+  uint32_t machine;
+  uint64_t configurations;
+  uint64_t finals;
+  uint64_t transitions;
+  uint32_t depth;
+  unsigned long long ns;
+
+  // Non-final configurations without any transition out, and states that
+  // are never active. Both sorted.
+  uint32_t* deadlocks;
+  uint32_t deadlock_count;
+  uint32_t* unreachable;
+  uint32_t unreachable_count;
+} ExploreReport;
+
+typedef struct ExploreResult {
+  bool success;
+  int flags;
+  int jobs;
+  IRProgram* ir;
+  ExploreReport* reports;
+  uint32_t report_count;
+  Diagnostics diagnostics;
+  const LucyAllocator* allocator;
+} ExploreResult;
+
+ExploreResult* explore_create();
+void explore_init(ExploreResult*, int flags, int jobs);
+void explore_set_allocator(ExploreResult*, const LucyAllocator*);
+void explore_program(ExploreResult*, char*, char*);
+void explore_print(FILE*, ExploreResult*);
+char* explore_to_json(ExploreResult*);
+void destroy_explore_result(ExploreResult*);
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdbool.h>
+#include "alloc.h"
+#include "frontend.h"
+#include "ir.h"
+#include "optimize.h"
+#include "parser.h"
+#include "program.h"
+#include "stats.h"
+
+IRProgram* frontend_compile(char* source, char* filename, bool minimize, bool optimize,
+  Diagnostics* diagnostics) {
+  ParseResult *parse_result = parse(source, filename, diagnostics);
+
+  if(parse_result->success == false) {
+    program_destroy(parse_result->program);
+    lucy_free(parse_result);
+    return NULL;
+  }
+
+  stats_phase_begin(STATS_PHASE_LOWER);
+  Program *program = parse_result->program;
+  IRProgram* ir = ir_lower(program);
+  program_destroy(program);
+  lucy_free(parse_result);
+  stats_phase_end(STATS_PHASE_LOWER);
+
+  if(minimize || optimize) {
+    stats_phase_begin(STATS_PHASE_OPTIMIZE);
+    // Merging first leaves the optimizer fewer, more alike states.
+    if(minimize) {
+      ir_minimize(ir);
+    }
+    if(optimize) {
+      ir_optimize(ir);
+    }
+    stats_phase_end(STATS_PHASE_OPTIMIZE);
+  }
+
+  return ir;
+}
@@ -0,0 +1,13 @@
+#ifndef LUCY_FRONTEND_H_
+#define LUCY_FRONTEND_H_
+
+#include <stdbool.h>
+#include "diagnostics.h"
+#include "ir.h"
+
+// Parses, validates and lowers a program, then runs the requested passes
+// over the IR. Errors and warnings are added to the diagnostics, returns
+// NULL if there were errors.
+IRProgram* frontend_compile(char*, char*, bool minimize, bool optimize, Diagnostics*);
+
+#endif
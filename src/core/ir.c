@@ -0,0 +1,429 @@
+#include <stddef.h>
+#include <string.h>
+#include "alloc.h"
+#include "node.h"
+#include "program.h"
+#include "symtab.h"
+#include "ir.h"
+
+#define ir_grow(ptr, count, capacity) \
+  if((count) == (capacity)) { \
+    (capacity) = (capacity) == 0 ? 8 : (capacity) * 2; \
+    (ptr) = lucy_realloc((ptr), (capacity) * sizeof(*(ptr))); \
+  }
+
+typedef struct Lowering {
+  IRProgram* ir;
+  IRMachine* machine;
+
+  uint32_t state_capacity;
+  uint32_t invoke_capacity;
+  uint32_t guard_capacity;
+  uint32_t action_capacity;
+  uint32_t binding_capacity;
+  uint32_t invoke_offset_capacity;
+
+  // Transitions per kind, concatenated once the machine is done.
+  IRTransition* kinds[IR_KIND_COUNT];
+  uint32_t kind_count[IR_KIND_COUNT];
+  uint32_t kind_capacity[IR_KIND_COUNT];
+  uint32_t offset_count[IR_KIND_COUNT];
+  uint32_t offset_capacity[IR_KIND_COUNT];
+
+  SymbolTable guard_names;
+  SymbolTable action_names;
+
+  // Machine blocks waiting to be numbered, and the state they belong to.
+  MachineNode** queue;
+  uint32_t* queue_parents;
+  uint32_t queue_count;
+  uint32_t queue_capacity;
+} Lowering;
+
+static void strings_init(IRStrings* strings) {
+  symtab_init(&strings->table, 0);
+  strings->items = NULL;
+  strings->count = 0;
+  strings->capacity = 0;
+}
+
+uint32_t ir_intern(IRProgram* ir, char* str) {
+  if(str == NULL) {
+    return IR_NONE;
+  }
+
+  IRStrings* strings = &ir->strings;
+  int id = symtab_get(&strings->table, str);
+  if(id != SYMTAB_NOT_FOUND) {
+    return id;
+  }
+
+  ir_grow(strings->items, strings->count, strings->capacity);
+  char* copy = lucy_strdup(str);
+  strings->items[strings->count] = copy;
+  symtab_insert(&strings->table, copy, strings->count);
+  return strings->count++;
+}
+
+uint32_t ir_state_path(IRMachine* machine, uint32_t state, uint32_t** path, uint32_t* capacity) {
+  uint32_t count = 0;
+  for(uint32_t s = state; s != IR_NONE; s = machine->states[s].parent) {
+    ir_grow(*path, count, *capacity);
+    (*path)[count++] = s;
+  }
+  for(uint32_t i = 0; i < count / 2; i++) {
+    uint32_t s = (*path)[i];
+    (*path)[i] = (*path)[count - 1 - i];
+    (*path)[count - 1 - i] = s;
+  }
+  return count;
+}
+
+static void push_row(Lowering* l, int kind) {
+  IRMachine* machine = l->machine;
+  ir_grow(machine->offsets[kind], l->offset_count[kind], l->offset_capacity[kind]);
+  machine->offsets[kind][l->offset_count[kind]++] = l->kind_count[kind];
+}
+
+static void enqueue(Lowering* l, MachineNode* machine_node, uint32_t parent) {
+  if(l->queue_count == l->queue_capacity) {
+    l->queue_capacity = l->queue_capacity == 0 ? 8 : l->queue_capacity * 2;
+    l->queue = lucy_realloc(l->queue, l->queue_capacity * sizeof(MachineNode*));
+    l->queue_parents = lucy_realloc(l->queue_parents, l->queue_capacity * sizeof(uint32_t));
+  }
+  l->queue[l->queue_count] = machine_node;
+  l->queue_parents[l->queue_count] = parent;
+  l->queue_count++;
+}
+
+// Bindings are collected in document order, which is the order the
+// emitter prints them in.
+static void lower_bindings(Lowering* l, Node* root) {
+  IRMachine* machine = l->machine;
+  Node* node = root->child;
+
+  while(node != NULL) {
+    if(node->type == NODE_ASSIGNMENT_TYPE) {
+      Assignment* assignment = (Assignment*)node;
+      ir_grow(machine->bindings, machine->binding_count, l->binding_capacity);
+      IRBinding* binding = &machine->bindings[machine->binding_count];
+      binding->name = ir_intern(l->ir, assignment->binding_name);
+      binding->key = IR_NONE;
+
+      if(assignment->binding_type == ASSIGNMENT_GUARD) {
+        binding->type = IR_BINDING_GUARD;
+        binding->ref = ir_intern(l->ir, ((IdentifierExpression*)assignment->value)->name);
+        symtab_insert(&l->guard_names, assignment->binding_name, machine->binding_count);
+      } else {
+        AssignExpression* expression = (AssignExpression*)assignment->value;
+        binding->type = IR_BINDING_ACTION;
+        binding->ref = ir_intern(l->ir, expression->identifier);
+        binding->key = ir_intern(l->ir, expression->key);
+        symtab_insert(&l->action_names, assignment->binding_name, machine->binding_count);
+      }
+      machine->binding_count++;
+    }
+
+    // Only machines and states can contain bindings.
+    if(node->child != NULL && (node->type == NODE_MACHINE_TYPE || node->type == NODE_STATE_TYPE)) {
+      node = node->child;
+      continue;
+    }
+
+    while(node != root && node->next == NULL) {
+      node = node->parent;
+    }
+    node = node == root ? NULL : node->next;
+  }
+}
+
+static void lower_transition(Lowering* l, SymbolTable* block, int kind, TransitionNode* transition_node) {
+  IRMachine* machine = l->machine;
+  IRTransition* transition;
+
+  ir_grow(l->kinds[kind], l->kind_count[kind], l->kind_capacity[kind]);
+  transition = &l->kinds[kind][l->kind_count[kind]++];
+
+  transition->event = kind == IR_EVENT ? ir_intern(l->ir, transition_node->event) : IR_NONE;
+  transition->delay = kind == IR_DELAY ? transition_node->delay->ms : 0;
+
+  int target = symtab_get(block, transition_node->dest);
+  transition->target = target == SYMTAB_NOT_FOUND ? IR_NONE : target;
+
+  transition->guard_start = machine->guard_count;
+  TransitionGuard* guard = transition_node->guard;
+  while(guard != NULL) {
+    ir_grow(machine->guards, machine->guard_count, l->guard_capacity);
+    IRRef* ref = &machine->guards[machine->guard_count++];
+    if(guard->name != NULL) {
+      ref->type = IR_REF_BINDING;
+      ref->id = symtab_get(&l->guard_names, guard->name);
+    } else {
+      ref->type = IR_REF_INLINE;
+      ref->id = ir_intern(l->ir, guard->expression->ref);
+    }
+    guard = guard->next;
+  }
+  transition->guard_count = machine->guard_count - transition->guard_start;
+
+  transition->action_start = machine->action_count;
+  TransitionAction* action = transition_node->action;
+  while(action != NULL) {
+    ir_grow(machine->actions, machine->action_count, l->action_capacity);
+    IRRef* ref = &machine->actions[machine->action_count++];
+    if(action->name != NULL) {
+      ref->type = IR_REF_BINDING;
+      ref->id = symtab_get(&l->action_names, action->name);
+    } else if(action->expression->type == EXPRESSION_ASSIGN) {
+      ref->type = IR_REF_ASSIGN;
+      ref->id = ir_intern(l->ir, ((AssignExpression*)action->expression)->key);
+    } else {
+      ref->type = IR_REF_INLINE;
+      ref->id = ir_intern(l->ir, ((ActionExpression*)action->expression)->ref);
+    }
+    action = action->next;
+  }
+  transition->action_count = machine->action_count - transition->action_start;
+}
+
+static int state_transition_kind(TransitionNode* transition_node) {
+  switch(transition_node->type) {
+    case TRANSITION_IMMEDIATE_TYPE: return IR_ALWAYS;
+    case TRANSITION_DELAY_TYPE: return IR_DELAY;
+    default: return IR_EVENT;
+  }
+}
+
+static int invoke_transition_kind(TransitionNode* transition_node) {
+  char* event = transition_node->event;
+  if(event != NULL && strcmp(event, "done") == 0) {
+    return IR_DONE;
+  } else if(event != NULL && strcmp(event, "error") == 0) {
+    return IR_ERROR;
+  }
+  return -1;
+}
+
+// Numbers one machine block's states and lowers their transitions. States
+// are numbered breadth-first, so each block's ids are contiguous and rows
+// are filled in id order.
+static void lower_block(Lowering* l, MachineNode* machine_node, uint32_t parent) {
+  IRMachine* machine = l->machine;
+  uint32_t start = machine->state_count;
+
+  Node* child = ((Node*)machine_node)->child;
+  while(child != NULL) {
+    if(child->type == NODE_STATE_TYPE) {
+      StateNode* state_node = (StateNode*)child;
+      ir_grow(machine->states, machine->state_count, l->state_capacity);
+      IRState* state = &machine->states[machine->state_count++];
+      state->name = ir_intern(l->ir, state_node->name);
+      state->parent = parent;
+      state->flags = state_node->final ? IR_STATE_FINAL : 0;
+      state->child_start = 0;
+      state->child_count = 0;
+      state->initial = IR_NONE;
+    }
+    child = child->next;
+  }
+
+  uint32_t count = machine->state_count - start;
+  SymbolTable block;
+  symtab_init(&block, count);
+  for(uint32_t i = start; i < machine->state_count; i++) {
+    symtab_insert(&block, ir_string(l->ir, machine->states[i].name), i);
+  }
+
+  int initial = machine_node->initial == NULL ? SYMTAB_NOT_FOUND : symtab_get(&block, machine_node->initial);
+  uint32_t initial_id = initial == SYMTAB_NOT_FOUND ? IR_NONE : initial;
+  if(parent == IR_NONE) {
+    machine->top_count = count;
+    machine->initial = initial_id;
+  } else {
+    machine->states[parent].child_start = start;
+    machine->states[parent].child_count = count;
+    machine->states[parent].initial = initial_id;
+  }
+
+  uint32_t id = start;
+  child = ((Node*)machine_node)->child;
+  while(child != NULL) {
+    if(child->type != NODE_STATE_TYPE) {
+      child = child->next;
+      continue;
+    }
+
+    push_row(l, IR_EVENT);
+    push_row(l, IR_ALWAYS);
+    push_row(l, IR_DELAY);
+    ir_grow(machine->invoke_offsets, id, l->invoke_offset_capacity);
+    machine->invoke_offsets[id] = machine->invoke_count;
+
+    Node* state_child = child->child;
+    while(state_child != NULL) {
+      switch(state_child->type) {
+        case NODE_TRANSITION_TYPE: {
+          TransitionNode* transition_node = (TransitionNode*)state_child;
+          lower_transition(l, &block, state_transition_kind(transition_node), transition_node);
+          break;
+        }
+        case NODE_INVOKE_TYPE: {
+          ir_grow(machine->invokes, machine->invoke_count, l->invoke_capacity);
+          machine->invokes[machine->invoke_count++].src = ir_intern(l->ir, ((InvokeNode*)state_child)->call);
+          push_row(l, IR_DONE);
+          push_row(l, IR_ERROR);
+
+          Node* invoke_child = state_child->child;
+          while(invoke_child != NULL) {
+            TransitionNode* transition_node = (TransitionNode*)invoke_child;
+            int kind = invoke_transition_kind(transition_node);
+            if(kind != -1) {
+              lower_transition(l, &block, kind, transition_node);
+            }
+            invoke_child = invoke_child->next;
+          }
+          break;
+        }
+        case NODE_MACHINE_TYPE: {
+          enqueue(l, (MachineNode*)state_child, id);
+          break;
+        }
+      }
+      state_child = state_child->next;
+    }
+
+    id++;
+    child = child->next;
+  }
+
+  symtab_destroy(&block);
+}
+
+static void lower_machine(Lowering* l, MachineNode* machine_node) {
+  IRProgram* ir = l->ir;
+  ir->machines = lucy_realloc(ir->machines, (ir->machine_count + 1) * sizeof(IRMachine));
+  IRMachine* machine = &ir->machines[ir->machine_count++];
+  memset(machine, 0, sizeof(IRMachine));
+  machine->name = ir_intern(ir, machine_node->name);
+  machine->initial = IR_NONE;
+
+  memset(l, 0, offsetof(Lowering, queue));
+  l->ir = ir;
+  l->machine = machine;
+  symtab_init(&l->guard_names, 0);
+  symtab_init(&l->action_names, 0);
+
+  lower_bindings(l, (Node*)machine_node);
+
+  l->queue_count = 0;
+  enqueue(l, machine_node, IR_NONE);
+  for(uint32_t i = 0; i < l->queue_count; i++) {
+    lower_block(l, l->queue[i], l->queue_parents[i]);
+  }
+
+  // Close out the rows and lay the kinds out one after another.
+  uint32_t total = 0;
+  for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+    push_row(l, kind);
+    for(uint32_t row = 0; row < l->offset_count[kind]; row++) {
+      machine->offsets[kind][row] += total;
+    }
+    total += l->kind_count[kind];
+  }
+
+  machine->transitions = lucy_malloc((total == 0 ? 1 : total) * sizeof(IRTransition));
+  machine->transition_count = total;
+  for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+    if(l->kind_count[kind] > 0) {
+      memcpy(&machine->transitions[machine->offsets[kind][0]], l->kinds[kind],
+        l->kind_count[kind] * sizeof(IRTransition));
+    }
+    lucy_free(l->kinds[kind]);
+  }
+
+  // Invokes of state s are invoke_offsets[s]..invoke_offsets[s + 1].
+  uint32_t state_count = machine->state_count;
+  ir_grow(machine->invoke_offsets, state_count, l->invoke_offset_capacity);
+  machine->invoke_offsets[state_count] = machine->invoke_count;
+
+  symtab_destroy(&l->guard_names);
+  symtab_destroy(&l->action_names);
+}
+
+static void lower_import(IRProgram* ir, ImportNode* import_node, uint32_t* specifier_capacity) {
+  ir->imports = lucy_realloc(ir->imports, (ir->import_count + 1) * sizeof(IRImport));
+  IRImport* import = &ir->imports[ir->import_count++];
+  import->from = ir_intern(ir, import_node->from);
+  import->specifier_start = ir->specifier_count;
+
+  Node* child = ((Node*)import_node)->child;
+  while(child != NULL) {
+    ir_grow(ir->specifiers, ir->specifier_count, *specifier_capacity);
+    ir->specifiers[ir->specifier_count++] = ir_intern(ir, ((ImportSpecifier*)child)->imported);
+    child = child->next;
+  }
+  import->specifier_count = ir->specifier_count - import->specifier_start;
+}
+
+IRProgram* ir_lower(Program* program) {
+  IRProgram* ir = lucy_calloc(1, sizeof(IRProgram));
+  strings_init(&ir->strings);
+  ir->flags = program->flags;
+
+  Lowering l;
+  l.queue = NULL;
+  l.queue_parents = NULL;
+  l.queue_capacity = 0;
+  l.ir = ir;
+
+  uint32_t specifier_capacity = 0;
+  Node* node = program->body;
+  while(node != NULL) {
+    switch(node->type) {
+      case NODE_IMPORT_TYPE: {
+        lower_import(ir, (ImportNode*)node, &specifier_capacity);
+        break;
+      }
+      case NODE_MACHINE_TYPE: {
+        lower_machine(&l, (MachineNode*)node);
+        break;
+      }
+    }
+    node = node->next;
+  }
+
+  lucy_free(l.queue);
+  lucy_free(l.queue_parents);
+  return ir;
+}
+
+void ir_destroy(IRProgram* ir) {
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    IRMachine* machine = &ir->machines[i];
+    lucy_free(machine->states);
+    lucy_free(machine->invokes);
+    lucy_free(machine->invoke_offsets);
+    for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+      lucy_free(machine->offsets[kind]);
+    }
+    lucy_free(machine->transitions);
+    lucy_free(machine->guards);
+    lucy_free(machine->actions);
+    lucy_free(machine->bindings);
+    lucy_free(machine->state_consts);
+    lucy_free(machine->block_consts);
+    lucy_free(machine->guard_consts);
+    lucy_free(machine->action_consts);
+    lucy_free(machine->consts);
+  }
+  lucy_free(ir->machines);
+  lucy_free(ir->imports);
+  lucy_free(ir->specifiers);
+
+  for(uint32_t i = 0; i < ir->strings.count; i++) {
+    lucy_free(ir->strings.items[i]);
+  }
+  lucy_free(ir->strings.items);
+  symtab_destroy(&ir->strings.table);
+  lucy_free(ir);
+}
@@ -0,0 +1,164 @@
+#ifndef LUCY_IR_H_
+#define LUCY_IR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "program.h"
+#include "symtab.h"
+
+#define IR_NONE UINT32_MAX
+
+// Transition kinds. Event, always and delay transitions are grouped by
+// source state, done and error transitions by invoke.
+#define IR_EVENT 0
+#define IR_ALWAYS 1
+#define IR_DELAY 2
+#define IR_DONE 3
+#define IR_ERROR 4
+#define IR_KIND_COUNT 5
+
+#define IR_STATE_FINAL 1 << 0
+
+// Guard and action references
+#define IR_REF_BINDING 0
+#define IR_REF_INLINE 1
+#define IR_REF_ASSIGN 2
+
+#define IR_BINDING_GUARD 0
+#define IR_BINDING_ACTION 1
+
+// Values hoisted out of a machine by the optimizer
+#define IR_CONST_STATE 0
+#define IR_CONST_BLOCK 1
+#define IR_CONST_GUARDS 2
+#define IR_CONST_ACTIONS 3
+
+// Interned strings, ids index into items.
+typedef struct IRStrings {
+  SymbolTable table;
+  char** items;
+  uint32_t count;
+  uint32_t capacity;
+} IRStrings;
+
+typedef struct IRRef {
+  uint8_t type;
+  // A binding id for IR_REF_BINDING, otherwise a string id: the imported
+  // function, or the key for an inline assign.
+  uint32_t id;
+} IRRef;
+
+typedef struct IRTransition {
+  uint32_t event;
+  uint32_t delay;
+  uint32_t target;
+  uint32_t guard_start;
+  uint32_t guard_count;
+  uint32_t action_start;
+  uint32_t action_count;
+} IRTransition;
+
+typedef struct IRState {
+  uint32_t name;
+  uint32_t parent;
+  uint32_t flags;
+
+  // Nested states are contiguous, children of a nested machine in a state.
+  uint32_t child_start;
+  uint32_t child_count;
+  uint32_t initial;
+} IRState;
+
+typedef struct IRInvoke {
+  uint32_t src;
+} IRInvoke;
+
+typedef struct IRBinding {
+  uint8_t type;
+  uint32_t name;
+  // The referenced function, and for actions the key being assigned.
+  uint32_t ref;
+  uint32_t key;
+} IRBinding;
+
+// A value printed once before its machine and referenced by name. The id
+// is the state whose body or nested states it holds, or the transition
+// whose guards or actions it holds.
+typedef struct IRConst {
+  uint8_t type;
+  uint32_t id;
+} IRConst;
+
+// A top-level machine with its nested machines flattened into it.
+typedef struct IRMachine {
+  uint32_t name;
+
+  // States 0..top_count are the machine's own, the rest are nested.
+  IRState* states;
+  uint32_t state_count;
+  uint32_t top_count;
+  uint32_t initial;
+
+  IRInvoke* invokes;
+  uint32_t invoke_count;
+  uint32_t* invoke_offsets;
+
+  // CSR rows: offsets[kind][row]..offsets[kind][row + 1] index into
+  // transitions. Rows are states, or invokes for IR_DONE and IR_ERROR.
+  uint32_t* offsets[IR_KIND_COUNT];
+  IRTransition* transitions;
+  uint32_t transition_count;
+
+  IRRef* guards;
+  uint32_t guard_count;
+  IRRef* actions;
+  uint32_t action_count;
+
+  IRBinding* bindings;
+  uint32_t binding_count;
+
+  // Set by ir_optimize, NULL otherwise. Index into consts or IR_NONE, per
+  // state for state_consts and block_consts, per transition for the rest.
+  uint32_t* state_consts;
+  uint32_t* block_consts;
+  uint32_t* guard_consts;
+  uint32_t* action_consts;
+  IRConst* consts;
+  uint32_t const_count;
+} IRMachine;
+
+typedef struct IRImport {
+  uint32_t from;
+  uint32_t specifier_start;
+  uint32_t specifier_count;
+} IRImport;
+
+typedef struct IRProgram {
+  IRStrings strings;
+  int flags;
+
+  IRImport* imports;
+  uint32_t import_count;
+  uint32_t* specifiers;
+  uint32_t specifier_count;
+
+  IRMachine* machines;
+  uint32_t machine_count;
+} IRProgram;
+
+IRProgram* ir_lower(Program*);
+void ir_destroy(IRProgram*);
+uint32_t ir_intern(IRProgram*, char*);
+// Fills path with the states from the top-level ancestor down to the
+// given one, growing it as needed, and returns how many there are.
+uint32_t ir_state_path(IRMachine*, uint32_t, uint32_t**, uint32_t*);
+
+static inline char* ir_string(IRProgram* ir, uint32_t id) {
+  return ir->strings.items[id];
+}
+
+static inline uint32_t ir_row_count(IRMachine* machine, int kind) {
+  return kind >= IR_DONE ? machine->invoke_count : machine->state_count;
+}
+
+#endif
@@ -2,11 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include "alloc.h"
 #include "js_builder.h"
 #include "str_builder.h"
 
 JSBuilder* js_builder_create() {
-  JSBuilder* jsb = malloc(sizeof(*jsb));
+  JSBuilder* jsb = lucy_malloc(sizeof(*jsb));
   jsb->indent_str = "  ";
   jsb->indent_len = strlen(jsb->indent_str);
   jsb->sb = str_builder_create();
@@ -19,7 +20,7 @@ JSBuilder* js_builder_create() {
 void js_builder_destroy(JSBuilder* jsb) {
   str_builder_destroy(jsb->sb);
   str_builder_destroy(jsb->ib);
-  free(jsb);
+  lucy_free(jsb);
 }
 
 static bool current_is_newline(JSBuilder* jsb) {
@@ -47,8 +48,7 @@ void js_builder_add_string(JSBuilder* jsb, char* value) {
 }
 
 void js_builder_add_indent(JSBuilder* jsb) {
-  char* indent = str_builder_dump(jsb->ib, NULL);
-  str_builder_add_str(jsb->sb, indent, 0);
+  str_builder_add_str(jsb->sb, str_builder_peek(jsb->ib), str_builder_len(jsb->ib));
 }
 
 void js_builder_increase_indent(JSBuilder* jsb) {
@@ -118,11 +118,17 @@ void js_builder_end_array(JSBuilder* jsb, bool newline) {
   js_builder_add_str(jsb, "]");
 }
 
-void js_builder_add_export(JSBuilder* jsb) {
+// Leaves a blank line before a top-level statement.
+void js_builder_start_statement(JSBuilder* jsb) {
   if(!current_is_newline(jsb)) {
     js_builder_add_str(jsb, "\n");
   }
-  js_builder_add_str(jsb, "\nexport ");
+  js_builder_add_str(jsb, "\n");
+}
+
+void js_builder_add_export(JSBuilder* jsb) {
+  js_builder_start_statement(jsb);
+  js_builder_add_str(jsb, "export ");
 }
 
 void js_builder_add_const(JSBuilder* jsb, char* identifier) {
@@ -1,29 +1,30 @@
 #include <stdlib.h>
 #include <string.h>
-#include "dict.h"
 #include "keyword.h"
+#include "symtab.h"
 
-dict *keywords;
+static SymbolTable keywords;
 
 bool is_keyword(char* key) {
-  return dict_search(keywords, key) > 0;
+  return symtab_get(&keywords, key) != SYMTAB_NOT_FOUND;
 }
 
 unsigned short keyword_get(char* key) {
-  return dict_search(keywords, key);
+  int keyword = symtab_get(&keywords, key);
+  return keyword == SYMTAB_NOT_FOUND ? 0 : keyword;
 }
 
 void keyword_init() {
-  keywords = dict_create();
+  symtab_init(&keywords, KW_DELAY);
 
-  dict_insert(keywords, "import", KW_IMPORT);
-  dict_insert(keywords, "state", KW_STATE);
-  dict_insert(keywords, "initial", KW_INITIAL);
-  dict_insert(keywords, "final", KW_FINAL);
-  dict_insert(keywords, "action", KW_ACTION);
-  dict_insert(keywords, "guard", KW_GUARD);
-  dict_insert(keywords, "assign", KW_ASSIGN);
-  dict_insert(keywords, "invoke", KW_INVOKE);
-  dict_insert(keywords, "machine", KW_MACHINE);
-  dict_insert(keywords, "delay", KW_DELAY);
+  symtab_insert(&keywords, "import", KW_IMPORT);
+  symtab_insert(&keywords, "state", KW_STATE);
+  symtab_insert(&keywords, "initial", KW_INITIAL);
+  symtab_insert(&keywords, "final", KW_FINAL);
+  symtab_insert(&keywords, "action", KW_ACTION);
+  symtab_insert(&keywords, "guard", KW_GUARD);
+  symtab_insert(&keywords, "assign", KW_ASSIGN);
+  symtab_insert(&keywords, "invoke", KW_INVOKE);
+  symtab_insert(&keywords, "machine", KW_MACHINE);
+  symtab_insert(&keywords, "delay", KW_DELAY);
 }
\ No newline at end of file
@@ -1,15 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "alloc.h"
 #include "node.h"
+#include "scope.h"
+#include "stats.h"
 
 static void node_destroy_guardexpression(GuardExpression*);
 static void node_destroy_actionexpression(ActionExpression*);
 static void node_destroy_assignexpression(AssignExpression*);
 static void node_destroy_delayexpression(DelayExpression*);
 
+// Zeroed, so a node the parser gave up on partway can still be destroyed.
 Node* node_create_type(unsigned short type, size_t size) {
-  Node *node = malloc(size);
+  Node *node = lucy_calloc(1, size);
+  stats_count_node(type);
   node->type = type;
   node->child = NULL;
   node->next = NULL;
@@ -30,21 +35,21 @@ TransitionNode* node_create_transition() {
 }
 
 static TransitionGuard* create_transition_guard() {
-  TransitionGuard* guard = malloc(sizeof(*guard));
+  TransitionGuard* guard = lucy_malloc(sizeof(*guard));
   guard->next = NULL;
   guard->expression = NULL;
   return guard;
 }
 
 static TransitionAction* create_transition_action() {
-  TransitionAction* action = malloc(sizeof(*action));
+  TransitionAction* action = lucy_malloc(sizeof(*action));
   action->next = NULL;
   action->expression = NULL;
   return action;
 }
 
 static TransitionDelay* create_transition_delay() {
-  TransitionDelay* delay = malloc(sizeof(*delay));
+  TransitionDelay* delay = lucy_malloc(sizeof(*delay));
   delay->ms = 0;
   delay->ref = NULL;
   delay->expression = NULL;
@@ -54,8 +59,9 @@ static TransitionDelay* create_transition_delay() {
 MachineNode* node_create_machine() {
   Node* node = node_create_type(NODE_MACHINE_TYPE, sizeof(MachineNode));
   MachineNode *machine_node = (MachineNode*)node;
+  machine_node->name = NULL;
   machine_node->initial = NULL;
-  machine_node->impl_flags = 0;
+  machine_node->scope = NULL;
   return machine_node;
 }
 
@@ -94,7 +100,7 @@ InvokeNode* node_create_invoke() {
 }
 
 AssignExpression* node_create_assignexpression() {
-  AssignExpression* expression = malloc(sizeof *expression);
+  AssignExpression* expression = lucy_malloc(sizeof *expression);
   ((Expression*)expression)->type = EXPRESSION_ASSIGN;
   expression->identifier = NULL;
   expression->key = NULL;
@@ -102,26 +108,27 @@ AssignExpression* node_create_assignexpression() {
 }
 
 IdentifierExpression* node_create_identifierexpression() {
-  IdentifierExpression* expression = malloc(sizeof *expression);
+  IdentifierExpression* expression = lucy_malloc(sizeof *expression);
   ((Expression*)expression)->type = EXPRESSION_IDENTIFIER;
   return expression;
 }
 
 GuardExpression* node_create_guardexpression() {
-  GuardExpression* expression = malloc(sizeof *expression);
+  GuardExpression* expression = lucy_malloc(sizeof *expression);
   ((Expression*)expression)->type = EXPRESSION_GUARD;
   return expression;
 }
 
 ActionExpression* node_create_actionexpression() {
-  ActionExpression* expression = malloc(sizeof *expression);
+  ActionExpression* expression = lucy_malloc(sizeof *expression);
   ((Expression*)expression)->type = EXPRESSION_ACTION;
   return expression;
 }
 
 DelayExpression* node_create_delayexpression() {
-  DelayExpression* expression = malloc(sizeof *expression);
+  DelayExpression* expression = lucy_malloc(sizeof *expression);
   ((Expression*)expression)->type = EXPRESSION_DELAY;
+  expression->ref = NULL;
   return expression;
 }
 
@@ -160,24 +167,12 @@ TransitionAction* node_transition_add_action(TransitionNode* transition_node, ch
 TransitionDelay* node_transition_add_delay(TransitionNode* transition_node, char* ref, DelayExpression* expression) {
   TransitionDelay* delay = create_transition_delay();
   delay->ms = expression->time;
+  delay->ref = ref;
+  delay->expression = expression;
   transition_node->delay = delay;
   return delay;
 }
 
-bool node_machine_is_nested(Node* node) {
-  return node->type == NODE_MACHINE_TYPE &&
-    node->parent != NULL &&
-    node->parent->type == NODE_STATE_TYPE;
-}
-
-bool inline node_transition_has_sibling_always(TransitionNode* transition_node) {
-  Node* next = ((Node*)transition_node)->next;
-  if(next != NULL && next->type == NODE_TRANSITION_TYPE && ((TransitionNode*)next)->type == TRANSITION_IMMEDIATE_TYPE) {
-    return true;
-  }
-  return false;
-}
-
 void node_append(Node* parent, Node* child) {
   if(parent == NULL) {
     return;
@@ -201,25 +196,26 @@ void node_after_last(Node* ref, Node* node) {
 }
 
 static void node_destroy_transition_guards(TransitionGuard* guard) {
-  if(guard != NULL) {
+  while(guard != NULL) {
+    TransitionGuard* next = guard->next;
     if(guard->name != NULL) {
-      free(guard->name);
+      lucy_free(guard->name);
     }
     if(guard->expression != NULL) {
       node_destroy_guardexpression(guard->expression);
-    }
-    if(guard->next != NULL) {
-      node_destroy_transition_guards(guard->next);
+      lucy_free(guard->expression);
     }
 
-    free(guard);
+    lucy_free(guard);
+    guard = next;
   }
 }
 
 static void node_destroy_transition_actions(TransitionAction* action) {
-  if(action != NULL) {
+  while(action != NULL) {
+    TransitionAction* next = action->next;
     if(action->name != NULL) {
-      free(action->name);
+      lucy_free(action->name);
     }
     if(action->expression != NULL) {
       switch(action->expression->type) {
@@ -235,55 +231,32 @@ static void node_destroy_transition_actions(TransitionAction* action) {
           printf("Unknown expression type.\n");
         }
       }
-    }
-    if(action->next != NULL) {
-      node_destroy_transition_actions(action->next);
+      lucy_free(action->expression);
     }
 
-    free(action);
+    lucy_free(action);
+    action = next;
   }
 }
 
 static void node_destroy_transition_delay(TransitionDelay* delay) {
   if(delay->ref != NULL) {
-    free(delay->ref);
+    lucy_free(delay->ref);
   }
   if(delay->expression != NULL) {
     node_destroy_delayexpression(delay->expression);
-    free(delay->expression);
+    lucy_free(delay->expression);
   }
-  free(delay);
-}
-
-Expression* node_clone_expression(Expression* input) {
-  Expression* output;
-  switch(input->type) {
-    case EXPRESSION_IDENTIFIER: {
-      IdentifierExpression *in_id = (IdentifierExpression*)input;
-      IdentifierExpression *out_id = node_create_identifierexpression();
-      out_id->name = strdup(in_id->name);
-      output = (Expression*)out_id;
-      break;
-    }
-    case EXPRESSION_ASSIGN: {
-      AssignExpression *in_ae = (AssignExpression*)input;
-      AssignExpression *out_ae = node_create_assignexpression();
-      out_ae->identifier = strdup(in_ae->identifier);
-      out_ae->key = strdup(in_ae->key);
-      output = (Expression*)out_ae;
-      break;
-    }
-    default: {
-      output = NULL;
-    }
-  }
-  return output;
+  lucy_free(delay);
 }
 
 /**
  * Begin teardown code
  */
 void node_destroy_transition(TransitionNode* transition_node) {
+  lucy_free(transition_node->event);
+  lucy_free(transition_node->dest);
+
   if(transition_node->guard != NULL) {
     node_destroy_transition_guards(transition_node->guard);
   }
@@ -300,40 +273,44 @@ void node_destroy_transition(TransitionNode* transition_node) {
 static void node_destroy_assignexpression(AssignExpression* expression) {
   if(expression != NULL) {
     if(expression->identifier != NULL) {
-      free(expression->identifier);
+      lucy_free(expression->identifier);
     }
     if(expression->key != NULL) {
-      free(expression->key);
+      lucy_free(expression->key);
     }
   }
 }
 
 static void node_destroy_identifierexpression(IdentifierExpression* expression) {
   if(expression != NULL) {
-    free(expression->name);
+    lucy_free(expression->name);
   }
 }
 
 static void node_destroy_guardexpression(GuardExpression* expression) {
   if(expression != NULL) {
-    free(expression->ref);
+    lucy_free(expression->ref);
   }
 }
 
 static void node_destroy_actionexpression(ActionExpression* expression) {
   if(expression != NULL) {
-    free(expression->ref);
+    lucy_free(expression->ref);
   }
 }
 
 static void node_destroy_delayexpression(DelayExpression* expression) {
   if(expression != NULL) {
-    free(expression->ref);
+    lucy_free(expression->ref);
   }
 }
 
 void node_destroy_assignment(Assignment* assignment) {
+  lucy_free(assignment->binding_name);
   Expression *expression = assignment->value;
+  if(expression == NULL) {
+    return;
+  }
 
   switch(expression->type) {
     case EXPRESSION_ASSIGN: {
@@ -351,53 +328,57 @@ void node_destroy_assignment(Assignment* assignment) {
     }
   }
 
-  free(expression);
+  lucy_free(expression);
 }
 
 void node_destroy_import(ImportNode* import_node) {
-  free(import_node->from);
+  lucy_free(import_node->from);
 }
 
 void node_destroy_import_specifier(ImportSpecifier* specifier) {
   if(specifier->imported != NULL)
-    free(specifier->imported);
+    lucy_free(specifier->imported);
 
   if(specifier->local != NULL)
-    free(specifier->local);
+    lucy_free(specifier->local);
 }
 
 void node_destroy_machine(MachineNode* machine_node) {
-  free(machine_node->initial);
+  lucy_free(machine_node->name);
+  lucy_free(machine_node->initial);
+  if(machine_node->scope != NULL) {
+    scope_destroy(machine_node->scope);
+  }
 }
 
 void node_destroy_state(StateNode* state_node) {
-  free(state_node->name);
+  lucy_free(state_node->name);
 }
 
 void node_destroy_expression(Expression* expression) {
   switch(expression->type) {
     case EXPRESSION_IDENTIFIER: {
       IdentifierExpression *identifier_expression = (IdentifierExpression*)expression;
-      free(identifier_expression->name);
+      lucy_free(identifier_expression->name);
       break;
     }
     case EXPRESSION_ASSIGN: {
       AssignExpression *assign_expression = (AssignExpression*)expression;
-      free(assign_expression->identifier);
-      free(assign_expression->key);
+      lucy_free(assign_expression->identifier);
+      lucy_free(assign_expression->key);
       break;
     }
   }
-  free(expression);
+  lucy_free(expression);
 }
 
 void node_destroy_invoke(InvokeNode* invoke_node) {
-  free(invoke_node->call);
+  lucy_free(invoke_node->call);
 }
 
 void node_destroy(Node* node) {
   if(node == NULL)
     return;
 
-  free(node);
+  lucy_free(node);
 }
\ No newline at end of file
@@ -2,15 +2,26 @@
 
 #include <stddef.h>
 #include <stdbool.h>
-#include "set.h"
-
-#define NODE_MACHINE_TYPE 0
-#define NODE_STATE_TYPE 1
-#define NODE_TRANSITION_TYPE 2
-#define NODE_IMPORT_TYPE 3
-#define NODE_IMPORT_SPECIFIER_TYPE 4
-#define NODE_ASSIGNMENT_TYPE 5
-#define NODE_INVOKE_TYPE 6
+#include <stdint.h>
+
+// Every node type as X(NAME, name, struct). The type constants, names,
+// teardown and visitor tables are generated from this, so a new node type
+// is added here and given a node_destroy_<name>.
+#define NODE_TYPES(X) \
+  X(MACHINE, machine, MachineNode) \
+  X(STATE, state, StateNode) \
+  X(TRANSITION, transition, TransitionNode) \
+  X(IMPORT, import, ImportNode) \
+  X(IMPORT_SPECIFIER, import_specifier, ImportSpecifier) \
+  X(ASSIGNMENT, assignment, Assignment) \
+  X(INVOKE, invoke, InvokeNode)
+
+enum {
+#define X(NAME, name, type) NODE_##NAME##_TYPE,
+  NODE_TYPES(X)
+#undef X
+  NODE_TYPE_COUNT
+};
 
 #define TRANSITION_EVENT_TYPE 0
 #define TRANSITION_IMMEDIATE_TYPE 1
@@ -25,11 +36,13 @@
 #define EXPRESSION_ACTION 3
 #define EXPRESSION_DELAY 4
 
+// Positions are 32-bit, parse rejects larger sources, which keeps them
+// packed with the type ahead of the links.
 typedef struct Node {
   unsigned short type;
-  size_t start;
-  size_t end;
-  unsigned short line;
+  uint32_t line;
+  uint32_t start;
+  uint32_t end;
   struct Node* parent;
   struct Node* child;
   struct Node* next;
@@ -38,9 +51,9 @@ typedef struct Node {
 typedef struct MachineNode {
   Node node;
 
-  int impl_flags;
   char* name;
   char* initial;
+  struct Scope* scope;
 } MachineNode;
 
 typedef struct StateNode {
@@ -150,9 +163,6 @@ GuardExpression* node_create_guardexpression();
 ActionExpression* node_create_actionexpression();
 DelayExpression* node_create_delayexpression();
 
-bool node_machine_is_nested(Node*);
-bool node_transition_has_sibling_always(TransitionNode*);
-
 void node_append(Node*, Node*);
 void node_after_last(Node*, Node*);
 
@@ -160,8 +170,6 @@ TransitionGuard* node_transition_add_guard(TransitionNode*, char*);
 TransitionAction* node_transition_add_action(TransitionNode*, char*);
 TransitionDelay* node_transition_add_delay(TransitionNode*, char*, DelayExpression*);
 
-Expression* node_clone_expression(Expression*);
-
 void node_destroy_assignment(Assignment*);
 void node_destroy_import(ImportNode*);
 void node_destroy_import_specifier(ImportSpecifier*);
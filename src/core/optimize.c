@@ -0,0 +1,897 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "alloc.h"
+#include "ir.h"
+#include "optimize.h"
+#include "stats.h"
+#include "str_builder.h"
+#include "symtab.h"
+
+// Structural keys, two values with the same key print the same JS.
+typedef struct Keys {
+  SymbolTable table;
+  char** items;
+  uint32_t count;
+  uint32_t capacity;
+  str_builder_t* sb;
+} Keys;
+
+// Keys of a machine's transitions and of their guard and action lists.
+typedef struct TransitionKeys {
+  uint32_t* transitions;
+  uint32_t* guards;
+  uint32_t* actions;
+} TransitionKeys;
+
+static void key_add(Keys* keys, char tag, uint32_t value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%c%u", tag, value);
+  str_builder_add_str(keys->sb, buf, 0);
+}
+
+// Interns the key being built and starts a new one.
+static uint32_t key_intern(Keys* keys) {
+  const char* key = str_builder_peek(keys->sb);
+  int id = symtab_get(&keys->table, key);
+  if(id == SYMTAB_NOT_FOUND) {
+    if(keys->count == keys->capacity) {
+      keys->capacity = keys->capacity == 0 ? 64 : keys->capacity * 2;
+      keys->items = lucy_realloc(keys->items, keys->capacity * sizeof(char*));
+    }
+    char* copy = lucy_strdup(key);
+    keys->items[keys->count] = copy;
+    symtab_insert(&keys->table, copy, keys->count);
+    id = keys->count++;
+  }
+  str_builder_clear(keys->sb);
+  return id;
+}
+
+static uint32_t* fill(uint32_t count, uint32_t value) {
+  uint32_t* items = lucy_malloc((count == 0 ? 1 : count) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < count; i++) {
+    items[i] = value;
+  }
+  return items;
+}
+
+// Renumbers the kept states and transitions, keeping each block's states
+// contiguous and rows in id order. NULL keeps everything.
+static void rebuild(IRMachine* machine, bool* keep_state, bool* keep_transition) {
+  uint32_t* state_map = fill(machine->state_count, IR_NONE);
+  uint32_t state_count = 0;
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(keep_state == NULL || keep_state[s]) {
+      state_map[s] = state_count++;
+    }
+  }
+
+  IRState* states = lucy_malloc((state_count == 0 ? 1 : state_count) * sizeof(IRState));
+  uint32_t* invoke_offsets = lucy_malloc((state_count + 1) * sizeof(uint32_t));
+  IRInvoke* invokes = lucy_malloc((machine->invoke_count == 0 ? 1 : machine->invoke_count) * sizeof(IRInvoke));
+  uint32_t* invoke_map = fill(machine->invoke_count, IR_NONE);
+  uint32_t invoke_count = 0;
+  uint32_t top_count = 0;
+
+  for(uint32_t s = 0; s < machine->state_count; s++) {
+    if(state_map[s] == IR_NONE) {
+      continue;
+    }
+
+    IRState* state = &states[state_map[s]];
+    *state = machine->states[s];
+    if(state->parent == IR_NONE) {
+      top_count++;
+    } else {
+      state->parent = state_map[state->parent];
+    }
+
+    uint32_t child_start = state->child_start;
+    uint32_t child_end = child_start + state->child_count;
+    state->child_start = 0;
+    state->child_count = 0;
+    for(uint32_t c = child_start; c < child_end; c++) {
+      if(state_map[c] != IR_NONE) {
+        if(state->child_count == 0) {
+          state->child_start = state_map[c];
+        }
+        state->child_count++;
+      }
+    }
+    if(state->initial != IR_NONE) {
+      state->initial = state_map[state->initial];
+    }
+
+    invoke_offsets[state_map[s]] = invoke_count;
+    for(uint32_t i = machine->invoke_offsets[s]; i < machine->invoke_offsets[s + 1]; i++) {
+      invoke_map[i] = invoke_count;
+      invokes[invoke_count++] = machine->invokes[i];
+    }
+  }
+  invoke_offsets[state_count] = invoke_count;
+
+  IRTransition* transitions = lucy_malloc((machine->transition_count == 0 ? 1 : machine->transition_count) * sizeof(IRTransition));
+  uint32_t transition_count = 0;
+  for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+    uint32_t* row_map = kind >= IR_DONE ? invoke_map : state_map;
+    uint32_t row_count = kind >= IR_DONE ? invoke_count : state_count;
+    uint32_t* old_offsets = machine->offsets[kind];
+    uint32_t* offsets = lucy_malloc((row_count + 1) * sizeof(uint32_t));
+
+    for(uint32_t row = 0; row < ir_row_count(machine, kind); row++) {
+      if(row_map[row] == IR_NONE) {
+        continue;
+      }
+      offsets[row_map[row]] = transition_count;
+      for(uint32_t t = old_offsets[row]; t < old_offsets[row + 1]; t++) {
+        if(keep_transition == NULL || keep_transition[t]) {
+          IRTransition* transition = &transitions[transition_count++];
+          *transition = machine->transitions[t];
+          transition->target = state_map[transition->target];
+        }
+      }
+    }
+    offsets[row_count] = transition_count;
+
+    lucy_free(old_offsets);
+    machine->offsets[kind] = offsets;
+  }
+
+  // Guards and actions only dropped transitions used would otherwise
+  // stay behind, and backends walk all of them.
+  uint32_t guard_count = 0;
+  uint32_t action_count = 0;
+  for(uint32_t t = 0; t < transition_count; t++) {
+    guard_count += transitions[t].guard_count;
+    action_count += transitions[t].action_count;
+  }
+  IRRef* guards = lucy_malloc((guard_count == 0 ? 1 : guard_count) * sizeof(IRRef));
+  IRRef* actions = lucy_malloc((action_count == 0 ? 1 : action_count) * sizeof(IRRef));
+  guard_count = 0;
+  action_count = 0;
+  for(uint32_t t = 0; t < transition_count; t++) {
+    IRTransition* transition = &transitions[t];
+    for(uint32_t i = 0; i < transition->guard_count; i++) {
+      guards[guard_count + i] = machine->guards[transition->guard_start + i];
+    }
+    transition->guard_start = guard_count;
+    guard_count += transition->guard_count;
+    for(uint32_t i = 0; i < transition->action_count; i++) {
+      actions[action_count + i] = machine->actions[transition->action_start + i];
+    }
+    transition->action_start = action_count;
+    action_count += transition->action_count;
+  }
+
+  if(machine->initial != IR_NONE) {
+    machine->initial = state_map[machine->initial];
+  }
+
+  lucy_free(machine->states);
+  lucy_free(machine->invokes);
+  lucy_free(machine->invoke_offsets);
+  lucy_free(machine->transitions);
+  lucy_free(machine->guards);
+  lucy_free(machine->actions);
+  machine->states = states;
+  machine->state_count = state_count;
+  machine->top_count = top_count;
+  machine->invokes = invokes;
+  machine->invoke_count = invoke_count;
+  machine->invoke_offsets = invoke_offsets;
+  machine->transitions = transitions;
+  machine->transition_count = transition_count;
+  machine->guards = guards;
+  machine->guard_count = guard_count;
+  machine->actions = actions;
+  machine->action_count = action_count;
+
+  lucy_free(state_map);
+  lucy_free(invoke_map);
+}
+
+static void reach(bool* reached, uint32_t* queue, uint32_t* tail, uint32_t s) {
+  if(!reached[s]) {
+    reached[s] = true;
+    queue[(*tail)++] = s;
+  }
+}
+
+// Breadth-first from the initial state. Entering a state enters its nested
+// initial state, or all of its nested states when there is none.
+static void remove_unreachable(IRMachine* machine) {
+  uint32_t state_count = machine->state_count;
+  bool* reached = lucy_calloc(state_count == 0 ? 1 : state_count, sizeof(bool));
+  uint32_t* queue = fill(state_count, 0);
+  uint32_t head = 0;
+  uint32_t tail = 0;
+
+  if(machine->initial != IR_NONE) {
+    reach(reached, queue, &tail, machine->initial);
+  } else {
+    for(uint32_t s = 0; s < machine->top_count; s++) {
+      reach(reached, queue, &tail, s);
+    }
+  }
+
+  while(head < tail) {
+    uint32_t s = queue[head++];
+    for(int kind = IR_EVENT; kind <= IR_DELAY; kind++) {
+      uint32_t* offsets = machine->offsets[kind];
+      for(uint32_t t = offsets[s]; t < offsets[s + 1]; t++) {
+        reach(reached, queue, &tail, machine->transitions[t].target);
+      }
+    }
+    for(uint32_t i = machine->invoke_offsets[s]; i < machine->invoke_offsets[s + 1]; i++) {
+      for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+        uint32_t* offsets = machine->offsets[kind];
+        for(uint32_t t = offsets[i]; t < offsets[i + 1]; t++) {
+          reach(reached, queue, &tail, machine->transitions[t].target);
+        }
+      }
+    }
+
+    IRState* state = &machine->states[s];
+    if(state->initial != IR_NONE) {
+      reach(reached, queue, &tail, state->initial);
+    } else {
+      for(uint32_t c = state->child_start; c < state->child_start + state->child_count; c++) {
+        reach(reached, queue, &tail, c);
+      }
+    }
+  }
+
+  if(tail < state_count) {
+    if(stats_current != NULL) {
+      stats_current->states_removed += state_count - tail;
+    }
+    rebuild(machine, reached, NULL);
+  }
+
+  lucy_free(reached);
+  lucy_free(queue);
+}
+
+static uint32_t ref_list_key(Keys* keys, IRMachine* machine, char tag, IRRef* refs, uint32_t count) {
+  if(count == 0) {
+    return IR_NONE;
+  }
+  key_add(keys, tag, count);
+  for(uint32_t i = 0; i < count; i++) {
+    if(refs[i].type == IR_REF_BINDING) {
+      key_add(keys, 'b', machine->bindings[refs[i].id].name);
+    } else {
+      key_add(keys, refs[i].type == IR_REF_ASSIGN ? 's' : 'i', refs[i].id);
+    }
+  }
+  return key_intern(keys);
+}
+
+// Targets are keyed by name, which is what gets printed, so transitions
+// in different blocks can share a key.
+static void transition_keys(Keys* keys, IRMachine* machine, TransitionKeys* out) {
+  uint32_t count = machine->transition_count;
+  out->transitions = fill(count, IR_NONE);
+  out->guards = fill(count, IR_NONE);
+  out->actions = fill(count, IR_NONE);
+
+  for(uint32_t t = 0; t < count; t++) {
+    IRTransition* transition = &machine->transitions[t];
+    out->guards[t] = ref_list_key(keys, machine, 'G',
+      &machine->guards[transition->guard_start], transition->guard_count);
+    out->actions[t] = ref_list_key(keys, machine, 'A',
+      &machine->actions[transition->action_start], transition->action_count);
+
+    key_add(keys, 'T', transition->event);
+    key_add(keys, 'd', transition->delay);
+    key_add(keys, 't', machine->states[transition->target].name);
+    key_add(keys, 'g', out->guards[t]);
+    key_add(keys, 'a', out->actions[t]);
+    out->transitions[t] = key_intern(keys);
+  }
+}
+
+static void transition_keys_destroy(TransitionKeys* tk) {
+  lucy_free(tk->transitions);
+  lucy_free(tk->guards);
+  lucy_free(tk->actions);
+}
+
+// Drops transitions identical to an earlier one in the same row, they
+// would overwrite the same key or never be taken.
+static void dedupe_transitions(Keys* keys, IRMachine* machine) {
+  TransitionKeys tk;
+  transition_keys(keys, machine, &tk);
+
+  bool* keep = lucy_malloc((machine->transition_count == 0 ? 1 : machine->transition_count) * sizeof(bool));
+  uint32_t* seen = fill(keys->count, IR_NONE);
+  uint32_t removed = 0;
+  uint32_t row_id = 0;
+
+  for(int kind = 0; kind < IR_KIND_COUNT; kind++) {
+    uint32_t* offsets = machine->offsets[kind];
+    for(uint32_t row = 0; row < ir_row_count(machine, kind); row++, row_id++) {
+      for(uint32_t t = offsets[row]; t < offsets[row + 1]; t++) {
+        uint32_t key = tk.transitions[t];
+        keep[t] = seen[key] != row_id;
+        seen[key] = row_id;
+        removed += keep[t] ? 0 : 1;
+      }
+    }
+  }
+
+  if(removed > 0) {
+    if(stats_current != NULL) {
+      stats_current->transitions_removed += removed;
+    }
+    rebuild(machine, NULL, keep);
+  }
+
+  lucy_free(keep);
+  lucy_free(seen);
+  transition_keys_destroy(&tk);
+}
+
+static void count_list_uses(IRMachine* machine, TransitionKeys* tk, uint32_t* uses, uint32_t t) {
+  if(machine->transitions[t].guard_count > 1) {
+    uses[tk->guards[t]]++;
+  }
+  if(tk->actions[t] != IR_NONE) {
+    uses[tk->actions[t]]++;
+  }
+}
+
+// Hoists state bodies, nested state blocks and guard and action lists that
+// are printed more than once into consts. Only printed copies count: a
+// state inside a hoisted body is printed once, however often the body is
+// referenced.
+static void share(Keys* keys, IRMachine* machine) {
+  uint32_t state_count = machine->state_count;
+  TransitionKeys tk;
+  transition_keys(keys, machine, &tk);
+
+  // Keys and nesting levels, children have higher ids than their parent.
+  uint32_t* state_keys = fill(state_count, IR_NONE);
+  uint32_t* block_keys = fill(state_count, IR_NONE);
+  uint32_t* state_levels = fill(state_count, 0);
+  uint32_t empty_key = IR_NONE;
+
+  for(uint32_t s = state_count; s-- > 0;) {
+    IRState* state = &machine->states[s];
+    bool empty = state->flags == 0 && state->child_count == 0;
+
+    if(state->child_count > 0) {
+      uint32_t level = 0;
+      key_add(keys, 'B', state->child_count);
+      for(uint32_t c = state->child_start; c < state->child_start + state->child_count; c++) {
+        key_add(keys, 'n', machine->states[c].name);
+        key_add(keys, 's', state_keys[c]);
+        if(state_levels[c] > level) {
+          level = state_levels[c];
+        }
+      }
+      block_keys[s] = key_intern(keys);
+      state_levels[s] = level + 2;
+    }
+
+    key_add(keys, 'S', state->flags);
+    for(int kind = IR_EVENT; kind <= IR_DELAY; kind++) {
+      uint32_t* offsets = machine->offsets[kind];
+      key_add(keys, 'k', kind);
+      for(uint32_t t = offsets[s]; t < offsets[s + 1]; t++) {
+        key_add(keys, 't', tk.transitions[t]);
+        empty = false;
+      }
+    }
+    for(uint32_t i = machine->invoke_offsets[s]; i < machine->invoke_offsets[s + 1]; i++) {
+      key_add(keys, 'v', machine->invokes[i].src);
+      for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+        uint32_t* offsets = machine->offsets[kind];
+        key_add(keys, 'k', kind);
+        for(uint32_t t = offsets[i]; t < offsets[i + 1]; t++) {
+          key_add(keys, 't', tk.transitions[t]);
+        }
+      }
+      empty = false;
+    }
+    key_add(keys, 'i', state->initial == IR_NONE ? IR_NONE : machine->states[state->initial].name);
+    key_add(keys, 'b', block_keys[s]);
+    state_keys[s] = key_intern(keys);
+    if(empty) {
+      empty_key = state_keys[s];
+    }
+  }
+
+  uint32_t key_count = keys->count;
+  uint32_t* totals = fill(key_count, 0);
+  uint32_t* uses = fill(key_count, 0);
+  uint32_t* reps = fill(key_count, IR_NONE);
+  for(uint32_t s = 0; s < state_count; s++) {
+    totals[state_keys[s]]++;
+    if(block_keys[s] != IR_NONE) {
+      totals[block_keys[s]]++;
+    }
+  }
+  if(empty_key != IR_NONE) {
+    totals[empty_key] = 0;
+  }
+
+  // Walk the states as the emitter would. A state is printed when its
+  // parent's nested states are; the first printed copy of a shared value
+  // becomes the const, later ones reference it.
+  bool* expanded = lucy_calloc(state_count == 0 ? 1 : state_count, sizeof(bool));
+  for(uint32_t s = 0; s < state_count; s++) {
+    uint32_t parent = machine->states[s].parent;
+    if(parent != IR_NONE && !expanded[parent]) {
+      continue;
+    }
+
+    uint32_t key = state_keys[s];
+    uses[key]++;
+    if(reps[key] == IR_NONE) {
+      reps[key] = s;
+    }
+    if(totals[key] >= 2 && reps[key] != s) {
+      continue;
+    }
+
+    for(int kind = IR_EVENT; kind <= IR_DELAY; kind++) {
+      uint32_t* offsets = machine->offsets[kind];
+      for(uint32_t t = offsets[s]; t < offsets[s + 1]; t++) {
+        count_list_uses(machine, &tk, uses, t);
+      }
+    }
+    for(uint32_t i = machine->invoke_offsets[s]; i < machine->invoke_offsets[s + 1]; i++) {
+      for(int kind = IR_DONE; kind <= IR_ERROR; kind++) {
+        uint32_t* offsets = machine->offsets[kind];
+        for(uint32_t t = offsets[i]; t < offsets[i + 1]; t++) {
+          count_list_uses(machine, &tk, uses, t);
+        }
+      }
+    }
+
+    key = block_keys[s];
+    if(key == IR_NONE) {
+      continue;
+    }
+    uses[key]++;
+    if(reps[key] == IR_NONE) {
+      reps[key] = s;
+    }
+    expanded[s] = totals[key] < 2 || reps[key] == s;
+  }
+
+  // Consts are ordered so that each only references earlier ones: lists
+  // first, then bodies and blocks by nesting level.
+  uint32_t* const_of = fill(key_count, IR_NONE);
+  IRConst* consts = NULL;
+  uint32_t const_count = 0;
+  uint32_t const_capacity = 0;
+
+  #define add_const(const_type, const_id, key) \
+    if(const_count == const_capacity) { \
+      const_capacity = const_capacity == 0 ? 8 : const_capacity * 2; \
+      consts = lucy_realloc(consts, const_capacity * sizeof(IRConst)); \
+    } \
+    const_of[key] = const_count; \
+    consts[const_count].type = (const_type); \
+    consts[const_count++].id = (const_id);
+
+  for(uint32_t t = 0; t < machine->transition_count; t++) {
+    uint32_t key = tk.guards[t];
+    if(machine->transitions[t].guard_count > 1 && uses[key] >= 2 && const_of[key] == IR_NONE) {
+      add_const(IR_CONST_GUARDS, t, key);
+    }
+    key = tk.actions[t];
+    if(key != IR_NONE && uses[key] >= 2 && const_of[key] == IR_NONE) {
+      add_const(IR_CONST_ACTIONS, t, key);
+    }
+  }
+
+  // Sort the states by level. A block is one level below its state, so
+  // level L holds the bodies of states at L and blocks of states at L + 1.
+  uint32_t level_count = 1;
+  for(uint32_t s = 0; s < state_count; s++) {
+    if(state_levels[s] >= level_count) {
+      level_count = state_levels[s] + 1;
+    }
+  }
+  uint32_t* level_starts = fill(level_count + 2, 0);
+  uint32_t* order = fill(state_count, 0);
+  for(uint32_t s = 0; s < state_count; s++) {
+    level_starts[state_levels[s] + 2]++;
+  }
+  for(uint32_t level = 2; level < level_count + 2; level++) {
+    level_starts[level] += level_starts[level - 1];
+  }
+  for(uint32_t s = 0; s < state_count; s++) {
+    order[level_starts[state_levels[s] + 1]++] = s;
+  }
+
+  for(uint32_t level = 0; level < level_count; level++) {
+    for(uint32_t i = level_starts[level]; i < level_starts[level + 1]; i++) {
+      uint32_t s = order[i];
+      uint32_t key = state_keys[s];
+      if(reps[key] == s && uses[key] >= 2 && key != empty_key) {
+        add_const(IR_CONST_STATE, s, key);
+      }
+    }
+    for(uint32_t i = level_starts[level + 1]; level + 1 < level_count && i < level_starts[level + 2]; i++) {
+      uint32_t s = order[i];
+      uint32_t key = block_keys[s];
+      if(key != IR_NONE && reps[key] == s && uses[key] >= 2) {
+        add_const(IR_CONST_BLOCK, s, key);
+      }
+    }
+  }
+
+  #undef add_const
+
+  if(const_count > 0) {
+    if(stats_current != NULL) {
+      stats_current->consts_hoisted += const_count;
+    }
+
+    machine->state_consts = fill(state_count, IR_NONE);
+    machine->block_consts = fill(state_count, IR_NONE);
+    for(uint32_t s = 0; s < state_count; s++) {
+      machine->state_consts[s] = const_of[state_keys[s]];
+      if(block_keys[s] != IR_NONE) {
+        machine->block_consts[s] = const_of[block_keys[s]];
+      }
+    }
+
+    machine->guard_consts = fill(machine->transition_count, IR_NONE);
+    machine->action_consts = fill(machine->transition_count, IR_NONE);
+    for(uint32_t t = 0; t < machine->transition_count; t++) {
+      if(machine->transitions[t].guard_count > 1) {
+        machine->guard_consts[t] = const_of[tk.guards[t]];
+      }
+      if(tk.actions[t] != IR_NONE) {
+        machine->action_consts[t] = const_of[tk.actions[t]];
+      }
+    }
+
+    machine->consts = consts;
+    machine->const_count = const_count;
+  }
+
+  lucy_free(state_keys);
+  lucy_free(block_keys);
+  lucy_free(state_levels);
+  lucy_free(totals);
+  lucy_free(uses);
+  lucy_free(reps);
+  lucy_free(expanded);
+  lucy_free(const_of);
+  lucy_free(level_starts);
+  lucy_free(order);
+  transition_keys_destroy(&tk);
+}
+
+// Hopcroft partition refinement. Blocks of states are kept contiguous in
+// elems, the marked states of a block at the front of it.
+typedef struct Partition {
+  uint32_t* elems;
+  uint32_t* loc;
+  uint32_t* block_of;
+  uint32_t* first;
+  uint32_t* end;
+  uint32_t* mid;
+  uint32_t block_count;
+
+  uint32_t* touched;
+  uint32_t touched_count;
+  uint32_t* work;
+  uint32_t work_count;
+} Partition;
+
+static void partition_mark(Partition* p, uint32_t s) {
+  uint32_t block = p->block_of[s];
+  uint32_t i = p->loc[s];
+  uint32_t m = p->mid[block];
+  if(i < m) {
+    return;
+  }
+  if(m == p->first[block]) {
+    p->touched[p->touched_count++] = block;
+  }
+
+  uint32_t other = p->elems[m];
+  p->elems[m] = s;
+  p->loc[s] = m;
+  p->elems[i] = other;
+  p->loc[other] = i;
+  p->mid[block] = m + 1;
+}
+
+// Splits every touched block into its marked and unmarked states. The
+// smaller half becomes the new block and is queued as a splitter, which
+// is what bounds the work to O(m log n).
+static void partition_split(Partition* p) {
+  for(uint32_t i = 0; i < p->touched_count; i++) {
+    uint32_t block = p->touched[i];
+    uint32_t first = p->first[block];
+    uint32_t mid = p->mid[block];
+    uint32_t end = p->end[block];
+    if(mid == end) {
+      p->mid[block] = first;
+      continue;
+    }
+
+    uint32_t split = p->block_count++;
+    if(mid - first <= end - mid) {
+      p->first[split] = first;
+      p->end[split] = mid;
+      p->first[block] = mid;
+    } else {
+      p->first[split] = mid;
+      p->end[split] = end;
+      p->end[block] = mid;
+    }
+    p->mid[block] = p->first[block];
+    p->mid[split] = p->first[split];
+    for(uint32_t e = p->first[split]; e < p->end[split]; e++) {
+      p->block_of[p->elems[e]] = split;
+    }
+    p->work[p->work_count++] = split;
+  }
+  p->touched_count = 0;
+}
+
+static bool is_mergeable(IRMachine* machine, uint32_t s) {
+  IRState* state = &machine->states[s];
+  return (state->flags & IR_STATE_FINAL) == 0 && state->child_count == 0 &&
+    machine->invoke_offsets[s] == machine->invoke_offsets[s + 1];
+}
+
+// Merges states that can't be told apart: siblings with the same
+// transitions, in the same order, to targets that are equivalent in turn.
+// Final states and states with invokes or nested states are kept as is.
+static void minimize(Keys* keys, IRMachine* machine) {
+  uint32_t state_count = machine->state_count;
+  if(state_count < 2) {
+    return;
+  }
+
+  // Initial blocks: the transitions of a state without their targets.
+  // Symbols are positions in that list, so only states of the same block
+  // share their meaning.
+  TransitionKeys tk;
+  transition_keys(keys, machine, &tk);
+
+  uint32_t* initial_keys = fill(state_count, IR_NONE);
+  uint32_t edge_count = 0;
+  for(uint32_t s = 0; s < state_count; s++) {
+    if(!is_mergeable(machine, s)) {
+      continue;
+    }
+    key_add(keys, 'M', machine->states[s].parent);
+    for(int kind = IR_EVENT; kind <= IR_DELAY; kind++) {
+      uint32_t* offsets = machine->offsets[kind];
+      key_add(keys, 'k', kind);
+      for(uint32_t t = offsets[s]; t < offsets[s + 1]; t++) {
+        key_add(keys, 'e', machine->transitions[t].event);
+        key_add(keys, 'd', machine->transitions[t].delay);
+        key_add(keys, 'g', tk.guards[t]);
+        key_add(keys, 'a', tk.actions[t]);
+        edge_count++;
+      }
+    }
+    initial_keys[s] = key_intern(keys);
+  }
+  transition_keys_destroy(&tk);
+
+  Partition p;
+  p.elems = fill(state_count, 0);
+  p.loc = fill(state_count, 0);
+  p.block_of = fill(state_count, 0);
+  p.first = fill(state_count, 0);
+  p.end = fill(state_count, 0);
+  p.mid = fill(state_count, 0);
+  p.touched = fill(state_count, 0);
+  p.work = fill(state_count, 0);
+  p.block_count = 0;
+  p.touched_count = 0;
+  p.work_count = 0;
+
+  uint32_t* key_blocks = fill(keys->count, IR_NONE);
+  uint32_t* sizes = fill(state_count, 0);
+  for(uint32_t s = 0; s < state_count; s++) {
+    uint32_t key = initial_keys[s];
+    uint32_t block;
+    if(key == IR_NONE) {
+      block = p.block_count++;
+    } else {
+      if(key_blocks[key] == IR_NONE) {
+        key_blocks[key] = p.block_count++;
+      }
+      block = key_blocks[key];
+    }
+    p.block_of[s] = block;
+    sizes[block]++;
+  }
+
+  uint32_t offset = 0;
+  for(uint32_t b = 0; b < p.block_count; b++) {
+    p.first[b] = p.mid[b] = p.end[b] = offset;
+    offset += sizes[b];
+    p.work[p.work_count++] = b;
+  }
+  for(uint32_t s = 0; s < state_count; s++) {
+    uint32_t block = p.block_of[s];
+    p.loc[s] = p.end[block]++;
+    p.elems[p.loc[s]] = s;
+  }
+
+  // Incoming edges by target, labelled with their position in the source.
+  uint32_t* in_offsets = fill(state_count + 1, 0);
+  uint32_t* in_sources = fill(edge_count, 0);
+  uint32_t* in_symbols = fill(edge_count, 0);
+  uint32_t symbol_count = 0;
+  for(int pass = 0; pass < 2; pass++) {
+    for(uint32_t s = 0; s < state_count; s++) {
+      if(initial_keys[s] == IR_NONE) {
+        continue;
+      }
+      uint32_t position = 0;
+      for(int kind = IR_EVENT; kind <= IR_DELAY; kind++) {
+        uint32_t* offsets = machine->offsets[kind];
+        for(uint32_t t = offsets[s]; t < offsets[s + 1]; t++, position++) {
+          uint32_t target = machine->transitions[t].target;
+          if(pass == 0) {
+            in_offsets[target + 1]++;
+          } else {
+            uint32_t i = in_offsets[target]++;
+            in_sources[i] = s;
+            in_symbols[i] = position;
+          }
+        }
+      }
+      if(position > symbol_count) {
+        symbol_count = position;
+      }
+    }
+
+    // Prefix sums, then fill shifts them back into place.
+    if(pass == 0) {
+      for(uint32_t s = 0; s < state_count; s++) {
+        in_offsets[s + 1] += in_offsets[s];
+      }
+    } else {
+      for(uint32_t s = state_count; s > 0; s--) {
+        in_offsets[s] = in_offsets[s - 1];
+      }
+      in_offsets[0] = 0;
+    }
+  }
+
+  // Sources of the edges into a splitter, linked by symbol.
+  uint32_t* heads = fill(symbol_count, IR_NONE);
+  uint32_t* symbols = fill(symbol_count, 0);
+  uint32_t* sources = fill(edge_count, 0);
+  uint32_t* links = fill(edge_count, 0);
+
+  while(p.work_count > 0) {
+    uint32_t splitter = p.work[--p.work_count];
+    uint32_t gathered = 0;
+    uint32_t touched_symbols = 0;
+
+    for(uint32_t e = p.first[splitter]; e < p.end[splitter]; e++) {
+      uint32_t q = p.elems[e];
+      for(uint32_t i = in_offsets[q]; i < in_offsets[q + 1]; i++) {
+        uint32_t symbol = in_symbols[i];
+        if(heads[symbol] == IR_NONE) {
+          symbols[touched_symbols++] = symbol;
+        }
+        sources[gathered] = in_sources[i];
+        links[gathered] = heads[symbol];
+        heads[symbol] = gathered++;
+      }
+    }
+
+    for(uint32_t i = 0; i < touched_symbols; i++) {
+      uint32_t symbol = symbols[i];
+      for(uint32_t g = heads[symbol]; g != IR_NONE; g = links[g]) {
+        partition_mark(&p, sources[g]);
+      }
+      partition_split(&p);
+      heads[symbol] = IR_NONE;
+    }
+  }
+
+  // The first state of each block in document order stands in for it.
+  uint32_t* reps = fill(p.block_count, IR_NONE);
+  uint32_t* state_reps = sizes;
+  bool* keep = lucy_malloc(state_count * sizeof(bool));
+  uint32_t merged = 0;
+  for(uint32_t s = 0; s < state_count; s++) {
+    uint32_t block = p.block_of[s];
+    if(reps[block] == IR_NONE) {
+      reps[block] = s;
+    }
+    state_reps[s] = reps[block];
+    keep[s] = state_reps[s] == s;
+    merged += keep[s] ? 0 : 1;
+  }
+
+  if(merged > 0) {
+    if(stats_current != NULL) {
+      stats_current->states_merged += merged;
+    }
+
+    for(uint32_t t = 0; t < machine->transition_count; t++) {
+      machine->transitions[t].target = state_reps[machine->transitions[t].target];
+    }
+    for(uint32_t s = 0; s < state_count; s++) {
+      IRState* state = &machine->states[s];
+      if(state->initial != IR_NONE) {
+        state->initial = state_reps[state->initial];
+      }
+    }
+    if(machine->initial != IR_NONE) {
+      machine->initial = state_reps[machine->initial];
+    }
+    rebuild(machine, keep, NULL);
+  }
+
+  lucy_free(heads);
+  lucy_free(symbols);
+  lucy_free(sources);
+  lucy_free(links);
+  lucy_free(reps);
+  lucy_free(keep);
+  lucy_free(p.elems);
+  lucy_free(p.loc);
+  lucy_free(p.block_of);
+  lucy_free(p.first);
+  lucy_free(p.end);
+  lucy_free(p.mid);
+  lucy_free(p.touched);
+  lucy_free(p.work);
+  lucy_free(in_offsets);
+  lucy_free(in_sources);
+  lucy_free(in_symbols);
+  lucy_free(key_blocks);
+  lucy_free(sizes);
+  lucy_free(initial_keys);
+}
+
+static void keys_init(Keys* keys) {
+  symtab_init(&keys->table, 0);
+  keys->items = NULL;
+  keys->count = 0;
+  keys->capacity = 0;
+  keys->sb = str_builder_create();
+}
+
+static void keys_destroy(Keys* keys) {
+  for(uint32_t i = 0; i < keys->count; i++) {
+    lucy_free(keys->items[i]);
+  }
+  lucy_free(keys->items);
+  symtab_destroy(&keys->table);
+  str_builder_destroy(keys->sb);
+}
+
+void ir_minimize(IRProgram* ir) {
+  Keys keys;
+  keys_init(&keys);
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    minimize(&keys, &ir->machines[i]);
+  }
+  keys_destroy(&keys);
+}
+
+void ir_optimize(IRProgram* ir) {
+  Keys keys;
+  keys_init(&keys);
+  for(uint32_t i = 0; i < ir->machine_count; i++) {
+    IRMachine* machine = &ir->machines[i];
+    remove_unreachable(machine);
+    dedupe_transitions(&keys, machine);
+    share(&keys, machine);
+  }
+  keys_destroy(&keys);
+}
@@ -0,0 +1,9 @@
+#ifndef LUCY_OPTIMIZE_H_
+#define LUCY_OPTIMIZE_H_
+
+#include "ir.h"
+
+void ir_minimize(IRProgram*);
+void ir_optimize(IRProgram*);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "alloc.h"
 #include "node.h"
 #include "state.h"
 #include "scope.h"
@@ -12,6 +13,8 @@
 #include "timeframe.h"
 #include "parser.h"
 #include "error.h"
+#include "stats.h"
+#include "validate.h"
 
 #define TOKEN_EOF 0
 #define TOKEN_EOL 1
@@ -27,7 +30,14 @@
 
 #define _check(f) { int _fa = f; if(_fa == 2)  { return 2; } else if(_fa > err) { err = _fa; } }
 
-static int consume_machine(State*);
+// Returned by step_state and step_machine once their block has closed.
+#define PARSE_BLOCK_END -1
+
+static uint32_t max_depth = PARSER_DEFAULT_MAX_DEPTH;
+// Overrides max_depth for parses on this thread, 0 when not set.
+static _Thread_local uint32_t thread_max_depth = 0;
+
+static int open_machine(State*);
 
 int is_newline(char c) {
   return c == '\n';
@@ -121,7 +131,7 @@ static void consume_timeframe(State* state) {
   consume_while(state, &timeframe_consume_condition);
 }
 
-static int consume_token(State* state) {
+static int lex_token(State* state) {
   while(state_inbounds(state)) {
     state_next(state);
     state_advance_column(state);
@@ -182,6 +192,18 @@ static int consume_token(State* state) {
   return TOKEN_EOF;
 }
 
+static int consume_token(State* state) {
+  if(stats_current == NULL) {
+    return lex_token(state);
+  }
+
+  stats_phase_begin(STATS_PHASE_LEX);
+  int token = lex_token(state);
+  stats_phase_end(STATS_PHASE_LEX);
+  stats_count_token();
+  return token;
+}
+
 static int consume_transition(State* state) {
   int err = 0;
   TransitionNode* transition_node = node_create_transition();
@@ -202,35 +224,21 @@ static int consume_transition(State* state) {
       case KW_DELAY: {
         int token = consume_token(state);
 
-        int time;
-        switch(token) {
-          case TOKEN_INTEGER: {
-            char* num_str = state_take_word(state);
-            time = atoi(num_str);
-            free(num_str);
-            break;
-          }
-          case TOKEN_TIMEFRAME: {
-            char* num_str = state_take_word(state);
-            Timeframe tf = timeframe_parse(num_str, state->word_len);
-            free(num_str);
-
-            if(tf.error != NULL) {
-              error_msg_with_code_block(state, NULL, tf.error);
-              err = 2;
-              goto end;
-            }
-
-            time = tf.time;
-            break;
-          }
-          default: {
-            error_msg_with_code_block(state, NULL, "Expected either an integer time (in milliseconds) or a timeframe such as 200ms.");
-            err = 2;
-            goto end;
-          }
+        if(token != TOKEN_INTEGER && token != TOKEN_TIMEFRAME) {
+          error_msg_with_code_block(state, NULL, DIAG_EXPECTED_DELAY, "Expected either an integer time (in milliseconds) or a timeframe such as 200ms.");
+          err = 2;
+          goto discard;
         }
 
+        Timeframe tf = timeframe_parse(state->word, state->word_len);
+        state_reset_word(state);
+        if(tf.error != NULL) {
+          error_msg_with_code_block(state, NULL, DIAG_INVALID_TIMEFRAME, tf.error);
+          err = 2;
+          goto discard;
+        }
+        int time = tf.time;
+
         transition_node->type = TRANSITION_DELAY_TYPE;
         DelayExpression* expression = node_create_delayexpression();
         expression->time = time;
@@ -252,29 +260,34 @@ static int consume_transition(State* state) {
   Node* transition_node_node = (Node*)transition_node;
   int rewind_to_start = event == NULL ? 2 : strlen(event);
   state_node_start_pos(state, transition_node_node, rewind_to_start);
+  if(event != transition_node->event) {
+    lucy_free(event);
+  }
 
   switch(current_node_type) {
     case NODE_STATE_TYPE: {
-      node_append(current_node, transition_node_node);
+      state_append_child(state, current_node, transition_node_node);
       state->parent_node = current_node;
       break;
     }
     case NODE_INVOKE_TYPE: {
-      node_append(current_node, transition_node_node);
+      state_append_child(state, current_node, transition_node_node);
       state->parent_node = current_node;
       break;
     }
     case NODE_TRANSITION_TYPE: {
-      error_msg_with_code_block(state, transition_node_node, "A transition sibiling to another, hasn't happened before, this is likely a compiler bug.");
+      error_msg_with_code_block(state, transition_node_node, DIAG_INTERNAL, "A transition sibiling to another, hasn't happened before, this is likely a compiler bug.");
       return 2;
     }
     default: {
-      error_msg_with_code_block(state, transition_node_node, "Unexpected parent node to a transition.");
+      error_msg_with_code_block(state, transition_node_node, DIAG_INTERNAL, "Unexpected parent node to a transition.");
       return 2;
     }
   }
 
-  StateNode* state_node = (StateNode*)current_node;
+  // Transitions default to the state they are in, for invoke that's the parent.
+  StateNode* state_node = current_node_type == NODE_INVOKE_TYPE ?
+    (StateNode*)current_node->parent : (StateNode*)current_node;
 
   state->node = transition_node_node;
 
@@ -292,7 +305,7 @@ static int consume_transition(State* state) {
         }
 
         if(token != TOKEN_END_BLOCK) {
-          error_msg_with_code_block(state, transition_node_node, "Block transition expects destination state.");
+          error_msg_with_code_block(state, transition_node_node, DIAG_EXPECTED_DESTINATION, "Block transition expects destination state.");
           err = 2;
           goto end;
         }
@@ -304,7 +317,7 @@ static int consume_transition(State* state) {
     }
 
     if(token != TOKEN_CALL) {
-      error_msg_with_code_block(state, NULL, "Expected to pipe to a destination.");
+      error_msg_with_code_block(state, NULL, DIAG_EXPECTED_DESTINATION, "Expected to pipe to a destination.");
       err = 2;
       goto end;
     }
@@ -337,7 +350,7 @@ static int consume_transition(State* state) {
       case KW_GUARD: {
         token = consume_token(state);
         if(token != TOKEN_IDENTIFIER) {
-          error_msg_with_code_block(state, NULL, "Expected a reference to an imported function after guard.");
+          error_msg_with_code_block(state, NULL, DIAG_EXPECTED_FUNCTION, "Expected a reference to an imported function after guard.");
           err = 2;
           goto end;
         }
@@ -346,13 +359,13 @@ static int consume_transition(State* state) {
         guard_expression->ref = state_take_word(state);
         TransitionGuard* guard = node_transition_add_guard(transition_node, NULL);
         guard->expression = guard_expression;
-        free(identifier);
-        break;
+        lucy_free(identifier);
+        continue;
       }
       case KW_ASSIGN: {
         token = consume_token(state);
         if(token != TOKEN_IDENTIFIER) {
-          error_msg_with_code_block(state, NULL, "Expected a property to assign to.");
+          error_msg_with_code_block(state, NULL, DIAG_EXPECTED_PROPERTY, "Expected a property to assign to.");
           err = 2;
           goto end;
         }
@@ -363,15 +376,15 @@ static int consume_transition(State* state) {
         action->expression = (Expression*)assign_expression;
 
         program_add_flag(state->program, PROGRAM_USES_ASSIGN);
-        free(identifier);
-        break;
+        lucy_free(identifier);
+        continue;
       }
       case KW_ACTION: {
         token = consume_token(state);
         if(token != TOKEN_IDENTIFIER) {
-          error_msg_with_code_block(state, NULL, "Expected a reference to an imported function after action.");
+          error_msg_with_code_block(state, NULL, DIAG_EXPECTED_FUNCTION, "Expected a reference to an imported function after action.");
           err = 2;
-          free(identifier);
+          lucy_free(identifier);
           goto end;
         }
 
@@ -379,28 +392,52 @@ static int consume_transition(State* state) {
         action_expression->ref = state_take_word(state);
         TransitionAction* action = node_transition_add_action(transition_node, NULL);
         action->expression = (Expression*)action_expression;
-        free(identifier);
-        break;
+        lucy_free(identifier);
+        continue;
       }
     }
 
-    if(state_has_guard(state, identifier)) {
-      node_transition_add_guard(transition_node, identifier);
-    } else if(state_has_action(state, identifier)) {
-      node_transition_add_action(transition_node, identifier);
+    Binding* binding = scope_lookup(state->scope, identifier);
+    if(binding != NULL) {
+      binding->used = true;
+      if(binding->assignment->binding_type == ASSIGNMENT_GUARD) {
+        node_transition_add_guard(transition_node, identifier);
+      } else {
+        node_transition_add_action(transition_node, identifier);
+      }
+    } else if(transition_node->dest != NULL) {
+      // Only the last identifier is the destination.
+      size_t len = strlen(transition_node->dest) + 32;
+      char* msg = lucy_malloc(len);
+      snprintf(msg, len, "'%s' is not a guard or action.", transition_node->dest);
+      error_msg_with_code_block(state, transition_node_node, DIAG_NOT_A_BINDING, msg);
+      lucy_free(msg);
+      lucy_free(identifier);
+      err = 2;
+      goto end;
     } else {
       transition_node->dest = identifier;
     }
   }
 
   if(transition_node->dest == NULL) {
-    transition_node->dest = state_node->name;
+    transition_node->dest = lucy_strdup(state_node->name);
   }
+  transition_node_node->end = state->index;
 
   end: {
     state_node_up(state);
     return err;
   }
+
+  // Not attached to the tree yet, so nothing else will free it.
+  discard: {
+    lucy_free(event);
+    node_destroy_transition(transition_node);
+    node_destroy((Node*)transition_node);
+    state_node_up(state);
+    return err;
+  }
 }
 
 static int consume_invoke(State* state) {
@@ -412,7 +449,7 @@ static int consume_invoke(State* state) {
 
   Node* parent_node = state->node;
   if(parent_node->type != NODE_STATE_TYPE) {
-    error_msg_with_code_block(state, node, "Unexpected parent for invoke.");
+    error_msg_with_code_block(state, node, DIAG_INTERNAL, "Unexpected parent for invoke.");
     return 2;
   }
 
@@ -421,7 +458,7 @@ static int consume_invoke(State* state) {
   int token = consume_token(state);
 
   if(token != TOKEN_IDENTIFIER) {
-    error_msg_with_code_block(state, node, "Expected a function to call with invoke.");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_FUNCTION, "Expected a function to call with invoke.");
     return 2;
   }
 
@@ -460,7 +497,9 @@ static int consume_invoke(State* state) {
   }
 }
 
-static int consume_state(State* state) {
+// Parses a state's name and opening brace, then leaves its body to
+// consume_blocks.
+static int open_state(State* state) {
   int err = 0;
 
   StateNode* state_node = node_create_state();
@@ -469,7 +508,7 @@ static int consume_state(State* state) {
 
   Node* parent_node = state->node;
   if(parent_node->type != NODE_MACHINE_TYPE) {
-    error_msg_with_code_block(state, state_node_node, "Unexpected parent node for state.");
+    error_msg_with_code_block(state, state_node_node, DIAG_INTERNAL, "Unexpected parent node for state.");
     return 2;
   }
 
@@ -486,7 +525,7 @@ static int consume_state(State* state) {
         case MODIFIER_TYPE_INITIAL: {
           state->modifier = MODIFIER_NONE;
           MachineNode* machine_node = (MachineNode*)parent_node;
-          machine_node->initial = strdup(state_node->name);
+          machine_node->initial = lucy_strdup(state_node->name);
           break;
         }
         case MODIFIER_TYPE_FINAL: {
@@ -501,7 +540,7 @@ static int consume_state(State* state) {
     }
     default: {
       err = 1;
-      error_msg_with_code_block(state, state_node_node, "States must be given a name.");
+      error_msg_with_code_block(state, state_node_node, DIAG_EXPECTED_NAME, "States must be given a name.");
       break;
     }
   }
@@ -511,6 +550,18 @@ static int consume_state(State* state) {
     return 2;
   }
 
+  ParseFrame* frame = state_push_frame(state, FRAME_STATE);
+  frame->err = err;
+  return 0;
+}
+
+// Parses a state body until it closes or opens a nested machine.
+static int step_state(State* state) {
+  ParseFrame* frame = &state->frames[state->frame_count - 1];
+  int err = frame->err;
+  Node* state_node_node = frame->node;
+  int token;
+
   while(true) {
     token = consume_token(state);
 
@@ -534,8 +585,8 @@ static int consume_state(State* state) {
             break;
           }
           case KW_MACHINE: {
-            _check(consume_machine(state));
-            break;
+            frame->err = err;
+            return open_machine(state);
           }
           default: {
             _check(consume_transition(state));
@@ -553,8 +604,8 @@ static int consume_state(State* state) {
   }
 
   end: {
-    state_node_up(state);
-    return err;
+    frame->err = err;
+    return PARSE_BLOCK_END;
   }
 }
 
@@ -562,7 +613,8 @@ static int consume_import_specifiers(ImportNode* import_node, State* state) {
   int err = 0;
   int token;
 
-  ImportSpecifier *specifier;
+  // The specifier being read, appended once its comma or brace is seen.
+  ImportSpecifier *specifier = NULL;
   while(true) {
     token = consume_token(state);
     
@@ -571,7 +623,7 @@ static int consume_import_specifiers(ImportNode* import_node, State* state) {
         char* identifier = state_take_word(state);
         if(strcmp(identifier, "as") == 0) {
 
-          error_msg_with_code_block(state, (Node*)import_node, "Import aliases are not currently supported.");
+          error_msg_with_code_block(state, (Node*)import_node, DIAG_UNSUPPORTED, "Import aliases are not currently supported.");
           return 2;
         }
 
@@ -579,15 +631,18 @@ static int consume_import_specifiers(ImportNode* import_node, State* state) {
         break;
       }
       case TOKEN_END_BLOCK: {
-        node_append((Node*)import_node, (Node*)specifier);
+        if(specifier != NULL) {
+          node_append((Node*)import_node, (Node*)specifier);
+        }
         goto end;
       }
       case TOKEN_UNKNOWN: {
         char c = state_char(state);
 
         // Getting into another specifier, close out this one.
-        if(c == ',') {
+        if(c == ',' && specifier != NULL) {
           node_append((Node*)import_node, (Node*)specifier);
+          specifier = NULL;
         }
 
         break;
@@ -609,7 +664,7 @@ static int consume_import(State* state) {
   Node *current_node = state->node;
 
   if(current_node != NULL) {
-    error_msg_with_code_block(state, current_node, "Import statement must be at the top of the file.");
+    error_msg_with_code_block(state, current_node, DIAG_IMPORT_NOT_FIRST, "Import statement must be at the top of the file.");
     return 2;
   }
 
@@ -670,9 +725,37 @@ static int consume_import(State* state) {
   }
 }
 
+static int add_binding(State* state, Assignment* assignment) {
+  Node* node = (Node*)assignment;
+  Scope* scope = state->scope;
+
+  // Nested machines share their options with the top-level machine, so a
+  // guard can't shadow an outer guard of the same name (same for actions).
+  Binding* outer = scope_lookup(scope->parent, assignment->binding_name);
+  if(outer != NULL && outer->assignment->binding_type == assignment->binding_type) {
+    error_msg_with_code_block(state, node, DIAG_DUPLICATE_NAME, "This name is already defined in an enclosing machine.");
+    return 2;
+  }
+
+  if(!scope_add_binding(scope, assignment)) {
+    error_msg_with_code_block(state, node, DIAG_DUPLICATE_NAME, "A guard or action with this name is already defined in this machine.");
+    return 2;
+  }
+
+  // Sibling machines, or a nested one declaring it first, would still
+  // share the name.
+  SymbolTable* names = assignment->binding_type == ASSIGNMENT_GUARD ? &state->guard_names : &state->action_names;
+  if(!symtab_insert(names, assignment->binding_name, 0)) {
+    error_msg_with_code_block(state, node, DIAG_DUPLICATE_NAME, "This name is already defined elsewhere in the same top-level machine.");
+    return 2;
+  }
+  return 0;
+}
+
 static int consume_action(State* state) {
   Assignment* assignment = node_create_assignment(ASSIGNMENT_ACTION);
   Node *node = (Node*)assignment;
+  state_node_start_pos(state, node, 6); // "action"
   state_node_set(state, node);
 
   int token;
@@ -689,23 +772,24 @@ static int consume_action(State* state) {
   token = consume_token(state);
 
   if(token != TOKEN_ASSIGNMENT) {
-    error_msg_with_code_block(state, node, "Expected an assignment");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_ASSIGNMENT, "Expected an assignment");
     return 2;
   }
 
   token = consume_token(state);
 
   if(token != TOKEN_IDENTIFIER) {
-    error_msg_with_code_block(state, node, "Expected an identifier");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_IDENTIFIER, "Expected an identifier");
     return 2;
   }
 
   if(keyword_get(state->word) != KW_ASSIGN) {
-    error_msg_with_code_block(state, node, "Only assign expressions are supported at this time");
+    error_msg_with_code_block(state, node, DIAG_UNSUPPORTED, "Only assign expressions are supported at this time");
     return 2;
   }
 
   AssignExpression *expression = node_create_assignexpression();
+  assignment->value = (Expression*)expression;
   program_add_flag(state->program, PROGRAM_USES_ASSIGN);
 
   token = consume_token(state);
@@ -725,9 +809,11 @@ static int consume_action(State* state) {
   }
 
   expression->identifier = state_take_word(state);
-  assignment->value = (Expression*)expression;
 
-  state_add_action(state, assignment->binding_name);
+  if(add_binding(state, assignment) != 0) {
+    return 2;
+  }
+
   state_node_up(state);
   return 0;
 }
@@ -735,6 +821,7 @@ static int consume_action(State* state) {
 static int consume_guard(State* state) {
   Assignment* assignment = node_create_assignment(ASSIGNMENT_GUARD);
   Node* node = (Node*)assignment;
+  state_node_start_pos(state, node, 5); // "guard"
   state_node_set(state, node);
 
   int token;
@@ -751,34 +838,48 @@ static int consume_guard(State* state) {
   token = consume_token(state);
 
   if(token != TOKEN_ASSIGNMENT) {
-    error_msg_with_code_block(state, node, "Expected an identifier");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_IDENTIFIER, "Expected an identifier");
     return 2;
   }
 
   token = consume_token(state);
 
   if(token != TOKEN_IDENTIFIER) {
-    error_msg_with_code_block(state, node, "Expected an identifier");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_IDENTIFIER, "Expected an identifier");
     return 2;
   }
 
   IdentifierExpression *expression = node_create_identifierexpression();
   expression->name = state_take_word(state);
 
-  state_add_guard(state, assignment->binding_name);
-
   assignment->value = (Expression*)expression;
+
+  if(add_binding(state, assignment) != 0) {
+    return 2;
+  }
+
   state_node_up(state);
   return 0;
 }
 
-static int consume_machine_inner(State* state, bool is_implicit, int initial_token) {
-  int err = 0;
-  int token = is_implicit ? initial_token : consume_token(state);
+// Parses a machine body until it closes or opens a state.
+static int step_machine(State* state) {
+  ParseFrame* frame = &state->frames[state->frame_count - 1];
+  bool is_implicit = frame->is_implicit;
+  int err = frame->err;
+  int token;
 
   while(true) {
+    // Implicit machines start on the token that showed there was one.
+    if(frame->token != -1) {
+      token = frame->token;
+      frame->token = -1;
+    } else {
+      token = consume_token(state);
+    }
+
     switch(token) {
-      case TOKEN_EOL: goto next;
+      case TOKEN_EOL: continue;
       case TOKEN_EOF: goto end;
       case TOKEN_END_BLOCK: {
         if(!is_implicit) {
@@ -792,9 +893,8 @@ static int consume_machine_inner(State* state, bool is_implicit, int initial_tok
         char* identifier = state->word;
 
         if(!is_keyword(identifier)) {
-          error_msg_with_code_block(state, state->node, "Unknown top-level identifier.");
-          err = 2;
-          goto end;
+          error_msg_with_code_block(state, state->node, DIAG_UNKNOWN_TOP_LEVEL, "Unknown top-level identifier.");
+          return 2;
         }
 
         unsigned short key = keyword_get(identifier);
@@ -808,8 +908,8 @@ static int consume_machine_inner(State* state, bool is_implicit, int initial_tok
             break;
           }
           case KW_STATE: {
-            _check(consume_state(state));
-            break;
+            frame->err = err;
+            return open_state(state);
           }
           case KW_IMPORT: {
             _check(consume_import(state));
@@ -829,31 +929,45 @@ static int consume_machine_inner(State* state, bool is_implicit, int initial_tok
       }
       default: {
         error_unexpected_identifier(state, state->node);
-        err = 2;
-        goto end;
+        return 2;
       }
     }
-
-    next: {
-      token = consume_token(state);
-    }
   }
 
   end: {
-    return err;
+    frame->err = err;
+    return PARSE_BLOCK_END;
   }
 }
 
-static int consume_machine(State* state) {
+// Parses a machine's name and opening brace, then leaves its body to
+// consume_blocks.
+static int open_machine(State* state) {
   int err = 0;
 
   MachineNode* machine_node = node_create_machine();
   Node* node = (Node*)machine_node;
+  state_node_start_pos(state, node, 7); // "machine"
   state_node_set(state, node);
 
+  uint32_t depth = thread_max_depth != 0 ? thread_max_depth : max_depth;
+  if(state->frame_count > 0 && state->machine_depth >= depth) {
+    char msg[80];
+    snprintf(msg, sizeof(msg), "Machines can only be nested %u deep.", depth);
+    error_msg_with_code_block(state, node, DIAG_TOO_DEEP, msg);
+    return 2;
+  }
+
+  if(state->frame_count == 0) {
+    state_reset_names(state);
+  }
+  Scope* parent_scope = state->scope;
+  machine_node->scope = scope_create_scope(parent_scope, node);
+  state->scope = machine_node->scope;
+
   int token = consume_token(state);
   if(token != TOKEN_IDENTIFIER) {
-    error_msg_with_code_block(state, node, "Machine must have a name.");
+    error_msg_with_code_block(state, node, DIAG_EXPECTED_NAME, "Machine must have a name.");
     err = 1;
     goto end;
   }
@@ -867,25 +981,74 @@ static int consume_machine(State* state) {
     goto end;
   }
 
-  _check(consume_machine_inner(state, false, 0));
+  ParseFrame* frame = state_push_frame(state, FRAME_MACHINE);
+  frame->parent_scope = parent_scope;
+  return 0;
 
   end: {
+    state->scope = parent_scope;
     state_node_up(state);
     return err;
   }
 }
 
-static int consume_implicit_machine(State* state, int current_token) {
-  int err = 0;
-
+static int open_implicit_machine(State* state, int current_token) {
   MachineNode* machine_node = node_create_machine();
   Node* node = (Node*)machine_node;
 
   state_node_set(state, node);
 
-  _check(consume_machine_inner(state, true, current_token));
+  state_reset_names(state);
+  machine_node->scope = scope_create_scope(NULL, node);
+  state->scope = machine_node->scope;
+
+  ParseFrame* frame = state_push_frame(state, FRAME_MACHINE);
+  frame->is_implicit = true;
+  frame->token = current_token;
+  return 0;
+}
+
+// Runs the blocks on the frame stack until the one opened last from the
+// top level is done. Each finished block adds its error to its parent's,
+// like _check, and a 2 stops everything.
+static int consume_blocks(State* state, int err) {
+  if(err == 2) {
+    return 2;
+  }
+
+  while(state->frame_count > 0) {
+    ParseFrame* frame = &state->frames[state->frame_count - 1];
+    int result = frame->type == FRAME_STATE ? step_state(state) : step_machine(state);
+    if(result == 2) {
+      return 2;
+    }
+
+    frame = &state->frames[state->frame_count - 1];
+    if(result != PARSE_BLOCK_END) {
+      // A nested block failed to open, count it against this one.
+      if(result > frame->err) {
+        frame->err = result;
+      }
+      continue;
+    }
+
+    int block_err = frame->err;
+    if(frame->type == FRAME_MACHINE) {
+      state->scope = frame->parent_scope;
+    }
+    state_node_up(state);
+    state_pop_frame(state);
+
+    if(state->frame_count > 0) {
+      frame = &state->frames[state->frame_count - 1];
+      if(block_err > frame->err) {
+        frame->err = block_err;
+      }
+    } else if(block_err > err) {
+      err = block_err;
+    }
+  }
 
-  state_node_up(state);
   return err;
 }
 
@@ -905,7 +1068,7 @@ static int consume_program(State* state) {
         char* identifier = state->word;
 
         if(!is_keyword(identifier)) {
-          error_msg_with_code_block(state, state->node, "Unknown top-level identifier.");
+          error_msg_with_code_block(state, state->node, DIAG_UNKNOWN_TOP_LEVEL, "Unknown top-level identifier.");
           return 2;
         }
 
@@ -916,12 +1079,12 @@ static int consume_program(State* state) {
             break;
           }
           case KW_MACHINE: {
-            _check(consume_machine(state));
+            _check(consume_blocks(state, open_machine(state)));
             break;
           }
           default: {
             // Top-level machine
-            _check(consume_implicit_machine(state, token));
+            _check(consume_blocks(state, open_implicit_machine(state, token)));
             break;
           }
         }
@@ -936,26 +1099,61 @@ static int consume_program(State* state) {
   }
 }
 
-ParseResult* parse(char* source, char* filename) {
+size_t parser_count_tokens(char* source) {
+  State* state = state_new_state(source, "");
+  size_t count = 0;
+  while(consume_token(state) != TOKEN_EOF) {
+    count++;
+  }
+  state_destroy(state);
+  return count;
+}
+
+ParseResult* parse(char* source, char* filename, Diagnostics* diagnostics) {
   int err = 0;
   Program* program = new_program();
   State* state = state_new_state(source, filename);
   state->program = program;
+  state->diagnostics = diagnostics;
 
   /*MachineNode* machine_node = node_create_machine();
   program->body = (Node*)machine_node;
   state->node = (Node*)machine_node;*/
 
-  err = consume_program(state);
+  // Node and diagnostic positions are 32-bit.
+  if(state->source_len > UINT32_MAX) {
+    error_msg_with_code_block(state, NULL, DIAG_TOO_LARGE, "Source files can be at most 4 GiB.");
+    err = 2;
+  } else {
+    stats_phase_begin(STATS_PHASE_PARSE);
+    err = consume_program(state);
+    stats_phase_end(STATS_PHASE_PARSE);
+  }
+
+  if(err == 0) {
+    stats_phase_begin(STATS_PHASE_VALIDATE);
+    err = validate_program(state, program);
+    stats_phase_end(STATS_PHASE_VALIDATE);
+  }
 
-  ParseResult *result = malloc(sizeof(*result));
+  ParseResult *result = lucy_malloc(sizeof(*result));
   result->success = err == 0;
   result->program = program;
+  state_destroy(state);
 
   return result;
 }
 
 void parser_init() {
   keyword_init();
-  timeframe_init();
+}
+
+void parser_set_max_depth(uint32_t depth) {
+  max_depth = depth;
+}
+
+uint32_t parser_use_max_depth(uint32_t depth) {
+  uint32_t previous = thread_max_depth;
+  thread_max_depth = depth;
+  return previous;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define LUCY_PARSER_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "diagnostics.h"
 #include "program.h"
 
 typedef struct ParseResult {
@@ -9,7 +11,20 @@ typedef struct ParseResult {
   Program* program;
 } ParseResult;
 
-ParseResult* parse(char*, char*);
+// How many levels machines can nest, see parser_set_max_depth.
+#define PARSER_DEFAULT_MAX_DEPTH 100000
+
+// Parses and validates a program, adding any problems to the diagnostics.
+ParseResult* parse(char*, char*, Diagnostics*);
 void parser_init();
+// Limits how deeply machines can nest before parsing fails, for all
+// programs parsed after.
+void parser_set_max_depth(uint32_t);
+// Overrides the max depth for parses on this thread, 0 to stop, and
+// returns the override to restore.
+uint32_t parser_use_max_depth(uint32_t);
+// Lexes the source without parsing it and returns how many tokens it has,
+// for measuring the lexer on its own.
+size_t parser_count_tokens(char*);
 
 #endif
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include <stdlib.h>
+#include "alloc.h"
 #include "program.h"
 #include "node.h"
+#include "visit.h"
 
 Program * new_program() {
-  Program * program = malloc(sizeof(Program));
+  Program * program = lucy_malloc(sizeof(Program));
   program->body = NULL;
   program->flags = 0;
   return program;
@@ -11,4 +13,24 @@ Program * new_program() {
 
 __attribute__((always_inline)) void program_add_flag(Program* program, int flag) {
   program->flags |= flag;
-}
\ No newline at end of file
+}
+
+#define X(NAME, name, type) \
+static void destroy_##name(type* node, void* ctx) { \
+  node_destroy_##name(node); \
+  node_destroy((Node*)node); \
+}
+NODE_TYPES(X)
+#undef X
+
+// Post-order teardown, so deeply nested programs don't need a deep C
+// stack.
+void program_destroy(Program* program) {
+  Visitor destroyer = {
+#define X(NAME, name, type) .exit_##name = destroy_##name,
+    NODE_TYPES(X)
+#undef X
+  };
+  visit(program->body, &destroyer, 1);
+  lucy_free(program);
+}
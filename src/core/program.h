@@ -10,4 +10,5 @@ typedef struct Program {
 } Program;
 
 Program * new_program();
-void program_add_flag(Program*, int);
\ No newline at end of file
+void program_add_flag(Program*, int);
+void program_destroy(Program*);
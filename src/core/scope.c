@@ -1,9 +1,49 @@
 #include <stdlib.h>
+#include "alloc.h"
 #include "scope.h"
 
-Scope* scope_create_scope(Scope* parent)
+Scope* scope_create_scope(Scope* parent, Node* node)
 {
-  Scope *scope = malloc(sizeof *scope);
+  Scope *scope = lucy_malloc(sizeof *scope);
   scope->parent = parent;
+  scope->node = node;
+  scope->outer = parent == NULL || parent->binding_count > 0 ? parent : parent->outer;
+  symtab_init(&scope->names, 0);
+  scope->bindings = NULL;
+  scope->binding_count = 0;
+  scope->binding_capacity = 0;
   return scope;
-}
\ No newline at end of file
+}
+
+void scope_destroy(Scope* scope) {
+  symtab_destroy(&scope->names);
+  lucy_free(scope->bindings);
+  lucy_free(scope);
+}
+
+bool scope_add_binding(Scope* scope, Assignment* assignment) {
+  if(!symtab_insert(&scope->names, assignment->binding_name, scope->binding_count)) {
+    return false;
+  }
+
+  if(scope->binding_count == scope->binding_capacity) {
+    scope->binding_capacity = scope->binding_capacity == 0 ? 4 : scope->binding_capacity * 2;
+    scope->bindings = lucy_realloc(scope->bindings, scope->binding_capacity * sizeof(Binding));
+  }
+
+  Binding* binding = &scope->bindings[scope->binding_count++];
+  binding->assignment = assignment;
+  binding->used = false;
+  return true;
+}
+
+Binding* scope_lookup(Scope* scope, char* name) {
+  while(scope != NULL) {
+    int index = symtab_get(&scope->names, name);
+    if(index != SYMTAB_NOT_FOUND) {
+      return &scope->bindings[index];
+    }
+    scope = scope->outer;
+  }
+  return NULL;
+}
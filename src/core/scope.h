@@ -1,13 +1,35 @@
 #ifndef LUCY_SCOPE_H_
 #define LUCY_SCOPE_H_
 
+#include <stdbool.h>
 #include "node.h"
+#include "symtab.h"
 
+typedef struct Binding {
+  Assignment* assignment;
+  bool used;
+} Binding;
+
+// The guards and actions declared in a machine block. Lookups fall back to
+// the enclosing machine's scope.
 typedef struct Scope {
   struct Scope* parent;
   Node* node;
+
+  // The nearest enclosing scope with bindings when this one was created.
+  // Only the innermost scope gains bindings while parsing, so lookups can
+  // skip the empty ones between.
+  struct Scope* outer;
+
+  SymbolTable names;
+  Binding* bindings;
+  size_t binding_count;
+  size_t binding_capacity;
 } Scope;
 
-Scope* scope_create_scope(Scope*);
+Scope* scope_create_scope(Scope*, Node*);
+void scope_destroy(Scope*);
+bool scope_add_binding(Scope*, Assignment*);
+Binding* scope_lookup(Scope*, char*);
 
-#endif
\ No newline at end of file
+#endif
@@ -2,25 +2,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include "alloc.h"
 #include "node.h"
 #include "scope.h"
 #include "state.h"
 
 State* state_new_state(char* source, char* filename) {
-  State *state = malloc(sizeof *state);
+  State *state = lucy_malloc(sizeof *state);
   state->source = source;
   state->filename = filename;
   state->source_len = strlen(source);
   state->index = 0;
   state->started = false;
 
-  state->guards = malloc(sizeof(SimpleSet));
-  set_init(state->guards);
-  state->actions = malloc(sizeof(SimpleSet));
-  set_init(state->actions);
-
   state->node = NULL;
   state->parent_node = NULL;
+  memset(state->tails, 0, sizeof(state->tails));
+  state->body_tail = NULL;
+  state->scope = NULL;
+  symtab_init(&state->guard_names, 0);
+  symtab_init(&state->action_names, 0);
+  state->diagnostics = NULL;
+
+  state->frames = NULL;
+  state->frame_count = 0;
+  state->frame_capacity = 0;
+  state->machine_depth = 0;
 
   state->word = NULL;
   state->line = 0;
@@ -28,6 +35,40 @@ State* state_new_state(char* source, char* filename) {
   return state;
 }
 
+void state_destroy(State* state) {
+  state_reset_word(state);
+  symtab_destroy(&state->guard_names);
+  symtab_destroy(&state->action_names);
+  lucy_free(state->frames);
+  lucy_free(state);
+}
+
+ParseFrame* state_push_frame(State* state, int type) {
+  if(state->frame_count == state->frame_capacity) {
+    state->frame_capacity = state->frame_capacity == 0 ? 16 : state->frame_capacity * 2;
+    state->frames = lucy_realloc(state->frames, state->frame_capacity * sizeof(ParseFrame));
+  }
+
+  ParseFrame* frame = &state->frames[state->frame_count++];
+  frame->type = type;
+  frame->err = 0;
+  frame->node = state->node;
+  frame->token = -1;
+  frame->is_implicit = false;
+  frame->parent_scope = NULL;
+  if(type == FRAME_MACHINE && state->frame_count > 1) {
+    state->machine_depth++;
+  }
+  return frame;
+}
+
+void state_pop_frame(State* state) {
+  ParseFrame* frame = &state->frames[--state->frame_count];
+  if(frame->type == FRAME_MACHINE && state->frame_count > 0) {
+    state->machine_depth--;
+  }
+}
+
 void state_set_word(State* state, char* word) {
   state_reset_word(state);
   state->word = word;
@@ -41,11 +82,19 @@ char* state_take_word(State* state) {
 
 void state_reset_word(State* state) {
   if(state->word != NULL) {
-    free(state->word);
+    lucy_free(state->word);
     state->word = NULL;
   }
 }
 
+// Called as each top-level machine opens.
+void state_reset_names(State* state) {
+  symtab_destroy(&state->guard_names);
+  symtab_destroy(&state->action_names);
+  symtab_init(&state->guard_names, 0);
+  symtab_init(&state->action_names, 0);
+}
+
 void state_advance_column(State* state) {
   state->column++;
 }
@@ -87,17 +136,43 @@ void state_node_set(State* state, Node* node) {
     Node* parent_node = state->node;
     state->parent_node = parent_node;
 
-    node_append(parent_node, node);
+    state_append_child(state, parent_node, node);
   } else {
-    Program* program = state->program;
-    if(program->body == NULL) {
-      program->body = node;
+    state_append_child(state, NULL, node);
+  }
+
+  state->node = node;
+}
+
+// Appends to the parent's children, or the program body when it's NULL.
+void state_append_child(State* state, Node* parent, Node* child) {
+  child->parent = parent;
+
+  if(parent == NULL) {
+    if(state->program->body == NULL) {
+      state->program->body = child;
     } else {
-      node_after_last(program->body, node);
+      state->body_tail->next = child;
     }
+    state->body_tail = child;
+    return;
   }
 
-  state->node = node;
+  uint32_t hash = (uint32_t)(((uintptr_t)parent >> 3) * 2654435761u);
+  NodeTail* slot = &state->tails[(hash >> 16) % STATE_TAIL_SLOTS];
+  if(parent->child == NULL) {
+    parent->child = child;
+  } else {
+    // A cached tail may have been appended to since, so walk on from it.
+    Node* sibling = slot->parent == parent ? slot->tail : parent->child;
+    while(sibling->next != NULL) {
+      sibling = sibling->next;
+    }
+    sibling->next = child;
+  }
+
+  slot->parent = parent;
+  slot->tail = child;
 }
 
 void state_node_up(State* state) {
@@ -111,24 +186,10 @@ void state_node_up(State* state) {
   }
 }
 
-void state_node_start_pos(State* state, Node* node, unsigned short rewind_amount) {
-  size_t start = state->index - rewind_amount;
+void state_node_start_pos(State* state, Node* node, size_t rewind_amount) {
+  // The index is on the last character of the keyword being rewound.
+  size_t end = state->index + 1;
+  size_t start = end > rewind_amount ? end - rewind_amount : 0;
   node->start = start;
   node->line = state->line;
 }
-
-void state_add_guard(State* state, char* name) {
-  set_add(state->guards, name);
-}
-
-bool state_has_guard(State* state, char* name) {
-  return set_contains(state->guards, name) == SET_TRUE;
-}
-
-void state_add_action(State* state, char* name) {
-  set_add(state->actions, name);
-}
-
-bool state_has_action(State* state, char* name) {
-  return set_contains(state->actions, name) == SET_TRUE;
-}
\ No newline at end of file
@@ -1,15 +1,39 @@
 #ifndef LUCY_STATE_H_
 #define LUCY_STATE_H_
 
+#include "diagnostics.h"
 #include "scope.h"
 #include "node.h"
-#include "set.h"
 #include "program.h"
 
 #define MODIFIER_NONE 0
 #define MODIFIER_TYPE_INITIAL 1
 #define MODIFIER_TYPE_FINAL 2
 
+#define FRAME_STATE 0
+#define FRAME_MACHINE 1
+
+// A state or machine block being parsed. Blocks nest on this stack rather
+// than the C stack, so nesting depth is only bounded by max_depth.
+typedef struct ParseFrame {
+  int type;
+  int err;
+  Node* node;
+  // For machines, a token already read to start on, and the scope to
+  // restore once the block ends.
+  int token;
+  bool is_implicit;
+  Scope* parent_scope;
+} ParseFrame;
+
+// The last child appended to a parent, cached so long sibling lists aren't
+// walked from the start for each append.
+#define STATE_TAIL_SLOTS 64
+typedef struct NodeTail {
+  Node* parent;
+  Node* tail;
+} NodeTail;
+
 typedef struct State {
   char* source;
   char* filename;
@@ -23,14 +47,26 @@ typedef struct State {
   char* word;
   size_t word_len;
 
-  SimpleSet* guards;
-  SimpleSet* actions;
-
   Program* program;
   Node* node;
   Node* parent_node;
+  NodeTail tails[STATE_TAIL_SLOTS];
+  Node* body_tail;
 
   Scope* scope;
+  // Every guard and action name in the top-level machine being parsed,
+  // nested machines included, as they all end up in its options.
+  SymbolTable guard_names;
+  SymbolTable action_names;
+
+  ParseFrame* frames;
+  uint32_t frame_count;
+  uint32_t frame_capacity;
+  // Machines open on the stack, the outermost isn't counted.
+  uint32_t machine_depth;
+
+  // Where problems are recorded, owned by the caller of parse.
+  Diagnostics* diagnostics;
 } State;
 
 int state_inbounds(State*);
@@ -40,18 +76,18 @@ char state_next(State*);
 char state_prev(State*);
 
 State* state_new_state(char*, char*);
+void state_destroy(State*);
+ParseFrame* state_push_frame(State*, int);
+void state_pop_frame(State*);
 void state_advance_line(State*);
 void state_advance_column(State*);
 void state_set_word(State*, char*);
 char* state_take_word(State*);
 void state_reset_word(State*);
+void state_reset_names(State*);
 void state_node_set(State*, Node*);
+void state_append_child(State*, Node*, Node*);
 void state_node_up(State*);
-void state_node_start_pos(State*, Node*, unsigned short);
-
-void state_add_guard(State*, char*);
-void state_add_action(State*, char*);
-bool state_has_guard(State*, char*);
-bool state_has_action(State*, char*);
+void state_node_start_pos(State*, Node*, size_t);
 
 #endif
\ No newline at end of file
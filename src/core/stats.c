@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alloc.h"
+#include "node.h"
+#include "stats.h"
+#include "str_builder.h"
+#include "trace.h"
+
+_Thread_local Stats* stats_current = NULL;
+
+static const char* phase_names[STATS_PHASE_COUNT] = {
+  "read", "lex", "parse", "validate", "lower", "optimize", "emit"
+};
+
+static const char* node_type_names[NODE_TYPE_COUNT] = {
+#define X(NAME, name, type) #name,
+  NODE_TYPES(X)
+#undef X
+};
+
+Stats* stats_create() {
+  Stats* stats = lucy_calloc(1, sizeof(*stats));
+  return stats;
+}
+
+void stats_destroy(Stats* stats) {
+  lucy_free(stats);
+}
+
+void stats_start(Stats* stats) {
+  stats_current = stats;
+}
+
+void stats_stop() {
+  stats_current = NULL;
+}
+
+unsigned long long stats_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Phases are traced too, except lexing which is timed a token at a time.
+void stats_phase_begin(int phase) {
+  if(stats_current != NULL) {
+    stats_current->phase_start[phase] = stats_now();
+  }
+  if(trace_enabled && phase != STATS_PHASE_LEX) {
+    trace_begin(phase_names[phase], NULL);
+  }
+}
+
+void stats_phase_end(int phase) {
+  if(stats_current != NULL) {
+    stats_current->phase_ns[phase] += stats_now() - stats_current->phase_start[phase];
+  }
+  if(trace_enabled && phase != STATS_PHASE_LEX) {
+    trace_end(phase_names[phase]);
+  }
+}
+
+// Lexing happens on demand while parsing, so it is reported separately
+// and taken out of the parse time.
+unsigned long long stats_phase_ns(Stats* stats, int phase) {
+  unsigned long long ns = stats->phase_ns[phase];
+  if(phase == STATS_PHASE_PARSE) {
+    unsigned long long lex_ns = stats->phase_ns[STATS_PHASE_LEX];
+    ns = ns > lex_ns ? ns - lex_ns : 0;
+  }
+  return ns;
+}
+
+static void heap_change(long long delta) {
+  stats_current->heap_current += delta;
+  if(stats_current->heap_current > stats_current->heap_peak) {
+    stats_current->heap_peak = stats_current->heap_current;
+  }
+}
+
+void stats_count_alloc(size_t size) {
+  if(stats_current != NULL) {
+    stats_current->allocations++;
+    heap_change((long long)size);
+  }
+}
+
+void stats_count_realloc(size_t old_size, size_t new_size) {
+  if(stats_current != NULL) {
+    heap_change((long long)new_size - (long long)old_size);
+  }
+}
+
+void stats_count_free(size_t size) {
+  if(stats_current != NULL) {
+    stats_current->frees++;
+    heap_change(-(long long)size);
+  }
+}
+
+const char* stats_phase_name(int phase) {
+  return phase_names[phase];
+}
+
+const char* stats_node_type_name(int type) {
+  return node_type_names[type];
+}
+
+static size_t total_nodes(Stats* stats) {
+  size_t total = 0;
+  for(int i = 0; i < NODE_TYPE_COUNT; i++) {
+    total += stats->nodes[i];
+  }
+  return total;
+}
+
+char* stats_to_json(Stats* stats) {
+  char buf[64];
+  str_builder_t* sb = str_builder_create();
+
+  str_builder_add_str(sb, "{\"phases\": {", 0);
+  for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+    snprintf(buf, sizeof(buf), "%s\"%s_ns\": %llu", i > 0 ? ", " : "",
+      phase_names[i], stats_phase_ns(stats, i));
+    str_builder_add_str(sb, buf, 0);
+  }
+  str_builder_add_str(sb, "}, \"nodes\": {", 0);
+  for(int i = 0; i < NODE_TYPE_COUNT; i++) {
+    snprintf(buf, sizeof(buf), "%s\"%s\": %zu", i > 0 ? ", " : "",
+      node_type_names[i], stats->nodes[i]);
+    str_builder_add_str(sb, buf, 0);
+  }
+  str_builder_add_str(sb, "}", 0);
+
+  snprintf(buf, sizeof(buf), ", \"source_bytes\": %zu", stats->source_bytes);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"tokens\": %zu", stats->tokens);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"bytes_emitted\": %zu", stats->bytes_emitted);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"states_merged\": %zu", stats->states_merged);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"states_removed\": %zu", stats->states_removed);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"transitions_removed\": %zu", stats->transitions_removed);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"consts_hoisted\": %zu", stats->consts_hoisted);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"allocations\": %zu", stats->allocations);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"frees\": %zu", stats->frees);
+  str_builder_add_str(sb, buf, 0);
+  snprintf(buf, sizeof(buf), ", \"peak_heap_bytes\": %lld}", stats->heap_peak);
+  str_builder_add_str(sb, buf, 0);
+
+  char* json = str_builder_dump(sb, NULL);
+  str_builder_destroy(sb);
+  return json;
+}
+
+void stats_print(FILE* fp, Stats* stats, char* filename) {
+  unsigned long long total_ns = 0;
+
+  fprintf(fp, "%s\n", filename);
+  for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+    unsigned long long ns = stats_phase_ns(stats, i);
+    total_ns += ns;
+    fprintf(fp, "  %-16s %10.3f ms\n", phase_names[i], ns / 1e6);
+  }
+  fprintf(fp, "  %-16s %10.3f ms\n\n", "total", total_ns / 1e6);
+
+  fprintf(fp, "  %-16s %10zu\n", "source bytes", stats->source_bytes);
+  fprintf(fp, "  %-16s %10zu\n", "tokens", stats->tokens);
+  fprintf(fp, "  %-16s %10zu\n", "nodes", total_nodes(stats));
+  for(int i = 0; i < NODE_TYPE_COUNT; i++) {
+    if(stats->nodes[i] > 0) {
+      fprintf(fp, "    %-14s %10zu\n", node_type_names[i], stats->nodes[i]);
+    }
+  }
+  fprintf(fp, "  %-16s %10zu\n", "bytes emitted", stats->bytes_emitted);
+  if(stats->states_merged + stats->states_removed + stats->transitions_removed + stats->consts_hoisted > 0) {
+    fprintf(fp, "  %-16s %10zu\n", "states merged", stats->states_merged);
+    fprintf(fp, "  %-16s %10zu\n", "states removed", stats->states_removed);
+    fprintf(fp, "  %-16s %10zu\n", "dup transitions", stats->transitions_removed);
+    fprintf(fp, "  %-16s %10zu\n", "consts hoisted", stats->consts_hoisted);
+  }
+  fprintf(fp, "  %-16s %10zu\n", "allocations", stats->allocations);
+  fprintf(fp, "  %-16s %10zu\n", "frees", stats->frees);
+  fprintf(fp, "  %-16s %10lld\n", "peak heap bytes", stats->heap_peak);
+}
@@ -0,0 +1,72 @@
+#ifndef LUCY_STATS_H_
+#define LUCY_STATS_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "node.h"
+
+#define STATS_PHASE_READ 0
+#define STATS_PHASE_LEX 1
+#define STATS_PHASE_PARSE 2
+#define STATS_PHASE_VALIDATE 3
+#define STATS_PHASE_LOWER 4
+#define STATS_PHASE_OPTIMIZE 5
+#define STATS_PHASE_EMIT 6
+#define STATS_PHASE_COUNT 7
+
+typedef struct Stats {
+  unsigned long long phase_ns[STATS_PHASE_COUNT];
+  unsigned long long phase_start[STATS_PHASE_COUNT];
+
+  size_t source_bytes;
+  size_t tokens;
+  size_t nodes[NODE_TYPE_COUNT];
+  size_t bytes_emitted;
+
+  // Optimizer results, zero unless minimizing or optimizing.
+  size_t states_merged;
+  size_t states_removed;
+  size_t transitions_removed;
+  size_t consts_hoisted;
+
+  size_t allocations;
+  size_t frees;
+  long long heap_current;
+  long long heap_peak;
+} Stats;
+
+// The stats being recorded by the current thread, NULL when not recording.
+extern _Thread_local Stats* stats_current;
+
+Stats* stats_create();
+void stats_destroy(Stats*);
+void stats_start(Stats*);
+void stats_stop();
+
+unsigned long long stats_now();
+void stats_phase_begin(int);
+void stats_phase_end(int);
+unsigned long long stats_phase_ns(Stats*, int);
+
+void stats_count_alloc(size_t);
+void stats_count_realloc(size_t, size_t);
+void stats_count_free(size_t);
+
+static inline void stats_count_token() {
+  if(stats_current != NULL) {
+    stats_current->tokens++;
+  }
+}
+
+static inline void stats_count_node(unsigned short type) {
+  if(stats_current != NULL && type < NODE_TYPE_COUNT) {
+    stats_current->nodes[type]++;
+  }
+}
+
+const char* stats_phase_name(int);
+const char* stats_node_type_name(int);
+char* stats_to_json(Stats*);
+void stats_print(FILE*, Stats*, char*);
+
+#endif
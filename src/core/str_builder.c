@@ -1,9 +1,11 @@
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "str_builder.h"
 
 /* - - - - */
@@ -22,8 +24,8 @@ str_builder_t *str_builder_create(void)
 {
     str_builder_t *sb;
 
-    sb          = calloc(1, sizeof(*sb));
-    sb->str     = malloc(str_builder_min_size);
+    sb          = lucy_calloc(1, sizeof(*sb));
+    sb->str     = lucy_malloc(str_builder_min_size);
     *sb->str    = '\0';
     sb->alloced = str_builder_min_size;
     sb->len     = 0;
@@ -35,8 +37,8 @@ void str_builder_destroy(str_builder_t *sb)
 {
     if (sb == NULL)
         return;
-    free(sb->str);
-    free(sb);
+    lucy_free(sb->str);
+    lucy_free(sb);
 }
 
 /* - - - - */
@@ -67,7 +69,7 @@ static void str_builder_ensure_space(str_builder_t *sb, size_t add_len)
             sb->alloced--;
         }
     }
-    sb->str = realloc(sb->str, sb->alloced);
+    sb->str = lucy_realloc(sb->str, sb->alloced);
 }
 
 /* - - - - */
@@ -107,6 +109,59 @@ void str_builder_add_int(str_builder_t *sb, int val)
     str_builder_add_str(sb, str, 0);
 }
 
+void str_builder_add_vfmt(str_builder_t *sb, const char *fmt, va_list args)
+{
+    va_list copy;
+    int     len;
+
+    if (sb == NULL || fmt == NULL)
+        return;
+
+    va_copy(copy, args);
+    len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (len <= 0)
+        return;
+
+    /* Format straight into the buffer, vsnprintf writes the NULL. */
+    str_builder_ensure_space(sb, len);
+    vsnprintf(sb->str+sb->len, len+1, fmt, args);
+    sb->len += len;
+}
+
+void str_builder_add_fmt(str_builder_t *sb, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    str_builder_add_vfmt(sb, fmt, args);
+    va_end(args);
+}
+
+void str_builder_add_json_str(str_builder_t *sb, const char *str, size_t len)
+{
+    const unsigned char *c;
+
+    if (sb == NULL || str == NULL)
+        return;
+
+    if (len == 0)
+        len = strlen(str);
+
+    str_builder_add_char(sb, '"');
+    for (c = (const unsigned char *)str; c < (const unsigned char *)str + len; c++) {
+        if (*c == '"' || *c == '\\') {
+            str_builder_add_char(sb, '\\');
+            str_builder_add_char(sb, *c);
+        } else if (*c < 0x20) {
+            str_builder_add_fmt(sb, "\\u%04x", *c);
+        } else {
+            str_builder_add_char(sb, *c);
+        }
+    }
+    str_builder_add_char(sb, '"');
+}
+
 /* - - - - */
 
 void str_builder_clear(str_builder_t *sb)
@@ -165,7 +220,7 @@ char *str_builder_dump(const str_builder_t *sb, size_t *len)
 
     if (len != NULL)
         *len = sb->len;
-    out = malloc(sb->len+1);
+    out = lucy_malloc(sb->len+1);
     memcpy(out, sb->str, sb->len+1);
     return out;
 }
@@ -1,6 +1,7 @@
 #ifndef __STR_BUILDER_H__
 #define __STR_BUILDER_H__
 
+#include <stdarg.h>
 #include <stddef.h>
 
 /*! addtogroup str_builder String Builder
@@ -52,6 +53,30 @@ void str_builder_add_char(str_builder_t *sb, char c);
  */
 void str_builder_add_int(str_builder_t *sb, int val);
 
+/*! Add printf style formatted text to the builder.
+ *
+ * param[in,out] sb  Builder.
+ * param[in]     fmt Format string.
+ */
+void str_builder_add_fmt(str_builder_t *sb, const char *fmt, ...);
+
+/*! Add formatted text from a va_list to the builder.
+ *
+ * param[in,out] sb   Builder.
+ * param[in]     fmt  Format string.
+ * param[in]     args Arguments for fmt.
+ */
+void str_builder_add_vfmt(str_builder_t *sb, const char *fmt, va_list args);
+
+/*! Add a string as a quoted and escaped JSON string.
+ *
+ * param[in,out] sb  Builder.
+ * param[in]     str String to add.
+ * param[in]     len Length of string to add. If 0, strlen will be called
+ *                internally to determine length.
+ */
+void str_builder_add_json_str(str_builder_t *sb, const char *str, size_t len);
+
 /* - - - - */
 
 /*! Clear the builder.
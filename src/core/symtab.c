@@ -0,0 +1,193 @@
+#include <string.h>
+#include "alloc.h"
+#include "symtab.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define GROUP_WIDTH 16
+#else
+#define GROUP_WIDTH 8
+#endif
+
+#define CTRL_EMPTY 0x80
+
+// FNV-1a, which for names this short beats hashing a word at a time. Its
+// multiply carries every character into the high bits, so the control
+// byte takes the top 7 and the slot is picked from the low ones.
+static uint32_t hash_key(const char* key) {
+  uint32_t h = 2166136261u;
+  for(const unsigned char* c = (const unsigned char*)key; *c; c++) {
+    h ^= *c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static inline uint8_t hash_tag(uint32_t hash) {
+  return hash >> 25;
+}
+
+// A group is the control bytes of consecutive slots, matched as a bitmask
+// with a bit per slot, lowest first.
+#ifdef __SSE2__
+typedef __m128i Group;
+typedef uint32_t GroupMask;
+
+static inline Group group_load(const uint8_t* ctrl) {
+  return _mm_loadu_si128((const __m128i*)ctrl);
+}
+
+static inline GroupMask group_match(Group group, uint8_t tag) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+}
+
+static inline GroupMask group_empty(Group group) {
+  return _mm_movemask_epi8(group);
+}
+
+static inline size_t mask_first(GroupMask mask) {
+  return __builtin_ctz(mask);
+}
+#else
+// Eight at a time in a word, where a match is the high bit of its byte.
+// The match can give false positives, which the key compare rules out.
+typedef uint64_t Group;
+typedef uint64_t GroupMask;
+
+#define LSBS 0x0101010101010101ull
+#define MSBS 0x8080808080808080ull
+
+static inline Group group_load(const uint8_t* ctrl) {
+  uint64_t group;
+  memcpy(&group, ctrl, sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  group = __builtin_bswap64(group);
+#endif
+  return group;
+}
+
+static inline GroupMask group_match(Group group, uint8_t tag) {
+  uint64_t x = group ^ (LSBS * tag);
+  return (x - LSBS) & ~x & MSBS;
+}
+
+static inline GroupMask group_empty(Group group) {
+  return group & MSBS;
+}
+
+static inline size_t mask_first(GroupMask mask) {
+  return __builtin_ctzll(mask) >> 3;
+}
+#endif
+
+static size_t capacity_for(size_t count) {
+  size_t capacity = GROUP_WIDTH;
+  // Keep the load factor under 7/8.
+  while(capacity * 7 < count * 8) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+// The control bytes follow the entries in one block, with the first group
+// repeated after the last so a group read never wraps.
+static void allocate(SymbolTable* table, size_t capacity) {
+  size_t entries_size = capacity * sizeof(SymbolEntry);
+  char* block = lucy_malloc(entries_size + capacity + GROUP_WIDTH);
+  table->entries = (SymbolEntry*)block;
+  table->ctrl = (uint8_t*)block + entries_size;
+  table->capacity = capacity;
+  memset(table->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+}
+
+void symtab_init(SymbolTable* table, size_t expected) {
+  allocate(table, capacity_for(expected + 1));
+  table->count = 0;
+}
+
+void symtab_destroy(SymbolTable* table) {
+  lucy_free(table->entries);
+  table->entries = NULL;
+  table->ctrl = NULL;
+  table->capacity = 0;
+  table->count = 0;
+}
+
+static inline void set_ctrl(SymbolTable* table, size_t i, uint8_t tag) {
+  table->ctrl[i] = tag;
+  if(i < GROUP_WIDTH) {
+    table->ctrl[table->capacity + i] = tag;
+  }
+}
+
+// Probes a group at a time, each step a group further than the last,
+// which visits every group of a power of two table. Returns the key's
+// entry, or NULL and the empty slot it would go in.
+static inline SymbolEntry* find(SymbolTable* table, const char* key, uint32_t hash, size_t* slot) {
+  size_t mask = table->capacity - 1;
+  size_t pos = hash & mask;
+  uint8_t tag = hash_tag(hash);
+
+  for(size_t step = GROUP_WIDTH; ; step += GROUP_WIDTH) {
+    Group group = group_load(table->ctrl + pos);
+    GroupMask matches = group_match(group, tag);
+    while(matches != 0) {
+      SymbolEntry* entry = &table->entries[(pos + mask_first(matches)) & mask];
+      if(entry->hash == hash && strcmp(entry->key, key) == 0) {
+        return entry;
+      }
+      matches &= matches - 1;
+    }
+
+    GroupMask empty = group_empty(group);
+    if(empty != 0) {
+      *slot = (pos + mask_first(empty)) & mask;
+      return NULL;
+    }
+    pos = (pos + step) & mask;
+  }
+}
+
+static void grow(SymbolTable* table) {
+  SymbolEntry* entries = table->entries;
+  uint8_t* ctrl = table->ctrl;
+  size_t capacity = table->capacity;
+  allocate(table, capacity << 1);
+
+  for(size_t i = 0; i < capacity; i++) {
+    if(ctrl[i] != CTRL_EMPTY) {
+      size_t slot;
+      find(table, entries[i].key, entries[i].hash, &slot);
+      table->entries[slot] = entries[i];
+      set_ctrl(table, slot, hash_tag(entries[i].hash));
+    }
+  }
+
+  lucy_free(entries);
+}
+
+bool symtab_insert(SymbolTable* table, const char* key, int value) {
+  if((table->count + 1) * 8 > table->capacity * 7) {
+    grow(table);
+  }
+
+  uint32_t hash = hash_key(key);
+  size_t slot;
+  if(find(table, key, hash, &slot) != NULL) {
+    return false;
+  }
+
+  SymbolEntry* entry = &table->entries[slot];
+  entry->key = key;
+  entry->hash = hash;
+  entry->value = value;
+  set_ctrl(table, slot, hash_tag(hash));
+  table->count++;
+  return true;
+}
+
+int symtab_get(SymbolTable* table, const char* key) {
+  size_t slot;
+  SymbolEntry* entry = find(table, key, hash_key(key), &slot);
+  return entry != NULL ? entry->value : SYMTAB_NOT_FOUND;
+}
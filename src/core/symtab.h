@@ -0,0 +1,35 @@
+#ifndef LUCY_SYMTAB_H_
+#define LUCY_SYMTAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SYMTAB_NOT_FOUND -1
+
+// The map from names to integer ids used throughout the core. Open
+// addressing with a control byte per slot, 7 bits of the hash or empty,
+// so a probe compares a whole group of slots at once and only touches the
+// keys whose bits match. Keys are borrowed, the strings must outlive the
+// table. There is no removal.
+typedef struct SymbolEntry {
+  const char* key;
+  uint32_t hash;
+  int value;
+} SymbolEntry;
+
+typedef struct SymbolTable {
+  uint8_t* ctrl;
+  SymbolEntry* entries;
+  size_t capacity;
+  size_t count;
+} SymbolTable;
+
+// Sized to hold the expected count without growing.
+void symtab_init(SymbolTable*, size_t);
+void symtab_destroy(SymbolTable*);
+// Returns false, leaving the value, if the key is already there.
+bool symtab_insert(SymbolTable*, const char*, int);
+int symtab_get(SymbolTable*, const char*);
+
+#endif
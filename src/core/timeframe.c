@@ -1,111 +1,129 @@
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <stdbool.h>
-#include "dict.h"
+#include <limits.h>
+#include <stdint.h>
 #include "timeframe.h"
-#include "str_builder.h"
 
-#define TF_MS 0
-#define TF_S 1
-#define TF_M 2
+#define TF_NONE 0
+#define TF_MS 1
+#define TF_S 2
+#define TF_M 3
+#define TF_H 4
 
-static dict* suffixes;
+// Milliseconds in each unit, indexed by the TF_ constants.
+static const uint64_t unit_ms[] = { 1, 1, 1000, 60000, 3600000 };
+
+// Digits after the point beyond this must be zeros to be whole milliseconds
+// in any unit, so they're only checked.
+#define TF_MAX_FRACTION_DIGITS 9
 
 bool is_integer(char c) {
-  return c == '0' || c == '1' || c == '2' || c == '3' || c == '4' || c == '5' ||
-    c == '6' || c == '7' || c == '8' || c == '9';
+  return c >= '0' && c <= '9';
 }
 
 bool is_timeframe_char(char c) {
-  return is_integer(c) || c == 'm' || c == 's';
+  return is_integer(c) || c == '.' || c == 'm' || c == 's' || c == 'h';
 }
 
-bool timeframe_is_suffix(char* key) {
-  return dict_search(suffixes, key) > 0;
+static Timeframe timeframe_error(const char* error) {
+  Timeframe tf = {
+    .is_integer = false,
+    .time = 0,
+    .error = error
+  };
+  return tf;
 }
 
-unsigned short timeframe_get(char* key) {
-  return dict_search(suffixes, key);
+// Reads the unit at word[*i], advancing past it.
+static int read_unit(const char* word, size_t word_len, size_t* i) {
+  char c = word[*i];
+  char next = *i + 1 < word_len ? word[*i + 1] : '\0';
+  if(c == 'm' && next == 's') {
+    *i += 2;
+    return TF_MS;
+  }
+  (*i)++;
+  switch(c) {
+    case 's': return TF_S;
+    case 'm': return TF_M;
+    case 'h': return TF_H;
+    default: return TF_NONE;
+  }
 }
 
-Timeframe timeframe_parse(char* word, size_t word_len) {
-  str_builder_t* int_sb = str_builder_create();
-  str_builder_t* tf_sb = str_builder_create();
-  size_t int_len = 0;
-  size_t tf_len = 0;
-  bool is_int = true;
+Timeframe timeframe_parse(const char* word, size_t word_len) {
+  uint64_t total = 0;
+  int last_unit = TF_H + 1;
+  size_t i = 0;
 
-  int i = 0;
-  char c;
   while(i < word_len) {
-    c = word[i];
-    if(is_integer(c)) {
-      str_builder_add_char(int_sb, c);
-      int_len++;
-    } else {
-      str_builder_add_char(tf_sb, c);
-      tf_len++;
-      is_int = false;
+    if(!is_integer(word[i])) {
+      return timeframe_error("Expected a number before each timeframe unit.");
     }
-    i++;
-  }
 
-  char* int_str = str_builder_dump(int_sb, &int_len);
-  char* tf_str = str_builder_dump(tf_sb, &tf_len);
+    uint64_t whole = 0;
+    while(i < word_len && is_integer(word[i])) {
+      whole = whole * 10 + (word[i] - '0');
+      if(whole > INT_MAX) {
+        return timeframe_error("Delays can be at most 2147483647ms.");
+      }
+      i++;
+    }
+
+    uint64_t fraction = 0;
+    uint64_t scale = 1;
+    bool has_fraction = false;
+    if(i < word_len && word[i] == '.') {
+      has_fraction = true;
+      i++;
+      if(i == word_len || !is_integer(word[i])) {
+        return timeframe_error("Expected digits after the decimal point.");
+      }
+      for(int digits = 0; i < word_len && is_integer(word[i]); digits++, i++) {
+        if(digits < TF_MAX_FRACTION_DIGITS) {
+          fraction = fraction * 10 + (word[i] - '0');
+          scale *= 10;
+        } else if(word[i] != '0') {
+          return timeframe_error("Delays must be a whole number of milliseconds.");
+        }
+      }
+    }
 
-  int value = atoi(int_str);
-  if(!is_int) {
-    if(!timeframe_is_suffix(tf_str)) {
+    // A lone number is in milliseconds.
+    if(i == word_len && last_unit == TF_H + 1 && !has_fraction) {
       Timeframe tf = {
-        .is_integer = false,
-        .time = 0,
-        .error = "Unknown timeframe suffix"
+        .is_integer = true,
+        .time = (int)whole,
+        .error = NULL
       };
-      free(int_str);
-      free(tf_str);
-      str_builder_destroy(tf_sb);
-      str_builder_destroy(int_sb);
       return tf;
     }
-    
-    unsigned short key = timeframe_get(tf_str);
-    switch(key) {
-      case TF_MS: {
-        // 2ms = 2
-        break;
-      }
-      case TF_S: {
-        // 2s = 2000
-        value = value * 1000;
-        break;
-      }
-      case TF_M: {
-        // 2m = 120000
-        value = value * 60000;
-        break;
-      }
+
+    if(i == word_len) {
+      return timeframe_error("Expected a timeframe unit: ms, s, m or h.");
     }
-  }
 
-  free(int_str);
-  free(tf_str);
-  str_builder_destroy(tf_sb);
-  str_builder_destroy(int_sb);
+    int unit = read_unit(word, word_len, &i);
+    if(unit == TF_NONE) {
+      return timeframe_error("Unknown timeframe suffix, expected ms, s, m or h.");
+    }
+    if(unit >= last_unit) {
+      return timeframe_error("Timeframe units must go from largest to smallest, such as 1m30s.");
+    }
+    last_unit = unit;
+
+    uint64_t ms = unit_ms[unit];
+    if(fraction * ms % scale != 0) {
+      return timeframe_error("Delays must be a whole number of milliseconds.");
+    }
+    total += whole * ms + fraction * ms / scale;
+    if(total > INT_MAX) {
+      return timeframe_error("Delays can be at most 2147483647ms.");
+    }
+  }
 
   Timeframe tf = {
-    .is_integer = is_int,
-    .time = value,
+    .is_integer = false,
+    .time = (int)total,
     .error = NULL
   };
-
   return tf;
 }
-
-void timeframe_init() {
-  suffixes = dict_create();
-  
-  dict_insert(suffixes, "ms", TF_MS);
-  dict_insert(suffixes, "s", TF_S);
-  dict_insert(suffixes, "m", TF_M);
-}
\ No newline at end of file
@@ -1,15 +1,16 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct Timeframe {
   bool is_integer;
   int time;
-  char* error;
-} Timeframe; 
+  const char* error;
+} Timeframe;
 
 bool is_integer(char);
 bool is_timeframe_char(char);
-bool timeframe_is_suffix(char*);
-Timeframe timeframe_parse(char*, size_t);
-void timeframe_init();
\ No newline at end of file
+// Parses a delay in milliseconds, either a plain integer or units from
+// largest to smallest such as 200ms, 1.5s or 1h30m.
+Timeframe timeframe_parse(const char*, size_t);
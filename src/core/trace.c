@@ -0,0 +1,169 @@
+#include <pthread.h>
+#include <string.h>
+#include "alloc.h"
+#include "stats.h"
+#include "str_builder.h"
+#include "trace.h"
+
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+
+typedef struct TraceEvent {
+  const char* name;
+  const char* file;
+  unsigned long long ns;
+  char phase;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+  TraceEvent* events;
+  size_t count;
+  size_t capacity;
+  const char* thread_name;
+  unsigned int tid;
+  struct TraceBuffer* next;
+} TraceBuffer;
+
+bool trace_enabled = false;
+
+static unsigned long long origin_ns;
+static TraceBuffer* first_buffer = NULL;
+static TraceBuffer* last_buffer = NULL;
+static unsigned int buffer_count = 0;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local TraceBuffer* thread_buffer = NULL;
+
+void trace_start() {
+  origin_ns = stats_now();
+  trace_enabled = true;
+}
+
+// The trace's own memory isn't counted in the thread's stats.
+static void* trace_realloc(void* ptr, size_t size) {
+  Stats* stats = stats_current;
+  stats_current = NULL;
+  ptr = ptr == NULL ? lucy_malloc(size) : lucy_realloc(ptr, size);
+  stats_current = stats;
+  return ptr;
+}
+
+// A thread's buffer is created the first time it records, and kept in
+// the list only the writer walks.
+static TraceBuffer* get_buffer() {
+  if(thread_buffer != NULL) {
+    return thread_buffer;
+  }
+
+  TraceBuffer* buffer = trace_realloc(NULL, sizeof(TraceBuffer));
+  buffer->events = NULL;
+  buffer->count = 0;
+  buffer->capacity = 0;
+  buffer->thread_name = NULL;
+  buffer->next = NULL;
+
+  pthread_mutex_lock(&buffers_lock);
+  buffer->tid = ++buffer_count;
+  if(last_buffer == NULL) {
+    first_buffer = buffer;
+  } else {
+    last_buffer->next = buffer;
+  }
+  last_buffer = buffer;
+  pthread_mutex_unlock(&buffers_lock);
+
+  thread_buffer = buffer;
+  return buffer;
+}
+
+static void add_event(const char* name, const char* file, char phase) {
+  unsigned long long ns = stats_now();
+  TraceBuffer* buffer = get_buffer();
+  if(buffer->count == buffer->capacity) {
+    buffer->capacity = buffer->capacity == 0 ? 64 : buffer->capacity * 2;
+    buffer->events = trace_realloc(buffer->events, buffer->capacity * sizeof(TraceEvent));
+  }
+
+  TraceEvent* event = &buffer->events[buffer->count++];
+  event->name = name;
+  event->file = file;
+  event->ns = ns;
+  event->phase = phase;
+}
+
+void trace_thread_name(const char* name) {
+  if(trace_enabled) {
+    get_buffer()->thread_name = name;
+  }
+}
+
+void trace_begin(const char* name, const char* file) {
+  if(trace_enabled) {
+    add_event(name, file, TRACE_BEGIN);
+  }
+}
+
+void trace_end(const char* name) {
+  if(trace_enabled) {
+    add_event(name, NULL, TRACE_END);
+  }
+}
+
+static void add_json_str(str_builder_t* sb, const char* str) {
+  str_builder_add_json_str(sb, str, strlen(str));
+}
+
+int trace_write(FILE* fp) {
+  str_builder_t* sb = str_builder_create();
+  bool first = true;
+  str_builder_add_str(sb, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", 0);
+
+  for(TraceBuffer* buffer = first_buffer; buffer != NULL; buffer = buffer->next) {
+    if(buffer->thread_name != NULL) {
+      str_builder_add_fmt(sb, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+        "\"args\": {\"name\": ", first ? "" : ",", buffer->tid);
+      add_json_str(sb, buffer->thread_name);
+      str_builder_add_str(sb, "}}", 2);
+      first = false;
+    }
+
+    for(size_t i = 0; i < buffer->count; i++) {
+      TraceEvent* event = &buffer->events[i];
+      unsigned long long ns = event->ns - origin_ns;
+      str_builder_add_fmt(sb, "%s\n{\"name\": ", first ? "" : ",");
+      add_json_str(sb, event->name);
+      str_builder_add_fmt(sb, ", \"cat\": \"lucy\", \"ph\": \"%c\", \"ts\": %llu.%03llu, \"pid\": 1, \"tid\": %u",
+        event->phase, ns / 1000, ns % 1000, buffer->tid);
+      if(event->file != NULL) {
+        str_builder_add_str(sb, ", \"args\": {\"file\": ", 0);
+        add_json_str(sb, event->file);
+        str_builder_add_char(sb, '}');
+      }
+      str_builder_add_char(sb, '}');
+      first = false;
+    }
+  }
+  str_builder_add_str(sb, "\n]}\n", 0);
+
+  size_t len;
+  char* json = str_builder_dump(sb, &len);
+  str_builder_destroy(sb);
+  int ret = fwrite(json, 1, len, fp) == len ? 0 : 1;
+  lucy_free(json);
+  return ret;
+}
+
+void trace_destroy() {
+  TraceBuffer* buffer = first_buffer;
+  while(buffer != NULL) {
+    TraceBuffer* next = buffer->next;
+    lucy_free(buffer->events);
+    lucy_free(buffer);
+    buffer = next;
+  }
+  first_buffer = NULL;
+  last_buffer = NULL;
+  buffer_count = 0;
+  thread_buffer = NULL;
+  trace_enabled = false;
+}
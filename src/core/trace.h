@@ -0,0 +1,22 @@
+#ifndef LUCY_TRACE_H_
+#define LUCY_TRACE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Records when each phase begins and ends, per thread, for a trace viewer
+// such as chrome://tracing or Perfetto. Off unless trace_start is called,
+// and then each thread appends to its own buffer without locking.
+extern bool trace_enabled;
+
+void trace_start();
+// Names and files are kept by reference, they have to outlive the trace.
+void trace_thread_name(const char*);
+void trace_begin(const char*, const char*);
+void trace_end(const char*);
+// Writes every thread's events in the Chrome trace-event format, once the
+// threads recording them are done.
+int trace_write(FILE*);
+void trace_destroy();
+
+#endif
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "alloc.h"
+#include "error.h"
+#include "node.h"
+#include "program.h"
+#include "scope.h"
+#include "state.h"
+#include "symtab.h"
+#include "validate.h"
+#include "visit.h"
+
+// What the walk found in a machine, so checking it doesn't take another.
+typedef struct MachineInfo {
+  MachineNode* machine;
+  size_t depth;
+  size_t order;
+
+  StateNode** states;
+  size_t state_count;
+  size_t state_capacity;
+
+  Assignment** assignments;
+  size_t assignment_count;
+  size_t assignment_capacity;
+} MachineInfo;
+
+typedef struct Validator {
+  State* state;
+  int err;
+
+  SymbolTable imports;
+  SymbolTable machines;
+
+  // Every machine in the program, nested ones included.
+  MachineInfo* machine_list;
+  size_t machine_count;
+  size_t machine_capacity;
+
+  // The machines the walk is in, innermost last.
+  size_t* open;
+  size_t open_count;
+  size_t open_capacity;
+} Validator;
+
+#define grow(items, count, capacity) \
+  if((count) == (capacity)) { \
+    (capacity) = (capacity) == 0 ? 8 : (capacity) * 2; \
+    (items) = lucy_realloc((items), (capacity) * sizeof(*(items))); \
+  }
+
+static void report(Validator* v, Node* node, int code, bool warning, const char* fmt, const char* name) {
+  if(name == NULL) {
+    name = "";
+  }
+  size_t len = strlen(fmt) + strlen(name) + 1;
+  char* msg = lucy_malloc(len);
+  snprintf(msg, len, fmt, name);
+
+  if(warning) {
+    warning_msg_at_node(v->state, node, code, msg);
+  } else {
+    error_msg_at_node(v->state, node, code, msg);
+    v->err = 2;
+  }
+
+  lucy_free(msg);
+}
+
+static void check_imported(Validator* v, Node* node, char* name) {
+  if(name != NULL && symtab_get(&v->imports, name) == SYMTAB_NOT_FOUND) {
+    report(v, node, DIAG_NOT_IMPORTED, false, "'%s' is not imported.", name);
+  }
+}
+
+static void check_assignment(Validator* v, Assignment* assignment) {
+  Expression* value = assignment->value;
+  switch(value->type) {
+    case EXPRESSION_IDENTIFIER: {
+      check_imported(v, (Node*)assignment, ((IdentifierExpression*)value)->name);
+      break;
+    }
+    case EXPRESSION_ASSIGN: {
+      check_imported(v, (Node*)assignment, ((AssignExpression*)value)->identifier);
+      break;
+    }
+  }
+}
+
+static void check_transition(Validator* v, SymbolTable* states, TransitionNode* transition) {
+  Node* node = (Node*)transition;
+
+  TransitionGuard* guard = transition->guard;
+  while(guard != NULL) {
+    if(guard->name == NULL && guard->expression != NULL) {
+      check_imported(v, node, guard->expression->ref);
+    }
+    guard = guard->next;
+  }
+
+  TransitionAction* action = transition->action;
+  while(action != NULL) {
+    if(action->name == NULL && action->expression != NULL &&
+      action->expression->type == EXPRESSION_ACTION) {
+      check_imported(v, node, ((ActionExpression*)action->expression)->ref);
+    }
+    action = action->next;
+  }
+
+  if(symtab_get(states, transition->dest) == SYMTAB_NOT_FOUND) {
+    report(v, node, DIAG_UNKNOWN_STATE, false, "Unknown state '%s'. Transitions can only target states of the same machine.", transition->dest);
+  }
+}
+
+static void check_invoke(Validator* v, InvokeNode* invoke) {
+  char* call = invoke->call;
+  if(symtab_get(&v->imports, call) == SYMTAB_NOT_FOUND &&
+    symtab_get(&v->machines, call) == SYMTAB_NOT_FOUND) {
+    report(v, (Node*)invoke, DIAG_UNKNOWN_INVOKE, false, "'%s' is not imported or the name of a machine.", call);
+  }
+}
+
+// Queues the unreached targets of a state's transitions, invoke ones included.
+static int reach_transitions(SymbolTable* states, StateNode* state_node, bool* reached, int* queue, int tail) {
+  Node* child = ((Node*)state_node)->child;
+  while(child != NULL) {
+    Node* transition = NULL;
+    if(child->type == NODE_TRANSITION_TYPE) {
+      transition = child;
+    } else if(child->type == NODE_INVOKE_TYPE) {
+      transition = child->child;
+    }
+
+    while(transition != NULL) {
+      int index = symtab_get(states, ((TransitionNode*)transition)->dest);
+      if(index != SYMTAB_NOT_FOUND && !reached[index]) {
+        reached[index] = true;
+        queue[tail++] = index;
+      }
+      transition = child->type == NODE_INVOKE_TYPE ? transition->next : NULL;
+    }
+
+    child = child->next;
+  }
+  return tail;
+}
+
+static void validate_machine(Validator* v, MachineInfo* info) {
+  MachineNode* machine = info->machine;
+  size_t count = info->state_count;
+  if(count == 0) {
+    return;
+  }
+
+  StateNode** state_list = info->states;
+  SymbolTable states;
+  symtab_init(&states, count);
+
+  size_t i;
+  for(i = 0; i < count; i++) {
+    StateNode* state_node = state_list[i];
+    if(!symtab_insert(&states, state_node->name, i)) {
+      report(v, (Node*)state_node, DIAG_DUPLICATE_STATE, false, "Duplicate state '%s'.", state_node->name);
+    }
+  }
+
+  for(i = 0; i < count; i++) {
+    Node* child = ((Node*)state_list[i])->child;
+    while(child != NULL) {
+      switch(child->type) {
+        case NODE_TRANSITION_TYPE: {
+          check_transition(v, &states, (TransitionNode*)child);
+          break;
+        }
+        case NODE_INVOKE_TYPE: {
+          check_invoke(v, (InvokeNode*)child);
+          Node* transition = child->child;
+          while(transition != NULL) {
+            char* event = ((TransitionNode*)transition)->event;
+            if(event == NULL || (strcmp(event, "done") != 0 && strcmp(event, "error") != 0)) {
+              report(v, transition, DIAG_INVOKE_TRANSITION, false, "Only done and error transitions are supported in invoke.", NULL);
+            }
+            check_transition(v, &states, (TransitionNode*)transition);
+            transition = transition->next;
+          }
+          break;
+        }
+      }
+      child = child->next;
+    }
+  }
+
+  // Breadth-first from the initial state, machines without one start
+  // wherever the runtime is told to so there is nothing to check.
+  int initial = machine->initial == NULL ? SYMTAB_NOT_FOUND : symtab_get(&states, machine->initial);
+  if(initial != SYMTAB_NOT_FOUND) {
+    bool* reached = lucy_calloc(count, sizeof(bool));
+    int* queue = lucy_malloc(count * sizeof(int));
+    int head = 0;
+    int tail = 0;
+
+    reached[initial] = true;
+    queue[tail++] = initial;
+    while(head < tail) {
+      tail = reach_transitions(&states, state_list[queue[head++]], reached, queue, tail);
+    }
+
+    for(i = 0; i < count; i++) {
+      // Duplicates were already reported.
+      if(!reached[i] && symtab_get(&states, state_list[i]->name) == (int)i) {
+        report(v, (Node*)state_list[i], DIAG_UNREACHABLE_STATE, true, "State '%s' is unreachable.", state_list[i]->name);
+      }
+    }
+
+    lucy_free(reached);
+    lucy_free(queue);
+  }
+
+  symtab_destroy(&states);
+}
+
+// The program's imports and machine names, nested machines aren't
+// visible outside their state so this doesn't look inside machines.
+static int enter_import_specifier(ImportSpecifier* specifier, void* ctx) {
+  Validator* v = ctx;
+  symtab_insert(&v->imports, specifier->imported, 0);
+  return VISIT_CONTINUE;
+}
+
+static int enter_top_machine(MachineNode* machine, void* ctx) {
+  Validator* v = ctx;
+  if(machine->name != NULL) {
+    symtab_insert(&v->machines, machine->name, 0);
+  }
+  return VISIT_SKIP;
+}
+
+// Every machine with its states and bindings. Transitions are checked
+// once the machine's states are all known, so aren't walked into.
+static int enter_machine(MachineNode* machine, void* ctx) {
+  Validator* v = ctx;
+  grow(v->machine_list, v->machine_count, v->machine_capacity);
+  MachineInfo* info = &v->machine_list[v->machine_count];
+  *info = (MachineInfo){0};
+  info->machine = machine;
+  info->depth = v->open_count;
+  info->order = v->machine_count;
+
+  grow(v->open, v->open_count, v->open_capacity);
+  v->open[v->open_count++] = v->machine_count++;
+  return VISIT_CONTINUE;
+}
+
+static void exit_machine(MachineNode* machine, void* ctx) {
+  Validator* v = ctx;
+  v->open_count--;
+}
+
+static MachineInfo* open_machine(Validator* v) {
+  return &v->machine_list[v->open[v->open_count - 1]];
+}
+
+static int enter_state(StateNode* state_node, void* ctx) {
+  Validator* v = ctx;
+  MachineInfo* info = open_machine(v);
+  grow(info->states, info->state_count, info->state_capacity);
+  info->states[info->state_count++] = state_node;
+  return VISIT_CONTINUE;
+}
+
+static int enter_assignment(Assignment* assignment, void* ctx) {
+  Validator* v = ctx;
+  MachineInfo* info = open_machine(v);
+  if(((Node*)assignment)->parent == (Node*)info->machine) {
+    grow(info->assignments, info->assignment_count, info->assignment_capacity);
+    info->assignments[info->assignment_count++] = assignment;
+  }
+  return VISIT_SKIP;
+}
+
+// Outer machines first, each level in document order, which is the order
+// the checks report in.
+static int compare_machines(const void* a, const void* b) {
+  const MachineInfo* x = a;
+  const MachineInfo* y = b;
+  if(x->depth != y->depth) {
+    return x->depth < y->depth ? -1 : 1;
+  }
+  return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Collects the program's names and every machine, nested ones included,
+// in one walk.
+static void collect(Validator* v, Program* program) {
+  symtab_init(&v->imports, 0);
+  symtab_init(&v->machines, 0);
+
+  Visitor visitors[2] = {
+    {
+      .enter_import_specifier = enter_import_specifier,
+      .enter_machine = enter_top_machine,
+      .ctx = v
+    },
+    {
+      .enter_import = visit_skip_import,
+      .enter_machine = enter_machine,
+      .exit_machine = exit_machine,
+      .enter_state = enter_state,
+      .enter_assignment = enter_assignment,
+      .enter_transition = visit_skip_transition,
+      .enter_invoke = visit_skip_invoke,
+      .ctx = v
+    }
+  };
+  visit(program->body, visitors, 2);
+
+  qsort(v->machine_list, v->machine_count, sizeof(MachineInfo), compare_machines);
+}
+
+int validate_program(State* state, Program* program) {
+  Validator v = {0};
+  v.state = state;
+
+  collect(&v, program);
+
+  for(size_t i = 0; i < v.machine_count; i++) {
+    MachineInfo* info = &v.machine_list[i];
+    for(size_t a = 0; a < info->assignment_count; a++) {
+      check_assignment(&v, info->assignments[a]);
+    }
+  }
+
+  for(size_t i = 0; i < v.machine_count; i++) {
+    validate_machine(&v, &v.machine_list[i]);
+  }
+
+  // The parser marks bindings as used as it resolves them.
+  for(size_t i = 0; i < v.machine_count; i++) {
+    Scope* scope = v.machine_list[i].machine->scope;
+    for(size_t b = 0; scope != NULL && b < scope->binding_count; b++) {
+      Assignment* assignment = scope->bindings[b].assignment;
+      if(!scope->bindings[b].used) {
+        report(&v, (Node*)assignment, DIAG_UNUSED_BINDING, true,
+          assignment->binding_type == ASSIGNMENT_GUARD ? "Guard '%s' is never used." : "Action '%s' is never used.",
+          assignment->binding_name);
+      }
+    }
+  }
+
+  for(size_t i = 0; i < v.machine_count; i++) {
+    lucy_free(v.machine_list[i].states);
+    lucy_free(v.machine_list[i].assignments);
+  }
+  symtab_destroy(&v.imports);
+  symtab_destroy(&v.machines);
+  lucy_free(v.machine_list);
+  lucy_free(v.open);
+
+  return v.err;
+}
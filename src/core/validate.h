@@ -0,0 +1,9 @@
+#ifndef LUCY_VALIDATE_H_
+#define LUCY_VALIDATE_H_
+
+#include "program.h"
+#include "state.h"
+
+int validate_program(State*, Program*);
+
+#endif
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <stdbool.h>
+#include "visit.h"
+
+static int enter(Visitor* visitor, Node* node) {
+  switch(node->type) {
+#define X(NAME, name, type) \
+    case NODE_##NAME##_TYPE: \
+      return visitor->enter_##name == NULL ? VISIT_CONTINUE : \
+        visitor->enter_##name((type*)node, visitor->ctx);
+    NODE_TYPES(X)
+#undef X
+  }
+  return VISIT_CONTINUE;
+}
+
+static void leave(Visitor* visitor, Node* node) {
+  switch(node->type) {
+#define X(NAME, name, type) \
+    case NODE_##NAME##_TYPE: \
+      if(visitor->exit_##name != NULL) { \
+        visitor->exit_##name((type*)node, visitor->ctx); \
+      } \
+      break;
+    NODE_TYPES(X)
+#undef X
+  }
+}
+
+#define X(NAME, name, type) \
+int visit_skip_##name(type* node, void* ctx) { \
+  return VISIT_SKIP; \
+}
+NODE_TYPES(X)
+#undef X
+
+void visit(Node* first, Visitor* visitors, size_t count) {
+  if(first == NULL) {
+    return;
+  }
+  // Callers pass a fixed set, so more than fit is a bug rather than
+  // something to drop visitors for.
+  assert(count <= VISIT_MAX_VISITORS);
+
+  // The node each visitor skips the subtree of, if any.
+  Node* skipping[VISIT_MAX_VISITORS] = {0};
+  Node* top = first->parent;
+  Node* node = first;
+
+  while(node != NULL) {
+    bool descend = false;
+    for(size_t i = 0; i < count; i++) {
+      if(skipping[i] == NULL) {
+        if(enter(&visitors[i], node) == VISIT_SKIP) {
+          skipping[i] = node;
+        } else {
+          descend = true;
+        }
+      }
+    }
+
+    if(descend && node->child != NULL) {
+      node = node->child;
+      continue;
+    }
+
+    // Exits may free the node, so its links are read first.
+    while(node != NULL) {
+      Node* next = node->next;
+      Node* parent = node->parent;
+      for(size_t i = count; i-- > 0;) {
+        if(skipping[i] == NULL || skipping[i] == node) {
+          skipping[i] = NULL;
+          leave(&visitors[i], node);
+        }
+      }
+
+      if(next != NULL) {
+        node = next;
+        break;
+      }
+      node = parent == top ? NULL : parent;
+    }
+  }
+}
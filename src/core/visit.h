@@ -0,0 +1,38 @@
+#ifndef LUCY_VISIT_H_
+#define LUCY_VISIT_H_
+
+#include <stddef.h>
+#include "node.h"
+
+#define VISIT_CONTINUE 0
+// Returned by an enter callback to not see what's under the node, the
+// node's exit is still called.
+#define VISIT_SKIP 1
+
+#define VISIT_MAX_VISITORS 8
+
+// Enter and exit callbacks per node type, any of them can be NULL. Enter
+// is called before a node's children and exit after, when it is safe for
+// exit to free the node.
+typedef struct Visitor {
+#define X(NAME, name, type) \
+  int (*enter_##name)(type*, void*); \
+  void (*exit_##name)(type*, void*);
+  NODE_TYPES(X)
+#undef X
+  void* ctx;
+} Visitor;
+
+// Enter callbacks that only skip, visit_skip_machine and so on.
+#define X(NAME, name, type) int visit_skip_##name(type*, void*);
+NODE_TYPES(X)
+#undef X
+
+// Walks the node, its following siblings and everything under them once,
+// running each of the visitors at every node: enters in the order given
+// and exits in reverse. A subtree is only descended into while one of the
+// visitors wants it. Doesn't recurse, so depth is only limited by memory.
+// Takes at most VISIT_MAX_VISITORS.
+void visit(Node*, Visitor*, size_t);
+
+#endif
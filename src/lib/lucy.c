@@ -0,0 +1,176 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../core/compiler_js.h"
+#include "../core/compiler_json.h"
+#include "../core/compiler_xstate.h"
+#include "../core/identifier.h"
+#include "../core/parser.h"
+#include "lucy.h"
+
+#ifdef VERSION
+  #define LIBRARY_VERSION VERSION
+#else
+  #define LIBRARY_VERSION "0.0.0"
+#endif
+
+#define XS_FLAGS (XS_FLAG_USE_REMOTE | XS_FLAG_OPTIMIZE | XS_FLAG_MINIMIZE)
+
+typedef void (*CompileFn)(CompileResult*, char*, char*);
+
+struct LucyCompiler {
+  CompileFn compile;
+  unsigned flags;
+  uint32_t max_depth;
+};
+
+struct LucyResult {
+  CompileResult* result;
+};
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_core() {
+  identifier_init();
+  parser_init();
+}
+
+static char* copy_string(const char* str, size_t length) {
+  char* copy = malloc(length + 1);
+  if(copy != NULL) {
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+int lucy_abi_version(void) {
+  return LUCY_ABI_VERSION;
+}
+
+const char* lucy_version(void) {
+  return LIBRARY_VERSION;
+}
+
+const char* lucy_error_string(int err) {
+  switch(err) {
+    case LUCY_OK: return "ok";
+    case LUCY_ERROR_COMPILE: return "compilation failed";
+    case LUCY_ERROR_INVALID: return "invalid argument";
+    case LUCY_ERROR_MEMORY: return "out of memory";
+  }
+  return "unknown error";
+}
+
+LucyCompiler* lucy_compiler_create(void) {
+  pthread_once(&init_once, init_core);
+  LucyCompiler* compiler = malloc(sizeof(*compiler));
+  if(compiler != NULL) {
+    compiler->compile = compile_xstate;
+    compiler->flags = 0;
+    compiler->max_depth = 0;
+  }
+  return compiler;
+}
+
+void lucy_compiler_destroy(LucyCompiler* compiler) {
+  free(compiler);
+}
+
+int lucy_compiler_set_target(LucyCompiler* compiler, int target) {
+  switch(target) {
+    case LUCY_TARGET_XSTATE: compiler->compile = compile_xstate; break;
+    case LUCY_TARGET_JS: compiler->compile = compile_js; break;
+    case LUCY_TARGET_JSON: compiler->compile = compile_json; break;
+    default: return LUCY_ERROR_INVALID;
+  }
+  return LUCY_OK;
+}
+
+void lucy_compiler_set_flags(LucyCompiler* compiler, unsigned flags) {
+  compiler->flags = flags;
+}
+
+void lucy_compiler_set_max_depth(LucyCompiler* compiler, uint32_t depth) {
+  compiler->max_depth = depth;
+}
+
+// The core reads NUL terminated strings, so both are copied. A NUL inside
+// the source would silently end it early, so that's refused.
+int lucy_compile(const LucyCompiler* compiler, const char* source, size_t length,
+  const char* filename, size_t filename_length, LucyResult** out) {
+  if(compiler == NULL || source == NULL || filename == NULL || out == NULL ||
+    memchr(source, '\0', length) != NULL) {
+    return LUCY_ERROR_INVALID;
+  }
+
+  LucyResult* result = malloc(sizeof(*result));
+  char* source_copy = copy_string(source, length);
+  char* filename_copy = copy_string(filename, filename_length);
+  if(result == NULL || source_copy == NULL || filename_copy == NULL) {
+    free(result);
+    free(source_copy);
+    free(filename_copy);
+    return LUCY_ERROR_MEMORY;
+  }
+
+  result->result = xs_create();
+  xs_init(result->result, (compiler->flags & XS_FLAGS) |
+    (compiler->flags & LUCY_FLAG_LAZY ? XS_FLAG_LAZY : 0));
+  if(compiler->flags & LUCY_FLAG_STATS) {
+    xs_enable_stats(result->result);
+  }
+
+  uint32_t outer = parser_use_max_depth(compiler->max_depth);
+  compiler->compile(result->result, source_copy, filename_copy);
+  parser_use_max_depth(outer);
+
+  free(source_copy);
+  free(filename_copy);
+  *out = result;
+  return result->result->success ? LUCY_OK : LUCY_ERROR_COMPILE;
+}
+
+const char* lucy_result_output(const LucyResult* result, size_t* length) {
+  const char* js = result->result->success ? result->result->js : NULL;
+  if(length != NULL) {
+    *length = js != NULL ? strlen(js) : 0;
+  }
+  return js;
+}
+
+size_t lucy_result_diagnostic_count(const LucyResult* result) {
+  return result->result->diagnostics.count;
+}
+
+int lucy_result_diagnostic(const LucyResult* result, size_t index, LucyDiagnostic* out) {
+  if(index >= result->result->diagnostics.count) {
+    return LUCY_ERROR_INVALID;
+  }
+
+  Diagnostic* diagnostic = &result->result->diagnostics.items[index];
+  out->code = diagnostic->code;
+  out->severity = diagnostic->severity == DIAGNOSTIC_ERROR ?
+    LUCY_SEVERITY_ERROR : LUCY_SEVERITY_WARNING;
+  out->start = diagnostic->start;
+  out->end = diagnostic->end;
+  out->line = diagnostic->line;
+  out->column = diagnostic->column;
+  out->message = diagnostic->message;
+  return LUCY_OK;
+}
+
+const char* lucy_result_diagnostics_json(LucyResult* result) {
+  return xs_get_diagnostics_json(result->result);
+}
+
+const char* lucy_result_stats_json(LucyResult* result) {
+  return xs_get_stats_json(result->result);
+}
+
+void lucy_result_destroy(LucyResult* result) {
+  if(result != NULL) {
+    destroy_xstate_result(result->result);
+    free(result);
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef LUCY_H_
+#define LUCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The embedding API of liblucy.so and liblucy.a, the only symbols they
+// export. Everything is reached through opaque handles, so the ABI only
+// changes when LUCY_ABI_VERSION does, and that is the library's soname.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define LUCY_API __declspec(dllexport)
+#else
+#define LUCY_API __attribute__((visibility("default")))
+#endif
+
+#define LUCY_ABI_VERSION 1
+
+#define LUCY_OK 0
+// The source had errors, see the result's diagnostics.
+#define LUCY_ERROR_COMPILE 1
+// A NULL handle or string, an unknown target, or a source containing NUL.
+#define LUCY_ERROR_INVALID 2
+#define LUCY_ERROR_MEMORY 3
+
+#define LUCY_TARGET_XSTATE 0
+// A module with no dependencies, like lc --target js.
+#define LUCY_TARGET_JS 1
+// JSON describing the imports and machines, like lc --emit json.
+#define LUCY_TARGET_JSON 2
+
+#define LUCY_FLAG_USE_REMOTE (1 << 0)
+#define LUCY_FLAG_OPTIMIZE (1 << 1)
+#define LUCY_FLAG_MINIMIZE (1 << 2)
+// Collect statistics, see lucy_result_stats_json.
+#define LUCY_FLAG_STATS (1 << 3)
+// Export functions that build each machine on the first call, like
+// lc --lazy. Only changes LUCY_TARGET_XSTATE output.
+#define LUCY_FLAG_LAZY (1 << 4)
+
+#define LUCY_SEVERITY_ERROR 0
+#define LUCY_SEVERITY_WARNING 1
+
+// Options for compiling. Set them up front, a compiler can then be used
+// by any number of threads at once.
+typedef struct LucyCompiler LucyCompiler;
+// What one compile produced, owned by the caller.
+typedef struct LucyResult LucyResult;
+
+// Positions are byte offsets into the source, line and column are 1-based.
+// The message belongs to the result.
+typedef struct LucyDiagnostic {
+  uint32_t code;
+  uint32_t severity;
+  uint32_t start;
+  uint32_t end;
+  uint32_t line;
+  uint32_t column;
+  const char* message;
+} LucyDiagnostic;
+
+// The ABI and package version of the library that was loaded, which can
+// be newer than the header.
+LUCY_API int lucy_abi_version(void);
+LUCY_API const char* lucy_version(void);
+LUCY_API const char* lucy_error_string(int);
+
+// NULL when out of memory. Compiles to LUCY_TARGET_XSTATE with no flags
+// until told otherwise.
+LUCY_API LucyCompiler* lucy_compiler_create(void);
+LUCY_API void lucy_compiler_destroy(LucyCompiler*);
+LUCY_API int lucy_compiler_set_target(LucyCompiler*, int target);
+LUCY_API void lucy_compiler_set_flags(LucyCompiler*, unsigned flags);
+// Fails compiles with machines nested deeper than this, 0 for the default.
+LUCY_API void lucy_compiler_set_max_depth(LucyCompiler*, uint32_t depth);
+
+// Compiles length bytes of source, which need not be NUL terminated. On
+// LUCY_OK and LUCY_ERROR_COMPILE *result is set and has to be destroyed.
+LUCY_API int lucy_compile(const LucyCompiler*, const char* source, size_t length,
+  const char* filename, size_t filename_length, LucyResult** result);
+
+// The compiled module, NULL if compiling failed. Its length is stored in
+// length unless that is NULL, and the text is NUL terminated.
+LUCY_API const char* lucy_result_output(const LucyResult*, size_t* length);
+LUCY_API size_t lucy_result_diagnostic_count(const LucyResult*);
+// Fills in the diagnostic at the index, LUCY_ERROR_INVALID past the end.
+LUCY_API int lucy_result_diagnostic(const LucyResult*, size_t index, LucyDiagnostic*);
+// The diagnostics as JSON, in the shape of lc --diagnostics json.
+LUCY_API const char* lucy_result_diagnostics_json(LucyResult*);
+// NULL unless compiled with LUCY_FLAG_STATS.
+LUCY_API const char* lucy_result_stats_json(LucyResult*);
+LUCY_API void lucy_result_destroy(LucyResult*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
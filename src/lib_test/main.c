@@ -0,0 +1,184 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../lib/lucy.h"
+
+// Links liblucy.a through its public header only. Checks the argument
+// handling, then compiles each file on several threads at once, with
+// compilers set up differently, and fails on any output that differs from
+// compiling it alone.
+
+#define THREADS 4
+#define ROUNDS 8
+
+typedef struct Expected {
+  int err;
+  char* output;
+  size_t diagnostic_count;
+} Expected;
+
+typedef struct TestFile {
+  char* name;
+  char* source;
+  size_t length;
+  // Compiled alone by each compiler.
+  Expected expected[2];
+} TestFile;
+
+static LucyCompiler* compilers[2];
+static TestFile* files;
+static int file_count;
+static int failures = 0;
+static pthread_mutex_t failures_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fail(const char* filename, const char* msg) {
+  pthread_mutex_lock(&failures_lock);
+  fprintf(stderr, "FAIL %s: %s\n", filename, msg);
+  failures++;
+  pthread_mutex_unlock(&failures_lock);
+}
+
+static Expected compile_file(LucyCompiler* compiler, TestFile* file) {
+  LucyResult* result = NULL;
+  Expected got = { 0 };
+  got.err = lucy_compile(compiler, file->source, file->length, file->name, strlen(file->name), &result);
+  if(result != NULL) {
+    const char* output = lucy_result_output(result, NULL);
+    got.output = output != NULL ? strdup(output) : NULL;
+    got.diagnostic_count = lucy_result_diagnostic_count(result);
+    lucy_result_destroy(result);
+  }
+  return got;
+}
+
+static bool same(Expected* a, Expected* b) {
+  if(a->err != b->err || a->diagnostic_count != b->diagnostic_count) {
+    return false;
+  }
+  if(a->output == NULL || b->output == NULL) {
+    return a->output == b->output;
+  }
+  return strcmp(a->output, b->output) == 0;
+}
+
+static void* run_thread(void* arg) {
+  size_t id = (size_t)arg;
+  for(int round = 0; round < ROUNDS; round++) {
+    for(int i = 0; i < file_count; i++) {
+      int which = (id + round + i) % 2;
+      Expected got = compile_file(compilers[which], &files[i]);
+      if(!same(&got, &files[i].expected[which])) {
+        fail(files[i].name, "differs when compiled alongside others");
+      }
+      free(got.output);
+    }
+  }
+  return NULL;
+}
+
+static void test_arguments() {
+  LucyResult* result = NULL;
+  LucyCompiler* compiler = compilers[0];
+  const char source[] = "machine m {\0}";
+
+  if(lucy_abi_version() != LUCY_ABI_VERSION) {
+    fail("abi", "lucy_abi_version doesn't match the header");
+  }
+  if(lucy_compile(NULL, source, 1, "x", 1, &result) != LUCY_ERROR_INVALID ||
+    lucy_compile(compiler, NULL, 0, "x", 1, &result) != LUCY_ERROR_INVALID ||
+    lucy_compile(compiler, source, sizeof(source) - 1, "x", 1, &result) != LUCY_ERROR_INVALID ||
+    lucy_compiler_set_target(compiler, 99) != LUCY_ERROR_INVALID || result != NULL) {
+    fail("arguments", "invalid arguments were accepted");
+  }
+
+  // Only length bytes are read, what follows doesn't matter.
+  const char padded[] = "machine m { state a {} }garbage";
+  if(lucy_compile(compiler, padded, strlen(padded) - 7, "x.lucy", 6, &result) != LUCY_OK) {
+    fail("arguments", "source length wasn't respected");
+  }
+  lucy_result_destroy(result);
+
+  if(lucy_compile(compiler, "machine {", 9, "x.lucy", 6, &result) != LUCY_ERROR_COMPILE) {
+    fail("arguments", "an invalid program compiled");
+  } else {
+    LucyDiagnostic diagnostic;
+    if(lucy_result_output(result, NULL) != NULL ||
+      lucy_result_diagnostic(result, 0, &diagnostic) != LUCY_OK ||
+      diagnostic.severity != LUCY_SEVERITY_ERROR ||
+      lucy_result_diagnostic(result, lucy_result_diagnostic_count(result), &diagnostic) != LUCY_ERROR_INVALID ||
+      strstr(lucy_result_diagnostics_json(result), diagnostic.message) == NULL) {
+      fail("arguments", "diagnostics weren't reported");
+    }
+  }
+  lucy_result_destroy(result);
+}
+
+static char* read_file(char* filename, size_t* length) {
+  FILE* fp = fopen(filename, "rb");
+  if(fp == NULL) {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char* buffer = malloc(size);
+  *length = fread(buffer, 1, size, fp);
+  fclose(fp);
+  return buffer;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    fprintf(stderr, "Usage: %s file ...\n", argv[0]);
+    return 1;
+  }
+
+  // One with the defaults and one that compiles differently in every way
+  // it can, down to rejecting nested machines.
+  compilers[0] = lucy_compiler_create();
+  compilers[1] = lucy_compiler_create();
+  lucy_compiler_set_target(compilers[1], LUCY_TARGET_JS);
+  lucy_compiler_set_flags(compilers[1], LUCY_FLAG_OPTIMIZE | LUCY_FLAG_MINIMIZE | LUCY_FLAG_STATS);
+  lucy_compiler_set_max_depth(compilers[1], 1);
+
+  test_arguments();
+
+  files = calloc(argc - 1, sizeof(TestFile));
+  for(int i = 1; i < argc; i++) {
+    TestFile* file = &files[file_count];
+    file->name = argv[i];
+    file->source = read_file(argv[i], &file->length);
+    if(file->source == NULL) {
+      fail(argv[i], "can't read it");
+      continue;
+    }
+    file->expected[0] = compile_file(compilers[0], file);
+    file->expected[1] = compile_file(compilers[1], file);
+    file_count++;
+  }
+
+  pthread_t threads[THREADS];
+  for(size_t i = 0; i < THREADS; i++) {
+    pthread_create(&threads[i], NULL, run_thread, (void*)i);
+  }
+  for(size_t i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for(int i = 0; i < file_count; i++) {
+    free(files[i].source);
+    free(files[i].expected[0].output);
+    free(files[i].expected[1].output);
+  }
+  free(files);
+  lucy_compiler_destroy(compilers[0]);
+  lucy_compiler_destroy(compilers[1]);
+
+  if(failures > 0) {
+    fprintf(stderr, "%d library checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
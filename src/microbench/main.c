@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include "../core/alloc.h"
+#include "../core/identifier.h"
+#include "../core/js_builder.h"
+#include "../core/keyword.h"
+#include "../core/parser.h"
+#include "../core/stats.h"
+#include "../core/str_builder.h"
+#include "../core/symtab.h"
+#include "../core/timeframe.h"
+#include "reference/dict.h"
+#include "reference/set.h"
+
+// Times the compiler's building blocks one at a time. Each benchmark runs
+// a given number of operations, the driver doubles that until a run takes
+// long enough to time, then reports the fastest and mean of several runs
+// and, from one more run with stats on, the allocations per operation.
+
+#define DEFAULT_RUNS 5
+#define DEFAULT_MIN_TIME_MS 50
+
+typedef struct Microbench {
+  const char* name;
+  void (*run)(size_t);
+} Microbench;
+
+// Read after each benchmark so the work can't be optimized away.
+static volatile size_t sink;
+
+static unsigned long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Representative source for the lexer and character class benchmarks.
+static char* program_source =
+  "import { check, log } from './util.js'\n"
+  "\n"
+  "machine light {\n"
+  "  guard isReady = check\n"
+  "  action record = assign count\n"
+  "\n"
+  "  initial state green {\n"
+  "    timer => guard(isReady) => yellow\n"
+  "    delay 30s => yellow\n"
+  "  }\n"
+  "  state yellow {\n"
+  "    timer => action(log) => red\n"
+  "    delay 1500 => red\n"
+  "  }\n"
+  "  state red {\n"
+  "    timer => record => green\n"
+  "    delay 1m30s => green\n"
+  "  }\n"
+  "  final state off {}\n"
+  "}\n";
+
+static char* identifier_source =
+  "machine toggle initial state enabled disabled toggle action guard "
+  "assign invoke fetchUser loadingData onDone onError\n";
+
+static char* delay_source =
+  "delay 200ms => a\ndelay 1s => b\ndelay 1h30m => c\ndelay 1500 => d\ndelay 2.5s => e\n";
+
+// Appends a character at a time, clearing every 4KiB so the builder stays
+// warm like an emitter's.
+static void str_builder_add_char_bench(size_t ops) {
+  str_builder_t* sb = str_builder_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & 4095) == 0) {
+      str_builder_clear(sb);
+    }
+    str_builder_add_char(sb, 'a' + (i & 15));
+  }
+  sink += str_builder_len(sb);
+  str_builder_destroy(sb);
+}
+
+static void str_builder_add_str_bench(size_t ops) {
+  str_builder_t* sb = str_builder_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & 511) == 0) {
+      str_builder_clear(sb);
+    }
+    str_builder_add_str(sb, "target: ", 8);
+  }
+  sink += str_builder_len(sb);
+  str_builder_destroy(sb);
+}
+
+static void str_builder_add_fmt_bench(size_t ops) {
+  str_builder_t* sb = str_builder_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & 255) == 0) {
+      str_builder_clear(sb);
+    }
+    str_builder_add_fmt(sb, "%s: %zu,", "after", i);
+  }
+  sink += str_builder_len(sb);
+  str_builder_destroy(sb);
+}
+
+// A short string built from scratch and dumped, as for identifiers.
+static void str_builder_dump_bench(size_t ops) {
+  for(size_t i = 0; i < ops; i++) {
+    str_builder_t* sb = str_builder_create();
+    str_builder_add_str(sb, "loadingData", 11);
+    size_t len;
+    char* str = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+    sink += len;
+    lucy_free(str);
+  }
+}
+
+#define NAME_COUNT 1024
+#define NAME_LEN 16
+static char names[NAME_COUNT][NAME_LEN];
+static char missing[NAME_COUNT][NAME_LEN];
+
+static void init_names() {
+  for(int i = 0; i < NAME_COUNT; i++) {
+    snprintf(names[i], NAME_LEN, "state%d", i * 7919);
+    snprintf(missing[i], NAME_LEN, "other%d", i * 7919);
+  }
+}
+
+// A table of a machine's worth of names built from empty, per insert.
+static void symtab_insert_bench(size_t ops) {
+  SymbolTable table;
+  symtab_init(&table, 0);
+  for(size_t i = 0; i < ops; i++) {
+    if((i & (NAME_COUNT - 1)) == 0) {
+      symtab_destroy(&table);
+      symtab_init(&table, 0);
+    }
+    symtab_insert(&table, names[i & (NAME_COUNT - 1)], i);
+  }
+  sink += table.count;
+  symtab_destroy(&table);
+}
+
+static SymbolTable lookup_table;
+
+static void init_lookup_table() {
+  symtab_init(&lookup_table, NAME_COUNT);
+  for(int i = 0; i < NAME_COUNT; i++) {
+    symtab_insert(&lookup_table, names[i], i);
+  }
+}
+
+static void symtab_get_hit_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += symtab_get(&lookup_table, names[(i * 31) & (NAME_COUNT - 1)]);
+  }
+  sink += sum;
+}
+
+static void symtab_get_miss_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += symtab_get(&lookup_table, missing[(i * 31) & (NAME_COUNT - 1)]);
+  }
+  sink += sum;
+}
+
+// Half keywords, half names, as the parser sees them.
+static char* keyword_words[] = {
+  "state", "idle", "initial", "busy", "machine", "go", "action", "done",
+  "guard", "toggle", "delay", "on", "assign", "off", "invoke", "fetch"
+};
+
+static void keyword_get_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += keyword_get(keyword_words[i & 15]);
+  }
+  sink += sum;
+}
+
+// The tables symtab replaced, for comparison with the benchmarks above:
+// dict_insert with symtab_insert, dict_search_* with symtab_get_*,
+// dict_keyword_get with keyword_get and simple_set_identifier_char with
+// is_valid_identifier_char.
+static dict* lookup_dict;
+static dict* keyword_dict;
+static SimpleSet identifier_set;
+
+static void init_reference_tables() {
+  lookup_dict = dict_create();
+  for(int i = 0; i < NAME_COUNT; i++) {
+    dict_insert(lookup_dict, names[i], i);
+  }
+
+  char* keywords[] = {
+    "import", "state", "initial", "final", "action",
+    "guard", "assign", "invoke", "machine", "delay"
+  };
+  keyword_dict = dict_create();
+  for(int i = 0; i < 10; i++) {
+    dict_insert(keyword_dict, keywords[i], i + 1);
+  }
+
+  set_init(&identifier_set);
+  char str[2] = {0};
+  for(char c = 'a'; c <= 'z'; c++) {
+    str[0] = c;
+    set_add(&identifier_set, str);
+    str[0] = c - 'a' + 'A';
+    set_add(&identifier_set, str);
+  }
+}
+
+static void destroy_reference_tables() {
+  dict_destroy(lookup_dict);
+  dict_destroy(keyword_dict);
+  set_destroy(&identifier_set);
+}
+
+static void dict_insert_bench(size_t ops) {
+  dict* d = dict_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & (NAME_COUNT - 1)) == 0) {
+      dict_destroy(d);
+      d = dict_create();
+    }
+    dict_insert(d, names[i & (NAME_COUNT - 1)], i);
+  }
+  sink += d->n;
+  dict_destroy(d);
+}
+
+static void dict_search_hit_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += dict_search(lookup_dict, names[(i * 31) & (NAME_COUNT - 1)]);
+  }
+  sink += sum;
+}
+
+static void dict_search_miss_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += dict_search(lookup_dict, missing[(i * 31) & (NAME_COUNT - 1)]);
+  }
+  sink += sum;
+}
+
+static void dict_keyword_get_bench(size_t ops) {
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += dict_search(keyword_dict, keyword_words[i & 15]);
+  }
+  sink += sum;
+}
+
+// As is_valid_identifier_char did, a one character string per lookup.
+static void simple_set_identifier_char_bench(size_t ops) {
+  size_t len = strlen(program_source);
+  size_t sum = 0;
+  size_t j = 0;
+  char str[2] = {0};
+  for(size_t i = 0; i < ops; i++) {
+    str[0] = program_source[j];
+    sum += set_contains(&identifier_set, str) == SET_TRUE;
+    if(++j == len) {
+      j = 0;
+    }
+  }
+  sink += sum;
+}
+
+static void is_valid_identifier_char_bench(size_t ops) {
+  size_t len = strlen(program_source);
+  size_t sum = 0;
+  size_t j = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += is_valid_identifier_char(program_source[j]);
+    if(++j == len) {
+      j = 0;
+    }
+  }
+  sink += sum;
+}
+
+// Lexes until ops tokens have been read, a source at a time.
+static void lex_bench(char* source, size_t ops) {
+  size_t per_source = parser_count_tokens(source);
+  for(size_t done = per_source; done < ops; done += per_source) {
+    sink += parser_count_tokens(source);
+  }
+}
+
+static void consume_token_program_bench(size_t ops) {
+  lex_bench(program_source, ops);
+}
+
+static void consume_token_identifiers_bench(size_t ops) {
+  lex_bench(identifier_source, ops);
+}
+
+static void consume_token_delays_bench(size_t ops) {
+  lex_bench(delay_source, ops);
+}
+
+static void timeframe_bench(const char* str, size_t ops) {
+  size_t len = strlen(str);
+  size_t sum = 0;
+  for(size_t i = 0; i < ops; i++) {
+    sum += timeframe_parse(str, len).time;
+  }
+  sink += sum;
+}
+
+static void timeframe_parse_integer_bench(size_t ops) {
+  timeframe_bench("1500", ops);
+}
+
+static void timeframe_parse_unit_bench(size_t ops) {
+  timeframe_bench("200ms", ops);
+}
+
+static void timeframe_parse_compound_bench(size_t ops) {
+  timeframe_bench("1h30m15s", ops);
+}
+
+// A transition object as the XState emitter writes it.
+static void js_builder_object_bench(size_t ops) {
+  JSBuilder* jsb = js_builder_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & 63) == 0) {
+      str_builder_clear(jsb->sb);
+    }
+    js_builder_start_object(jsb);
+    js_builder_start_prop(jsb, "target");
+    js_builder_add_string(jsb, "yellow");
+    js_builder_start_prop(jsb, "cond");
+    js_builder_add_string(jsb, "isReady");
+    js_builder_start_prop(jsb, "actions");
+    js_builder_add_str(jsb, "log");
+    js_builder_end_object(jsb);
+  }
+  sink += str_builder_len(jsb->sb);
+  js_builder_destroy(jsb);
+}
+
+static void js_builder_array_bench(size_t ops) {
+  JSBuilder* jsb = js_builder_create();
+  for(size_t i = 0; i < ops; i++) {
+    if((i & 63) == 0) {
+      str_builder_clear(jsb->sb);
+    }
+    bool multiline = i & 1;
+    js_builder_start_array(jsb, multiline);
+    for(int j = 0; j < 4; j++) {
+      if(j > 0) {
+        js_builder_add_str(jsb, ", ");
+      }
+      if(multiline) {
+        js_builder_add_indent(jsb);
+      }
+      js_builder_add_string(jsb, keyword_words[j]);
+    }
+    js_builder_end_array(jsb, multiline);
+  }
+  sink += str_builder_len(jsb->sb);
+  js_builder_destroy(jsb);
+}
+
+// Names are part of the output, keep them stable.
+static Microbench benches[] = {
+  {"str_builder_add_char", str_builder_add_char_bench},
+  {"str_builder_add_str", str_builder_add_str_bench},
+  {"str_builder_add_fmt", str_builder_add_fmt_bench},
+  {"str_builder_dump", str_builder_dump_bench},
+  {"symtab_insert", symtab_insert_bench},
+  {"symtab_get_hit", symtab_get_hit_bench},
+  {"symtab_get_miss", symtab_get_miss_bench},
+  {"keyword_get", keyword_get_bench},
+  {"is_valid_identifier_char", is_valid_identifier_char_bench},
+  {"consume_token_program", consume_token_program_bench},
+  {"consume_token_identifiers", consume_token_identifiers_bench},
+  {"consume_token_delays", consume_token_delays_bench},
+  {"timeframe_parse_integer", timeframe_parse_integer_bench},
+  {"timeframe_parse_unit", timeframe_parse_unit_bench},
+  {"timeframe_parse_compound", timeframe_parse_compound_bench},
+  {"js_builder_object", js_builder_object_bench},
+  {"js_builder_array", js_builder_array_bench},
+  {"dict_insert", dict_insert_bench},
+  {"dict_search_hit", dict_search_hit_bench},
+  {"dict_search_miss", dict_search_miss_bench},
+  {"dict_keyword_get", dict_keyword_get_bench},
+  {"simple_set_identifier_char", simple_set_identifier_char_bench}
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+static unsigned long long time_run(Microbench* bench, size_t ops) {
+  unsigned long long start = now_ns();
+  bench->run(ops);
+  return now_ns() - start;
+}
+
+static void run_bench(Microbench* bench, int runs, unsigned long long min_ns, bool first) {
+  size_t ops = 1024;
+  while(time_run(bench, ops) < min_ns && ops < ((size_t)1 << 40)) {
+    ops <<= 1;
+  }
+
+  unsigned long long best = 0;
+  unsigned long long total = 0;
+  for(int i = 0; i < runs; i++) {
+    unsigned long long elapsed = time_run(bench, ops);
+    total += elapsed;
+    if(i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  Stats* stats = stats_create();
+  stats_start(stats);
+  bench->run(ops);
+  stats_stop();
+
+  printf("%s\n  {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.3f, \"mean_ns_per_op\": %.3f, "
+    "\"allocations_per_op\": %.4f}", first ? "" : ",", bench->name, ops,
+    (double)best / ops, (double)total / runs / ops, (double)stats->allocations / ops);
+  fflush(stdout);
+  stats_destroy(stats);
+}
+
+static void usage(char* program_name) {
+  fprintf(stderr, "%s - Microbenchmark the Lucy compiler's components.\n\n", program_name);
+  fprintf(stderr, "Usage: %s [--runs N] [--min-time MS] [--filter SUBSTRING] [--list]\n", program_name);
+  fprintf(stderr, "\nns_per_op is the fastest of the runs, each at least --min-time long.\n");
+}
+
+#define OPTION_RUNS 0
+#define OPTION_MIN_TIME 1
+#define OPTION_FILTER 2
+#define OPTION_LIST 3
+
+static struct option long_options[] = {
+  {"runs", required_argument, 0, OPTION_RUNS},
+  {"min-time", required_argument, 0, OPTION_MIN_TIME},
+  {"filter", required_argument, 0, OPTION_FILTER},
+  {"list", no_argument, 0, OPTION_LIST},
+  {"help", no_argument, 0, 'h'},
+  {0, 0, 0, 0}
+};
+
+int main(int argc, char *argv[]) {
+  identifier_init();
+  parser_init();
+
+  int runs = DEFAULT_RUNS;
+  int min_time_ms = DEFAULT_MIN_TIME_MS;
+  char* filter = NULL;
+
+  int option_index = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+    switch(opt) {
+      case OPTION_RUNS: {
+        runs = atoi(optarg);
+        break;
+      }
+      case OPTION_MIN_TIME: {
+        min_time_ms = atoi(optarg);
+        break;
+      }
+      case OPTION_FILTER: {
+        filter = optarg;
+        break;
+      }
+      case OPTION_LIST: {
+        for(size_t i = 0; i < BENCH_COUNT; i++) {
+          printf("%s\n", benches[i].name);
+        }
+        return 0;
+      }
+      case 'h': {
+        usage(argv[0]);
+        exit(0);
+      }
+      default: {
+        usage(argv[0]);
+        exit(1);
+      }
+    }
+  }
+
+  if(optind < argc || runs < 1 || min_time_ms < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  init_names();
+  init_lookup_table();
+  init_reference_tables();
+
+  bool first = true;
+  printf("[");
+  for(size_t i = 0; i < BENCH_COUNT; i++) {
+    if(filter != NULL && strstr(benches[i].name, filter) == NULL) {
+      continue;
+    }
+    run_bench(&benches[i], runs, (unsigned long long)min_time_ms * 1000000ULL, first);
+    first = false;
+  }
+  printf("\n]\n");
+
+  symtab_destroy(&lookup_table);
+  destroy_reference_tables();
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include "../../core/alloc.h"
 #include "dict.h"
 
 #define INITIAL_SIZE (1024)
@@ -11,11 +12,11 @@ static dict* internal_dict_create(int size) {
     dict *d;
     int i;
 
-    d = malloc(sizeof(*d));
+    d = lucy_malloc(sizeof(*d));
 
     d->size = size;
     d->n = 0;
-    d->table = malloc(sizeof(struct elt *) * d->size);
+    d->table = lucy_malloc(sizeof(struct elt *) * d->size);
 
     for(i = 0; i < d->size; i++) d->table[i] = 0;
 
@@ -26,7 +27,7 @@ dict* dict_create(void) {
     return internal_dict_create(INITIAL_SIZE);
 }
 
-static void dict_destroy(dict *d) {
+void dict_destroy(dict *d) {
     int i;
     struct elt *e;
     struct elt *next;
@@ -35,13 +36,13 @@ static void dict_destroy(dict *d) {
         for(e = d->table[i]; e != 0; e = next) {
             next = e->next;
 
-            free(e->key);
-            free(e);
+            lucy_free(e->key);
+            lucy_free(e);
         }
     }
 
-    free(d->table);
-    free(d);
+    lucy_free(d->table);
+    lucy_free(d);
 }
 
 #define MULTIPLIER (97)
@@ -92,9 +93,9 @@ void dict_insert(dict *d, const char *key, unsigned short value) {
     struct elt *e;
     unsigned long h;
 
-    e = malloc(sizeof(*e));
+    e = lucy_malloc(sizeof(*e));
 
-    e->key = strdup(key);
+    e->key = lucy_strdup(key);
     e->value = value;
 
     h = hash_function(key) % d->size;
@@ -137,8 +138,8 @@ static void dict_delete(dict *d, const char *key) {
             e = *prev;
             *prev = e->next;
 
-            free(e->key);
-            free(e);
+            lucy_free(e->key);
+            lucy_free(e);
 
             return;
         }
@@ -1,5 +1,8 @@
 #pragma once
 
+// The chained table keywords were looked up in before symtab replaced it,
+// kept so lc-microbench can time the two side by side.
+
 struct elt {
     struct elt *next;
     char *key;
@@ -13,5 +16,6 @@ typedef struct dict {
 } dict;
 
 dict* dict_create(void);
+void dict_destroy(dict*);
 void dict_insert(dict*, const char*, unsigned short);
 unsigned short dict_search(dict*, const char*);
\ No newline at end of file
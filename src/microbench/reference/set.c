@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "../../core/alloc.h"
 #include "set.h"
 
 #define MAX_FULLNESS_PERCENT 0.25       /* arbitrary */
@@ -30,7 +31,7 @@ static void __relayout_nodes(SimpleSet *set, uint64_t start, short end_on_null);
 *******************************************************************************/
 
 int set_init_alt(SimpleSet *set, uint64_t num_els, set_hash_function hash) {
-    set->nodes = (simple_set_node**) malloc(num_els * sizeof(simple_set_node*));
+    set->nodes = (simple_set_node**) lucy_malloc(num_els * sizeof(simple_set_node*));
     if (set->nodes == NULL) {
         return SET_MALLOC_ERROR;
     }
@@ -57,7 +58,7 @@ int set_clear(SimpleSet *set) {
 
 int set_destroy(SimpleSet *set) {
     set_clear(set);
-    free(set->nodes);
+    lucy_free(set->nodes);
     set->number_nodes = 0;
     set->used_nodes = 0;
     set->hash_function = NULL;
@@ -94,13 +95,13 @@ uint64_t set_length(SimpleSet *set) {
 
 char** set_to_array(SimpleSet *set, uint64_t *size) {
     *size = set->used_nodes;
-    char** results = (char**)calloc(set->used_nodes + 1, sizeof(char*));
+    char** results = (char**)lucy_calloc(set->used_nodes + 1, sizeof(char*));
     uint64_t i, j = 0;
     size_t len;
     for (i = 0; i < set->number_nodes; ++i) {
         if (set->nodes[i] != NULL) {
             len = strlen(set->nodes[i]->_key);
-            results[j] = (char*)calloc(len + 1, sizeof(char));
+            results[j] = (char*)lucy_calloc(len + 1, sizeof(char));
             memcpy(results[j], set->nodes[i]->_key, len);
             ++j;
         }
@@ -249,7 +250,7 @@ static int __set_add(SimpleSet *set, const char *key, uint64_t hash) {
     // Expand nodes if we are close to our desired fullness
     if ((float)set->used_nodes / set->number_nodes > MAX_FULLNESS_PERCENT) {
         uint64_t num_els = set->number_nodes * 2; // we want to double each time
-        simple_set_node** tmp = (simple_set_node**)realloc(set->nodes, num_els * sizeof(simple_set_node*));
+        simple_set_node** tmp = (simple_set_node**)lucy_realloc(set->nodes, num_els * sizeof(simple_set_node*));
         if (tmp == NULL || set->nodes == NULL) // malloc failure
             return SET_MALLOC_ERROR;
 
@@ -295,16 +296,16 @@ static int __get_index(SimpleSet *set, const char *key, uint64_t hash, uint64_t
 
 static int __assign_node(SimpleSet *set, const char *key, uint64_t hash, uint64_t index) {
     size_t len = strlen(key);
-    set->nodes[index] = (simple_set_node*)malloc(sizeof(simple_set_node));
-    set->nodes[index]->_key = (char*)calloc(len + 1, sizeof(char));
+    set->nodes[index] = (simple_set_node*)lucy_malloc(sizeof(simple_set_node));
+    set->nodes[index]->_key = (char*)lucy_calloc(len + 1, sizeof(char));
     memcpy(set->nodes[index]->_key, key, len);
     set->nodes[index]->_hash = hash;
     return SET_TRUE;
 }
 
 static void __free_index(SimpleSet *set, uint64_t index) {
-    free(set->nodes[index]->_key);
-    free(set->nodes[index]);
+    lucy_free(set->nodes[index]->_key);
+    lucy_free(set->nodes[index]);
     set->nodes[index] = NULL;
 }
 
@@ -0,0 +1,308 @@
+#include <node_api.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../core/compiler_js.h"
+#include "../core/compiler_json.h"
+#include "../core/compiler_xstate.h"
+#include "../core/identifier.h"
+#include "../core/parser.h"
+
+// Returns NULL from the callback, leaving Node's pending exception, when a
+// napi call fails.
+#define CHECK(call) \
+  if((call) != napi_ok) { \
+    return NULL; \
+  }
+
+typedef void (*CompileFn)(CompileResult*, char*, char*);
+
+// A compile waiting for, running on, or returning from the thread pool.
+typedef struct CompileTask {
+  napi_async_work work;
+  napi_deferred deferred;
+  CompileFn compile;
+  CompileResult* result;
+  char* source;
+  char* filename;
+  bool stats;
+  uint32_t max_depth;
+} CompileTask;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_core() {
+  identifier_init();
+  parser_init();
+}
+
+static char* get_string(napi_env env, napi_value value) {
+  size_t length;
+  if(napi_get_value_string_utf8(env, value, NULL, 0, &length) != napi_ok) {
+    return NULL;
+  }
+  char* str = malloc(length + 1);
+  napi_get_value_string_utf8(env, value, str, length + 1, &length);
+  return str;
+}
+
+static bool get_flag(napi_env env, napi_value options, const char* name) {
+  napi_value value;
+  bool flag = false;
+  if(napi_get_named_property(env, options, name, &value) == napi_ok &&
+    napi_coerce_to_bool(env, value, &value) == napi_ok) {
+    napi_get_value_bool(env, value, &flag);
+  }
+  return flag;
+}
+
+// Takes the arguments of compileXstate, throwing like the wasm build when
+// they're missing.
+static CompileTask* task_create(napi_env env, napi_callback_info info, CompileFn compile) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_valuetype type;
+  CHECK(napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+
+  char* source = argc > 0 ? get_string(env, argv[0]) : NULL;
+  char* filename = argc > 1 ? get_string(env, argv[1]) : NULL;
+  if(source == NULL || filename == NULL || *source == '\0' || *filename == '\0') {
+    free(source);
+    free(filename);
+    napi_throw_type_error(env, NULL, "Source and filename are both required.");
+    return NULL;
+  }
+
+  int flags = 0;
+  bool stats = false;
+  uint32_t depth = 0;
+  if(argc > 2 && napi_typeof(env, argv[2], &type) == napi_ok && type == napi_object) {
+    napi_value options = argv[2];
+    flags = (get_flag(env, options, "useRemote") ? XS_FLAG_USE_REMOTE : 0) |
+      (get_flag(env, options, "optimize") ? XS_FLAG_OPTIMIZE : 0) |
+      (get_flag(env, options, "minimize") ? XS_FLAG_MINIMIZE : 0) |
+      (get_flag(env, options, "lazy") ? XS_FLAG_LAZY : 0);
+    stats = get_flag(env, options, "stats");
+
+    napi_value value;
+    uint32_t given;
+    if(napi_get_named_property(env, options, "maxDepth", &value) == napi_ok &&
+      napi_get_value_uint32(env, value, &given) == napi_ok && given > 0) {
+      depth = given;
+    }
+  }
+  CompileTask* task = calloc(1, sizeof(CompileTask));
+  task->compile = compile;
+  task->source = source;
+  task->filename = filename;
+  task->stats = stats;
+  task->max_depth = depth;
+  task->result = xs_create();
+  xs_init(task->result, flags);
+  if(stats) {
+    xs_enable_stats(task->result);
+  }
+  return task;
+}
+
+static void task_destroy(CompileTask* task) {
+  destroy_xstate_result(task->result);
+  free(task->source);
+  free(task->filename);
+  free(task);
+}
+
+// Other compiles running at the same time keep their own max depth.
+static void task_run(CompileTask* task) {
+  uint32_t outer = parser_use_max_depth(task->max_depth);
+  task->compile(task->result, task->source, task->filename);
+  parser_use_max_depth(outer);
+}
+
+static napi_value create_diagnostic(napi_env env, Diagnostic* diagnostic) {
+  napi_value object, value;
+  CHECK(napi_create_object(env, &object));
+  CHECK(napi_create_uint32(env, diagnostic->code, &value));
+  CHECK(napi_set_named_property(env, object, "code", value));
+  CHECK(napi_create_string_utf8(env, diagnostics_severity_name(diagnostic->severity),
+    NAPI_AUTO_LENGTH, &value));
+  CHECK(napi_set_named_property(env, object, "severity", value));
+  CHECK(napi_create_uint32(env, diagnostic->start, &value));
+  CHECK(napi_set_named_property(env, object, "start", value));
+  CHECK(napi_create_uint32(env, diagnostic->end, &value));
+  CHECK(napi_set_named_property(env, object, "end", value));
+  CHECK(napi_create_uint32(env, diagnostic->line, &value));
+  CHECK(napi_set_named_property(env, object, "line", value));
+  CHECK(napi_create_uint32(env, diagnostic->column, &value));
+  CHECK(napi_set_named_property(env, object, "column", value));
+  CHECK(napi_create_string_utf8(env, diagnostic->message, NAPI_AUTO_LENGTH, &value));
+  CHECK(napi_set_named_property(env, object, "message", value));
+  return object;
+}
+
+// The Error thrown for a failed compile, its message from the first error
+// and every diagnostic attached, see liblucy.mjs.
+static napi_value create_compile_error(napi_env env, Diagnostics* diagnostics) {
+  const char* message = "Compiler error";
+  for(uint32_t i = 0; i < diagnostics->count; i++) {
+    if(diagnostics->items[i].severity == DIAGNOSTIC_ERROR) {
+      message = diagnostics->items[i].message;
+      break;
+    }
+  }
+
+  napi_value error, msg, list;
+  CHECK(napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &msg));
+  CHECK(napi_create_error(env, NULL, msg, &error));
+  CHECK(napi_create_array_with_length(env, diagnostics->count, &list));
+  for(uint32_t i = 0; i < diagnostics->count; i++) {
+    napi_value item = create_diagnostic(env, &diagnostics->items[i]);
+    if(item == NULL) {
+      return NULL;
+    }
+    CHECK(napi_set_element(env, list, i, item));
+  }
+  CHECK(napi_set_named_property(env, error, "diagnostics", list));
+  return error;
+}
+
+static napi_value parse_json(napi_env env, const char* json) {
+  napi_value global, object, parse, str, value;
+  CHECK(napi_get_global(env, &global));
+  CHECK(napi_get_named_property(env, global, "JSON", &object));
+  CHECK(napi_get_named_property(env, object, "parse", &parse));
+  CHECK(napi_create_string_utf8(env, json, NAPI_AUTO_LENGTH, &str));
+  CHECK(napi_call_function(env, object, parse, 1, &str, &value));
+  return value;
+}
+
+// The compiled output, or { js, stats } when stats were asked for. Sets
+// *error instead on a failed compile.
+static napi_value task_output(napi_env env, CompileTask* task, napi_value* error) {
+  CompileResult* result = task->result;
+  *error = NULL;
+  if(!result->success) {
+    *error = create_compile_error(env, xs_get_diagnostics(result));
+    return NULL;
+  }
+
+  napi_value js;
+  CHECK(napi_create_string_utf8(env, xs_get_js(result), NAPI_AUTO_LENGTH, &js));
+  if(!task->stats) {
+    return js;
+  }
+
+  napi_value output, stats;
+  stats = parse_json(env, xs_get_stats_json(result));
+  if(stats == NULL) {
+    return NULL;
+  }
+  CHECK(napi_create_object(env, &output));
+  CHECK(napi_set_named_property(env, output, "js", js));
+  CHECK(napi_set_named_property(env, output, "stats", stats));
+  return output;
+}
+
+static napi_value compile_sync(napi_env env, napi_callback_info info, CompileFn compile) {
+  CompileTask* task = task_create(env, info, compile);
+  if(task == NULL) {
+    return NULL;
+  }
+
+  task_run(task);
+  napi_value error;
+  napi_value output = task_output(env, task, &error);
+  task_destroy(task);
+  if(error != NULL) {
+    napi_throw(env, error);
+  }
+  return output;
+}
+
+static void execute_async(napi_env env, void* data) {
+  task_run(data);
+}
+
+static void complete_async(napi_env env, napi_status status, void* data) {
+  CompileTask* task = data;
+  napi_value error = NULL;
+  napi_value output = NULL;
+  if(status == napi_ok) {
+    output = task_output(env, task, &error);
+  }
+
+  // A napi call that failed while building the output left an exception.
+  bool pending = false;
+  if(output == NULL && error == NULL) {
+    napi_is_exception_pending(env, &pending);
+    if(pending) {
+      napi_get_and_clear_last_exception(env, &error);
+    } else {
+      napi_value msg;
+      napi_create_string_utf8(env, "Compile cancelled", NAPI_AUTO_LENGTH, &msg);
+      napi_create_error(env, NULL, msg, &error);
+    }
+  }
+
+  if(error != NULL) {
+    napi_reject_deferred(env, task->deferred, error);
+  } else {
+    napi_resolve_deferred(env, task->deferred, output);
+  }
+  napi_delete_async_work(env, task->work);
+  task_destroy(task);
+}
+
+// Reads the arguments here and compiles on libuv's pool, so several can
+// run at once, each with its own result.
+static napi_value compile_async(napi_env env, napi_callback_info info, CompileFn compile) {
+  CompileTask* task = task_create(env, info, compile);
+  if(task == NULL) {
+    return NULL;
+  }
+
+  napi_value promise, name;
+  if(napi_create_promise(env, &task->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, "lucy:compile", NAPI_AUTO_LENGTH, &name) != napi_ok ||
+    napi_create_async_work(env, NULL, name, execute_async, complete_async, task,
+      &task->work) != napi_ok) {
+    task_destroy(task);
+    return NULL;
+  }
+  if(napi_queue_async_work(env, task->work) != napi_ok) {
+    napi_delete_async_work(env, task->work);
+    task_destroy(task);
+    return NULL;
+  }
+  return promise;
+}
+
+#define COMPILERS(X) \
+  X(compileXstate, compile_xstate) \
+  X(compileJs, compile_js) \
+  X(compileJson, compile_json)
+
+#define X(js_name, c_name) \
+  static napi_value js_name##_sync(napi_env env, napi_callback_info info) { \
+    return compile_sync(env, info, c_name); \
+  } \
+  static napi_value js_name##_async(napi_env env, napi_callback_info info) { \
+    return compile_async(env, info, c_name); \
+  }
+COMPILERS(X)
+#undef X
+
+NAPI_MODULE_INIT() {
+  pthread_once(&init_once, init_core);
+
+  napi_property_descriptor properties[] = {
+#define X(js_name, c_name) \
+    { #js_name, NULL, js_name##_sync, NULL, NULL, NULL, napi_enumerable, NULL }, \
+    { #js_name "Async", NULL, js_name##_async, NULL, NULL, NULL, napi_enumerable, NULL },
+    COMPILERS(X)
+#undef X
+  };
+  CHECK(napi_define_properties(env, exports,
+    sizeof(properties) / sizeof(properties[0]), properties));
+  return exports;
+}
@@ -0,0 +1,108 @@
+#ifndef LUCY_BYTECODE_H_
+#define LUCY_BYTECODE_H_
+
+#include <stdint.h>
+
+// The binary format written by lc --emit=bytecode and run by the VM. Every
+// field is a little-endian uint32 and every table is 4-byte aligned, so a
+// mapped file is used in place. Offsets are in bytes from the start of the
+// file, ids index into the string table.
+//
+// Both sides copy uint32s as they are in memory, which is only the format
+// on a little-endian host, so they don't build anywhere else.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The bytecode writer and VM need a little-endian host."
+#endif
+
+#define BC_MAGIC 0x5943554c // "LUCY"
+#define BC_VERSION 1
+#define BC_NONE UINT32_MAX
+
+#define BC_STATE_FINAL 1 << 0
+
+// Transition kinds, rows are states except for done and error which are
+// rows of invokes.
+#define BC_EVENT 0
+#define BC_ALWAYS 1
+#define BC_DELAY 2
+#define BC_DONE 3
+#define BC_ERROR 4
+#define BC_KIND_COUNT 5
+
+typedef struct BCHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+
+  // string_count offsets of NUL terminated strings, then the ids of the
+  // same strings in strcmp order for lookups by name.
+  uint32_t string_count;
+  uint32_t strings;
+  uint32_t sorted;
+
+  uint32_t machine_count;
+  uint32_t machines;
+} BCHeader;
+
+typedef struct BCState {
+  // The state's path, like red.walk for nested states.
+  uint32_t name;
+  uint32_t parent;
+  // The child entered with the state, or BC_NONE.
+  uint32_t child;
+  uint32_t flags;
+} BCState;
+
+typedef struct BCTransition {
+  // A string id for event transitions, ms for delays.
+  uint32_t event;
+  uint32_t delay;
+  uint32_t target;
+  uint32_t guard_start;
+  uint32_t guard_count;
+  uint32_t action_start;
+  uint32_t action_count;
+} BCTransition;
+
+// The transition taken on an event, one per event a state handles, sorted
+// by event.
+typedef struct BCDispatch {
+  uint32_t event;
+  uint32_t transition;
+} BCDispatch;
+
+// An imported function, a key it's assigned to or both. Without a function
+// the key is set to the event's data.
+typedef struct BCAction {
+  uint32_t fn;
+  uint32_t key;
+} BCAction;
+
+typedef struct BCMachine {
+  // BC_NONE for the implicit machine.
+  uint32_t name;
+  uint32_t initial;
+
+  uint32_t state_count;
+  uint32_t transition_count;
+  uint32_t guard_count;
+  uint32_t action_count;
+  uint32_t invoke_count;
+  uint32_t dispatch_count;
+
+  uint32_t states;
+  uint32_t transitions;
+  // Per kind, row count + 1 offsets into transitions.
+  uint32_t offsets[BC_KIND_COUNT];
+  // state_count + 1 offsets into dispatch.
+  uint32_t dispatch_offsets;
+  uint32_t dispatch;
+  // Function ids of guards, and actions.
+  uint32_t guards;
+  uint32_t actions;
+  // Source ids of invokes, and state_count + 1 offsets into them.
+  uint32_t invokes;
+  uint32_t invoke_offsets;
+} BCMachine;
+
+#endif
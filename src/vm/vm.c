@@ -0,0 +1,463 @@
+#include <string.h>
+#include "bytecode.h"
+#include "vm.h"
+
+static const void* vm_at(const VMProgram* program, uint32_t offset) {
+  return program->data + offset;
+}
+
+static const BCState* vm_states(const VMMachine* m) {
+  return vm_at(m->program, m->def->states);
+}
+
+static const BCTransition* vm_transitions(const VMMachine* m) {
+  return vm_at(m->program, m->def->transitions);
+}
+
+static const uint32_t* vm_offsets(const VMMachine* m, int kind) {
+  return vm_at(m->program, m->def->offsets[kind]);
+}
+
+// Whether count items of a size fit in the file at offset, aligned.
+static bool fits(uint32_t size, uint32_t offset, uint32_t count, uint32_t item) {
+  return offset % 4 == 0 && offset <= size && (uint64_t)count * item <= size - offset;
+}
+
+static bool is_id(uint32_t id, uint32_t count) {
+  return id == BC_NONE || id < count;
+}
+
+// Offsets have to be ascending and end within the table they index.
+static bool valid_offsets(const uint32_t* offsets, uint32_t rows, uint32_t count) {
+  for(uint32_t i = 0; i < rows; i++) {
+    if(offsets[i] > offsets[i + 1]) {
+      return false;
+    }
+  }
+  return offsets[rows] <= count;
+}
+
+// Checks everything the interpreter indexes with, so that a corrupt file is
+// rejected here rather than read out of bounds later.
+static bool valid_machine(const VMProgram* program, const BCMachine* def) {
+  uint32_t size = program->header->size;
+  uint32_t strings = program->header->string_count;
+  uint32_t states = def->state_count;
+
+  if(!fits(size, def->states, states, sizeof(BCState)) ||
+    !fits(size, def->transitions, def->transition_count, sizeof(BCTransition)) ||
+    !fits(size, def->dispatch_offsets, states + 1, sizeof(uint32_t)) ||
+    !fits(size, def->dispatch, def->dispatch_count, sizeof(BCDispatch)) ||
+    !fits(size, def->guards, def->guard_count, sizeof(uint32_t)) ||
+    !fits(size, def->actions, def->action_count, sizeof(BCAction)) ||
+    !fits(size, def->invokes, def->invoke_count, sizeof(uint32_t)) ||
+    !fits(size, def->invoke_offsets, states + 1, sizeof(uint32_t)) ||
+    states == UINT32_MAX || !is_id(def->name, strings)) {
+    return false;
+  }
+  if(states == 0 ? def->initial != BC_NONE : def->initial >= states) {
+    return false;
+  }
+
+  for(int kind = 0; kind < BC_KIND_COUNT; kind++) {
+    uint32_t rows = kind >= BC_DONE ? def->invoke_count : states;
+    if(rows == UINT32_MAX || !fits(size, def->offsets[kind], rows + 1, sizeof(uint32_t)) ||
+      !valid_offsets(vm_at(program, def->offsets[kind]), rows, def->transition_count)) {
+      return false;
+    }
+  }
+  if(!valid_offsets(vm_at(program, def->dispatch_offsets), states, def->dispatch_count) ||
+    !valid_offsets(vm_at(program, def->invoke_offsets), states, def->invoke_count)) {
+    return false;
+  }
+
+  // Parents come before their children, so walking up always ends.
+  const BCState* state = vm_at(program, def->states);
+  for(uint32_t s = 0; s < states; s++) {
+    if(state[s].name >= strings || (state[s].parent != BC_NONE && state[s].parent >= s) ||
+      (state[s].child != BC_NONE && (state[s].child >= states || state[s].child <= s))) {
+      return false;
+    }
+  }
+
+  const BCTransition* transition = vm_at(program, def->transitions);
+  for(uint32_t t = 0; t < def->transition_count; t++) {
+    if(transition[t].target >= states ||
+      (uint64_t)transition[t].guard_start + transition[t].guard_count > def->guard_count ||
+      (uint64_t)transition[t].action_start + transition[t].action_count > def->action_count) {
+      return false;
+    }
+  }
+
+  const uint32_t* dispatch_offsets = vm_at(program, def->dispatch_offsets);
+  const BCDispatch* dispatch = vm_at(program, def->dispatch);
+  for(uint32_t s = 0; s < states; s++) {
+    for(uint32_t i = dispatch_offsets[s]; i < dispatch_offsets[s + 1]; i++) {
+      if(dispatch[i].transition >= def->transition_count ||
+        (i > dispatch_offsets[s] && dispatch[i].event <= dispatch[i - 1].event)) {
+        return false;
+      }
+    }
+  }
+
+  const uint32_t* guards = vm_at(program, def->guards);
+  for(uint32_t i = 0; i < def->guard_count; i++) {
+    if(guards[i] >= strings) {
+      return false;
+    }
+  }
+  const BCAction* actions = vm_at(program, def->actions);
+  for(uint32_t i = 0; i < def->action_count; i++) {
+    if(!is_id(actions[i].fn, strings) || !is_id(actions[i].key, strings)) {
+      return false;
+    }
+  }
+  const uint32_t* invokes = vm_at(program, def->invokes);
+  for(uint32_t i = 0; i < def->invoke_count; i++) {
+    if(invokes[i] >= strings) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int vm_load(VMProgram* program, const void* data, size_t size) {
+  const BCHeader* header = data;
+  if(size < sizeof(BCHeader) || (uintptr_t)data % 4 != 0) {
+    return VM_ERROR_CORRUPT;
+  }
+  if(header->magic != BC_MAGIC) {
+    return VM_ERROR_MAGIC;
+  }
+  if(header->version != BC_VERSION) {
+    return VM_ERROR_VERSION;
+  }
+  if(header->size > size ||
+    !fits(header->size, header->strings, header->string_count, sizeof(uint32_t)) ||
+    !fits(header->size, header->sorted, header->string_count, sizeof(uint32_t)) ||
+    !fits(header->size, header->machines, header->machine_count, sizeof(BCMachine))) {
+    return VM_ERROR_CORRUPT;
+  }
+
+  program->data = data;
+  program->header = header;
+  program->machines = vm_at(program, header->machines);
+
+  const uint32_t* strings = vm_at(program, header->strings);
+  const uint32_t* sorted = vm_at(program, header->sorted);
+  for(uint32_t i = 0; i < header->string_count; i++) {
+    if(strings[i] >= header->size || memchr(program->data + strings[i], '\0', header->size - strings[i]) == NULL ||
+      sorted[i] >= header->string_count) {
+      return VM_ERROR_CORRUPT;
+    }
+  }
+  for(uint32_t i = 0; i < header->machine_count; i++) {
+    if(!valid_machine(program, &program->machines[i])) {
+      return VM_ERROR_CORRUPT;
+    }
+  }
+  return VM_OK;
+}
+
+const char* vm_load_error(int error) {
+  switch(error) {
+    case VM_OK: return "ok";
+    case VM_ERROR_MAGIC: return "not a Lucy bytecode file";
+    case VM_ERROR_VERSION: return "unsupported bytecode version";
+    default: return "corrupt bytecode file";
+  }
+}
+
+const char* vm_string(const VMProgram* program, uint32_t id) {
+  if(id >= program->header->string_count) {
+    return NULL;
+  }
+  const uint32_t* strings = vm_at(program, program->header->strings);
+  return (const char*)program->data + strings[id];
+}
+
+uint32_t vm_string_id(const VMProgram* program, const char* str) {
+  const uint32_t* sorted = vm_at(program, program->header->sorted);
+  uint32_t low = 0;
+  uint32_t high = program->header->string_count;
+  while(low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    int cmp = strcmp(vm_string(program, sorted[mid]), str);
+    if(cmp == 0) {
+      return sorted[mid];
+    }
+    if(cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return VM_NONE;
+}
+
+uint32_t vm_machine_count(const VMProgram* program) {
+  return program->header->machine_count;
+}
+
+// NULL finds the implicit machine.
+uint32_t vm_find_machine(const VMProgram* program, const char* name) {
+  uint32_t id = name == NULL ? BC_NONE : vm_string_id(program, name);
+  if(name != NULL && id == VM_NONE) {
+    return VM_NONE;
+  }
+  for(uint32_t i = 0; i < program->header->machine_count; i++) {
+    if(program->machines[i].name == id) {
+      return i;
+    }
+  }
+  return VM_NONE;
+}
+
+static bool vm_guards(VMMachine* m, uint32_t t, uint32_t event, const void* data) {
+  const VMHost* host = m->host;
+  const BCTransition* transition = &vm_transitions(m)[t];
+  const uint32_t* guards = vm_at(m->program, m->def->guards);
+  if(host->guard == NULL) {
+    return true;
+  }
+  for(uint32_t i = 0; i < transition->guard_count; i++) {
+    if(!host->guard(host->context, m, guards[transition->guard_start + i], event, data)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void vm_actions(VMMachine* m, uint32_t t, uint32_t event, const void* data) {
+  const VMHost* host = m->host;
+  const BCTransition* transition = &vm_transitions(m)[t];
+  const BCAction* actions = vm_at(m->program, m->def->actions);
+  if(host->action == NULL) {
+    return;
+  }
+  for(uint32_t i = 0; i < transition->action_count; i++) {
+    const BCAction* action = &actions[transition->action_start + i];
+    host->action(host->context, m, action->fn, action->key, event, data);
+  }
+}
+
+// Schedules a state's delays and starts its invokes as it's entered.
+static void vm_activate(VMMachine* m, uint32_t state) {
+  const VMHost* host = m->host;
+  const BCTransition* transitions = vm_transitions(m);
+  const uint32_t* rows = vm_offsets(m, BC_DELAY);
+
+  if(host->schedule != NULL) {
+    for(uint32_t t = rows[state]; t < rows[state + 1]; t++) {
+      bool first = true;
+      for(uint32_t earlier = rows[state]; earlier < t && first; earlier++) {
+        first = transitions[earlier].delay != transitions[t].delay;
+      }
+      if(first) {
+        host->schedule(host->context, m, state, transitions[t].delay);
+      }
+    }
+  }
+
+  if(host->invoke != NULL) {
+    const uint32_t* offsets = vm_at(m->program, m->def->invoke_offsets);
+    const uint32_t* invokes = vm_at(m->program, m->def->invokes);
+    for(uint32_t i = offsets[state]; i < offsets[state + 1]; i++) {
+      host->invoke(host->context, m, i, invokes[i]);
+    }
+  }
+}
+
+static void vm_enter(VMMachine* m, uint32_t state) {
+  const BCState* states = vm_states(m);
+  while(state != BC_NONE) {
+    vm_activate(m, state);
+    m->state = state;
+    state = states[state].child;
+  }
+}
+
+// Exits the active states up to and including until.
+static void vm_exit(VMMachine* m, uint32_t until) {
+  const VMHost* host = m->host;
+  const BCState* states = vm_states(m);
+  for(uint32_t state = m->state; state != BC_NONE; state = states[state].parent) {
+    if(host->cancel != NULL) {
+      host->cancel(host->context, m, state);
+    }
+    if(state == until) {
+      break;
+    }
+  }
+}
+
+static void vm_step(VMMachine* m, uint32_t source, uint32_t t, uint32_t event, const void* data) {
+  vm_exit(m, source);
+  vm_actions(m, t, event, data);
+  vm_enter(m, vm_transitions(m)[t].target);
+}
+
+static uint32_t vm_select_always(VMMachine* m, uint32_t state) {
+  const uint32_t* rows = vm_offsets(m, BC_ALWAYS);
+  for(uint32_t t = rows[state]; t < rows[state + 1]; t++) {
+    if(vm_guards(m, t, VM_NONE, NULL)) {
+      return t;
+    }
+  }
+  return BC_NONE;
+}
+
+// Takes enabled always transitions, bounded so that ones which cycle
+// can't hang the host.
+static void vm_settle(VMMachine* m) {
+  const BCState* states = vm_states(m);
+  const uint32_t* rows = vm_offsets(m, BC_ALWAYS);
+  if(rows[0] == rows[m->def->state_count]) {
+    return;
+  }
+
+  for(uint32_t i = 0; i <= m->def->state_count; i++) {
+    uint32_t t = BC_NONE;
+    uint32_t source = m->state;
+    while(source != BC_NONE && (t = vm_select_always(m, source)) == BC_NONE) {
+      source = states[source].parent;
+    }
+    if(t == BC_NONE) {
+      return;
+    }
+    vm_step(m, source, t, VM_NONE, NULL);
+  }
+}
+
+static void vm_take(VMMachine* m, uint32_t source, uint32_t t, uint32_t event, const void* data) {
+  vm_step(m, source, t, event, data);
+  vm_settle(m);
+}
+
+void vm_init(VMMachine* m, const VMProgram* program, uint32_t index, const VMHost* host) {
+  m->program = program;
+  m->def = &program->machines[index];
+  m->host = host;
+  m->state = BC_NONE;
+  vm_enter(m, m->def->initial);
+  vm_settle(m);
+}
+
+// The dispatch row of a state is sorted, so the event is found by bisection.
+static uint32_t vm_select(VMMachine* m, uint32_t state, uint32_t event, const void* data) {
+  const uint32_t* offsets = vm_at(m->program, m->def->dispatch_offsets);
+  const BCDispatch* dispatch = vm_at(m->program, m->def->dispatch);
+  uint32_t low = offsets[state];
+  uint32_t high = offsets[state + 1];
+  while(low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if(dispatch[mid].event == event) {
+      uint32_t t = dispatch[mid].transition;
+      return vm_guards(m, t, event, data) ? t : BC_NONE;
+    }
+    if(dispatch[mid].event < event) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return BC_NONE;
+}
+
+bool vm_send(VMMachine* m, uint32_t event, const void* data) {
+  const BCState* states = vm_states(m);
+  for(uint32_t state = m->state; state != BC_NONE; state = states[state].parent) {
+    uint32_t t = vm_select(m, state, event, data);
+    if(t != BC_NONE) {
+      vm_take(m, state, t, event, data);
+      return true;
+    }
+  }
+  return false;
+}
+
+// The last delay transition for ms is the one taken.
+void vm_timeout(VMMachine* m, uint32_t state, uint32_t ms) {
+  if(!vm_in(m, state)) {
+    return;
+  }
+  const BCTransition* transitions = vm_transitions(m);
+  const uint32_t* rows = vm_offsets(m, BC_DELAY);
+  for(uint32_t t = rows[state + 1]; t > rows[state]; t--) {
+    if(transitions[t - 1].delay == ms) {
+      if(vm_guards(m, t - 1, VM_NONE, NULL)) {
+        vm_take(m, state, t - 1, VM_NONE, NULL);
+      }
+      return;
+    }
+  }
+}
+
+static void vm_settled(VMMachine* m, uint32_t id, int kind, const void* data) {
+  if(id >= m->def->invoke_count) {
+    return;
+  }
+
+  // The state that owns the invoke is the last whose offset is at most id.
+  const uint32_t* offsets = vm_at(m->program, m->def->invoke_offsets);
+  uint32_t low = 0;
+  uint32_t high = m->def->state_count;
+  while(low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if(offsets[mid + 1] <= id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  uint32_t state = low;
+  if(!vm_in(m, state)) {
+    return;
+  }
+
+  const uint32_t* rows = vm_offsets(m, kind);
+  if(rows[id] < rows[id + 1]) {
+    uint32_t t = rows[id + 1] - 1;
+    if(vm_guards(m, t, VM_NONE, data)) {
+      vm_take(m, state, t, VM_NONE, data);
+    }
+  }
+}
+
+void vm_done(VMMachine* m, uint32_t id, const void* data) {
+  vm_settled(m, id, BC_DONE, data);
+}
+
+void vm_error(VMMachine* m, uint32_t id, const void* data) {
+  vm_settled(m, id, BC_ERROR, data);
+}
+
+bool vm_in(const VMMachine* m, uint32_t state) {
+  const BCState* states = vm_states(m);
+  for(uint32_t active = m->state; active != BC_NONE; active = states[active].parent) {
+    if(active == state) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the machine reached one of its own final states.
+bool vm_is_final(const VMMachine* m) {
+  const BCState* states = vm_states(m);
+  uint32_t state = m->state;
+  if(state == BC_NONE) {
+    return false;
+  }
+  while(states[state].parent != BC_NONE) {
+    state = states[state].parent;
+  }
+  return states[state].flags & BC_STATE_FINAL;
+}
+
+const char* vm_state_name(const VMMachine* m, uint32_t state) {
+  if(state >= m->def->state_count) {
+    return NULL;
+  }
+  return vm_string(m->program, vm_states(m)[state].name);
+}
@@ -0,0 +1,68 @@
+#ifndef LUCY_VM_H_
+#define LUCY_VM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+#define VM_OK 0
+#define VM_ERROR_MAGIC 1
+#define VM_ERROR_VERSION 2
+#define VM_ERROR_CORRUPT 3
+
+#define VM_NONE BC_NONE
+
+// A loaded bytecode file. Nothing is copied, the data has to be 4-byte
+// aligned and outlive the program, and can be shared by any number of
+// machines.
+typedef struct VMProgram {
+  const uint8_t* data;
+  const BCHeader* header;
+  const BCMachine* machines;
+} VMProgram;
+
+struct VMMachine;
+
+// Callbacks into the host, any of them can be NULL. Functions, keys and
+// events are string ids, see vm_string and vm_string_id.
+typedef struct VMHost {
+  void* context;
+  // Missing guards pass.
+  bool (*guard)(void* context, struct VMMachine*, uint32_t fn, uint32_t event, const void* data);
+  // fn is VM_NONE when key is set to the event's data, key is VM_NONE for
+  // actions that only call fn.
+  void (*action)(void* context, struct VMMachine*, uint32_t fn, uint32_t key, uint32_t event, const void* data);
+  // Call vm_timeout with the state and ms once ms have passed.
+  void (*schedule)(void* context, struct VMMachine*, uint32_t state, uint32_t ms);
+  // Call vm_done or vm_error with the id once src settles.
+  void (*invoke)(void* context, struct VMMachine*, uint32_t id, uint32_t src);
+  // The state was exited, what it scheduled or invoked can be dropped.
+  void (*cancel)(void* context, struct VMMachine*, uint32_t state);
+} VMHost;
+
+typedef struct VMMachine {
+  const VMProgram* program;
+  const BCMachine* def;
+  const VMHost* host;
+  // The active leaf state, its parents are active too.
+  uint32_t state;
+} VMMachine;
+
+int vm_load(VMProgram*, const void* data, size_t size);
+const char* vm_load_error(int);
+const char* vm_string(const VMProgram*, uint32_t id);
+uint32_t vm_string_id(const VMProgram*, const char*);
+uint32_t vm_machine_count(const VMProgram*);
+uint32_t vm_find_machine(const VMProgram*, const char* name);
+
+void vm_init(VMMachine*, const VMProgram*, uint32_t index, const VMHost*);
+bool vm_send(VMMachine*, uint32_t event, const void* data);
+void vm_timeout(VMMachine*, uint32_t state, uint32_t ms);
+void vm_done(VMMachine*, uint32_t id, const void* data);
+void vm_error(VMMachine*, uint32_t id, const void* data);
+bool vm_in(const VMMachine*, uint32_t state);
+bool vm_is_final(const VMMachine*);
+const char* vm_state_name(const VMMachine*, uint32_t state);
+
+#endif
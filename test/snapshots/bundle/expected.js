@@ -0,0 +1,73 @@
+import { Machine, assign } from 'xstate';
+import { save, isValid as isValid$1 } from './test/snapshots/bundle/actions.js';
+import { isValid } from './test/snapshots/bundle/lights.js';
+
+export const trafficLight_light = Machine({
+  initial: 'green',
+  states: {
+    green: {
+      on: {
+        next: {
+          target: 'yellow',
+          cond: 'ok',
+          actions: ['store']
+        }
+      }
+    },
+    yellow: {
+      on: {
+        next: 'green'
+      }
+    }
+  }
+}, {
+  guards: {
+    ok: isValid
+  },
+  actions: {
+    store: assign({
+      value: save
+    })
+  }
+});
+
+export const trafficLight_walker = Machine({
+  initial: 'walk',
+  states: {
+    walk: {
+      on: {
+        stop: 'stopped'
+      }
+    },
+    stopped: {
+
+    }
+  }
+});
+
+export const input = Machine({
+  initial: 'idle',
+  states: {
+    idle: {
+      on: {
+        go: {
+          target: 'done',
+          cond: 'ok',
+          actions: ['store']
+        }
+      }
+    },
+    done: {
+      type: 'final'
+    }
+  }
+}, {
+  guards: {
+    ok: isValid$1
+  },
+  actions: {
+    store: assign({
+      value: save
+    })
+  }
+});
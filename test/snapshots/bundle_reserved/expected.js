@@ -0,0 +1,45 @@
+import { Machine, assign } from 'xstate';
+import { Machine as Machine$1, assign as assign$1 } from './test/snapshots/bundle_reserved/helpers.js';
+
+export const switch_toggle = Machine({
+  initial: 'off',
+  states: {
+    off: {
+      on: {
+        flip: 'on'
+      }
+    },
+    on: {
+      on: {
+        flip: 'off'
+      }
+    }
+  }
+});
+
+export const input = Machine({
+  initial: 'idle',
+  states: {
+    idle: {
+      on: {
+        go: {
+          target: 'done',
+          cond: 'ok',
+          actions: ['store']
+        }
+      }
+    },
+    done: {
+      type: 'final'
+    }
+  }
+}, {
+  guards: {
+    ok: Machine$1
+  },
+  actions: {
+    store: assign({
+      value: assign$1
+    })
+  }
+});
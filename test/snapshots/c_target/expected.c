@@ -0,0 +1,416 @@
+// light.h
+// Generated by lc from test/snapshots/c_target/input.lucy. Do not edit.
+#ifndef LIGHT_H_
+#define LIGHT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum light_state {
+  LIGHT_STATE_green,
+  LIGHT_STATE_yellow,
+  LIGHT_STATE_red,
+  LIGHT_STATE_done,
+  LIGHT_STATE_red_walk,
+  LIGHT_STATE_red_wait,
+  LIGHT_STATE_red_stop,
+  LIGHT_STATE_COUNT
+} light_state;
+
+// Transitions that aren't taken on an event pass LIGHT_EVENT_COUNT.
+typedef enum light_event {
+  LIGHT_EVENT_timer,
+  LIGHT_EVENT_skip,
+  LIGHT_EVENT_stop,
+  LIGHT_EVENT_countdown,
+  LIGHT_EVENT_COUNT
+} light_event;
+
+// Callbacks into the host, any of them can be NULL. Missing guards pass.
+typedef struct light_host {
+  void* context;
+  bool (*guard_canWalk)(void* context, light_event event, const void* data);
+  bool (*guard_isBusy)(void* context, light_event event, const void* data);
+  void (*action_log)(void* context, const char* key, light_event event, const void* data);
+  // Sets key to the event data.
+  void (*assign)(void* context, const char* key, light_event event, const void* data);
+  // Call light_timeout with the state and ms once ms have passed.
+  void (*schedule)(void* context, light_state state, uint32_t ms);
+  // Call light_done or light_error with the id once src settles.
+  void (*invoke)(void* context, int id, const char* src);
+  // The state was exited, what it scheduled or invoked can be dropped.
+  void (*cancel)(void* context, light_state state);
+} light_host;
+
+typedef struct light_machine {
+  // The active leaf state, its parents are active too.
+  light_state state;
+  const light_host* host;
+} light_machine;
+
+void light_init(light_machine*, const light_host*);
+bool light_send(light_machine*, light_event, const void* data);
+void light_timeout(light_machine*, light_state, uint32_t ms);
+void light_done(light_machine*, int id, const void* data);
+void light_error(light_machine*, int id, const void* data);
+bool light_in(const light_machine*, light_state);
+bool light_is_final(const light_machine*);
+const char* light_state_name(light_state);
+
+#endif
+
+// light.c
+// Generated by lc from test/snapshots/c_target/input.lucy. Do not edit.
+#include <stddef.h>
+#include "light.h"
+
+static const light_state light_parents[LIGHT_STATE_COUNT + 1] = {
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_red,
+  LIGHT_STATE_red,
+  LIGHT_STATE_red,
+  LIGHT_STATE_COUNT
+};
+
+static const light_state light_children[LIGHT_STATE_COUNT + 1] = {
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_red_walk,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT,
+  LIGHT_STATE_COUNT
+};
+
+static const bool light_final[LIGHT_STATE_COUNT + 1] = {
+  false,
+  false,
+  false,
+  true,
+  false,
+  false,
+  true,
+  false
+};
+
+static const char* const light_names[LIGHT_STATE_COUNT + 1] = {
+  "green",
+  "yellow",
+  "red",
+  "done",
+  "red.walk",
+  "red.wait",
+  "red.stop",
+  NULL
+};
+
+static const light_state light_targets[12] = {
+  LIGHT_STATE_yellow,
+  LIGHT_STATE_red,
+  LIGHT_STATE_green,
+  LIGHT_STATE_green,
+  LIGHT_STATE_done,
+  LIGHT_STATE_red_wait,
+  LIGHT_STATE_red_walk,
+  LIGHT_STATE_yellow,
+  LIGHT_STATE_red_stop,
+  LIGHT_STATE_green,
+  LIGHT_STATE_done,
+  LIGHT_STATE_COUNT
+};
+
+static const light_state light_invoke_states[1] = {
+  LIGHT_STATE_red,
+};
+
+static const uint32_t light_guard_offsets[12] = {
+  0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3
+};
+
+static const uint16_t light_guard_list[3] = {
+  0, 1, 1
+};
+
+static bool light_guard(const light_host* host, int guard, light_event event, const void* data) {
+  switch(guard) {
+    case 0:
+      return host->guard_canWalk == NULL || host->guard_canWalk(host->context, event, data);
+    case 1:
+      return host->guard_isBusy == NULL || host->guard_isBusy(host->context, event, data);
+    default:
+      return true;
+  }
+}
+
+// Whether a transition's guards pass, true for transitions without any.
+static bool light_guards(const light_host* host, int transition, light_event event, const void* data) {
+  for(uint32_t i = light_guard_offsets[transition]; i < light_guard_offsets[transition + 1]; i++) {
+    if(!light_guard(host, light_guard_list[i], event, data)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The transition taken per state and event, or -1.
+static const int light_events[LIGHT_STATE_COUNT + 1][LIGHT_EVENT_COUNT + 1] = {
+  { 0, -1, -1, -1, -1 },
+  { 1, 2, -1, -1, -1 },
+  { 3, -1, 4, -1, -1 },
+  { -1, -1, -1, -1, -1 },
+  { -1, -1, -1, 5, -1 },
+  { -1, -1, -1, -1, -1 },
+  { -1, -1, -1, -1, -1 },
+  { -1, -1, -1, -1, -1 }
+};
+
+static int light_select(const light_host* host, light_state state, light_event event, const void* data) {
+  int transition = light_events[state][event];
+  if(transition >= 0 && !light_guards(host, transition, event, data)) {
+    return -1;
+  }
+  return transition;
+}
+
+static int light_select_always(const light_host* host, light_state state, light_event event, const void* data) {
+  (void)host;
+  (void)event;
+  (void)data;
+  switch(state) {
+    case LIGHT_STATE_red_wait:
+      if(light_guards(host, 6, event, data)) {
+        return 6;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+static int light_select_delay(const light_host* host, light_state state, uint32_t ms, light_event event, const void* data) {
+  (void)host;
+  (void)event;
+  (void)data;
+  switch(state) {
+    case LIGHT_STATE_green:
+      if(ms == 2000u) {
+        return 7;
+      }
+      return -1;
+    case LIGHT_STATE_red_wait:
+      if(ms == 1000u) {
+        return 8;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+static int light_select_settled(const light_host* host, int id, bool error, light_event event, const void* data) {
+  (void)host;
+  (void)event;
+  (void)data;
+  switch(id) {
+    case 0:
+      if(!error) {
+        return 9;
+      }
+      if(error && light_guards(host, 10, event, data)) {
+        return 10;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+static const uint32_t light_action_offsets[12] = {
+  0, 0, 1, 2, 2, 2, 2, 2, 2, 2, 3, 3
+};
+
+static const uint16_t light_action_list[3] = {
+  0, 0, 1
+};
+
+static const char* const light_action_keys[3] = {
+  "count",
+  NULL,
+  "result"
+};
+
+static void light_action(const light_host* host, int action, const char* key, light_event event, const void* data) {
+  switch(action) {
+    case 0:
+      if(host->action_log != NULL) {
+        host->action_log(host->context, key, event, data);
+      }
+      break;
+    case 1:
+      if(host->assign != NULL) {
+        host->assign(host->context, key, event, data);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void light_actions(const light_host* host, int transition, light_event event, const void* data) {
+  for(uint32_t i = light_action_offsets[transition]; i < light_action_offsets[transition + 1]; i++) {
+    light_action(host, light_action_list[i], light_action_keys[i], event, data);
+  }
+}
+
+static void light_activate(const light_host* host, light_state state) {
+  switch(state) {
+    case LIGHT_STATE_green:
+      if(host->schedule != NULL) {
+        host->schedule(host->context, state, 2000u);
+      }
+      break;
+    case LIGHT_STATE_red:
+      if(host->invoke != NULL) {
+        host->invoke(host->context, 0, "fetchIt");
+      }
+      break;
+    case LIGHT_STATE_red_wait:
+      if(host->schedule != NULL) {
+        host->schedule(host->context, state, 1000u);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void light_enter(light_machine* m, light_state state) {
+  while(state != LIGHT_STATE_COUNT) {
+    light_activate(m->host, state);
+    m->state = state;
+    state = light_children[state];
+  }
+}
+
+// Exits the active states up to and including until.
+static void light_exit(light_machine* m, light_state until) {
+  const light_host* host = m->host;
+  light_state state = m->state;
+  while(state != LIGHT_STATE_COUNT) {
+    if(host->cancel != NULL) {
+      host->cancel(host->context, state);
+    }
+    if(state == until) {
+      break;
+    }
+    state = light_parents[state];
+  }
+}
+
+static void light_step(light_machine* m, light_state source, int transition, light_event event, const void* data) {
+  light_exit(m, source);
+  light_actions(m->host, transition, event, data);
+  light_enter(m, light_targets[transition]);
+}
+
+// Takes enabled always transitions, bounded so that ones which cycle
+// can't hang the host.
+static void light_settle(light_machine* m) {
+  for(int i = 0; i <= LIGHT_STATE_COUNT; i++) {
+    int transition = -1;
+    light_state source = m->state;
+    while(source != LIGHT_STATE_COUNT) {
+      transition = light_select_always(m->host, source, LIGHT_EVENT_COUNT, NULL);
+      if(transition >= 0) {
+        break;
+      }
+      source = light_parents[source];
+    }
+    if(transition < 0) {
+      return;
+    }
+    light_step(m, source, transition, LIGHT_EVENT_COUNT, NULL);
+  }
+}
+
+static void light_take(light_machine* m, light_state source, int transition, light_event event, const void* data) {
+  light_step(m, source, transition, event, data);
+  light_settle(m);
+}
+
+static void light_settled(light_machine* m, int id, bool error, const void* data) {
+  if(id < 0 || id >= 1) {
+    return;
+  }
+  light_state state = light_invoke_states[id];
+  if(!light_in(m, state)) {
+    return;
+  }
+  int transition = light_select_settled(m->host, id, error, LIGHT_EVENT_COUNT, data);
+  if(transition >= 0) {
+    light_take(m, state, transition, LIGHT_EVENT_COUNT, data);
+  }
+}
+
+void light_init(light_machine* m, const light_host* host) {
+  m->state = LIGHT_STATE_COUNT;
+  m->host = host;
+  light_enter(m, LIGHT_STATE_green);
+  light_settle(m);
+}
+
+bool light_send(light_machine* m, light_event event, const void* data) {
+  for(light_state state = m->state; state != LIGHT_STATE_COUNT; state = light_parents[state]) {
+    int transition = light_select(m->host, state, event, data);
+    if(transition >= 0) {
+      light_take(m, state, transition, event, data);
+      return true;
+    }
+  }
+  return false;
+}
+
+void light_timeout(light_machine* m, light_state state, uint32_t ms) {
+  if(!light_in(m, state)) {
+    return;
+  }
+  int transition = light_select_delay(m->host, state, ms, LIGHT_EVENT_COUNT, NULL);
+  if(transition >= 0) {
+    light_take(m, state, transition, LIGHT_EVENT_COUNT, NULL);
+  }
+}
+
+void light_done(light_machine* m, int id, const void* data) {
+  light_settled(m, id, false, data);
+}
+
+void light_error(light_machine* m, int id, const void* data) {
+  light_settled(m, id, true, data);
+}
+
+bool light_in(const light_machine* m, light_state state) {
+  for(light_state active = m->state; active != LIGHT_STATE_COUNT; active = light_parents[active]) {
+    if(active == state) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the machine reached one of its own final states.
+bool light_is_final(const light_machine* m) {
+  light_state state = m->state;
+  while(state != LIGHT_STATE_COUNT && light_parents[state] != LIGHT_STATE_COUNT) {
+    state = light_parents[state];
+  }
+  return light_final[state];
+}
+
+const char* light_state_name(light_state state) {
+  return state < LIGHT_STATE_COUNT ? light_names[state] : NULL;
+}
+
@@ -0,0 +1,22 @@
+import { Machine } from 'xstate';
+
+export default Machine({
+  initial: 'green',
+  states: {
+    green: {
+      delay: {
+        90000: 'yellow'
+      }
+    },
+    yellow: {
+      delay: {
+        1500: 'red'
+      }
+    },
+    red: {
+      delay: {
+        7200000: 'green'
+      }
+    }
+  }
+});
@@ -0,0 +1,289 @@
+import { canWalk, isBusy, log, fetchIt } from './util.js';
+
+function __interpret(machine, context = {}) {
+  const { parents, children, targets, actions } = machine;
+  const listeners = new Set();
+  const activities = new Map();
+  let state = -1;
+  let running = false;
+
+  function active(s) {
+    for(let a = state; a !== -1; a = parents[a]) {
+      if(a === s) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  function fire(s, event) {
+    if(running && active(s)) {
+      const t = machine.select(s, event, context);
+      if(t !== -1) {
+        take(s, t, event);
+      }
+    }
+  }
+
+  // Settled invokes report back as done:id and error:id events.
+  function invoke(s, id, src, event) {
+    let live = true;
+    const settle = type => data => {
+      if(live) {
+        fire(s, { type: type + id, data });
+      }
+    };
+    if(typeof src === 'object') {
+      const child = __interpret(src).start();
+      const subscription = child.subscribe(snapshot => {
+        if(snapshot.done) {
+          Promise.resolve(snapshot.context).then(settle('done:'));
+        }
+      });
+      return () => {
+        live = false;
+        subscription.unsubscribe();
+        child.stop();
+      };
+    }
+    Promise.resolve().then(() => src(context, event)).then(settle('done:'), settle('error:'));
+    return () => {
+      live = false;
+    };
+  }
+
+  // Delays fire after:ms events at the state that scheduled them.
+  function activate(s, event) {
+    const delays = machine.delays && machine.delays[s];
+    const invokes = machine.invokes && machine.invokes[s];
+    if(!delays && !invokes) {
+      return;
+    }
+    const stops = [];
+    for(const ms of delays || []) {
+      const timer = setTimeout(fire, ms, s, { type: 'after:' + ms });
+      stops.push(() => clearTimeout(timer));
+    }
+    for(const [id, src] of invokes || []) {
+      stops.push(invoke(s, id, src, event));
+    }
+    activities.set(s, stops);
+  }
+
+  // Exits the active states up to and including until.
+  function exit(until) {
+    for(let a = state; a !== -1; a = parents[a]) {
+      const stops = activities.get(a);
+      if(stops) {
+        activities.delete(a);
+        for(const stop of stops) {
+          stop();
+        }
+      }
+      if(a === until) {
+        break;
+      }
+    }
+  }
+
+  function enter(s, event) {
+    for(; s !== -1; s = children[s]) {
+      state = s;
+      activate(s, event);
+    }
+  }
+
+  // Actions are [key, fn] pairs, a null key calls fn for its effect and a
+  // null fn assigns the event's data. The context is copied at most once.
+  function step(source, t, event) {
+    exit(source);
+    const list = actions[t];
+    if(list !== null) {
+      let next = context;
+      for(const [key, fn] of list) {
+        if(key === null) {
+          fn(next, event);
+          continue;
+        }
+        if(next === context) {
+          next = { ...context };
+        }
+        next[key] = fn === null ? event.data : fn(next, event);
+      }
+      context = next;
+    }
+    enter(targets[t], event);
+  }
+
+  // Takes enabled always transitions, bounded so that ones which cycle
+  // can't hang, then tells the listeners.
+  function settle(event) {
+    for(let i = 0; machine.always && i <= parents.length; i++) {
+      let source = state;
+      let t = -1;
+      while(source !== -1 && (t = machine.always(source, event, context)) === -1) {
+        source = parents[source];
+      }
+      if(t === -1) {
+        break;
+      }
+      step(source, t, event);
+    }
+
+    let top = state;
+    while(top !== -1 && parents[top] !== -1) {
+      top = parents[top];
+    }
+    const done = top !== -1 && machine.final[top];
+    service.state = { value: machine.names[state], context, done };
+    if(done) {
+      exit(-1);
+      running = false;
+    }
+    for(const listener of listeners) {
+      listener(service.state);
+    }
+  }
+
+  function take(source, t, event) {
+    step(source, t, event);
+    settle(event);
+  }
+
+  const service = {
+    state: undefined,
+    start() {
+      if(!running && service.state === undefined) {
+        const event = { type: 'init' };
+        running = true;
+        enter(machine.initial, event);
+        settle(event);
+      }
+      return service;
+    },
+    send(event) {
+      if(typeof event === 'string') {
+        event = { type: event };
+      }
+      for(let a = running ? state : -1; a !== -1; a = parents[a]) {
+        const t = machine.select(a, event, context);
+        if(t !== -1) {
+          take(a, t, event);
+          break;
+        }
+      }
+      return service.state;
+    },
+    subscribe(listener) {
+      listeners.add(listener);
+      if(service.state !== undefined) {
+        listener(service.state);
+      }
+      return { unsubscribe: () => listeners.delete(listener) };
+    },
+    stop() {
+      exit(-1);
+      running = false;
+      return service;
+    }
+  };
+  return service;
+}
+
+export { __interpret as interpret };
+
+export const light = {
+  initial: 0,
+  names: ['green', 'yellow', 'red', 'done', 'red.walk', 'red.wait', 'red.stop'],
+  parents: [-1, -1, -1, -1, 2, 2, 2],
+  children: [-1, -1, 4, -1, -1, -1, -1],
+  final: [false, false, false, true, false, false, true],
+  targets: [1, 2, 0, 0, 3, 5, 4, 1, 6, 0, 3],
+  actions: [
+    null,
+    [['count', log]],
+    [[null, log]],
+    null,
+    null,
+    null,
+    null,
+    null,
+    null,
+    [['result', null]],
+    null
+  ],
+  delays: [
+    [2000],
+    null,
+    null,
+    null,
+    null,
+    [1000],
+    null
+  ],
+  invokes: [
+    null,
+    null,
+    [[0, fetchIt]],
+    null,
+    null,
+    null,
+    null
+  ],
+  select(state, event, context) {
+    switch(state) {
+      case 0:
+        switch(event.type) {
+          case 'timer':
+            return 0;
+          case 'after:2000':
+            return 7;
+        }
+        break;
+      case 1:
+        switch(event.type) {
+          case 'skip':
+            return 2;
+          case 'timer':
+            return canWalk(context, event) ? 1 : -1;
+        }
+        break;
+      case 2:
+        switch(event.type) {
+          case 'stop':
+            return 4;
+          case 'timer':
+            return 3;
+          case 'done:0':
+            return 9;
+          case 'error:0':
+            return isBusy(context, event) ? 10 : -1;
+        }
+        break;
+      case 4:
+        switch(event.type) {
+          case 'countdown':
+            return 5;
+        }
+        break;
+      case 5:
+        switch(event.type) {
+          case 'after:1000':
+            return 8;
+        }
+        break;
+    }
+    return -1;
+  },
+  always(state, event, context) {
+    switch(state) {
+      case 5:
+        if(isBusy(context, event)) {
+          return 6;
+        }
+        break;
+    }
+    return -1;
+  }
+};
+
@@ -0,0 +1,66 @@
+import { Machine, assign } from 'xstate';
+import { check, save } from './util.js';
+
+const __lazy = build => {
+  let machine;
+  return () => machine || (machine = build());
+};
+
+export const light = /*#__PURE__*/ __lazy(() => {
+  const __c0 = ['store'];
+  return Machine({
+    initial: 'green',
+    states: {
+      green: {
+        on: {
+          next: 'yellow'
+        }
+      },
+      yellow: {
+        on: {
+          next: 'red',
+          reset: {
+            target: 'green',
+            cond: 'ok',
+            actions: __c0
+          }
+        }
+      },
+      red: {
+        on: {
+          next: 'green',
+          reset: {
+            target: 'green',
+            cond: 'ok',
+            actions: __c0
+          }
+        }
+      }
+    }
+  }, {
+    guards: {
+      ok: check
+    },
+    actions: {
+      store: assign({
+        data: save
+      })
+    }
+  });
+});
+
+export const toggle = /*#__PURE__*/ __lazy(() => Machine({
+  initial: 'off',
+  states: {
+    off: {
+      on: {
+        flip: 'on'
+      }
+    },
+    on: {
+      on: {
+        flip: 'off'
+      }
+    }
+  }
+}));
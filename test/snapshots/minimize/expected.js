@@ -0,0 +1,41 @@
+import { Machine, assign } from 'xstate';
+import { check, save } from './util.js';
+
+export const checkout = Machine({
+  initial: 'cart',
+  states: {
+    cart: {
+      on: {
+        card: 'card',
+        paypal: 'card'
+      }
+    },
+    card: {
+      on: {
+        next: 'cardReview'
+      }
+    },
+    cardReview: {
+      on: {
+        confirm: {
+          target: 'done',
+          cond: 'valid',
+          actions: ['store']
+        },
+        back: 'cart'
+      }
+    },
+    done: {
+      type: 'final'
+    }
+  }
+}, {
+  guards: {
+    valid: check
+  },
+  actions: {
+    store: assign({
+      order: save
+    })
+  }
+});
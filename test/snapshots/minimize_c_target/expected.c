@@ -0,0 +1,252 @@
+// checkout.h
+// Generated by lc from test/snapshots/minimize_c_target/input.lucy. Do not edit.
+#ifndef CHECKOUT_H_
+#define CHECKOUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum checkout_state {
+  CHECKOUT_STATE_cart,
+  CHECKOUT_STATE_card,
+  CHECKOUT_STATE_cardReview,
+  CHECKOUT_STATE_done,
+  CHECKOUT_STATE_COUNT
+} checkout_state;
+
+// Transitions that aren't taken on an event pass CHECKOUT_EVENT_COUNT.
+typedef enum checkout_event {
+  CHECKOUT_EVENT_card,
+  CHECKOUT_EVENT_paypal,
+  CHECKOUT_EVENT_next,
+  CHECKOUT_EVENT_confirm,
+  CHECKOUT_EVENT_back,
+  CHECKOUT_EVENT_COUNT
+} checkout_event;
+
+// Callbacks into the host, any of them can be NULL. Missing guards pass.
+typedef struct checkout_host {
+  void* context;
+  bool (*guard_check)(void* context, checkout_event event, const void* data);
+  void (*action_save)(void* context, const char* key, checkout_event event, const void* data);
+} checkout_host;
+
+typedef struct checkout_machine {
+  // The active leaf state, its parents are active too.
+  checkout_state state;
+  const checkout_host* host;
+} checkout_machine;
+
+void checkout_init(checkout_machine*, const checkout_host*);
+bool checkout_send(checkout_machine*, checkout_event, const void* data);
+void checkout_timeout(checkout_machine*, checkout_state, uint32_t ms);
+void checkout_done(checkout_machine*, int id, const void* data);
+void checkout_error(checkout_machine*, int id, const void* data);
+bool checkout_in(const checkout_machine*, checkout_state);
+bool checkout_is_final(const checkout_machine*);
+const char* checkout_state_name(checkout_state);
+
+#endif
+
+// checkout.c
+// Generated by lc from test/snapshots/minimize_c_target/input.lucy. Do not edit.
+#include <stddef.h>
+#include "checkout.h"
+
+static const checkout_state checkout_parents[CHECKOUT_STATE_COUNT + 1] = {
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT
+};
+
+static const checkout_state checkout_children[CHECKOUT_STATE_COUNT + 1] = {
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT,
+  CHECKOUT_STATE_COUNT
+};
+
+static const bool checkout_final[CHECKOUT_STATE_COUNT + 1] = {
+  false,
+  false,
+  false,
+  true,
+  false
+};
+
+static const char* const checkout_names[CHECKOUT_STATE_COUNT + 1] = {
+  "cart",
+  "card",
+  "cardReview",
+  "done",
+  NULL
+};
+
+static const checkout_state checkout_targets[6] = {
+  CHECKOUT_STATE_card,
+  CHECKOUT_STATE_card,
+  CHECKOUT_STATE_cardReview,
+  CHECKOUT_STATE_done,
+  CHECKOUT_STATE_cart,
+  CHECKOUT_STATE_COUNT
+};
+
+static const uint32_t checkout_guard_offsets[6] = {
+  0, 0, 0, 0, 1, 1
+};
+
+static const uint16_t checkout_guard_list[1] = {
+  0
+};
+
+static bool checkout_guard(const checkout_host* host, int guard, checkout_event event, const void* data) {
+  switch(guard) {
+    case 0:
+      return host->guard_check == NULL || host->guard_check(host->context, event, data);
+    default:
+      return true;
+  }
+}
+
+// Whether a transition's guards pass, true for transitions without any.
+static bool checkout_guards(const checkout_host* host, int transition, checkout_event event, const void* data) {
+  for(uint32_t i = checkout_guard_offsets[transition]; i < checkout_guard_offsets[transition + 1]; i++) {
+    if(!checkout_guard(host, checkout_guard_list[i], event, data)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The transition taken per state and event, or -1.
+static const int checkout_events[CHECKOUT_STATE_COUNT + 1][CHECKOUT_EVENT_COUNT + 1] = {
+  { 0, 1, -1, -1, -1, -1 },
+  { -1, -1, 2, -1, -1, -1 },
+  { -1, -1, -1, 3, 4, -1 },
+  { -1, -1, -1, -1, -1, -1 },
+  { -1, -1, -1, -1, -1, -1 }
+};
+
+static int checkout_select(const checkout_host* host, checkout_state state, checkout_event event, const void* data) {
+  int transition = checkout_events[state][event];
+  if(transition >= 0 && !checkout_guards(host, transition, event, data)) {
+    return -1;
+  }
+  return transition;
+}
+
+static const uint32_t checkout_action_offsets[6] = {
+  0, 0, 0, 0, 1, 1
+};
+
+static const uint16_t checkout_action_list[1] = {
+  0
+};
+
+static const char* const checkout_action_keys[1] = {
+  "order"
+};
+
+static void checkout_action(const checkout_host* host, int action, const char* key, checkout_event event, const void* data) {
+  switch(action) {
+    case 0:
+      if(host->action_save != NULL) {
+        host->action_save(host->context, key, event, data);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void checkout_actions(const checkout_host* host, int transition, checkout_event event, const void* data) {
+  for(uint32_t i = checkout_action_offsets[transition]; i < checkout_action_offsets[transition + 1]; i++) {
+    checkout_action(host, checkout_action_list[i], checkout_action_keys[i], event, data);
+  }
+}
+
+static void checkout_enter(checkout_machine* m, checkout_state state) {
+  while(state != CHECKOUT_STATE_COUNT) {
+    m->state = state;
+    state = checkout_children[state];
+  }
+}
+
+static void checkout_step(checkout_machine* m, checkout_state source, int transition, checkout_event event, const void* data) {
+  (void)source;
+  checkout_actions(m->host, transition, event, data);
+  checkout_enter(m, checkout_targets[transition]);
+}
+
+// Takes enabled always transitions, bounded so that ones which cycle
+// can't hang the host.
+static void checkout_settle(checkout_machine* m) {
+  (void)m;
+}
+
+static void checkout_take(checkout_machine* m, checkout_state source, int transition, checkout_event event, const void* data) {
+  checkout_step(m, source, transition, event, data);
+  checkout_settle(m);
+}
+
+void checkout_init(checkout_machine* m, const checkout_host* host) {
+  m->state = CHECKOUT_STATE_COUNT;
+  m->host = host;
+  checkout_enter(m, CHECKOUT_STATE_cart);
+  checkout_settle(m);
+}
+
+bool checkout_send(checkout_machine* m, checkout_event event, const void* data) {
+  for(checkout_state state = m->state; state != CHECKOUT_STATE_COUNT; state = checkout_parents[state]) {
+    int transition = checkout_select(m->host, state, event, data);
+    if(transition >= 0) {
+      checkout_take(m, state, transition, event, data);
+      return true;
+    }
+  }
+  return false;
+}
+
+void checkout_timeout(checkout_machine* m, checkout_state state, uint32_t ms) {
+  (void)m;
+  (void)state;
+  (void)ms;
+}
+
+void checkout_done(checkout_machine* m, int id, const void* data) {
+  (void)m;
+  (void)id;
+  (void)data;
+}
+
+void checkout_error(checkout_machine* m, int id, const void* data) {
+  (void)m;
+  (void)id;
+  (void)data;
+}
+
+bool checkout_in(const checkout_machine* m, checkout_state state) {
+  for(checkout_state active = m->state; active != CHECKOUT_STATE_COUNT; active = checkout_parents[active]) {
+    if(active == state) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the machine reached one of its own final states.
+bool checkout_is_final(const checkout_machine* m) {
+  checkout_state state = m->state;
+  while(state != CHECKOUT_STATE_COUNT && checkout_parents[state] != CHECKOUT_STATE_COUNT) {
+    state = checkout_parents[state];
+  }
+  return checkout_final[state];
+}
+
+const char* checkout_state_name(checkout_state state) {
+  return state < CHECKOUT_STATE_COUNT ? checkout_names[state] : NULL;
+}
+
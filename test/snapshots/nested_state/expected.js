@@ -1,3 +1,13 @@
+[1m[37mtest/snapshots/nested_state/input.lucy[0m:29:3
+
+ [1m[33m![0m[33m State 'another' is unreachable.
+
+[0m[1m[37m    27[0m │   }
+[1m[37m    28[0m │ 
+[1m[37m    29[0m │   state another {}
+                          [1m[31m˄[0m
+[1m[37m    30[0m │ }
+
 import { Machine } from 'xstate';
 
 export const light = Machine({
@@ -0,0 +1,85 @@
+[1m[37mtest/snapshots/optimize/input.lucy[0m:59:3
+
+ [1m[33m![0m[33m State 'broken' is unreachable.
+
+[0m[1m[37m    57[0m │   }
+[1m[37m    58[0m │ 
+[1m[37m    59[0m │   state broken {
+                        [1m[31m˄[0m
+[1m[37m    60[0m │     next => green
+[1m[37m    61[0m │   }
+[1m[37m    62[0m │ }
+
+import { Machine, assign } from 'xstate';
+import { check, save, fetchUser } from './util.js';
+
+const __c0 = ['store'];
+const __c1 = {
+  on: {
+    stop: 'green'
+  },
+  initial: 'walk',
+  states: {
+    walk: {
+      on: {
+        countdown: 'wait'
+      }
+    },
+    wait: {
+      on: {
+        countdown: 'walk'
+      }
+    }
+  }
+};
+
+export const light = Machine({
+  initial: 'green',
+  states: {
+    green: {
+      on: {
+        next: 'yellow',
+        load: 'loading',
+        hold: 'holding'
+      }
+    },
+    yellow: {
+      on: {
+        next: 'red',
+        reset: {
+          target: 'green',
+          cond: 'ok',
+          actions: __c0
+        }
+      }
+    },
+    red: {
+      on: {
+        next: 'green',
+        reset: {
+          target: 'green',
+          cond: 'ok',
+          actions: __c0
+        }
+      }
+    },
+    loading: {
+      invoke: {
+        src: fetchUser,
+        onDone: 'walking',
+        onError: 'green'
+      }
+    },
+    walking: __c1,
+    holding: __c1
+  }
+}, {
+  guards: {
+    ok: check
+  },
+  actions: {
+    store: assign({
+      data: save
+    })
+  }
+});
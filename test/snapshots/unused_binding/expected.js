@@ -0,0 +1,36 @@
+[1m[37mtest/snapshots/unused_binding/input.lucy[0m:4:1
+
+ [1m[33m![0m[33m Guard 'ready' is never used.
+
+[0m[1m[37m    2[0m │ 
+[1m[37m    3[0m │ guard valid = isValid
+[1m[37m    4[0m │ guard ready = isReady
+                            [1m[31m˄[0m
+[1m[37m    5[0m │ 
+[1m[37m    6[0m │ initial state editing {
+[1m[37m    7[0m │  
+
+import { Machine } from 'xstate';
+import { isValid, isReady } from './checks.js';
+
+export default Machine({
+  initial: 'editing',
+  states: {
+    editing: {
+      on: {
+        submit: {
+          target: 'submitted',
+          cond: 'valid'
+        }
+      }
+    },
+    submitted: {
+      type: 'final'
+    }
+  }
+}, {
+  guards: {
+    valid: isValid,
+    ready: isReady
+  }
+});